@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) Cvitek Co., Ltd. 2019-2020. All rights reserved.
+ *
+ * File Name: sd_bench.c
+ * Description: sequential/random read-write benchmark for the SD card.
+ *   Clears /proc/cvi/cvi_info before a run and prints it afterwards, so
+ *   the driver side latency histogram and descriptor counts can be read
+ *   next to the application side numbers.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CVI_STATS_PROC	"/proc/cvi/cvi_info"
+#define ALIGNMENT	4096
+
+enum bench_profile {
+	PROFILE_SEQ_READ,
+	PROFILE_SEQ_WRITE,
+	PROFILE_RAND_READ,
+	PROFILE_RAND_WRITE,
+	PROFILE_MAX,
+};
+
+static const char *profile_name[PROFILE_MAX] = {
+	"seqread", "seqwrite", "randread", "randwrite",
+};
+
+/* writes first so the read profiles have data to read */
+static const enum bench_profile run_order[PROFILE_MAX] = {
+	PROFILE_SEQ_WRITE, PROFILE_SEQ_READ, PROFILE_RAND_WRITE, PROFILE_RAND_READ,
+};
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void stats_reset(void)
+{
+	int fd = open(CVI_STATS_PROC, O_WRONLY);
+
+	if (fd < 0)
+		return;
+	if (write(fd, "0", 1) < 0)
+		perror(CVI_STATS_PROC);
+	close(fd);
+}
+
+static void stats_dump(void)
+{
+	char line[256];
+	FILE *fp = fopen(CVI_STATS_PROC, "r");
+
+	if (!fp)
+		return;
+	while (fgets(line, sizeof(line), fp))
+		fputs(line, stdout);
+	fclose(fp);
+}
+
+static int run_profile(const char *path, enum bench_profile profile,
+		       size_t bs, size_t total)
+{
+	int is_write = profile == PROFILE_SEQ_WRITE || profile == PROFILE_RAND_WRITE;
+	int is_rand = profile == PROFILE_RAND_READ || profile == PROFILE_RAND_WRITE;
+	size_t nr = total / bs, i;
+	uint64_t *lat, t0, t1, start;
+	void *buf;
+	ssize_t ret;
+	off_t off;
+	int fd;
+
+	if (!nr)
+		return -EINVAL;
+
+	fd = open(path, (is_write ? O_RDWR | O_CREAT : O_RDONLY) | O_DIRECT, 0644);
+	if (fd < 0) {
+		perror(path);
+		return -errno;
+	}
+
+	if (posix_memalign(&buf, ALIGNMENT, bs)) {
+		close(fd);
+		return -ENOMEM;
+	}
+	memset(buf, 0x5a, bs);
+
+	lat = calloc(nr, sizeof(*lat));
+	if (!lat) {
+		free(buf);
+		close(fd);
+		return -ENOMEM;
+	}
+
+	stats_reset();
+	start = now_us();
+	for (i = 0; i < nr; i++) {
+		off = is_rand ? (off_t)(rand() % nr) * bs : (off_t)i * bs;
+		t0 = now_us();
+		if (is_write)
+			ret = pwrite(fd, buf, bs, off);
+		else
+			ret = pread(fd, buf, bs, off);
+		t1 = now_us();
+		if (ret != (ssize_t)bs) {
+			fprintf(stderr, "%s: short %s at %lld\n", profile_name[profile],
+				is_write ? "write" : "read", (long long)off);
+			nr = i;
+			break;
+		}
+		lat[i] = t1 - t0;
+	}
+	if (is_write)
+		fsync(fd);
+	t1 = now_us() - start;
+
+	if (nr) {
+		qsort(lat, nr, sizeof(*lat), cmp_u64);
+		printf("%-10s bs %7zu: %8.2f MB/s %8.0f IOPS, lat us p50 %llu p99 %llu max %llu\n",
+		       profile_name[profile], bs,
+		       t1 ? (double)nr * bs / t1 : 0.0,
+		       t1 ? (double)nr * 1000000.0 / t1 : 0.0,
+		       (unsigned long long)lat[nr / 2],
+		       (unsigned long long)lat[nr * 99 / 100],
+		       (unsigned long long)lat[nr - 1]);
+	}
+	stats_dump();
+
+	free(lat);
+	free(buf);
+	close(fd);
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	printf("usage: %s -f file [-p profile] [-b bs] [-s size]\n", prog);
+	printf("  -f file     test file or block device on the SD card\n");
+	printf("  -p profile  seqread, seqwrite, randread, randwrite or all (default)\n");
+	printf("  -b bs       block size in bytes (default 4096 for random, 1M for sequential)\n");
+	printf("  -s size     bytes per profile (default 64M)\n");
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = NULL, *pname = "all";
+	size_t bs = 0, total = 64 << 20;
+	int opt, i, ret = 0;
+
+	while ((opt = getopt(argc, argv, "f:p:b:s:h")) != -1) {
+		switch (opt) {
+		case 'f':
+			path = optarg;
+			break;
+		case 'p':
+			pname = optarg;
+			break;
+		case 'b':
+			bs = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			total = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (!path) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	srand(1);
+	for (i = 0; i < PROFILE_MAX; i++) {
+		enum bench_profile p = run_order[i];
+		size_t pbs = bs;
+
+		if (strcmp(pname, "all") && strcmp(pname, profile_name[p]))
+			continue;
+		if (!pbs)
+			pbs = (p == PROFILE_RAND_READ || p == PROFILE_RAND_WRITE) ?
+			      4096 : (1 << 20);
+		ret = run_profile(path, p, pbs, total);
+		if (ret)
+			break;
+	}
+
+	return ret ? 1 : 0;
+}
@@ -0,0 +1,20 @@
+################################################################################
+#
+# cvitrace
+#
+################################################################################
+
+CVITRACE_VERSION = 1.0
+CVITRACE_SITE = $(CVITRACE_PKGDIR)/src
+CVITRACE_SITE_METHOD = local
+CVITRACE_LICENSE = GPL-2.0
+
+define CVITRACE_BUILD_CMDS
+	$(TARGET_MAKE_ENV) $(MAKE) $(TARGET_CONFIGURE_OPTS) -C $(@D)
+endef
+
+define CVITRACE_INSTALL_TARGET_CMDS
+	$(INSTALL) -D -m 0755 $(@D)/cvitrace $(TARGET_DIR)/usr/bin/cvitrace
+endef
+
+$(eval $(generic-package))
@@ -0,0 +1,160 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * cvitrace - one timeline for camera, control and servo activity.
+ *
+ * Sources, all on CLOCK_MONOTONIC:
+ *
+ *   ftrace   scheduling, interrupt handlers (the rtos_cmdqu mailbox among
+ *            them) and the trace_marker writes of CVI_SYS_TraceBegin/
+ *            TraceEnd/TraceCounter and of any other systrace style user
+ *   rtos     the event ring the small core fills (rtos_trace_begin() and
+ *            friends), mapped through /dev/mem; its time CSR stamps are
+ *            converted with the timebase the kernel shares with the RTOS
+ *
+ * The ftrace buffer is read once capture ends; the RTOS ring is small and
+ * is drained every --poll ms meanwhile. The result is Chrome trace JSON,
+ * which ui.perfetto.dev and chrome://tracing load as is.
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "ftrace.h"
+#include "rtos_ring.h"
+#include "rtos_trace.h"
+#include "trace_json.h"
+
+#define MAX_EXTRA	16
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -t, --time SEC       capture length, 0 until ^C (default 5)\n"
+		"  -o, --output FILE    trace JSON (default cvitrace.json)\n"
+		"  -b, --buffer KB      ftrace buffer per CPU (default 2048)\n"
+		"  -w, --wakeups        also record sched_wakeup\n"
+		"  -e, --event SUB/EV   enable another ftrace event, repeatable\n"
+		"  -r, --rtos ADDR      RTOS event ring address, 0 to skip (default %#x)\n"
+		"  -p, --poll MS        RTOS ring drain period (default 10)\n",
+		prog, RTOS_TRACE_ADDR);
+}
+
+int main(int argc, char **argv)
+{
+	static const struct option longopts[] = {
+		{ "time", required_argument, NULL, 't' },
+		{ "output", required_argument, NULL, 'o' },
+		{ "buffer", required_argument, NULL, 'b' },
+		{ "wakeups", no_argument, NULL, 'w' },
+		{ "event", required_argument, NULL, 'e' },
+		{ "rtos", required_argument, NULL, 'r' },
+		{ "poll", required_argument, NULL, 'p' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 },
+	};
+	const char *extra[MAX_EXTRA + 1] = { NULL };
+	struct ftrace_opts fo = { .buffer_kb = 2048, .extra = extra };
+	const char *output = "cvitrace.json";
+	unsigned long rtos_addr = RTOS_TRACE_ADDR;
+	unsigned int secs = 5, poll_ms = 10, nextra = 0;
+	struct rtos_ring_stats rs;
+	struct ftrace_stats fs;
+	struct trace_json tj;
+	struct timespec end, now;
+	int have_rtos, c;
+	FILE *f;
+
+	while ((c = getopt_long(argc, argv, "t:o:b:we:r:p:h", longopts, NULL)) != -1) {
+		switch (c) {
+		case 't':
+			secs = strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 'b':
+			fo.buffer_kb = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			fo.wakeups = 1;
+			break;
+		case 'e':
+			if (nextra < MAX_EXTRA)
+				extra[nextra++] = optarg;
+			break;
+		case 'r':
+			rtos_addr = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			poll_ms = strtoul(optarg, NULL, 0);
+			if (!poll_ms)
+				poll_ms = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	have_rtos = rtos_addr && !rtos_ring_open(rtos_addr);
+	if (rtos_addr && !have_rtos)
+		fprintf(stderr, "continuing without RTOS events\n");
+
+	if (ftrace_start(&fo))
+		return 1;
+
+	fprintf(stderr, "tracing%s...\n", secs ? "" : ", ^C to stop");
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	end.tv_sec += secs;
+	while (!stop) {
+		if (have_rtos)
+			rtos_ring_poll();
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (secs && (now.tv_sec > end.tv_sec ||
+			     (now.tv_sec == end.tv_sec && now.tv_nsec >= end.tv_nsec)))
+			break;
+		usleep(poll_ms * 1000);
+	}
+	ftrace_stop();
+	if (have_rtos)
+		rtos_ring_poll();
+
+	f = fopen(output, "w");
+	if (!f) {
+		fprintf(stderr, "%s: %s\n", output, strerror(errno));
+		return 1;
+	}
+	tj_open(&tj, f);
+	ftrace_export(&tj, &fs);
+	rtos_ring_export(&tj, &rs);
+	tj_close(&tj);
+	fclose(f);
+	rtos_ring_close();
+
+	fprintf(stderr, "ftrace: %llu lines, %llu switches, %llu irqs, %llu markers\n",
+		(unsigned long long)fs.lines, (unsigned long long)fs.switches,
+		(unsigned long long)fs.irqs, (unsigned long long)fs.markers);
+	if (have_rtos)
+		fprintf(stderr, "rtos: %llu events, %llu lost\n",
+			(unsigned long long)rs.events, (unsigned long long)rs.lost);
+	fprintf(stderr, "%llu trace events written to %s\n",
+		(unsigned long long)tj.events, output);
+
+	return 0;
+}
@@ -0,0 +1,382 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * ftrace capture and conversion.
+ *
+ * The buffer runs on the "mono" trace clock, so its timestamps are
+ * CLOCK_MONOTONIC like everything else in the trace. Conversion:
+ *
+ *   sched_switch        one slice per running task on a track per CPU
+ *   sched_wakeup        instant on the woken thread (-w)
+ *   irq_handler_*       one slice per handler on a track per CPU, named
+ *                       after the irq action ("mailbox" for rtos_cmdqu)
+ *   tracing_mark_write  systrace markers B|pid|name, E|pid and
+ *                       C|pid|name|value on the writing thread, anything
+ *                       else as an instant
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ftrace.h"
+
+#define MAX_CPUS	8
+#define MAX_TIDS	4096
+
+static const char *tracing_dir;
+
+struct cpu_state {
+	uint64_t task_ts;
+	int task_pid;
+	char task[32];
+	uint64_t irq_ts;
+	int irq;
+	char irq_name[32];
+};
+
+static struct cpu_state cpus[MAX_CPUS];
+static unsigned char tid_named[MAX_TIDS];
+static uint64_t last_ts;
+
+static int tracing_write(const char *file, const char *val)
+{
+	char path[256];
+	int fd, ret = 0;
+
+	snprintf(path, sizeof(path), "%s/%s", tracing_dir, file);
+	fd = open(path, O_WRONLY | O_TRUNC);
+	if (fd < 0 || write(fd, val, strlen(val)) < 0) {
+		fprintf(stderr, "ftrace: %s: %s\n", path, strerror(errno));
+		ret = -1;
+	}
+	if (fd >= 0)
+		close(fd);
+
+	return ret;
+}
+
+static int enable_event(const char *event)
+{
+	char file[128];
+
+	snprintf(file, sizeof(file), "events/%s/enable", event);
+	return tracing_write(file, "1");
+}
+
+int ftrace_start(const struct ftrace_opts *o)
+{
+	char buf[32];
+	const char **e;
+
+	if (!access("/sys/kernel/tracing/trace", F_OK))
+		tracing_dir = "/sys/kernel/tracing";
+	else if (!access("/sys/kernel/debug/tracing/trace", F_OK))
+		tracing_dir = "/sys/kernel/debug/tracing";
+	else {
+		fprintf(stderr, "ftrace: no tracefs, mount it or debugfs\n");
+		return -1;
+	}
+
+	tracing_write("tracing_on", "0");
+	if (tracing_write("trace_clock", "mono"))
+		return -1;
+	snprintf(buf, sizeof(buf), "%u", o->buffer_kb);
+	tracing_write("buffer_size_kb", buf);
+	tracing_write("events/enable", "0");
+	tracing_write("trace", "");
+
+	if (enable_event("sched/sched_switch") ||
+	    enable_event("irq/irq_handler_entry") ||
+	    enable_event("irq/irq_handler_exit"))
+		return -1;
+	if (o->wakeups)
+		enable_event("sched/sched_wakeup");
+	for (e = o->extra; e && *e; e++)
+		enable_event(*e);
+
+	return tracing_write("tracing_on", "1");
+}
+
+void ftrace_stop(void)
+{
+	if (tracing_dir)
+		tracing_write("tracing_on", "0");
+}
+
+/* length of a value: up to the next " key=", values like comm may hold spaces */
+static size_t value_len(const char *p)
+{
+	const char *s = p, *k;
+
+	while ((s = strchr(s, ' '))) {
+		for (k = s + 1; (*k >= 'a' && *k <= 'z') || *k == '_'; k++)
+			;
+		if (k > s + 1 && *k == '=')
+			return s - p;
+		s++;
+	}
+
+	return strcspn(p, "\n");
+}
+
+/* value of "key=" in an event's arguments */
+static int arg_str(const char *args, const char *key, char *out, size_t len)
+{
+	const char *p = args;
+	size_t klen = strlen(key), n;
+
+	while ((p = strstr(p, key))) {
+		if ((p == args || p[-1] == ' ') && p[klen] == '=') {
+			p += klen + 1;
+			n = value_len(p);
+			if (n >= len)
+				n = len - 1;
+			memcpy(out, p, n);
+			out[n] = '\0';
+			return 0;
+		}
+		p += klen;
+	}
+
+	return -1;
+}
+
+static int arg_int(const char *args, const char *key, int *val)
+{
+	char buf[24];
+
+	if (arg_str(args, key, buf, sizeof(buf)))
+		return -1;
+	*val = atoi(buf);
+	return 0;
+}
+
+static void name_thread(struct trace_json *tj, int tgid, int tid, const char *comm)
+{
+	if (tid <= 0 || tid >= MAX_TIDS || tid_named[tid])
+		return;
+	tid_named[tid] = 1;
+	tj_thread_name(tj, tgid, tid, comm);
+}
+
+static void do_switch(struct trace_json *tj, struct ftrace_stats *st, int cpu,
+		      uint64_t ts, const char *args)
+{
+	struct cpu_state *c = &cpus[cpu];
+	const char *next = strstr(args, "==>");
+
+	if (!next)
+		return;
+
+	if (c->task_ts && c->task_pid)
+		tj_complete(tj, c->task, TRACE_PID_CPU, cpu, c->task_ts,
+			    ts - c->task_ts);
+
+	c->task_ts = ts;
+	c->task_pid = 0;
+	c->task[0] = '\0';
+	arg_str(next + 4, "next_comm", c->task, sizeof(c->task));
+	arg_int(next + 4, "next_pid", &c->task_pid);
+	st->switches++;
+}
+
+static void do_irq(struct trace_json *tj, struct ftrace_stats *st, int cpu,
+		   uint64_t ts, const char *args, int entry)
+{
+	struct cpu_state *c = &cpus[cpu];
+	char name[48];
+	int irq;
+
+	if (arg_int(args, "irq", &irq))
+		return;
+
+	if (entry) {
+		c->irq_ts = ts;
+		c->irq = irq;
+		if (arg_str(args, "name", c->irq_name, sizeof(c->irq_name)))
+			c->irq_name[0] = '\0';
+		return;
+	}
+
+	if (!c->irq_ts || c->irq != irq)
+		return;
+	snprintf(name, sizeof(name), "irq %d %s", irq, c->irq_name);
+	tj_complete(tj, name, TRACE_PID_IRQ, cpu, c->irq_ts, ts - c->irq_ts);
+	c->irq_ts = 0;
+	st->irqs++;
+}
+
+static void do_marker(struct trace_json *tj, struct ftrace_stats *st, int tid,
+		      uint64_t ts, char *msg)
+{
+	char *pid_s, *name, *val;
+	int tgid;
+
+	msg[strcspn(msg, "\n")] = '\0';
+	st->markers++;
+
+	if ((msg[0] == 'B' || msg[0] == 'E' || msg[0] == 'C') && msg[1] == '|') {
+		pid_s = msg + 2;
+		tgid = atoi(pid_s);
+		name = strchr(pid_s, '|');
+		name = name ? name + 1 : NULL;
+
+		switch (msg[0]) {
+		case 'B':
+			tj_event(tj, 'B', name ? name : "?", tgid, tid, ts);
+			return;
+		case 'E':
+			tj_event(tj, 'E', NULL, tgid, tid, ts);
+			return;
+		case 'C':
+			val = name ? strrchr(name, '|') : NULL;
+			if (!val)
+				break;
+			*val++ = '\0';
+			tj_counter(tj, name, tgid, ts, atoll(val));
+			return;
+		}
+	}
+
+	tj_event(tj, 'i', msg, tid, tid, ts);
+}
+
+/* "secs.frac:" with 6 (us) or 9 (ns) fraction digits */
+static int parse_ts(const char *p, uint64_t *ns)
+{
+	uint64_t secs = 0, frac = 0;
+	int digits = 0;
+
+	if (*p < '0' || *p > '9')
+		return -1;
+	for (; *p >= '0' && *p <= '9'; p++)
+		secs = secs * 10 + (*p - '0');
+	if (*p++ != '.')
+		return -1;
+	for (; *p >= '0' && *p <= '9'; p++, digits++)
+		frac = frac * 10 + (*p - '0');
+	if (*p != ':' || !digits || digits > 9)
+		return -1;
+	for (; digits < 9; digits++)
+		frac *= 10;
+
+	*ns = secs * 1000000000ull + frac;
+	return 0;
+}
+
+/*
+ * "  comm-pid  [cpu] flags  secs.usecs: event: args", where comm may hold
+ * spaces and dashes and the flags column depends on the irq-info option.
+ */
+static void parse_line(struct trace_json *tj, struct ftrace_stats *st, char *line)
+{
+	char *lb, *rb, *dash, *p, *ev, *args, *comm;
+	uint64_t ts;
+	int pid, cpu;
+
+	if (line[0] == '#')
+		return;
+	lb = strstr(line, " [");
+	if (!lb)
+		return;
+	rb = strchr(lb, ']');
+	if (!rb)
+		return;
+
+	*lb = '\0';
+	dash = strrchr(line, '-');
+	if (!dash)
+		return;
+	*dash = '\0';
+	pid = atoi(dash + 1);
+	for (comm = line; *comm == ' '; comm++)
+		;
+	cpu = atoi(lb + 2);
+	if (cpu < 0 || cpu >= MAX_CPUS)
+		return;
+
+	/* the timestamp is the first "secs.frac:" word after the cpu */
+	for (p = rb + 1; *p; p += strcspn(p, " ")) {
+		p += strspn(p, " ");
+		if (!parse_ts(p, &ts))
+			break;
+	}
+	if (!*p)
+		return;
+	ev = strchr(p, ':');
+	for (ev++; *ev == ' '; ev++)
+		;
+	args = strchr(ev, ':');
+	if (!args)
+		return;
+	*args = '\0';
+	for (args++; *args == ' '; args++)
+		;
+
+	last_ts = ts;
+	st->lines++;
+
+	if (!strcmp(ev, "sched_switch")) {
+		do_switch(tj, st, cpu, ts, args);
+	} else if (!strcmp(ev, "irq_handler_entry")) {
+		do_irq(tj, st, cpu, ts, args, 1);
+	} else if (!strcmp(ev, "irq_handler_exit")) {
+		do_irq(tj, st, cpu, ts, args, 0);
+	} else if (!strcmp(ev, "tracing_mark_write") || !strcmp(ev, "print")) {
+		name_thread(tj, pid, pid, comm);
+		do_marker(tj, st, pid, ts, args);
+	} else if (!strcmp(ev, "sched_wakeup")) {
+		int wpid;
+		char wcomm[32];
+
+		if (!arg_int(args, "pid", &wpid) &&
+		    !arg_str(args, "comm", wcomm, sizeof(wcomm))) {
+			name_thread(tj, wpid, wpid, wcomm);
+			tj_event(tj, 'i', "wakeup", wpid, wpid, ts);
+		}
+	} else {
+		char name[96];
+
+		args[strcspn(args, "\n")] = '\0';
+		snprintf(name, sizeof(name), "%s %s", ev, args);
+		tj_event(tj, 'i', name, TRACE_PID_CPU, cpu, ts);
+		st->other++;
+	}
+}
+
+int ftrace_export(struct trace_json *tj, struct ftrace_stats *st)
+{
+	char path[256], line[1024], name[16];
+	FILE *f;
+	int i;
+
+	memset(st, 0, sizeof(*st));
+	snprintf(path, sizeof(path), "%s/trace", tracing_dir);
+	f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "ftrace: %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	tj_process_name(tj, TRACE_PID_CPU, "linux CPUs");
+	tj_process_name(tj, TRACE_PID_IRQ, "linux IRQs");
+	for (i = 0; i < MAX_CPUS; i++) {
+		snprintf(name, sizeof(name), "cpu%d", i);
+		tj_thread_name(tj, TRACE_PID_CPU, i, name);
+		tj_thread_name(tj, TRACE_PID_IRQ, i, name);
+	}
+
+	while (fgets(line, sizeof(line), f))
+		parse_line(tj, st, line);
+	fclose(f);
+
+	/* close the slices still open at the end of the buffer */
+	for (i = 0; i < MAX_CPUS; i++) {
+		if (cpus[i].task_ts && cpus[i].task_pid && last_ts > cpus[i].task_ts)
+			tj_complete(tj, cpus[i].task, TRACE_PID_CPU, i,
+				    cpus[i].task_ts, last_ts - cpus[i].task_ts);
+	}
+
+	return 0;
+}
@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef CVITRACE_FTRACE_H
+#define CVITRACE_FTRACE_H
+
+#include <stdint.h>
+#include "trace_json.h"
+
+struct ftrace_opts {
+	unsigned int buffer_kb;
+	int wakeups;		/* also sched_wakeup */
+	const char **extra;	/* more "subsys/event" to enable, NULL terminated */
+};
+
+struct ftrace_stats {
+	uint64_t lines;
+	uint64_t switches;
+	uint64_t irqs;
+	uint64_t markers;
+	uint64_t other;
+};
+
+/* clear the buffer, select the mono clock and the events, start tracing */
+int ftrace_start(const struct ftrace_opts *o);
+void ftrace_stop(void);
+/* convert the captured buffer */
+int ftrace_export(struct trace_json *tj, struct ftrace_stats *st);
+
+#endif
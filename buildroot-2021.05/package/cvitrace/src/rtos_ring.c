@@ -0,0 +1,220 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Reader for the RTOS event ring. The RTOS cleans every event out of its
+ * D-cache before moving head, and /dev/mem with O_SYNC maps the region
+ * uncached, so a copy taken between two reads of head is consistent for
+ * every event the second read has not lapped.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include "rtos_trace.h"
+#include "rtos_ring.h"
+
+static volatile struct rtos_trace_ring *ring;
+static void *map_base;
+static size_t map_len;
+static uint64_t tail;
+
+static struct rtos_trace_event *events;
+static size_t nevents, cap;
+static uint64_t lost;
+
+/* ticks to CLOCK_MONOTONIC ns */
+static struct rtos_timebase_shm tb;
+static int have_tb;
+static uint64_t ref_ticks, ref_ns, tick_hz;
+
+#ifdef __riscv
+static uint64_t mono_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+#endif
+
+static int timebase_setup(void)
+{
+	uint64_t t0, t1;
+	int fd;
+
+	tick_hz = ring->tick_hz;
+
+	fd = open(RTOS_CMDQU_DEV, O_RDONLY);
+	if (fd >= 0) {
+		have_tb = !ioctl(fd, RTOS_CMDQU_GET_TIMEBASE, &tb) && tb.mult;
+		close(fd);
+		if (have_tb)
+			return 0;
+	}
+
+#ifdef __riscv
+	/* no shared timebase: pair the time CSR with the clock ourselves */
+	t0 = mono_ns();
+	__asm__ __volatile__("rdtime %0" : "=r"(ref_ticks));
+	t1 = mono_ns();
+	ref_ns = t0 + (t1 - t0) / 2;
+	fprintf(stderr, "rtos: no shared timebase, using a local counter reading\n");
+	return 0;
+#else
+	(void)t0;
+	(void)t1;
+	fprintf(stderr, "rtos: no shared timebase\n");
+	return -1;
+#endif
+}
+
+static uint64_t ticks_to_ns(uint64_t ticks)
+{
+	int64_t delta;
+
+	if (have_tb)
+		return (uint64_t)(((unsigned __int128)ticks * tb.mult) >> tb.shift) +
+		       tb.offset_ns;
+
+	delta = (int64_t)(ticks - ref_ticks);
+	return ref_ns + delta * 1000000000ll / (int64_t)tick_hz;
+}
+
+int rtos_ring_open(unsigned long addr)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	unsigned long base = addr & ~(page - 1);
+	int fd;
+
+	fd = open("/dev/mem", O_RDONLY | O_SYNC);
+	if (fd < 0) {
+		fprintf(stderr, "rtos: /dev/mem: %s\n", strerror(errno));
+		return -1;
+	}
+
+	map_len = addr - base + sizeof(struct rtos_trace_ring);
+	map_base = mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, base);
+	close(fd);
+	if (map_base == MAP_FAILED) {
+		fprintf(stderr, "rtos: mmap %#lx: %s\n", addr, strerror(errno));
+		return -1;
+	}
+	ring = (void *)((char *)map_base + (addr - base));
+
+	if (ring->magic != RTOS_TRACE_MAGIC || ring->nevents != RTOS_TRACE_EVENTS ||
+	    !ring->tick_hz) {
+		fprintf(stderr, "rtos: no event ring at %#lx\n", addr);
+		goto err;
+	}
+	if (timebase_setup())
+		goto err;
+
+	tail = ring->head;
+	return 0;
+
+err:
+	munmap(map_base, map_len);
+	ring = NULL;
+	return -1;
+}
+
+void rtos_ring_poll(void)
+{
+	uint64_t head, head2, i;
+	struct rtos_trace_event *ev;
+
+	if (!ring)
+		return;
+
+	head = ring->head;
+	__sync_synchronize();
+	if (head - tail > RTOS_TRACE_EVENTS) {
+		lost += head - tail - RTOS_TRACE_EVENTS;
+		tail = head - RTOS_TRACE_EVENTS;
+	}
+	if (head == tail)
+		return;
+
+	if (nevents + (head - tail) > cap) {
+		cap = (cap ? cap * 2 : 4096) + (head - tail);
+		ev = realloc(events, cap * sizeof(*events));
+		if (!ev) {
+			lost += head - tail;
+			tail = head;
+			return;
+		}
+		events = ev;
+	}
+
+	for (i = tail; i < head; i++)
+		memcpy(&events[nevents + (i - tail)],
+		       (const void *)&ring->event[i & (RTOS_TRACE_EVENTS - 1)],
+		       sizeof(*events));
+
+	/* drop whatever the RTOS overwrote while we were copying */
+	__sync_synchronize();
+	head2 = ring->head;
+	i = tail;
+	if (head2 - tail > RTOS_TRACE_EVENTS) {
+		i = head2 - RTOS_TRACE_EVENTS;
+		if (i > head)
+			i = head;
+		lost += i - tail;
+	}
+	memmove(&events[nevents], &events[nevents + (i - tail)],
+		(head - i) * sizeof(*events));
+	nevents += head - i;
+	tail = head;
+}
+
+void rtos_ring_export(struct trace_json *tj, struct rtos_ring_stats *st)
+{
+	struct rtos_trace_event *ev;
+	char name[RTOS_TRACE_NAME_LEN];
+	uint64_t ts;
+	size_t i;
+
+	memset(st, 0, sizeof(*st));
+	if (!ring)
+		return;
+
+	tj_process_name(tj, TRACE_PID_RTOS, "rtos (small core)");
+	for (i = 0; i < nevents; i++) {
+		ev = &events[i];
+		memcpy(name, ev->name, sizeof(name));
+		name[sizeof(name) - 1] = '\0';
+		ts = ticks_to_ns(ev->ticks);
+
+		switch (ev->type) {
+		case RTOS_TRACE_BEGIN:
+			tj_event(tj, 'B', name, TRACE_PID_RTOS, 0, ts);
+			break;
+		case RTOS_TRACE_END:
+			tj_event(tj, 'E', NULL, TRACE_PID_RTOS, 0, ts);
+			break;
+		case RTOS_TRACE_COUNTER:
+			tj_counter(tj, name, TRACE_PID_RTOS, ts, ev->value);
+			break;
+		default:
+			tj_event(tj, 'i', name, TRACE_PID_RTOS, 0, ts);
+			break;
+		}
+	}
+
+	st->events = nevents;
+	st->lost = lost;
+}
+
+void rtos_ring_close(void)
+{
+	if (ring)
+		munmap(map_base, map_len);
+	ring = NULL;
+	free(events);
+	events = NULL;
+	nevents = cap = 0;
+}
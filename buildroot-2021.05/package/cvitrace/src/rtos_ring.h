@@ -0,0 +1,20 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef CVITRACE_RTOS_RING_H
+#define CVITRACE_RTOS_RING_H
+
+#include <stdint.h>
+#include "trace_json.h"
+
+struct rtos_ring_stats {
+	uint64_t events;
+	uint64_t lost;
+};
+
+/* map the ring at @addr through /dev/mem and start from its current head */
+int rtos_ring_open(unsigned long addr);
+/* copy what the RTOS wrote since the last call, often enough not to lap */
+void rtos_ring_poll(void);
+void rtos_ring_export(struct trace_json *tj, struct rtos_ring_stats *st);
+void rtos_ring_close(void);
+
+#endif
@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef CVITRACE_RTOS_TRACE_H
+#define CVITRACE_RTOS_TRACE_H
+
+#include <stdint.h>
+
+/*
+ * Event ring the RTOS writes in reserved DRAM, stamped with the time CSR.
+ * head counts every event ever written; events older than
+ * head - RTOS_TRACE_EVENTS have been overwritten.
+ *
+ * The layout must match freertos/cvitek/driver/trace/include/rtos_trace.h.
+ */
+#define RTOS_TRACE_ADDR		0x801f6000
+#define RTOS_TRACE_MAGIC	0x54524143	/* "TRAC" */
+#define RTOS_TRACE_EVENTS	1024
+#define RTOS_TRACE_NAME_LEN	16
+
+enum rtos_trace_type {
+	RTOS_TRACE_BEGIN = 'B',
+	RTOS_TRACE_END = 'E',
+	RTOS_TRACE_COUNTER = 'C',
+	RTOS_TRACE_INSTANT = 'I',
+};
+
+struct rtos_trace_event {
+	uint64_t ticks;
+	uint8_t type;
+	uint8_t reserved[3];
+	int32_t value;
+	char name[RTOS_TRACE_NAME_LEN];
+};
+
+struct rtos_trace_ring {
+	uint32_t magic;
+	uint32_t nevents;
+	uint64_t tick_hz;
+	uint64_t head;
+	uint32_t reserved[10];
+	struct rtos_trace_event event[RTOS_TRACE_EVENTS];
+} __attribute__((aligned(64)));
+
+/*
+ * Counter to CLOCK_MONOTONIC mapping the kernel shares with the RTOS,
+ * from drivers/soc/cvitek/rtos_cmdqu/rtos_timebase.h.
+ */
+struct rtos_timebase_shm {
+	uint32_t magic;
+	uint32_t seq;
+	uint64_t tick_hz;
+	uint32_t mult;
+	uint32_t shift;
+	int64_t offset_ns;
+	uint64_t update_ticks;
+	uint64_t update_mono_ns;
+} __attribute__((aligned(64)));
+
+#define RTOS_CMDQU_DEV		"/dev/cvi-rtos-cmdqu"
+#define RTOS_CMDQU_GET_TIMEBASE	_IOR('r', 0x10, struct rtos_timebase_shm)
+
+#endif
@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "trace_json.h"
+
+static void tj_sep(struct trace_json *tj)
+{
+	fputs(tj->events++ ? ",\n" : "\n", tj->f);
+}
+
+static void tj_str(struct trace_json *tj, const char *s)
+{
+	fputc('"', tj->f);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fprintf(tj->f, "\\%c", *s);
+		else if ((unsigned char)*s < 0x20)
+			fprintf(tj->f, "\\u%04x", *s);
+		else
+			fputc(*s, tj->f);
+	}
+	fputc('"', tj->f);
+}
+
+static void tj_ts(struct trace_json *tj, const char *key, uint64_t ns)
+{
+	fprintf(tj->f, ",\"%s\":%llu.%03u", key, (unsigned long long)(ns / 1000),
+		(unsigned int)(ns % 1000));
+}
+
+void tj_open(struct trace_json *tj, FILE *f)
+{
+	tj->f = f;
+	tj->events = 0;
+	fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", f);
+}
+
+void tj_close(struct trace_json *tj)
+{
+	fputs("\n]}\n", tj->f);
+}
+
+static void tj_meta(struct trace_json *tj, const char *what, int pid, int tid,
+		    const char *name)
+{
+	tj_sep(tj);
+	fprintf(tj->f, "{\"ph\":\"M\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":",
+		what, pid, tid);
+	tj_str(tj, name);
+	fputs("}}", tj->f);
+}
+
+void tj_process_name(struct trace_json *tj, int pid, const char *name)
+{
+	tj_meta(tj, "process_name", pid, 0, name);
+}
+
+void tj_thread_name(struct trace_json *tj, int pid, int tid, const char *name)
+{
+	tj_meta(tj, "thread_name", pid, tid, name);
+}
+
+void tj_event(struct trace_json *tj, char ph, const char *name, int pid,
+	      int tid, uint64_t ts_ns)
+{
+	tj_sep(tj);
+	fprintf(tj->f, "{\"ph\":\"%c\",\"pid\":%d,\"tid\":%d", ph, pid, tid);
+	tj_ts(tj, "ts", ts_ns);
+	if (name) {
+		fputs(",\"name\":", tj->f);
+		tj_str(tj, name);
+	}
+	if (ph == 'i')
+		fputs(",\"s\":\"t\"", tj->f);
+	fputc('}', tj->f);
+}
+
+void tj_complete(struct trace_json *tj, const char *name, int pid, int tid,
+		 uint64_t ts_ns, uint64_t dur_ns)
+{
+	tj_sep(tj);
+	fprintf(tj->f, "{\"ph\":\"X\",\"pid\":%d,\"tid\":%d", pid, tid);
+	tj_ts(tj, "ts", ts_ns);
+	tj_ts(tj, "dur", dur_ns);
+	fputs(",\"name\":", tj->f);
+	tj_str(tj, name);
+	fputc('}', tj->f);
+}
+
+void tj_counter(struct trace_json *tj, const char *name, int pid,
+		uint64_t ts_ns, long long value)
+{
+	tj_sep(tj);
+	fprintf(tj->f, "{\"ph\":\"C\",\"pid\":%d,\"tid\":0", pid);
+	tj_ts(tj, "ts", ts_ns);
+	fputs(",\"name\":", tj->f);
+	tj_str(tj, name);
+	fprintf(tj->f, ",\"args\":{\"value\":%lld}}", value);
+}
@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef CVITRACE_TRACE_JSON_H
+#define CVITRACE_TRACE_JSON_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Chrome trace event format writer. Timestamps are CLOCK_MONOTONIC in
+ * ns and written in us with ns precision; events need not be sorted.
+ */
+
+/* synthetic processes, above the default pid_max */
+#define TRACE_PID_CPU	100000
+#define TRACE_PID_IRQ	100001
+#define TRACE_PID_RTOS	100002
+
+struct trace_json {
+	FILE *f;
+	uint64_t events;
+};
+
+void tj_open(struct trace_json *tj, FILE *f);
+void tj_close(struct trace_json *tj);
+
+void tj_process_name(struct trace_json *tj, int pid, const char *name);
+void tj_thread_name(struct trace_json *tj, int pid, int tid, const char *name);
+/* ph is 'B', 'E' or 'i'; name may be NULL for 'E' */
+void tj_event(struct trace_json *tj, char ph, const char *name, int pid,
+	      int tid, uint64_t ts_ns);
+void tj_complete(struct trace_json *tj, const char *name, int pid, int tid,
+		 uint64_t ts_ns, uint64_t dur_ns);
+void tj_counter(struct trace_json *tj, const char *name, int pid,
+		uint64_t ts_ns, long long value);
+
+#endif
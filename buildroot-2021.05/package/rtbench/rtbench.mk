@@ -0,0 +1,20 @@
+################################################################################
+#
+# rtbench
+#
+################################################################################
+
+RTBENCH_VERSION = 1.0
+RTBENCH_SITE = $(RTBENCH_PKGDIR)/src
+RTBENCH_SITE_METHOD = local
+RTBENCH_LICENSE = GPL-2.0
+
+define RTBENCH_BUILD_CMDS
+	$(TARGET_MAKE_ENV) $(MAKE) $(TARGET_CONFIGURE_OPTS) -C $(@D)
+endef
+
+define RTBENCH_INSTALL_TARGET_CMDS
+	$(INSTALL) -D -m 0755 $(@D)/rtbench $(TARGET_DIR)/usr/bin/rtbench
+endef
+
+$(eval $(generic-package))
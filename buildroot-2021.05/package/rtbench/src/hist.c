@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <inttypes.h>
+#include <stdlib.h>
+#include "hist.h"
+
+int hist_init(struct hist *h, const char *name, unsigned int nbins)
+{
+	h->name = name;
+	h->bins = calloc(nbins, sizeof(*h->bins));
+	h->nbins = nbins;
+	h->overflow = 0;
+	h->count = 0;
+	h->sum_ns = 0;
+	h->min_ns = UINT64_MAX;
+	h->max_ns = 0;
+
+	return h->bins ? 0 : -1;
+}
+
+void hist_free(struct hist *h)
+{
+	free(h->bins);
+	h->bins = NULL;
+}
+
+void hist_add(struct hist *h, uint64_t ns)
+{
+	uint64_t us = ns / 1000;
+
+	if (us < h->nbins)
+		h->bins[us]++;
+	else
+		h->overflow++;
+
+	h->count++;
+	h->sum_ns += ns;
+	if (ns < h->min_ns)
+		h->min_ns = ns;
+	if (ns > h->max_ns)
+		h->max_ns = ns;
+}
+
+uint64_t hist_percentile(const struct hist *h, unsigned int permille)
+{
+	uint64_t want = (h->count * permille + 999) / 1000;
+	uint64_t seen = 0;
+	unsigned int i;
+
+	if (!h->count)
+		return 0;
+
+	for (i = 0; i < h->nbins; i++) {
+		seen += h->bins[i];
+		if (seen >= want)
+			return i;
+	}
+
+	/* somewhere in the overflow, the max is the best we know */
+	return h->max_ns / 1000;
+}
+
+void hist_summary(const struct hist *h, FILE *f)
+{
+	if (!h->count) {
+		fprintf(f, "%-16s no samples\n", h->name);
+		return;
+	}
+
+	fprintf(f, "%-16s n %8" PRIu64 "  min %6" PRIu64 "  avg %6" PRIu64
+		"  p99 %6" PRIu64 "  p99.9 %6" PRIu64 "  max %6" PRIu64
+		" us  overflow %" PRIu64 "\n",
+		h->name, h->count, h->min_ns / 1000,
+		h->sum_ns / h->count / 1000, hist_percentile(h, 990),
+		hist_percentile(h, 999), h->max_ns / 1000, h->overflow);
+}
+
+void hist_json(const struct hist *h, FILE *f)
+{
+	const char *sep = "";
+	unsigned int i;
+
+	fprintf(f, "{\"name\": \"%s\", \"unit\": \"us\", \"samples\": %" PRIu64,
+		h->name, h->count);
+	if (h->count)
+		fprintf(f, ", \"min\": %.3f, \"avg\": %.3f, \"max\": %.3f"
+			", \"p50\": %" PRIu64 ", \"p99\": %" PRIu64
+			", \"p999\": %" PRIu64,
+			h->min_ns / 1000.0, (double)h->sum_ns / h->count / 1000.0,
+			h->max_ns / 1000.0, hist_percentile(h, 500),
+			hist_percentile(h, 990), hist_percentile(h, 999));
+	fprintf(f, ", \"bin_us\": 1, \"overflow\": %" PRIu64 ", \"bins\": [",
+		h->overflow);
+
+	for (i = 0; i < h->nbins; i++) {
+		if (!h->bins[i])
+			continue;
+		fprintf(f, "%s[%u, %" PRIu64 "]", sep, i, h->bins[i]);
+		sep = ", ";
+	}
+	fprintf(f, "]}");
+}
@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef RTBENCH_HIST_H
+#define RTBENCH_HIST_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* latency histogram with 1 us bins; samples past the last bin overflow */
+struct hist {
+	const char *name;
+	uint64_t *bins;
+	unsigned int nbins;
+	uint64_t overflow;
+	uint64_t count;
+	uint64_t sum_ns;
+	uint64_t min_ns;
+	uint64_t max_ns;
+};
+
+int hist_init(struct hist *h, const char *name, unsigned int nbins);
+void hist_free(struct hist *h);
+void hist_add(struct hist *h, uint64_t ns);
+/* value in us below which @permille of the samples fall */
+uint64_t hist_percentile(const struct hist *h, unsigned int permille);
+void hist_summary(const struct hist *h, FILE *f);
+/* one JSON object, non-empty bins only as [us, count] pairs */
+void hist_json(const struct hist *h, FILE *f);
+
+#endif
@@ -0,0 +1,491 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * rtbench - real-time latency benchmark for the CV180x boards.
+ *
+ * Scenarios, run in the order given on the command line:
+ *
+ *   cyclic  wakeup latency of a periodic SCHED_FIFO thread sleeping on
+ *           CLOCK_MONOTONIC, as cyclictest measures it
+ *   irq     GPIO interrupt to userspace latency; needs an output line
+ *           wired to an input line (--gpio). The kernel stamps the edge
+ *           in the hard interrupt, the thread stamps the read()
+ *   cmdqu   round trip of RTOS_CMDQU_SEND_WAIT to the small core; the
+ *           RTOS has to send the command back (--cmdqu)
+ *
+ * Background load from stress.c can be added with --stress. The report
+ * is one JSON object with a histogram per measurement, so runs on
+ * different kernels or releases can be compared by script; a text
+ * summary goes to stderr.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/gpio.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/utsname.h>
+#include "hist.h"
+#include "stress.h"
+
+#define NSEC_PER_SEC		1000000000ULL
+#define MAX_HISTS		8
+
+/*
+ * The ioctl numbering of the kernel driver (drivers/soc/cvitek/rtos_cmdqu),
+ * which differs from the copy of rtos_cmdqu.h in middleware.
+ */
+struct cmdqu {
+	uint8_t ip_id;
+	uint8_t cmd_id : 7;
+	uint8_t block : 1;
+	uint16_t mstime;	/* wait timeout, 0xffff blocks forever */
+	uint32_t param_ptr;
+} __attribute__((packed)) __attribute__((aligned(0x8)));
+
+#define RTOS_CMDQU_DEV			"/dev/cvi-rtos-cmdqu"
+#define RTOS_CMDQU_SEND_WAIT		_IOW('r', 2, unsigned long)
+#define CMDQU_TIMEOUT_MS		100
+
+static struct {
+	unsigned int interval_us;
+	unsigned int loops;
+	int priority;
+	int cpu;
+	unsigned int nbins;
+	const char *tag;
+	const char *output;
+	const char *gpio_chip;
+	unsigned int gpio_out;
+	unsigned int gpio_in;
+	int cmdqu_ip;
+	int cmdqu_cmd;
+	struct stress_cfg stress;
+} cfg = {
+	.interval_us = 1000,
+	.loops = 10000,
+	.priority = 80,
+	.cpu = -1,
+	.nbins = 2000,
+	.cmdqu_ip = -1,
+};
+
+static struct hist hists[MAX_HISTS];
+static unsigned int nhists;
+static volatile sig_atomic_t stop;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void ns_to_ts(uint64_t ns, struct timespec *ts)
+{
+	ts->tv_sec = ns / NSEC_PER_SEC;
+	ts->tv_nsec = ns % NSEC_PER_SEC;
+}
+
+static void sleep_until(uint64_t ns)
+{
+	struct timespec ts;
+
+	ns_to_ts(ns, &ts);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR &&
+	       !stop)
+		;
+}
+
+static struct hist *new_hist(const char *name)
+{
+	struct hist *h;
+
+	if (nhists == MAX_HISTS)
+		return NULL;
+	h = &hists[nhists];
+	if (hist_init(h, name, cfg.nbins))
+		return NULL;
+	nhists++;
+
+	return h;
+}
+
+static int run_cyclic(void)
+{
+	struct hist *h = new_hist("cyclic");
+	uint64_t period = cfg.interval_us * 1000ULL, next, now;
+	unsigned int i;
+
+	if (!h)
+		return -1;
+
+	next = now_ns() + period;
+	for (i = 0; i < cfg.loops && !stop; i++) {
+		sleep_until(next);
+		now = now_ns();
+		hist_add(h, now - next);
+
+		next += period;
+		/* don't make up for missed periods with a burst of wakeups */
+		if (now > next)
+			next = now + period - (now - next) % period;
+	}
+
+	return 0;
+}
+
+static int gpio_set(int fd, int value)
+{
+	struct gpiohandle_data data = { .values = { value } };
+
+	return ioctl(fd, GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data);
+}
+
+static int run_irq(void)
+{
+	struct gpiohandle_request out = { .lines = 1, .flags = GPIOHANDLE_REQUEST_OUTPUT };
+	struct gpioevent_request in = { .handleflags = GPIOHANDLE_REQUEST_INPUT,
+					.eventflags = GPIOEVENT_REQUEST_RISING_EDGE };
+	struct hist *to_user, *to_irq;
+	struct gpioevent_data ev;
+	uint64_t period = cfg.interval_us * 1000ULL, next, t0, t1;
+	struct pollfd pfd;
+	unsigned int i;
+	int chip, ret = -1;
+
+	if (!cfg.gpio_chip) {
+		fprintf(stderr, "irq: needs --gpio CHIP:OUT:IN\n");
+		return -1;
+	}
+
+	chip = open(cfg.gpio_chip, O_RDONLY);
+	if (chip < 0) {
+		fprintf(stderr, "irq: %s: %s\n", cfg.gpio_chip, strerror(errno));
+		return -1;
+	}
+
+	out.lineoffsets[0] = cfg.gpio_out;
+	strcpy(out.consumer_label, "rtbench-out");
+	in.lineoffset = cfg.gpio_in;
+	strcpy(in.consumer_label, "rtbench-in");
+	if (ioctl(chip, GPIO_GET_LINEHANDLE_IOCTL, &out) ||
+	    ioctl(chip, GPIO_GET_LINEEVENT_IOCTL, &in)) {
+		fprintf(stderr, "irq: requesting lines: %s\n", strerror(errno));
+		goto out_chip;
+	}
+
+	to_user = new_hist("irq_to_user");
+	to_irq = new_hist("gpio_set_to_irq");
+	if (!to_user || !to_irq)
+		goto out_lines;
+
+	pfd.fd = in.fd;
+	pfd.events = POLLIN;
+	next = now_ns() + period;
+	for (i = 0; i < cfg.loops && !stop; i++) {
+		gpio_set(out.fd, 0);
+		sleep_until(next);
+		next += period;
+
+		t0 = now_ns();
+		gpio_set(out.fd, 1);
+		if (poll(&pfd, 1, 100) != 1 ||
+		    read(in.fd, &ev, sizeof(ev)) != sizeof(ev)) {
+			fprintf(stderr, "irq: no edge on line %u, is it wired to %u?\n",
+				cfg.gpio_in, cfg.gpio_out);
+			goto out_lines;
+		}
+		t1 = now_ns();
+
+		/* the event timestamp is CLOCK_MONOTONIC, taken in the hard irq */
+		hist_add(to_user, t1 - ev.timestamp);
+		hist_add(to_irq, ev.timestamp - t0);
+	}
+	ret = 0;
+
+out_lines:
+	close(out.fd);
+	close(in.fd);
+out_chip:
+	close(chip);
+	return ret;
+}
+
+static int run_cmdqu(void)
+{
+	struct cmdqu cmdq;
+	struct hist *h;
+	uint64_t period = cfg.interval_us * 1000ULL, next, t0, t;
+	unsigned int i, timeouts = 0;
+	int fd;
+
+	if (cfg.cmdqu_ip < 0) {
+		fprintf(stderr, "cmdqu: needs --cmdqu IP:CMD of a command the RTOS answers\n");
+		return -1;
+	}
+
+	fd = open(RTOS_CMDQU_DEV, O_RDWR);
+	if (fd < 0) {
+		fprintf(stderr, "cmdqu: %s: %s\n", RTOS_CMDQU_DEV, strerror(errno));
+		return -1;
+	}
+
+	h = new_hist("cmdqu_round_trip");
+	if (!h) {
+		close(fd);
+		return -1;
+	}
+
+	next = now_ns() + period;
+	for (i = 0; i < cfg.loops && !stop; i++) {
+		sleep_until(next);
+		next += period;
+
+		memset(&cmdq, 0, sizeof(cmdq));
+		cmdq.ip_id = cfg.cmdqu_ip;
+		cmdq.cmd_id = cfg.cmdqu_cmd;
+		cmdq.mstime = CMDQU_TIMEOUT_MS;
+		cmdq.param_ptr = i;
+
+		t0 = now_ns();
+		if (ioctl(fd, RTOS_CMDQU_SEND_WAIT, &cmdq) < 0) {
+			fprintf(stderr, "cmdqu: %s\n", strerror(errno));
+			close(fd);
+			return -1;
+		}
+		t = now_ns() - t0;
+
+		/* the driver does not report a timeout to userspace */
+		if (t >= CMDQU_TIMEOUT_MS * 1000000ULL) {
+			if (++timeouts == 10) {
+				fprintf(stderr, "cmdqu: no reply to %d:%#x\n",
+					cfg.cmdqu_ip, cfg.cmdqu_cmd);
+				break;
+			}
+			continue;
+		}
+		hist_add(h, t);
+	}
+
+	close(fd);
+	return timeouts == 10 ? -1 : 0;
+}
+
+static void report(FILE *f)
+{
+	struct utsname uts;
+	unsigned int i;
+
+	uname(&uts);
+	fprintf(f, "{\"tool\": \"rtbench\", \"version\": 1, \"tag\": \"%s\",\n",
+		cfg.tag ? cfg.tag : "");
+	fprintf(f, " \"kernel\": {\"release\": \"%s\", \"version\": \"%s\", \"machine\": \"%s\"},\n",
+		uts.release, uts.version, uts.machine);
+	fprintf(f, " \"config\": {\"interval_us\": %u, \"loops\": %u, \"priority\": %d, \"cpu\": %d, \"stress\": \"%s\"},\n",
+		cfg.interval_us, cfg.loops, cfg.priority, cfg.cpu,
+		stress_describe(&cfg.stress));
+	fprintf(f, " \"histograms\": [");
+	for (i = 0; i < nhists; i++) {
+		fprintf(f, "%s\n  ", i ? "," : "");
+		hist_json(&hists[i], f);
+	}
+	fprintf(f, "]}\n");
+}
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [options] cyclic|irq|cmdqu...\n"
+		"  -i, --interval US       period of each scenario (1000)\n"
+		"  -l, --loops N           samples per scenario (10000)\n"
+		"  -p, --priority PRIO     SCHED_FIFO priority (80)\n"
+		"  -a, --affinity CPU      pin the measuring thread\n"
+		"  -b, --bins N            histogram range in us (2000)\n"
+		"  -t, --tag TEXT          label stored in the report\n"
+		"  -o, --output FILE       JSON report (stdout)\n"
+		"  -s, --stress GEN=VAL    cpu=N, mem=N, io=DIR, net=HOST[:PORT]\n"
+		"      --gpio CHIP:OUT:IN  loopback lines for irq, e.g. /dev/gpiochip0:5:6\n"
+		"      --cmdqu IP:CMD      command echoed by the RTOS for cmdqu\n",
+		prog);
+}
+
+static int parse_gpio(char *arg)
+{
+	char *in, *out = strchr(arg, ':');
+
+	if (!out || !(in = strchr(out + 1, ':')))
+		return -1;
+	*out++ = '\0';
+	*in++ = '\0';
+	cfg.gpio_chip = arg;
+	cfg.gpio_out = strtoul(out, NULL, 0);
+	cfg.gpio_in = strtoul(in, NULL, 0);
+
+	return 0;
+}
+
+static int parse_cmdqu(char *arg)
+{
+	char *cmd = strchr(arg, ':');
+
+	if (!cmd)
+		return -1;
+	cfg.cmdqu_ip = strtol(arg, NULL, 0);
+	cfg.cmdqu_cmd = strtol(cmd + 1, NULL, 0);
+
+	return cfg.cmdqu_cmd >= 0 && cfg.cmdqu_cmd < 0x80 ? 0 : -1;
+}
+
+static int set_realtime(void)
+{
+	struct sched_param param = { .sched_priority = cfg.priority };
+	cpu_set_t set;
+
+	if (cfg.cpu >= 0) {
+		CPU_ZERO(&set);
+		CPU_SET(cfg.cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set))
+			return -1;
+	}
+
+	return sched_setscheduler(0, SCHED_FIFO, &param);
+}
+
+int main(int argc, char **argv)
+{
+	static const struct option opts[] = {
+		{ "interval", required_argument, NULL, 'i' },
+		{ "loops", required_argument, NULL, 'l' },
+		{ "priority", required_argument, NULL, 'p' },
+		{ "affinity", required_argument, NULL, 'a' },
+		{ "bins", required_argument, NULL, 'b' },
+		{ "tag", required_argument, NULL, 't' },
+		{ "output", required_argument, NULL, 'o' },
+		{ "stress", required_argument, NULL, 's' },
+		{ "gpio", required_argument, NULL, 'G' },
+		{ "cmdqu", required_argument, NULL, 'C' },
+		{ "help", no_argument, NULL, 'h' },
+		{ }
+	};
+	int32_t dma_latency = 0;
+	int opt, i, latency_fd, ret = 0;
+	FILE *f = stdout;
+
+	while ((opt = getopt_long(argc, argv, "i:l:p:a:b:t:o:s:h", opts, NULL)) != -1) {
+		switch (opt) {
+		case 'i':
+			cfg.interval_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			cfg.loops = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			cfg.priority = atoi(optarg);
+			break;
+		case 'a':
+			cfg.cpu = atoi(optarg);
+			break;
+		case 'b':
+			cfg.nbins = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			cfg.tag = optarg;
+			break;
+		case 'o':
+			cfg.output = optarg;
+			break;
+		case 's':
+			if (stress_parse(&cfg.stress, optarg))
+				goto bad_arg;
+			break;
+		case 'G':
+			if (parse_gpio(optarg))
+				goto bad_arg;
+			break;
+		case 'C':
+			if (parse_cmdqu(optarg))
+				goto bad_arg;
+			break;
+		default:
+			goto bad_arg;
+		}
+	}
+	if (optind == argc || !cfg.interval_us || !cfg.nbins)
+		goto bad_arg;
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	if (mlockall(MCL_CURRENT | MCL_FUTURE))
+		perror("mlockall");
+
+	/* keep the CPU out of deep idle states for the whole run */
+	latency_fd = open("/dev/cpu_dma_latency", O_WRONLY);
+	if (latency_fd >= 0)
+		write(latency_fd, &dma_latency, sizeof(dma_latency));
+
+	/* started first so the load threads stay SCHED_OTHER */
+	if (stress_start(&cfg.stress)) {
+		fprintf(stderr, "can't start the stress generators\n");
+		return 1;
+	}
+
+	if (set_realtime())
+		perror("SCHED_FIFO");
+
+	for (i = optind; i < argc && !stop; i++) {
+		if (!strcmp(argv[i], "cyclic"))
+			ret |= run_cyclic();
+		else if (!strcmp(argv[i], "irq"))
+			ret |= run_irq();
+		else if (!strcmp(argv[i], "cmdqu"))
+			ret |= run_cmdqu();
+		else
+			fprintf(stderr, "unknown scenario %s\n", argv[i]), ret = -1;
+	}
+
+	stress_stop();
+	if (latency_fd >= 0)
+		close(latency_fd);
+
+	for (i = 0; i < (int)nhists; i++)
+		hist_summary(&hists[i], stderr);
+
+	if (cfg.output) {
+		f = fopen(cfg.output, "w");
+		if (!f) {
+			perror(cfg.output);
+			return 1;
+		}
+	}
+	report(f);
+	if (f != stdout)
+		fclose(f);
+
+	for (i = 0; i < (int)nhists; i++)
+		hist_free(&hists[i]);
+
+	return ret ? 1 : 0;
+
+bad_arg:
+	usage(argv[0]);
+	return 2;
+}
@@ -0,0 +1,197 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "stress.h"
+
+#define STRESS_MEM_SIZE		(8 << 20)	/* well past the L2 */
+#define STRESS_IO_CHUNK		(256 << 10)
+#define STRESS_IO_FILE_MAX	(64 << 20)
+#define STRESS_NET_PAYLOAD	1400
+#define STRESS_MAX_THREADS	32
+
+static volatile int stress_running;
+static pthread_t threads[STRESS_MAX_THREADS];
+static int nthreads;
+
+static void *cpu_thread(void *arg)
+{
+	volatile unsigned long x = 1;
+
+	(void)arg;
+	while (stress_running)
+		x = x * 1103515245 + 12345;
+
+	return NULL;
+}
+
+static void *mem_thread(void *arg)
+{
+	char *a = malloc(STRESS_MEM_SIZE), *b = malloc(STRESS_MEM_SIZE);
+
+	(void)arg;
+	if (!a || !b)
+		goto out;
+
+	memset(a, 0x5a, STRESS_MEM_SIZE);
+	while (stress_running) {
+		memcpy(b, a, STRESS_MEM_SIZE);
+		memcpy(a, b, STRESS_MEM_SIZE);
+	}
+out:
+	free(a);
+	free(b);
+	return NULL;
+}
+
+/* SD card traffic: sequential writes with fsync, restarting at the cap */
+static void *io_thread(void *arg)
+{
+	const char *dir = arg;
+	char path[256], *buf;
+	off_t written = 0;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/rtbench.stress", dir);
+	buf = malloc(STRESS_IO_CHUNK);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (!buf || fd < 0) {
+		fprintf(stderr, "stress: io on %s: %s\n", path, strerror(errno));
+		goto out;
+	}
+	memset(buf, 0xa5, STRESS_IO_CHUNK);
+
+	while (stress_running) {
+		if (write(fd, buf, STRESS_IO_CHUNK) != STRESS_IO_CHUNK)
+			break;
+		fsync(fd);
+		written += STRESS_IO_CHUNK;
+		if (written >= STRESS_IO_FILE_MAX) {
+			ftruncate(fd, 0);
+			lseek(fd, 0, SEEK_SET);
+			written = 0;
+		}
+	}
+
+	close(fd);
+	unlink(path);
+out:
+	free(buf);
+	return NULL;
+}
+
+static void *net_thread(void *arg)
+{
+	char host[128], *port, buf[STRESS_NET_PAYLOAD];
+	struct addrinfo hints = { .ai_family = AF_UNSPEC,
+				  .ai_socktype = SOCK_DGRAM };
+	struct addrinfo *ai;
+	int fd;
+
+	snprintf(host, sizeof(host), "%s", (const char *)arg);
+	port = strrchr(host, ':');
+	if (port)
+		*port++ = '\0';
+
+	/* the discard port unless told otherwise */
+	if (getaddrinfo(host, port ? port : "9", &hints, &ai)) {
+		fprintf(stderr, "stress: can't resolve %s\n", host);
+		return NULL;
+	}
+
+	fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+	if (fd < 0 || connect(fd, ai->ai_addr, ai->ai_addrlen)) {
+		fprintf(stderr, "stress: net: %s\n", strerror(errno));
+		goto out;
+	}
+	memset(buf, 0x3c, sizeof(buf));
+
+	/* ECONNREFUSED from a closed port is expected, keep sending */
+	while (stress_running)
+		send(fd, buf, sizeof(buf), 0);
+
+out:
+	if (fd >= 0)
+		close(fd);
+	freeaddrinfo(ai);
+	return NULL;
+}
+
+static int spawn(void *(*fn)(void *), void *arg)
+{
+	if (nthreads == STRESS_MAX_THREADS)
+		return -1;
+	if (pthread_create(&threads[nthreads], NULL, fn, arg))
+		return -1;
+	nthreads++;
+
+	return 0;
+}
+
+/* cpu=N, mem=N, io=DIR or net=HOST[:PORT]; may be given several times */
+int stress_parse(struct stress_cfg *cfg, char *arg)
+{
+	char *val = strchr(arg, '=');
+
+	if (!val)
+		return -1;
+	*val++ = '\0';
+
+	if (!strcmp(arg, "cpu"))
+		cfg->cpu = atoi(val);
+	else if (!strcmp(arg, "mem"))
+		cfg->mem = atoi(val);
+	else if (!strcmp(arg, "io"))
+		cfg->io_dir = val;
+	else if (!strcmp(arg, "net"))
+		cfg->net = val;
+	else
+		return -1;
+
+	return 0;
+}
+
+int stress_start(const struct stress_cfg *cfg)
+{
+	int i, ret = 0;
+
+	stress_running = 1;
+
+	for (i = 0; i < cfg->cpu && !ret; i++)
+		ret = spawn(cpu_thread, NULL);
+	for (i = 0; i < cfg->mem && !ret; i++)
+		ret = spawn(mem_thread, NULL);
+	if (cfg->io_dir && !ret)
+		ret = spawn(io_thread, (void *)cfg->io_dir);
+	if (cfg->net && !ret)
+		ret = spawn(net_thread, (void *)cfg->net);
+
+	if (ret)
+		stress_stop();
+
+	return ret;
+}
+
+void stress_stop(void)
+{
+	stress_running = 0;
+	while (nthreads)
+		pthread_join(threads[--nthreads], NULL);
+}
+
+const char *stress_describe(const struct stress_cfg *cfg)
+{
+	static char desc[256];
+
+	snprintf(desc, sizeof(desc), "cpu=%d mem=%d io=%s net=%s",
+		 cfg->cpu, cfg->mem, cfg->io_dir ? cfg->io_dir : "-",
+		 cfg->net ? cfg->net : "-");
+
+	return desc;
+}
@@ -0,0 +1,22 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef RTBENCH_STRESS_H
+#define RTBENCH_STRESS_H
+
+/*
+ * Background load, run as SCHED_OTHER threads so the measured thread
+ * always outranks it. Zero/NULL disables a generator.
+ */
+struct stress_cfg {
+	int cpu;		/* spinning threads */
+	int mem;		/* threads copying STRESS_MEM_SIZE buffers */
+	const char *io_dir;	/* write + fsync a file in this directory */
+	const char *net;	/* send UDP datagrams to host[:port] */
+};
+
+int stress_parse(struct stress_cfg *cfg, char *arg);
+int stress_start(const struct stress_cfg *cfg);
+void stress_stop(void);
+/* one line describing the active generators, for the report */
+const char *stress_describe(const struct stress_cfg *cfg);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef __ARCH_DCACHE_H__
+#define __ARCH_DCACHE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DCACHE_LINE_SIZE	64
+
+/*
+ * Write the lines covering [addr, addr + size) back to the point of
+ * coherency, for memory a non-coherent master reads. Lines are cleaned in
+ * ascending order; callers that publish with a flag clean the data and
+ * the flag separately, in that order.
+ */
+static inline void dcache_clean_range(const volatile void *addr, size_t size)
+{
+	uintptr_t line = (uintptr_t)addr & ~(uintptr_t)(DCACHE_LINE_SIZE - 1);
+	uintptr_t end = (uintptr_t)addr + size;
+
+	for (; line < end; line += DCACHE_LINE_SIZE)
+		__asm__ __volatile__("dc cvac, %0" : : "r"(line) : "memory");
+	__asm__ __volatile__("dsb sy" : : : "memory");
+}
+
+#endif /* __ARCH_DCACHE_H__ */
@@ -0,0 +1,31 @@
+#ifndef __ARCH_DCACHE_H__
+#define __ARCH_DCACHE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DCACHE_LINE_SIZE	64
+
+/*
+ * Write the lines covering [addr, addr + size) back to DRAM, for memory a
+ * non-coherent master (linux on the other core) reads. C906 has no Zicbom,
+ * the T-Head cache ops are emitted as raw encodings:
+ *   dcache.cpa a0	0x0295000b	clean the line of physical address a0
+ *   sync.s		0x0190000b	wait until it is done
+ * Lines are cleaned in ascending order; callers that publish with a flag
+ * clean the data and the flag separately, in that order.
+ */
+static inline void dcache_clean_range(const volatile void *addr, size_t size)
+{
+	uintptr_t line = (uintptr_t)addr & ~(uintptr_t)(DCACHE_LINE_SIZE - 1);
+	uintptr_t end = (uintptr_t)addr + size;
+
+	for (; line < end; line += DCACHE_LINE_SIZE) {
+		register uintptr_t a0 __asm__("a0") = line;
+
+		__asm__ __volatile__(".long 0x0295000b" : : "r"(a0) : "memory");
+	}
+	__asm__ __volatile__(".long 0x0190000b" : : : "memory");
+}
+
+#endif /* __ARCH_DCACHE_H__ */
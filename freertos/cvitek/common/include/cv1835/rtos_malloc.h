@@ -31,8 +31,64 @@ struct shm_memcpy_t{
     void *mem_buf;
 };
 
-void memory_init(void *prt);
+/*
+ * Two level segregated fit heap shared with linux.
+ *
+ * Every block starts with a cache line sized rtos_block header, payloads
+ * are cache line aligned and sized. Free blocks sit on one of
+ * RTOS_MALLOC_FL_COUNT * RTOS_MALLOC_SL_COUNT size class lists found
+ * through two bitmaps, so alloc and free are O(1) and the cross-core
+ * lock is held for a bounded time. Like Header, every link is stored
+ * twice: once as an rtos address and once as a linux virtual address
+ * (the *_vpa fields), so both cores can walk the same lists.
+ *
+ * The control block lives at the start of the heap and is found through
+ * rtos_shm_t.mem_base.heap_ptr / heap_ptr_vpa.
+ */
+#define RTOS_MALLOC_MAGIC	0x544c5346	/* "TLSF" */
+#define RTOS_MALLOC_SL_LOG2	4
+#define RTOS_MALLOC_SL_COUNT	(1 << RTOS_MALLOC_SL_LOG2)
+#define RTOS_MALLOC_FL_COUNT	24
+
+typedef struct rtos_block rtos_block_t;
+
+struct rtos_block {
+	unsigned int size;	/* payload bytes */
+	unsigned int flags;
+	rtos_block_t *prev_phys;
+	rtos_block_t *prev_phys_vpa;
+	rtos_block_t *next_free;
+	rtos_block_t *next_free_vpa;
+	rtos_block_t *prev_free;
+	rtos_block_t *prev_free_vpa;
+} __attribute__ ((aligned (CACHE_LINE)));
+
+struct rtos_malloc_stats {
+	size_t heap_size;	/* bytes managed, headers included */
+	size_t used;		/* bytes in allocated blocks, headers included */
+	size_t high_water;	/* largest value used ever reached */
+	size_t free;		/* payload bytes in free blocks */
+	size_t largest_free;	/* largest single allocation possible */
+	unsigned int free_blocks;
+	unsigned int frag_permille;	/* 1000 * (1 - largest_free / free) */
+	unsigned int allocs;
+	unsigned int frees;
+	unsigned int failures;
+	unsigned int invalid_frees;
+};
+
+struct rtos_malloc_ctrl {
+	unsigned int magic;
+	unsigned int fl_bitmap;
+	unsigned int sl_bitmap[RTOS_MALLOC_FL_COUNT];
+	rtos_block_t *heads[RTOS_MALLOC_FL_COUNT][RTOS_MALLOC_SL_COUNT];
+	rtos_block_t *heads_vpa[RTOS_MALLOC_FL_COUNT][RTOS_MALLOC_SL_COUNT];
+	struct rtos_malloc_stats stats;
+} __attribute__ ((aligned (CACHE_LINE)));
+
+int memory_init(void *prt);
 void *memory_alloc(size_t bytes);
 void memory_free(void* ptr);
 void memory_set(char *ptr, char value, size_t size);
+void memory_get_stats(struct rtos_malloc_stats *stats);
 #endif // _MEM_HEADER_
@@ -4,6 +4,7 @@
 #include <stddef.h>
 
 #define QUEUE_NUM 0x40
+#define QUEUE_MASK (QUEUE_NUM - 1)
 
 typedef struct queue_t queue_t;
 typedef struct cmdqu_t cmdqu_t;
@@ -14,6 +15,17 @@ struct cmdqu_t {
 	void *param_ptr;
 }; // __attribute__((aligned(0x20)));
 
+/*
+ * Single producer / single consumer ring shared with linux. Each queue
+ * has exactly one writer core (linux_cmd_queue: linux, rtos_cmd_queue:
+ * rtos), so no cross-core lock is needed: the producer owns tail, the
+ * consumer owns head, and each publishes its index with a release store
+ * after touching the slots and reads the other's with an acquire load.
+ * head and tail are free running, the slot is index % QUEUE_NUM, so
+ * QUEUE_NUM must be a power of two.
+ *
+ * dropped and high_water are written by the producer only.
+ */
 struct queue_t {
 	unsigned int head;
 	unsigned int tail;
@@ -22,13 +34,21 @@ struct queue_t {
 		char *queue_buffer;
 		char *rtos_queue_buffer;
 	};
+	unsigned int dropped;
+	unsigned int high_water;
 };
 
 void queue_init(void *rtos_shm_para);
 void queue_new(queue_t *self);
 bool queue_is_empty(queue_t *self);
+bool queue_is_full(queue_t *self);
+unsigned int queue_count(queue_t *self);
+unsigned int queue_space(queue_t *self);
+bool queue_try_enqueue(queue_t *self, const cmdqu_t *data);
 bool queue_enqueue(queue_t *self, cmdqu_t *data);
+int queue_enqueue_batch(queue_t *self, const cmdqu_t *data, int count);
 cmdqu_t *queue_peek(queue_t *self);
-cmdqu_t *queue_dequeue(queue_t *self);
+bool queue_dequeue(queue_t *self, cmdqu_t *data);
+int queue_dequeue_batch(queue_t *self, cmdqu_t *data, int count);
 
 #endif // RTOS_QUEUE_H
@@ -2,158 +2,421 @@
 #include "rtos_malloc.h"
 #include "rtos_cmdqu.h"
 
-#define HEADER_SIZE sizeof(Header)
-#define NUNITS(bytes) bytes / HEADER_SIZE
+#define BLOCK_HDR		sizeof(rtos_block_t)
+#define BLOCK_ALIGN		CACHE_LINE
+#define BLOCK_MIN		BLOCK_ALIGN
+#define BLOCK_FREE		0x1
+#define BLOCK_TAG		0xb10c0000
+#define BLOCK_TAG_MASK		0xffff0000
+#define ALIGN_UP(x, a)		(((x) + (a) - 1) & ~((size_t)(a) - 1))
+#define ALIGN_DOWN(x, a)	((x) & ~((size_t)(a) - 1))
 
-static Header *increase_heap(unsigned int, Header *prev);
-static Header *free_list = NULL;
 static Header *base;
+static struct rtos_malloc_ctrl *ctrl;
 static size_t HeapBase = 0;
 static size_t HeapLimit = 0;
-static size_t offset = 0;
+static size_t vpa_offset = 0;
+static bool heap_broken;
 spinlock_t *rtos_memory_lock;
 
+/* address of @p as seen by linux */
+static inline void *to_vpa(void *p)
+{
+	return p ? (char *)p + vpa_offset : NULL;
+}
+
+static inline int fls_u32(unsigned int x)
+{
+	return x ? 32 - __builtin_clz(x) : 0;
+}
+
+static inline int ffs_u32(unsigned int x)
+{
+	return __builtin_ffs(x);
+}
+
+static inline rtos_block_t *block_next_phys(rtos_block_t *block)
+{
+	return (rtos_block_t *)((char *)(block + 1) + block->size);
+}
+
+static inline bool block_is_free(rtos_block_t *block)
+{
+	return block->flags & BLOCK_FREE;
+}
+
+/* size class of a block of @size bytes */
+static void mapping_insert(size_t size, int *fl, int *sl)
+{
+	size_t units = size / BLOCK_ALIGN;
+	int msb;
+
+	if (units < RTOS_MALLOC_SL_COUNT) {
+		*fl = 0;
+		*sl = units;
+		return;
+	}
+	msb = fls_u32(units) - 1;
+	*sl = (units >> (msb - RTOS_MALLOC_SL_LOG2)) ^ RTOS_MALLOC_SL_COUNT;
+	*fl = msb - RTOS_MALLOC_SL_LOG2 + 1;
+}
+
+/* smallest size class whose blocks are all at least @size bytes */
+static void mapping_search(size_t size, int *fl, int *sl)
+{
+	size_t units = size / BLOCK_ALIGN;
+
+	if (units >= RTOS_MALLOC_SL_COUNT)
+		size += ((size_t)1 << (fls_u32(units) - 1 - RTOS_MALLOC_SL_LOG2)) *
+			BLOCK_ALIGN - BLOCK_ALIGN;
+	mapping_insert(size, fl, sl);
+}
+
+static rtos_block_t *find_suitable(int *fl, int *sl)
+{
+	unsigned int sl_map, fl_map;
+
+	if (*fl >= RTOS_MALLOC_FL_COUNT)
+		return NULL;
+
+	sl_map = ctrl->sl_bitmap[*fl] & (~0U << *sl);
+	if (!sl_map) {
+		fl_map = *fl + 1 < 32 ? ctrl->fl_bitmap & (~0U << (*fl + 1)) : 0;
+		if (!fl_map)
+			return NULL;
+		*fl = ffs_u32(fl_map) - 1;
+		sl_map = ctrl->sl_bitmap[*fl];
+	}
+	*sl = ffs_u32(sl_map) - 1;
+
+	return ctrl->heads[*fl][*sl];
+}
+
+static void free_list_insert(rtos_block_t *block)
+{
+	rtos_block_t *head;
+	int fl, sl;
+
+	mapping_insert(block->size, &fl, &sl);
+	head = ctrl->heads[fl][sl];
+
+	block->flags = BLOCK_TAG | BLOCK_FREE;
+	block->next_free = head;
+	block->next_free_vpa = to_vpa(head);
+	block->prev_free = NULL;
+	block->prev_free_vpa = NULL;
+	if (head) {
+		head->prev_free = block;
+		head->prev_free_vpa = to_vpa(block);
+	}
+	ctrl->heads[fl][sl] = block;
+	ctrl->heads_vpa[fl][sl] = to_vpa(block);
+	ctrl->fl_bitmap |= 1U << fl;
+	ctrl->sl_bitmap[fl] |= 1U << sl;
+
+	ctrl->stats.free += block->size;
+	ctrl->stats.free_blocks++;
+}
+
+static void free_list_remove(rtos_block_t *block)
+{
+	rtos_block_t *prev = block->prev_free, *next = block->next_free;
+	int fl, sl;
+
+	mapping_insert(block->size, &fl, &sl);
+
+	if (next) {
+		next->prev_free = prev;
+		next->prev_free_vpa = to_vpa(prev);
+	}
+	if (prev) {
+		prev->next_free = next;
+		prev->next_free_vpa = to_vpa(next);
+	} else {
+		ctrl->heads[fl][sl] = next;
+		ctrl->heads_vpa[fl][sl] = to_vpa(next);
+		if (!next) {
+			ctrl->sl_bitmap[fl] &= ~(1U << sl);
+			if (!ctrl->sl_bitmap[fl])
+				ctrl->fl_bitmap &= ~(1U << fl);
+		}
+	}
+
+	block->flags = BLOCK_TAG;
+	ctrl->stats.free -= block->size;
+	ctrl->stats.free_blocks--;
+}
+
+static void block_set_prev_phys(rtos_block_t *block, rtos_block_t *prev)
+{
+	block->prev_phys = prev;
+	block->prev_phys_vpa = to_vpa(prev);
+}
+
+/*
+ * Lay the heap out as one free block followed by a zero sized, never
+ * free sentinel so the coalescing code needs no end of heap check.
+ * Whichever core allocates first does this, under rtos_memory_lock.
+ */
+static void heap_setup(void)
+{
+	size_t start = ALIGN_UP(HeapBase, BLOCK_ALIGN);
+	size_t end = ALIGN_DOWN(HeapLimit, BLOCK_ALIGN);
+	rtos_block_t *first, *sentinel;
+	int i, j;
+
+	ctrl = (struct rtos_malloc_ctrl *)start;
+	ctrl->fl_bitmap = 0;
+	for (i = 0; i < RTOS_MALLOC_FL_COUNT; i++) {
+		ctrl->sl_bitmap[i] = 0;
+		for (j = 0; j < RTOS_MALLOC_SL_COUNT; j++) {
+			ctrl->heads[i][j] = NULL;
+			ctrl->heads_vpa[i][j] = NULL;
+		}
+	}
+	memory_set((char *)&ctrl->stats, 0, sizeof(ctrl->stats));
+
+	first = (rtos_block_t *)(start + ALIGN_UP(sizeof(*ctrl), BLOCK_ALIGN));
+	sentinel = (rtos_block_t *)(end - BLOCK_HDR);
+	first->size = (char *)sentinel - (char *)(first + 1);
+	block_set_prev_phys(first, NULL);
+	sentinel->size = 0;
+	sentinel->flags = BLOCK_TAG;
+	block_set_prev_phys(sentinel, first);
+	free_list_insert(first);
+
+	ctrl->stats.heap_size = (char *)(sentinel + 1) - (char *)first;
+	ctrl->magic = RTOS_MALLOC_MAGIC;
+
+	base->heap_ptr = (char *)ctrl;
+	base->heap_ptr_vpa = to_vpa(ctrl);
+	base->next = (Header *)first;
+	base->next_vpa = to_vpa(first);
+	pr_debug("rtos heap ctrl=%lx first=%lx size=%lx\n", (size_t)ctrl,
+		 (size_t)first, (size_t)first->size);
+}
+
+/*
+ * A control block published through mem_base must lie inside the shared
+ * region, after rtos_shm_t, and carry the magic; anything else means the
+ * region or the other core's layout is not what we expect.
+ */
+static bool heap_ctrl_valid(struct rtos_malloc_ctrl *c)
+{
+	size_t p = (size_t)c;
+
+	if (p < HeapBase || p & (BLOCK_ALIGN - 1) ||
+	    p + ALIGN_UP(sizeof(*c), BLOCK_ALIGN) + 2 * BLOCK_HDR > HeapLimit) {
+		printk("rtos heap ctrl=%lx outside [%lx, %lx)\n", p, HeapBase, HeapLimit);
+		return false;
+	}
+	if (base->heap_ptr_vpa != to_vpa(c)) {
+		printk("rtos heap ctrl=%lx vpa=%lx, expected %lx\n", p,
+		       (size_t)base->heap_ptr_vpa, (size_t)to_vpa(c));
+		return false;
+	}
+	if (c->magic != RTOS_MALLOC_MAGIC) {
+		printk("rtos heap ctrl=%lx bad magic %x\n", p, c->magic);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Lay the heap out on first use if no core did yet. A heap that is there
+ * but does not check out is left alone, it may still be in use on the
+ * other side: every later call fails instead.
+ */
+static inline bool heap_check_setup(void)
+{
+	if (heap_broken)
+		return false;
+	if (ctrl && ctrl->magic != RTOS_MALLOC_MAGIC) {
+		printk("rtos heap ctrl=%lx lost its magic\n", (size_t)ctrl);
+		heap_broken = true;
+		return false;
+	}
+	if (ctrl)
+		return true;
+	if (!base->heap_ptr) {
+		heap_setup();
+		return true;
+	}
+	if (!heap_ctrl_valid((struct rtos_malloc_ctrl *)base->heap_ptr)) {
+		heap_broken = true;
+		return false;
+	}
+	ctrl = (struct rtos_malloc_ctrl *)base->heap_ptr;
+	return true;
+}
+
+/* give the tail of @block beyond @size bytes back to the free lists */
+static void block_trim(rtos_block_t *block, size_t size)
+{
+	rtos_block_t *rest, *next;
+
+	if (block->size < size + BLOCK_HDR + BLOCK_MIN)
+		return;
+
+	next = block_next_phys(block);
+	rest = (rtos_block_t *)((char *)(block + 1) + size);
+	rest->size = block->size - size - BLOCK_HDR;
+	block->size = size;
+	block_set_prev_phys(rest, block);
+	block_set_prev_phys(next, rest);
+	free_list_insert(rest);
+}
+
 void* memory_alloc(size_t bytes)
 {
 	unsigned long flags;
+	rtos_block_t *block;
+	size_t size;
+	int fl, sl;
+
+	size = bytes ? ALIGN_UP(bytes, BLOCK_ALIGN) : BLOCK_MIN;
+
 	spin_lock_irqsave(rtos_memory_lock, flags);
-	Header *block;
-	Header *previous = base;
-	unsigned int nunits = NUNITS(bytes);
-	if(!nunits)
-		nunits = 1;
-	if(!free_list){
-		// first block
-		Header *block = increase_heap(nunits, base);
-		block->next = NULL;
-		block->next_vpa = NULL;
-		base->size = 0;
-		base->next = block;
-		base->next_vpa = block + offset;
-		free_list = base;
+	if (!heap_check_setup()) {
 		spin_unlock_irqrestore(rtos_memory_lock, flags);
-		return block + 1;
-	}
-	//search a memory block with enough size
-	for(block = base->next; block != NULL ; previous = block, block = block->next ){
-		/* the lastest block, so increase heap size directly */
-		if(block->next == NULL) {
-			previous = block;
-			break;
-		}
-		if(nunits + 1 == block->next - block - (block->size + 1)) {
-			/* need block is the same as reserved block*/
-			block->next = block + 1 + block->size;
-			block->next_vpa = block + 1 + block->size + offset;
-			block->next->size = nunits;
-			spin_unlock_irqrestore(rtos_memory_lock, flags);
-			return block->next + 1;
-		} else if( nunits + 1 < block->next - block - (block->size + 1)) {
-			/* split large block into small block */
-			Header *need_block = block + 1 + block->size;
-			need_block->size = nunits;
-			need_block->next = block->next;
-			need_block->next_vpa = block->next_vpa;
-			block->next = need_block;
-			block->next_vpa = need_block + offset;
-			spin_unlock_irqrestore(rtos_memory_lock, flags);
-			return need_block + 1;
-		}
+		return NULL;
 	}
-	/* increase more memory directly */
-	block = increase_heap(nunits, previous);
+
+	mapping_search(size, &fl, &sl);
+	block = find_suitable(&fl, &sl);
+	if (!block) {
+		ctrl->stats.failures++;
+		spin_unlock_irqrestore(rtos_memory_lock, flags);
+		pr_debug("memory_alloc %lx failed\n", (size_t)bytes);
+		return NULL;
+	}
+
+	free_list_remove(block);
+	block_trim(block, size);
+
+	ctrl->stats.allocs++;
+	ctrl->stats.used += block->size + BLOCK_HDR;
+	if (ctrl->stats.used > ctrl->stats.high_water)
+		ctrl->stats.high_water = ctrl->stats.used;
 	spin_unlock_irqrestore(rtos_memory_lock, flags);
+
 	return block + 1;
 }
 
 void memory_free(void* ptr)
 {
 	unsigned long flags;
+	rtos_block_t *block = ((rtos_block_t *)ptr) - 1;
+	rtos_block_t *prev, *next;
+
+	if (!ptr)
+		return;
+
 	spin_lock_irqsave(rtos_memory_lock, flags);
-	Header *fblock = ((Header*)ptr) - 1;
-	Header *block;
-	Header *previous = base;
-	for(block = base->next; block != NULL; previous = block, block = block->next){
-		if(fblock == block) {
-			if(fblock->next) {
-				previous->next = fblock->next;
-				previous->next_vpa = fblock->next_vpa;
-			} else {
-				previous->next = NULL;
-				previous->next_vpa = NULL;
-				/* set heap back to fblock address */
-				base->heap_ptr -= (fblock->size + 1) * HEADER_SIZE;
-				base->heap_ptr_vpa -= (fblock->size + 1) * HEADER_SIZE;
-				/* set heap back to previois block + block size address */
-				base->heap_ptr -= (fblock - previous - previous->size - 1) * HEADER_SIZE;
-				base->heap_ptr_vpa -= (fblock - previous - previous->size - 1) * HEADER_SIZE;
-				pr_debug("fblock=%lx previous=%lx size=%x\n",fblock, previous, previous->size );
-				pr_debug("heap_ptr= %lx ptr_va=%lx\n", base->heap_ptr , base->heap_ptr_vpa);
-			}
-			spin_unlock_irqrestore(rtos_memory_lock, flags);
-			return;
-		}
+	if (!heap_check_setup()) {
+		spin_unlock_irqrestore(rtos_memory_lock, flags);
+		printk("free %lx on a broken heap\n", (size_t)ptr);
+		return;
+	}
+
+	if ((size_t)ptr & (BLOCK_ALIGN - 1) ||
+	    (size_t)block < (size_t)ctrl || (size_t)ptr >= HeapLimit ||
+	    (block->flags & BLOCK_TAG_MASK) != BLOCK_TAG ||
+	    block_is_free(block) || !block->size) {
+		ctrl->stats.invalid_frees++;
+		spin_unlock_irqrestore(rtos_memory_lock, flags);
+		printk("Double free or invalid pointer=%lx\n", (size_t)ptr);
+		return;
+	}
+
+	ctrl->stats.frees++;
+	ctrl->stats.used -= block->size + BLOCK_HDR;
+
+	/* coalesce with the physical neighbours, at most two merges */
+	prev = block->prev_phys;
+	if (prev && block_is_free(prev)) {
+		free_list_remove(prev);
+		prev->size += BLOCK_HDR + block->size;
+		/* untag the absorbed header so a second free is caught */
+		block->flags = 0;
+		block = prev;
+		block_set_prev_phys(block_next_phys(block), block);
+	}
+	next = block_next_phys(block);
+	if (block_is_free(next)) {
+		free_list_remove(next);
+		block->size += BLOCK_HDR + next->size;
+		next->flags = 0;
+		block_set_prev_phys(block_next_phys(block), block);
 	}
-	printk("Double free or invalid pointer=%lx\n", ptr);
+	free_list_insert(block);
+
 	spin_unlock_irqrestore(rtos_memory_lock, flags);
 }
-/* init heap with virtual address and size*/
-void memory_init(void *ptr)
+
+void memory_get_stats(struct rtos_malloc_stats *stats)
+{
+	unsigned long flags;
+	rtos_block_t *block;
+	int fl, sl;
+
+	spin_lock_irqsave(rtos_memory_lock, flags);
+	if (!heap_check_setup()) {
+		spin_unlock_irqrestore(rtos_memory_lock, flags);
+		memory_set((char *)stats, 0, sizeof(*stats));
+		return;
+	}
+
+	*stats = ctrl->stats;
+	stats->largest_free = 0;
+	if (ctrl->fl_bitmap) {
+		/* the largest block can only be in the highest non empty class */
+		fl = fls_u32(ctrl->fl_bitmap) - 1;
+		sl = fls_u32(ctrl->sl_bitmap[fl]) - 1;
+		for (block = ctrl->heads[fl][sl]; block; block = block->next_free)
+			if (block->size > stats->largest_free)
+				stats->largest_free = block->size;
+	}
+	spin_unlock_irqrestore(rtos_memory_lock, flags);
+
+	stats->frag_permille = stats->free ?
+		1000 - (unsigned int)(stats->largest_free * 1000 / stats->free) : 0;
+}
+
+/*
+ * init heap with virtual address and size. The region is the one rtos_shm_t
+ * heads, its size as linux reserved it; returns -1 and leaves the memory
+ * untouched when the region or a heap already laid out in it is not sane.
+ */
+int memory_init(void *ptr)
 {
 	rtos_shm_t *rtos_shm = (rtos_shm_t*) ptr;
-    HeapBase = rtos_shm->addr + sizeof(rtos_shm_t);
-	pr_debug("memory_init base=%lx\n", HeapBase);
-    HeapLimit = rtos_shm->addr + rtos_shm->size;
-	pr_debug("memory_init Limit=%lx\n", HeapLimit);
-	/* need to get offset block size from linux*/
-	offset = rtos_shm->virt_phys_offset / HEADER_SIZE;
-	/* linux will init heap_ptr & free_list after booting */
+
 	base = (Header*) &rtos_shm->mem_base;
-	/* free_list is init in linux */
-	free_list = base;
-	/* do not need to init heap_ptr again*/
-//	base->heap_ptr = 0;
-//	base->heap_ptr_vpa = 0;
 	rtos_memory_lock = &rtos_shm->rtos_memory_lock;
-}
+	ctrl = NULL;
+	heap_broken = true;
 
-__attribute__((weak)) char *memory_sbrk (int nbytes)
-{
-	char *sbrk_base;
-	/* linux will init heap_ptr after booting */
-	if (!base->heap_ptr) {
-		base->heap_ptr = HeapBase;
-		base->heap_ptr_vpa = HeapBase + offset * HEADER_SIZE;
-		pr_debug("HeapBase=%lx offset=%lx HEADER_SIZE=%x\n ", HeapBase, offset, HEADER_SIZE);
-	}
-	sbrk_base = (char *) base->heap_ptr;
-	pr_debug("base->heap_ptr=%lx\n", base->heap_ptr);
-	pr_debug("base->heap_ptr_vpa=%lx\n", base->heap_ptr_vpa);
-	if((base->heap_ptr != NULL) && (base->heap_ptr + nbytes <= HeapLimit + 1)) {
-		base->heap_ptr += nbytes;
-		base->heap_ptr_vpa += nbytes;
-		pr_debug("memory_sbrk =%lx\n", sbrk_base);
-		pr_debug("memory_sbrk ptr =%lx\n", base->heap_ptr);
-		pr_debug("memory_sbrk ptr_vpa =%lx\n", base->heap_ptr_vpa);
-		return sbrk_base;
-	} else {
-    	return ((char *) -1);
+	if (rtos_shm->addr != (size_t)ptr ||
+	    rtos_shm->size < sizeof(rtos_shm_t) + sizeof(*ctrl) + 2 * BLOCK_HDR + BLOCK_ALIGN ||
+	    rtos_shm->addr + rtos_shm->size < rtos_shm->addr) {
+		printk("rtos heap region %lx size %lx does not match shm %lx\n",
+		       rtos_shm->addr, rtos_shm->size, (size_t)ptr);
+		return -1;
 	}
-}
+	HeapBase = rtos_shm->addr + sizeof(rtos_shm_t);
+	pr_debug("memory_init base=%lx\n", HeapBase);
+	HeapLimit = rtos_shm->addr + rtos_shm->size;
+	pr_debug("memory_init Limit=%lx\n", HeapLimit);
+	/* need to get offset from linux*/
+	vpa_offset = rtos_shm->virt_phys_offset;
 
-Header* increase_heap(unsigned int units, Header *prev)
-{
-	Header *block;
-	if(units <= 1)
-		block = (Header*) memory_sbrk(HEADER_SIZE * 2);
-	else
-		block = (Header*) memory_sbrk( (1 + units) * HEADER_SIZE);
-	prev->next = block;
-	prev->next_vpa = block + offset;
-	block->size = units;
-	block->next = NULL;
-	block->next_vpa = NULL;
-	return block;
+	/* linux may already have laid out the heap */
+	if (base->heap_ptr && !heap_ctrl_valid((struct rtos_malloc_ctrl *)base->heap_ptr))
+		return -1;
+	ctrl = (struct rtos_malloc_ctrl *)base->heap_ptr;
+	heap_broken = false;
+	return 0;
 }
 
 #if 1
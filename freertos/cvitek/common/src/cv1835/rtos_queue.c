@@ -2,8 +2,16 @@
 #include "rtos_malloc.h"
 #include "rtos_cmdqu.h"
 #include <linux/spinlock.h>
+#include <string.h>
+
+#define load_acquire(p)		__atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define store_release(p, v)	__atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+static inline cmdqu_t *queue_slot(queue_t *self, unsigned int idx)
+{
+	return (cmdqu_t *)(self->queue_buffer + (idx & QUEUE_MASK) * sizeof(cmdqu_t));
+}
 
-spinlock_t *rtos_queue_lock;
 void queue_new(queue_t *self)
 {
 #if 0
@@ -17,64 +25,126 @@ void queue_new(queue_t *self)
 #endif
 }
 
+unsigned int queue_count(queue_t *self)
+{
+	return load_acquire(&self->tail) - load_acquire(&self->head);
+}
+
+unsigned int queue_space(queue_t *self)
+{
+	return QUEUE_NUM - queue_count(self);
+}
+
 bool queue_is_empty(queue_t *self)
 {
-	if (self->head == self->tail)
-		return 1; // empty
-	else
-		return 0;
+	return queue_count(self) == 0;
 }
 
 bool queue_is_full(queue_t *self)
 {
-	if (self->head == (self->tail + 1) % QUEUE_NUM)
-		return 1; // full
-	else
-		return 0;
+	return queue_count(self) >= QUEUE_NUM;
 }
 
-cmdqu_t *queue_peek(queue_t *self)
+/* producer side: account the new occupancy once the slots are published */
+static void queue_update_high_water(queue_t *self, unsigned int tail)
 {
-	if (queue_is_empty(self)) {
-		printf("queue_peek is empty\n");
-		return 0;
+	unsigned int used = tail - load_acquire(&self->head);
+
+	if (used > self->high_water)
+		self->high_water = used;
+}
+
+/*
+ * Enqueue up to @count commands and return how many went in. A short
+ * count is back-pressure: the consumer has not caught up and the
+ * caller decides whether to retry, wait or drop. Nothing is counted as
+ * dropped here.
+ */
+int queue_enqueue_batch(queue_t *self, const cmdqu_t *data, int count)
+{
+	unsigned int tail = self->tail;
+	unsigned int head = load_acquire(&self->head);
+	unsigned int space = QUEUE_NUM - (tail - head);
+	int i;
+
+	if (count > (int)space)
+		count = space;
+
+	for (i = 0; i < count; i++)
+		memcpy(queue_slot(self, tail + i), &data[i], sizeof(cmdqu_t));
+
+	if (count > 0) {
+		store_release(&self->tail, tail + count);
+		queue_update_high_water(self, tail + count);
 	}
-	return (cmdqu_t *)(self->queue_buffer + self->head * sizeof(cmdqu_t));
+
+	return count;
 }
+
+bool queue_try_enqueue(queue_t *self, const cmdqu_t *data)
+{
+	return queue_enqueue_batch(self, data, 1) == 1;
+}
+
+/* legacy enqueue: a full ring drops the command and counts it */
 bool queue_enqueue(queue_t *self, cmdqu_t *data)
 {
-	unsigned long flags;
-	spin_lock_irqsave(rtos_queue_lock, flags);
-	if (queue_is_full(self)) {
-		printf("queue is full\n");
-	} else {
-		memcpy(self->queue_buffer + self->tail * sizeof(cmdqu_t), data,
-		       sizeof(cmdqu_t));
-		self->tail = (self->tail + 1) % QUEUE_NUM;
-	}
-	spin_unlock_irqrestore(rtos_queue_lock, flags);
+	if (queue_try_enqueue(self, data))
+		return true;
+
+	self->dropped++;
+	return false;
 }
 
-cmdqu_t *queue_dequeue(queue_t *self)
+/*
+ * Consumer side. The returned slot stays valid until the next
+ * queue_dequeue on this queue, nothing else may be dequeued meanwhile.
+ */
+cmdqu_t *queue_peek(queue_t *self)
 {
-	unsigned long flags;
-	spin_lock_irqsave(rtos_queue_lock, flags);
-	if (queue_is_empty(self)) {
-		printf("queue is empty\n");
-		spin_unlock_irqrestore(rtos_queue_lock, flags);
-		return 0;
-	} else {
-		cmdqu_t *peekqu = queue_peek(self);
-		self->head = (self->head + 1) % QUEUE_NUM;
-		spin_unlock_irqrestore(rtos_queue_lock, flags);
-		return peekqu;
-	}
+	unsigned int head = self->head;
+
+	if (head == load_acquire(&self->tail))
+		return NULL;
+
+	return queue_slot(self, head);
+}
+
+/*
+ * Copy up to @count commands out of the ring and release their slots to
+ * the producer with one index update. Returns the number copied.
+ */
+int queue_dequeue_batch(queue_t *self, cmdqu_t *data, int count)
+{
+	unsigned int head = self->head;
+	unsigned int avail = load_acquire(&self->tail) - head;
+	int i;
+
+	if (count > (int)avail)
+		count = avail;
+
+	for (i = 0; i < count; i++)
+		memcpy(&data[i], queue_slot(self, head + i), sizeof(cmdqu_t));
+
+	if (count > 0)
+		store_release(&self->head, head + count);
+
+	return count;
 }
+
+bool queue_dequeue(queue_t *self, cmdqu_t *data)
+{
+	return queue_dequeue_batch(self, data, 1) == 1;
+}
+
 void queue_init(void *rtos_shm_para)
 {
-	rtos_queue_lock = &((rtos_shm_t *)rtos_shm_para)->rtos_queue_lock;
-	/* already init in linux*/
+	/*
+	 * already init in linux; rtos_shm_t.rtos_queue_lock is kept for the
+	 * shared layout but no longer taken, each ring has a single producer
+	 * and a single consumer.
+	 */
+	(void)rtos_shm_para;
 	//queue_new(&((rtos_shm_t *)rtos_shm_para)->linux_cmd_queue);
 	//queue_new(&((rtos_shm_t *)rtos_shm_para)->rtos_cmd_queue);
 }
-
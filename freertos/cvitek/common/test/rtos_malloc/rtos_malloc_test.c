@@ -0,0 +1,308 @@
+/*
+ * Copyright (C) Cvitek Co., Ltd. 2019-2020. All rights reserved.
+ *
+ * File Name: rtos_malloc_test.c
+ * Description: host side replay test for the shared heap in rtos_malloc.c.
+ *   Replays an alloc/free trace, or a seeded random one, against a heap
+ *   laid out in a plain buffer, checks the block and free list invariants
+ *   after every operation and prints the worst case operation time and
+ *   the heap statistics.
+ *
+ *   Trace format, one operation per line:
+ *     a <slot> <len>	allocate <len> bytes into <slot>
+ *     f <slot>		free the buffer held in <slot>
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rtos_malloc.h"
+#include "rtos_cmdqu.h"
+
+#define MAX_SLOTS	1024
+#define VPA_OFFSET	0x40000000UL
+
+struct slot {
+	unsigned char *ptr;
+	size_t len;
+	unsigned char fill;
+};
+
+static struct slot slots[MAX_SLOTS];
+static rtos_shm_t *shm;
+static uint64_t worst_alloc_ns, worst_free_ns;
+static unsigned long ops, failures;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *vpa(void *p)
+{
+	return p ? (char *)p + VPA_OFFSET : NULL;
+}
+
+#define CHECK(cond) do {						\
+	if (!(cond)) {							\
+		fprintf(stderr, "op %lu: check failed: %s\n", ops, #cond);	\
+		exit(1);						\
+	}								\
+} while (0)
+
+/* walk every block and free list and compare with the control block */
+static void check_heap(void)
+{
+	struct rtos_malloc_ctrl *ctrl = (struct rtos_malloc_ctrl *)shm->mem_base.heap_ptr;
+	rtos_block_t *block, *prev = NULL;
+	size_t free_bytes = 0;
+	unsigned int free_blocks = 0, listed = 0;
+	int fl, sl;
+
+	if (!ctrl)
+		return;
+	CHECK(ctrl->magic == RTOS_MALLOC_MAGIC);
+	CHECK(shm->mem_base.heap_ptr_vpa == vpa(ctrl));
+
+	for (block = (rtos_block_t *)shm->mem_base.next; block->size;
+	     block = (rtos_block_t *)((char *)(block + 1) + block->size)) {
+		CHECK(block->prev_phys == prev);
+		CHECK(block->prev_phys_vpa == vpa(prev));
+		CHECK(block->size % CACHE_LINE == 0);
+		if (block->flags & 1) {
+			CHECK(!prev || !(prev->flags & 1));
+			free_bytes += block->size;
+			free_blocks++;
+		}
+		prev = block;
+	}
+
+	for (fl = 0; fl < RTOS_MALLOC_FL_COUNT; fl++) {
+		CHECK(!!(ctrl->fl_bitmap & (1U << fl)) == !!ctrl->sl_bitmap[fl]);
+		for (sl = 0; sl < RTOS_MALLOC_SL_COUNT; sl++) {
+			rtos_block_t *head = ctrl->heads[fl][sl];
+
+			CHECK(!!(ctrl->sl_bitmap[fl] & (1U << sl)) == !!head);
+			CHECK(ctrl->heads_vpa[fl][sl] == vpa(head));
+			for (block = head; block; block = block->next_free) {
+				CHECK(block->flags & 1);
+				CHECK(block->next_free_vpa == vpa(block->next_free));
+				listed++;
+			}
+		}
+	}
+
+	CHECK(listed == free_blocks);
+	CHECK(ctrl->stats.free_blocks == free_blocks);
+	CHECK(ctrl->stats.free == free_bytes);
+}
+
+static void do_alloc(int idx, size_t len)
+{
+	uint64_t t0, dt;
+	unsigned char *p;
+
+	if (idx < 0 || idx >= MAX_SLOTS || slots[idx].ptr)
+		return;
+
+	t0 = now_ns();
+	p = memory_alloc(len);
+	dt = now_ns() - t0;
+	if (dt > worst_alloc_ns)
+		worst_alloc_ns = dt;
+
+	ops++;
+	if (!p) {
+		failures++;
+		return;
+	}
+	CHECK(((uintptr_t)p & (CACHE_LINE - 1)) == 0);
+
+	slots[idx].ptr = p;
+	slots[idx].len = len;
+	slots[idx].fill = (unsigned char)(idx * 7 + 1);
+	memset(p, slots[idx].fill, len);
+}
+
+static void do_free(int idx)
+{
+	uint64_t t0, dt;
+	size_t i;
+
+	if (idx < 0 || idx >= MAX_SLOTS || !slots[idx].ptr)
+		return;
+
+	/* an overlapping allocation would have overwritten the pattern */
+	for (i = 0; i < slots[idx].len; i++)
+		CHECK(slots[idx].ptr[i] == slots[idx].fill);
+
+	t0 = now_ns();
+	memory_free(slots[idx].ptr);
+	dt = now_ns() - t0;
+	if (dt > worst_free_ns)
+		worst_free_ns = dt;
+
+	ops++;
+	slots[idx].ptr = NULL;
+}
+
+static int replay_file(const char *path)
+{
+	char line[128];
+	size_t len;
+	FILE *fp;
+	int idx;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		perror(path);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "a %d %zu", &idx, &len) == 2)
+			do_alloc(idx, len);
+		else if (sscanf(line, "f %d", &idx) == 1)
+			do_free(idx);
+		check_heap();
+	}
+	fclose(fp);
+	return 0;
+}
+
+/* mostly command sized buffers with the odd frame sized one */
+static size_t random_len(void)
+{
+	if (rand() % 8)
+		return 1 + rand() % 512;
+
+	return 1 + rand() % (64 * 1024);
+}
+
+static void replay_random(unsigned long n)
+{
+	unsigned long i;
+	int idx;
+
+	for (i = 0; i < n; i++) {
+		idx = rand() % MAX_SLOTS;
+		if (slots[idx].ptr)
+			do_free(idx);
+		else
+			do_alloc(idx, random_len());
+		check_heap();
+	}
+}
+
+/* a heap that does not check out is reported and left as it is */
+static void check_broken_heap(void *mem, size_t heap_size)
+{
+	struct rtos_malloc_ctrl *ctrl = (struct rtos_malloc_ctrl *)shm->mem_base.heap_ptr;
+	unsigned char *copy = malloc(heap_size);
+
+	CHECK(copy);
+	ctrl->magic = 0;
+	memcpy(copy, mem, heap_size);
+	CHECK(memory_init(shm) < 0);
+	CHECK(!memory_alloc(64));
+	CHECK(!memcmp(copy, mem, heap_size));
+
+	ctrl->magic = RTOS_MALLOC_MAGIC;
+	shm->mem_base.heap_ptr = (char *)mem + heap_size;
+	memcpy(copy, mem, heap_size);
+	CHECK(memory_init(shm) < 0);
+	CHECK(!memory_alloc(64));
+	CHECK(!memcmp(copy, mem, heap_size));
+
+	shm->mem_base.heap_ptr = (char *)ctrl;
+	CHECK(memory_init(shm) == 0);
+	free(copy);
+}
+
+static void usage(const char *prog)
+{
+	printf("usage: %s [-t trace] [-n ops] [-s seed] [-m heap_size]\n", prog);
+	printf("  -t trace      replay the given trace file\n");
+	printf("  -n ops        number of random operations (default 100000)\n");
+	printf("  -s seed       random seed (default 1)\n");
+	printf("  -m heap_size  shared heap size in bytes (default 4M)\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct rtos_malloc_stats st;
+	const char *trace = NULL;
+	unsigned long n = 100000;
+	unsigned int seed = 1;
+	size_t heap_size = 4 << 20;
+	void *mem;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "t:n:s:m:h")) != -1) {
+		switch (opt) {
+		case 't':
+			trace = optarg;
+			break;
+		case 'n':
+			n = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			heap_size = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (posix_memalign(&mem, CACHE_LINE, heap_size))
+		return 1;
+	memset(mem, 0, sizeof(rtos_shm_t));
+	shm = mem;
+	shm->addr = (size_t)mem;
+	shm->size = heap_size;
+	shm->virt_phys_offset = VPA_OFFSET;
+	memory_init(shm);
+
+	if (trace) {
+		if (replay_file(trace))
+			return 1;
+	} else {
+		srand(seed);
+		replay_random(n);
+	}
+
+	memory_get_stats(&st);
+	printf("%lu ops, %lu failed allocations\n", ops, failures);
+	printf("worst alloc %llu ns, worst free %llu ns\n",
+	       (unsigned long long)worst_alloc_ns,
+	       (unsigned long long)worst_free_ns);
+	printf("heap %zu used %zu high water %zu free %zu largest %zu\n",
+	       st.heap_size, st.used, st.high_water, st.free, st.largest_free);
+	printf("free blocks %u fragmentation %u.%u%%\n",
+	       st.free_blocks, st.frag_permille / 10, st.frag_permille % 10);
+
+	for (i = 0; i < MAX_SLOTS; i++)
+		do_free(i);
+	check_heap();
+
+	/* everything returned: one free block spanning the heap again */
+	memory_get_stats(&st);
+	CHECK(st.free_blocks == 1 && st.used == 0);
+	CHECK(st.free + sizeof(rtos_block_t) * 2 == st.heap_size);
+
+	check_broken_heap(mem, heap_size);
+
+	free(mem);
+	printf("PASS\n");
+	return 0;
+}
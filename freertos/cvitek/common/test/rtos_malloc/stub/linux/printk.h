@@ -0,0 +1,9 @@
+/* host build: route kernel style logging to stdio */
+#ifndef __LINUX_PRINTK_H
+#define __LINUX_PRINTK_H
+#include <stdio.h>
+
+#define printk printf
+#define pr_debug(fmt, ...)
+
+#endif
@@ -0,0 +1,12 @@
+/* host build: single threaded, no cross-core lock */
+#ifndef __LINUX_SPINLOCK_H
+#define __LINUX_SPINLOCK_H
+
+typedef struct {
+	volatile unsigned int lock;
+} spinlock_t;
+
+#define spin_lock_irqsave(lock, flags)		do { (void)(lock); (flags) = 0; } while (0)
+#define spin_unlock_irqrestore(lock, flags)	do { (void)(lock); (void)(flags); } while (0)
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef __BOOT_LOG_H__
+#define __BOOT_LOG_H__
+
+#include <stdint.h>
+
+/*
+ * Boot stage log shared with linux, see its cvi_boot_log.h.
+ *
+ * Every stage appends named marks, stamped with the time CSR, to its own
+ * struct boot_log_stage in a reserved DRAM page. Linux shows all of them
+ * on one time line. The RTOS only ever writes the RTOS entry and cleans
+ * it out of the D-cache, so no lock is shared with the big core.
+ *
+ * The layout must match linux drivers/soc/cvitek/boot_log/cvi_boot_log.h.
+ */
+#ifndef BOOT_LOG_ADDR
+#define BOOT_LOG_ADDR		0x801ff000
+#endif
+
+#define BOOT_LOG_MAGIC		0x424f4f54	/* "BOOT" */
+#define BOOT_LOG_MARKS		7
+#define BOOT_LOG_NAME_LEN	24
+
+enum boot_log_stage_id {
+	BOOT_STAGE_FSBL,
+	BOOT_STAGE_OPENSBI,
+	BOOT_STAGE_UBOOT,
+	BOOT_STAGE_LINUX,
+	BOOT_STAGE_RTOS,
+	BOOT_STAGE_NUM,
+};
+
+struct boot_log_mark {
+	uint64_t ticks;
+	char name[BOOT_LOG_NAME_LEN];
+};
+
+struct boot_log_stage {
+	uint32_t magic;
+	uint32_t count;
+	uint32_t tick_hz;
+	uint32_t reserved[5];
+	struct boot_log_mark mark[BOOT_LOG_MARKS];
+} __attribute__((aligned(64)));
+
+struct boot_log {
+	struct boot_log_stage stage[BOOT_STAGE_NUM];
+};
+
+/* the first mark starts the RTOS entry over; returns -1 once it is full */
+int boot_log_mark(const char *name);
+
+#endif // end of __BOOT_LOG_H__
@@ -0,0 +1,51 @@
+#include <stddef.h>
+#include <string.h>
+#include "dcache.h"
+#include "timebase.h"
+#include "boot_log.h"
+
+static struct boot_log_stage *rtos_stage(void)
+{
+	return &((struct boot_log *)(uintptr_t)BOOT_LOG_ADDR)->stage[BOOT_STAGE_RTOS];
+}
+
+/*
+ * The entry may hold marks of the previous boot after a warm reset; it is
+ * started over on the first mark of this one, .bss is cleared on every boot.
+ */
+static int boot_log_ready;
+
+static void boot_log_init(void)
+{
+	struct boot_log_stage *st = rtos_stage();
+
+	memset(st, 0, sizeof(*st));
+	st->tick_hz = TIMEBASE_DEFAULT_HZ;
+	st->magic = BOOT_LOG_MAGIC;
+	dcache_clean_range(st, sizeof(*st));
+}
+
+int boot_log_mark(const char *name)
+{
+	struct boot_log_stage *st = rtos_stage();
+	struct boot_log_mark *mark;
+
+	if (!boot_log_ready) {
+		boot_log_init();
+		boot_log_ready = 1;
+	}
+	if (st->count >= BOOT_LOG_MARKS)
+		return -1;
+
+	mark = &st->mark[st->count];
+	mark->ticks = timebase_ticks();
+	strncpy(mark->name, name, BOOT_LOG_NAME_LEN - 1);
+	mark->name[BOOT_LOG_NAME_LEN - 1] = '\0';
+
+	/* mark first, then the count that publishes it */
+	dcache_clean_range(mark, sizeof(*mark));
+	st->count++;
+	dcache_clean_range(&st->count, sizeof(st->count));
+
+	return 0;
+}
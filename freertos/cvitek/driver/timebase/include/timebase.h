@@ -0,0 +1,54 @@
+#ifndef __TIMEBASE_H__
+#define __TIMEBASE_H__
+
+#include <stdint.h>
+
+/*
+ * Shared linux/RTOS timebase.
+ *
+ * Both cores read the RISC-V time CSR, which counts the same always-on
+ * timer, so RTOS timestamps taken with timebase_now_us() are directly
+ * comparable with linux get_cycles(). Linux publishes the mapping from
+ * counter ticks to its CLOCK_MONOTONIC in a page it sends over the
+ * command queue (RTOS_TIMEBASE_CMD_ID):
+ *
+ *   mono_ns = ((ticks * mult) >> shift) + offset_ns
+ *
+ * The layout must match linux drivers/soc/cvitek/rtos_cmdqu/rtos_timebase.h.
+ */
+#define RTOS_TIMEBASE_MAGIC	0x54494d45	/* "TIME" */
+#define RTOS_TIMEBASE_IP_ID	6		/* IP_SYSTEM */
+#define RTOS_TIMEBASE_CMD_ID	0x20
+
+/* time CSR rate until linux publishes the real one */
+#define TIMEBASE_DEFAULT_HZ	25000000
+
+struct rtos_timebase_shm {
+	uint32_t magic;
+	uint32_t seq;
+	uint64_t tick_hz;
+	uint32_t mult;
+	uint32_t shift;
+	int64_t offset_ns;
+	uint64_t update_ticks;
+	uint64_t update_mono_ns;
+} __attribute__((aligned(64)));
+
+static inline uint64_t timebase_ticks(void)
+{
+	uint64_t ticks;
+
+	__asm__ __volatile__("rdtime %0" : "=r"(ticks));
+	return ticks;
+}
+
+uint64_t timebase_ticks_to_us(uint64_t ticks);
+uint64_t timebase_now_us(void);
+uint32_t timebase_now_ms(void);
+
+/* called with param_ptr of RTOS_TIMEBASE_CMD_ID, 0 detaches */
+void timebase_attach(uintptr_t shm_addr);
+int timebase_ticks_to_linux_ns(uint64_t ticks, uint64_t *mono_ns);
+int timebase_now_linux_ns(uint64_t *mono_ns);
+
+#endif // end of __TIMEBASE_H__
@@ -0,0 +1,86 @@
+#include <stddef.h>
+#include "timebase.h"
+
+static volatile struct rtos_timebase_shm *tb_shm;
+static uint64_t tick_hz = TIMEBASE_DEFAULT_HZ;
+
+/*
+ * Linux writes the page through an uncached mapping; drop our cached
+ * copy of the line before each read (T-Head dcache.ipa a0).
+ */
+static inline void timebase_inval(volatile void *addr)
+{
+#ifdef __riscv
+	register uintptr_t a0 __asm__("a0") = (uintptr_t)addr;
+
+	__asm__ __volatile__(".long 0x02a5000b\n\t"	/* dcache.ipa a0 */
+			     ".long 0x0190000b"		/* sync.s */
+			     : : "r"(a0) : "memory");
+#else
+	(void)addr;
+#endif
+}
+
+uint64_t timebase_ticks_to_us(uint64_t ticks)
+{
+	uint64_t per_us = tick_hz / 1000000;
+
+	/* whole ticks per microsecond on every clock this runs on (25MHz) */
+	return per_us ? ticks / per_us : ticks * 1000000 / tick_hz;
+}
+
+uint64_t timebase_now_us(void)
+{
+	return timebase_ticks_to_us(timebase_ticks());
+}
+
+/* same time domain as timebase_now_us, e.g. for ServoInfoBuffer.last_read_ms */
+uint32_t timebase_now_ms(void)
+{
+	return (uint32_t)(timebase_ticks() / (tick_hz / 1000));
+}
+
+void timebase_attach(uintptr_t shm_addr)
+{
+	volatile struct rtos_timebase_shm *shm =
+		(volatile struct rtos_timebase_shm *)shm_addr;
+
+	if (shm) {
+		timebase_inval(shm);
+		if (shm->magic != RTOS_TIMEBASE_MAGIC || !shm->tick_hz)
+			return;
+		tick_hz = shm->tick_hz;
+	}
+	tb_shm = shm;
+}
+
+int timebase_ticks_to_linux_ns(uint64_t ticks, uint64_t *mono_ns)
+{
+	volatile struct rtos_timebase_shm *shm = tb_shm;
+	uint32_t seq, mult, shift;
+	int64_t offset;
+
+	if (!shm)
+		return -1;
+
+	do {
+		timebase_inval(shm);
+		seq = shm->seq;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		mult = shm->mult;
+		shift = shm->shift;
+		offset = shm->offset_ns;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		timebase_inval(shm);
+	} while ((seq & 1) || seq != shm->seq);
+
+	/* ticks * mult overflows 64 bits after ~10 minutes, split it */
+	*mono_ns = ((ticks >> shift) * mult) +
+		   (((ticks & ((1ULL << shift) - 1)) * mult) >> shift) + offset;
+	return 0;
+}
+
+int timebase_now_linux_ns(uint64_t *mono_ns)
+{
+	return timebase_ticks_to_linux_ns(timebase_ticks(), mono_ns);
+}
@@ -0,0 +1,56 @@
+#ifndef __RTOS_TRACE_H__
+#define __RTOS_TRACE_H__
+
+#include <stdint.h>
+
+/*
+ * RTOS event ring for the linux trace collector (package/cvitrace).
+ *
+ * The RTOS is the only writer. Events are stamped with the time CSR, the
+ * same counter linux maps to CLOCK_MONOTONIC through the shared timebase,
+ * so they line up with ftrace on one time line. head counts every event
+ * ever written; the reader keeps its own tail and treats anything older
+ * than head - RTOS_TRACE_EVENTS as lost. The region must be reserved
+ * no-map in the device tree, next to the boot log page.
+ *
+ * The layout must match buildroot package/cvitrace/src/rtos_trace.h.
+ */
+#ifndef RTOS_TRACE_ADDR
+#define RTOS_TRACE_ADDR		0x801f6000
+#endif
+
+#define RTOS_TRACE_MAGIC	0x54524143	/* "TRAC" */
+#define RTOS_TRACE_EVENTS	1024		/* power of two */
+#define RTOS_TRACE_NAME_LEN	16
+
+enum rtos_trace_type {
+	RTOS_TRACE_BEGIN = 'B',
+	RTOS_TRACE_END = 'E',
+	RTOS_TRACE_COUNTER = 'C',
+	RTOS_TRACE_INSTANT = 'I',
+};
+
+struct rtos_trace_event {
+	uint64_t ticks;
+	uint8_t type;
+	uint8_t reserved[3];
+	int32_t value;
+	char name[RTOS_TRACE_NAME_LEN];
+};
+
+struct rtos_trace_ring {
+	uint32_t magic;
+	uint32_t nevents;
+	uint64_t tick_hz;
+	uint64_t head;
+	uint32_t reserved[10];
+	struct rtos_trace_event event[RTOS_TRACE_EVENTS];
+} __attribute__((aligned(64)));
+
+/* all of these are safe from tasks and interrupt handlers */
+void rtos_trace_begin(const char *name);
+void rtos_trace_end(const char *name);
+void rtos_trace_counter(const char *name, int32_t value);
+void rtos_trace_instant(const char *name);
+
+#endif // end of __RTOS_TRACE_H__
@@ -0,0 +1,80 @@
+#include <stddef.h>
+#include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "dcache.h"
+#include "timebase.h"
+#include "rtos_trace.h"
+
+static struct rtos_trace_ring *trace_ring(void)
+{
+	return (struct rtos_trace_ring *)(uintptr_t)RTOS_TRACE_ADDR;
+}
+
+/*
+ * The ring may hold events of the previous boot after a warm reset; it is
+ * started over on the first event of this one, .bss is cleared on every boot.
+ */
+static int rtos_trace_ready;
+
+static void rtos_trace_init(void)
+{
+	struct rtos_trace_ring *ring = trace_ring();
+
+	ring->magic = 0;
+	dcache_clean_range(&ring->magic, sizeof(ring->magic));
+
+	ring->nevents = RTOS_TRACE_EVENTS;
+	ring->tick_hz = TIMEBASE_DEFAULT_HZ;
+	ring->head = 0;
+	ring->magic = RTOS_TRACE_MAGIC;
+	dcache_clean_range(ring, offsetof(struct rtos_trace_ring, event));
+}
+
+static void rtos_trace_add(uint8_t type, const char *name, int32_t value)
+{
+	struct rtos_trace_ring *ring = trace_ring();
+	struct rtos_trace_event *ev;
+	UBaseType_t flags;
+
+	flags = taskENTER_CRITICAL_FROM_ISR();
+
+	if (!rtos_trace_ready) {
+		rtos_trace_init();
+		rtos_trace_ready = 1;
+	}
+
+	ev = &ring->event[ring->head & (RTOS_TRACE_EVENTS - 1)];
+	ev->ticks = timebase_ticks();
+	ev->type = type;
+	ev->value = value;
+	strncpy(ev->name, name, RTOS_TRACE_NAME_LEN - 1);
+	ev->name[RTOS_TRACE_NAME_LEN - 1] = '\0';
+
+	/* event first, then the head that publishes it */
+	dcache_clean_range(ev, sizeof(*ev));
+	ring->head++;
+	dcache_clean_range(&ring->head, sizeof(ring->head));
+
+	taskEXIT_CRITICAL_FROM_ISR(flags);
+}
+
+void rtos_trace_begin(const char *name)
+{
+	rtos_trace_add(RTOS_TRACE_BEGIN, name, 0);
+}
+
+void rtos_trace_end(const char *name)
+{
+	rtos_trace_add(RTOS_TRACE_END, name, 0);
+}
+
+void rtos_trace_counter(const char *name, int32_t value)
+{
+	rtos_trace_add(RTOS_TRACE_COUNTER, name, value);
+}
+
+void rtos_trace_instant(const char *name)
+{
+	rtos_trace_add(RTOS_TRACE_INSTANT, name, 0);
+}
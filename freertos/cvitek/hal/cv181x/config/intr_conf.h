@@ -0,0 +1,14 @@
+#ifndef _CV181X_INTERRUPT_CONFIG_H_
+#define _CV181X_INTERRUPT_CONFIG_H_
+
+/*
+ * PLIC lines as seen by the small core, same numbering as the linux
+ * device tree. Only the lines the cv181x HAL drivers use are listed.
+ */
+
+#define SPI_0_SSI_INTR 54
+#define SPI_1_SSI_INTR 55
+#define SPI_2_SSI_INTR 56
+#define SPI_3_SSI_INTR 57
+
+#endif //endof_CV181X_INTERRUPT_CONFIG_H_
@@ -1,7 +1,19 @@
 #include "drv_spi.h"
 #include <stdio.h>
 #include <stddef.h>
-static struct cv1800_spi dw_spi[4];
+#include "FreeRTOS.h"
+#include "task.h"
+#include "irq.h"
+#include "intr_conf.h"
+
+/* SSI interrupt lines of the small core come from the platform intr_conf.h */
+#ifndef SPI_0_SSI_INTR
+#error "intr_conf.h does not define SPI_n_SSI_INTR"
+#endif
+
+static struct cv1800_spi dw_spi[4] = {
+    { .irq = -1 }, { .irq = -1 }, { .irq = -1 }, { .irq = -1 },
+};
 static struct spi_regs *get_spi_base(uint8_t spi_id)
 {
     struct spi_regs *spi_base = NULL;
@@ -23,105 +35,464 @@ static struct spi_regs *get_spi_base(uint8_t spi_id)
     return spi_base;
 }
 
+static int get_spi_irq(uint8_t spi_id)
+{
+    static const int irqs[] = {
+        SPI_0_SSI_INTR, SPI_1_SSI_INTR, SPI_2_SSI_INTR, SPI_3_SSI_INTR,
+    };
+
+    return spi_id < 4 ? irqs[spi_id] : -1;
+}
+
+static inline uint32_t spi_frame_bytes(struct cv1800_spi *dev)
+{
+    return dev->data_width >> 3;
+}
+
+static void spi_load_tx(struct cv1800_spi *dev, struct spi_message *seg)
+{
+    dev->tx_seg = seg;
+    dev->send_buf = seg->send_buf;
+    dev->send_end = seg->send_buf ? (const uint8_t *)seg->send_buf + seg->length : NULL;
+    dev->tx_left = seg->length / spi_frame_bytes(dev);
+}
+
+static void spi_load_rx(struct cv1800_spi *dev, struct spi_message *seg)
+{
+    dev->rx_seg = seg;
+    dev->recv_buf = seg->recv_buf;
+    dev->recv_end = seg->recv_buf ? (uint8_t *)seg->recv_buf + seg->length : NULL;
+    dev->rx_left = seg->length / spi_frame_bytes(dev);
+    dev->stats.segments++;
+}
+
+/*
+ * Fill the tx fifo from the current chain. Writing stops while fifo_len
+ * frames are in flight so the rx fifo, which is no deeper, can not
+ * overrun. Segments without send_buf clock out zeroes. Returns the
+ * number of frames still to write for the whole chain (0 or not).
+ */
 int hw_spi_send(struct cv1800_spi *dev) {
     uint32_t txflr = mmio_read_32((uintptr_t)&dev->reg->spi_txflr);
-    uint32_t max = dev->fifo_len - txflr;
+    uint32_t max = dev->fifo_len > txflr ? dev->fifo_len - txflr : 0;
+    uint32_t step = spi_frame_bytes(dev);
     uint16_t value;
 
+    if (max > dev->fifo_len - dev->inflight)
+        max = dev->fifo_len - dev->inflight;
+
     while (max)
     {
-        if (dev->send_end - dev->send_buf)
+        if (!dev->tx_left)
         {
-            if (dev->data_width == 8)
-                value = *(uint8_t *)(dev->send_buf);
-            else
-                value = *(uint16_t *)(dev->send_buf);
+            if (!dev->tx_seg || !dev->tx_seg->next)
+                return 0;
+            /* next segment goes out without a gap, CS stays asserted */
+            spi_load_tx(dev, dev->tx_seg->next);
+            continue;
         }
-        else
+
+        value = 0;
+        if (dev->send_buf)
         {
-            return 0;
+            if (dev->data_width == 8)
+                value = *(const uint8_t *)(dev->send_buf);
+            else
+                value = *(const uint16_t *)(dev->send_buf);
+            dev->send_buf = (const uint8_t *)dev->send_buf + step;
         }
 
         mmio_write_32((uintptr_t)&dev->reg->spi_dr, value);
-        dev->send_buf += dev->data_width >> 3;
+        dev->tx_left--;
+        dev->inflight++;
         max--;
     }
 
-    return 0;
+    return 1;
 }
 
+/*
+ * Drain the rx fifo into the current chain; segments without recv_buf
+ * discard what they read. Returns the number of frames read.
+ */
 int hw_spi_recv(struct cv1800_spi *dev) {
     uint32_t rxflr = mmio_read_32((uintptr_t)&dev->reg->spi_rxflr);
+    uint32_t step = spi_frame_bytes(dev);
     uint32_t tem;
-    int ret = rxflr;
+    int ret = 0;
 
     while (rxflr)
     {
+        if (!dev->rx_left)
+        {
+            if (!dev->rx_seg || !dev->rx_seg->next)
+                break;
+            spi_load_rx(dev, dev->rx_seg->next);
+            continue;
+        }
+
         tem = mmio_read_32((uintptr_t)&dev->reg->spi_dr);
 
-        if (dev->recv_buf < dev->recv_end)
+        if (dev->recv_buf)
         {
             if (dev->data_width == 8)
                 *(uint8_t *)(dev->recv_buf) = tem;
             else
                 *(uint16_t *)(dev->recv_buf) = tem;
-        }
-        else
-        {
-            return 0;
+            dev->recv_buf = (uint8_t *)dev->recv_buf + step;
         }
 
         rxflr--;
-        dev->recv_buf += dev->data_width >> 3;
+        dev->rx_left--;
+        dev->inflight--;
+        ret++;
     }
 
-    return (int)ret;
+    return ret;
+}
+
+static bool spi_chain_done(struct cv1800_spi *dev)
+{
+    return !dev->rx_left && (!dev->rx_seg || !dev->rx_seg->next);
 }
 
+static void spi_chain_load(struct cv1800_spi *dev, struct spi_message *message)
+{
+    dev->inflight = 0;
+    dev->status = 0;
+    spi_load_tx(dev, message);
+    spi_load_rx(dev, message);
+}
+
+/*
+ * Transmit and receive are interleaved: the old code sent the whole
+ * message before reading anything back, which overran the rx fifo for
+ * anything longer than the fifo.
+ */
 static int dw_spi_transfer_poll(struct cv1800_spi *spi_dev, struct spi_message *message) {
+    struct spi_message *seg;
     int ret = 0;
-    
-    if (message->send_buf != NULL)
+
+    for (seg = message; seg; seg = seg->next)
+        ret += seg->length;
+
+    spi_chain_load(spi_dev, message);
+
+    if (spi_dev->cs)
+        spi_dev->cs(spi_dev->spi_id, true);
+
+    while (!spi_chain_done(spi_dev))
     {
-        spi_dev->send_buf = message->send_buf;
-        spi_dev->send_end = (void *)((uint8_t *)spi_dev->send_buf + message->length);
+        hw_spi_send(spi_dev);
+        hw_spi_recv(spi_dev);
     }
 
-    if (message->recv_buf != NULL)
+    if (spi_dev->cs)
+        spi_dev->cs(spi_dev->spi_id, false);
+
+    return ret;
+}
+
+int spixfer_poll(uint8_t spi_id, struct spi_message *message)
+{
+    struct cv1800_spi *spi_dev = &dw_spi[spi_id];
+
+    /* the async path owns the controller while it has work */
+    if (spi_dev->cur)
+        return -1;
+
+    return dw_spi_transfer_poll(spi_dev, message);
+}
+
+/* async path */
+
+static bool spi_chain_dma_ok(struct cv1800_spi *dev, struct spi_message *message)
+{
+    if (!dev->dma)
+        return false;
+
+    for (; message; message = message->next)
+        if (message->length < SPI_DMA_MIN_LEN)
+            return false;
+
+    return true;
+}
+
+static void spi_dma_done(void *arg);
+
+static void spi_dma_segment(struct cv1800_spi *dev)
+{
+    struct spi_message *seg = dev->rx_seg;
+
+    dev->stats.dma_segments++;
+
+    /* tx request below half full, rx request on every frame */
+    mmio_write_32((uintptr_t)&dev->reg->spi_dmatdlr, dev->fifo_len / 2);
+    mmio_write_32((uintptr_t)&dev->reg->spi_dmardlr, 0);
+    mmio_write_32((uintptr_t)&dev->reg->spi_dmacr, SPI_DMA_RDMAE | SPI_DMA_TDMAE);
+
+    if (dev->dma->start(dev->spi_id, (uintptr_t)&dev->reg->spi_dr, seg->send_buf,
+                        seg->recv_buf, seg->length, dev->data_width, spi_dma_done, dev))
     {
-        spi_dev->recv_buf = message->recv_buf;
-        spi_dev->recv_end = (void *)((uint8_t *)spi_dev->recv_buf + message->length);
+        /* sysdma busy or refused, shift this one from the irq instead */
+        mmio_write_32((uintptr_t)&dev->reg->spi_dmacr, 0);
+        dev->use_dma = false;
+        dev->stats.dma_segments--;
     }
+}
+
+static void spi_pio_start(struct cv1800_spi *dev)
+{
+    /*
+     * TXEI fires at or below half a fifo, RXFI above half a fifo, so one
+     * interrupt moves about half a fifo each way.
+     */
+    mmio_write_32((uintptr_t)&dev->reg->spi_txftlr, dev->fifo_len / 2);
+    mmio_write_32((uintptr_t)&dev->reg->spi_rxftlr, dev->fifo_len / 2 - 1);
+    hw_spi_send(dev);
+    mmio_write_32((uintptr_t)&dev->reg->spi_imr, SPI_INT_TXEI | SPI_INT_RXFI | SPI_INT_RXOI);
+}
 
-    if (message->send_buf)
+/* called with the queue locked and the controller idle */
+static void spi_start_next(struct cv1800_spi *dev)
+{
+    struct spi_message *message;
+    struct spi_message *seg;
+
+    if (dev->q_head == dev->q_tail)
     {
-        while (spi_dev->send_buf != spi_dev->send_end)
-        {
-            hw_spi_send(spi_dev);
-        }
+        dev->cur = NULL;
+        return;
+    }
 
-        /* wait for complete */
-        while (mmio_read_32((uintptr_t)&spi_dev->reg->spi_txflr)) {}
+    message = dev->queue[dev->q_head % SPI_QUEUE_LEN];
+    dev->q_head++;
+    dev->cur = message;
+    dev->stats.transactions++;
+    for (seg = message; seg; seg = seg->next)
+        dev->stats.bytes += seg->length;
+
+    spi_chain_load(dev, message);
+    if (dev->cs)
+        dev->cs(dev->spi_id, true);
+
+    dev->use_dma = spi_chain_dma_ok(dev, message);
+    if (dev->use_dma)
+        spi_dma_segment(dev);
+    if (!dev->use_dma)
+        spi_pio_start(dev);
+}
+
+static void spi_finish(struct cv1800_spi *dev)
+{
+    struct spi_message *message = dev->cur;
+
+    mmio_write_32((uintptr_t)&dev->reg->spi_imr, 0);
+    mmio_write_32((uintptr_t)&dev->reg->spi_dmacr, 0);
+    if (dev->cs)
+        dev->cs(dev->spi_id, false);
+
+    /* start the next one first so the bus is busy while the callback runs */
+    dev->cur = NULL;
+    spi_start_next(dev);
+
+    if (message->complete)
+        message->complete(message, dev->status, message->priv);
+}
 
-        ret = message->length;
+static void spi_dma_done(void *arg)
+{
+    struct cv1800_spi *dev = arg;
+    UBaseType_t flags = taskENTER_CRITICAL_FROM_ISR();
+
+    if (dev->rx_seg->next)
+    {
+        spi_load_tx(dev, dev->rx_seg->next);
+        spi_load_rx(dev, dev->tx_seg);
+        spi_dma_segment(dev);
+        if (dev->use_dma)
+            goto out;
+        /* fall back for the rest of the chain */
+        spi_pio_start(dev);
+        goto out;
     }
 
-    if (message->recv_buf)
+    dev->rx_left = 0;
+    spi_finish(dev);
+out:
+    taskEXIT_CRITICAL_FROM_ISR(flags);
+}
+
+static int spi_irq_handler(int irqn, void *priv)
+{
+    struct cv1800_spi *dev = priv;
+    UBaseType_t flags = taskENTER_CRITICAL_FROM_ISR();
+    uint32_t isr = mmio_read_32((uintptr_t)&dev->reg->spi_isr);
+    uint32_t pending;
+
+    (void)irqn;
+    dev->stats.irqs++;
+
+    if (!dev->cur)
     {
-        while (spi_dev->recv_buf != spi_dev->recv_end)
+        mmio_write_32((uintptr_t)&dev->reg->spi_imr, 0);
+        goto out;
+    }
+
+    if (isr & SPI_INT_RXOI)
+    {
+        mmio_read_32((uintptr_t)&dev->reg->spi_rxoicr);
+        dev->stats.overruns++;
+        dev->status = -1;
+    }
+
+    hw_spi_recv(dev);
+    if (!hw_spi_send(dev))
+    {
+        /*
+         * Everything is written: stop the tx-empty interrupt and lower
+         * the rx threshold so the last, possibly short, batch still
+         * raises RXFI.
+         */
+        pending = dev->inflight;
+        mmio_write_32((uintptr_t)&dev->reg->spi_imr, SPI_INT_RXFI | SPI_INT_RXOI);
+        if (pending)
         {
-            hw_spi_recv(spi_dev);
+            if (pending > dev->fifo_len / 2)
+                pending = dev->fifo_len / 2;
+            mmio_write_32((uintptr_t)&dev->reg->spi_rxftlr, pending - 1);
         }
+    }
+
+    if (spi_chain_done(dev))
+        spi_finish(dev);
+out:
+    taskEXIT_CRITICAL_FROM_ISR(flags);
+    return 0;
+}
+
+/*
+ * Queue @message (a chain linked through next) and return straight
+ * away; message->complete is called from the interrupt once the last
+ * frame of the chain has been read back. The chain must stay untouched
+ * until then. Returns -1 if SPI_QUEUE_LEN transactions are pending.
+ */
+int spi_submit(uint8_t spi_id, struct spi_message *message)
+{
+    struct cv1800_spi *dev = &dw_spi[spi_id];
+    uint32_t pending;
 
-        ret = message->length;
+    if (dev->irq < 0 || !message)
+        return -1;
+
+    taskENTER_CRITICAL();
+    pending = dev->q_tail - dev->q_head;
+    if (pending >= SPI_QUEUE_LEN)
+    {
+        dev->stats.queue_full++;
+        taskEXIT_CRITICAL();
+        return -1;
     }
 
-    return ret;
+    dev->queue[dev->q_tail % SPI_QUEUE_LEN] = message;
+    dev->q_tail++;
+    if (pending + 1 > dev->stats.queue_high_water)
+        dev->stats.queue_high_water = pending + 1;
+
+    if (!dev->cur)
+        spi_start_next(dev);
+    taskEXIT_CRITICAL();
+
+    return 0;
 }
 
+static void spixfer_done(struct spi_message *message, int status, void *priv)
+{
+    BaseType_t woken = pdFALSE;
+
+    (void)message;
+    (void)status;
+    vTaskNotifyGiveFromISR((TaskHandle_t)priv, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+/*
+ * Blocking transfer. Once hal_spi_async_init() has run the caller
+ * sleeps on the interrupt path instead of spinning, woken through its
+ * own task notification; this overwrites message->complete and priv.
+ * The controller then belongs to the interrupt path, so a full queue
+ * is waited out rather than falling back to polling.
+ */
 void spixfer(uint8_t spi_id, struct spi_message *message){
     struct cv1800_spi *spi_dev = &dw_spi[spi_id];
-    dw_spi_transfer_poll(spi_dev, message);
+
+    if (spi_dev->irq < 0)
+    {
+        dw_spi_transfer_poll(spi_dev, message);
+        return;
+    }
+
+    message->complete = spixfer_done;
+    message->priv = xTaskGetCurrentTaskHandle();
+    while (spi_submit(spi_id, message))
+        vTaskDelay(1);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+}
+
+/*
+ * Switch @spi_id, already set up by hal_spi_init(), to interrupt driven
+ * transfers.
+ */
+int hal_spi_async_init(uint8_t spi_id)
+{
+    struct cv1800_spi *dev = &dw_spi[spi_id];
+
+    if (!dev->reg)
+        return -1;
+
+    dev->q_head = dev->q_tail = 0;
+    dev->cur = NULL;
+    dev->irq = get_spi_irq(spi_id);
+    mmio_write_32((uintptr_t)&dev->reg->spi_imr, 0);
+    request_irq(dev->irq, spi_irq_handler, 0, "spi", dev);
+
+    return 0;
+}
+
+void hal_spi_set_cs(uint8_t spi_id, spi_cs_t cs)
+{
+    dw_spi[spi_id].cs = cs;
+}
+
+void hal_spi_set_dma(uint8_t spi_id, const struct spi_dma_ops *ops)
+{
+    dw_spi[spi_id].dma = ops;
+}
+
+void spi_get_stats(uint8_t spi_id, struct spi_stats *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = dw_spi[spi_id].stats;
+    taskEXIT_CRITICAL();
+}
+
+/* SRL: tx shifter feeds rx internally, for tests without a device */
+void spi_set_loopback(uint8_t spi_id, bool enable)
+{
+    struct spi_regs *reg = dw_spi[spi_id].reg;
+    uint32_t ctrl0;
+
+    if (!reg)
+        return;
+
+    spi_enable(reg, 0);
+    ctrl0 = mmio_read_32((uintptr_t)&reg->spi_ctrl0);
+    if (enable)
+        ctrl0 |= 1 << SPI_CTRL0_LOOP_SHIFT;
+    else
+        ctrl0 &= ~(1 << SPI_CTRL0_LOOP_SHIFT);
+    mmio_write_32((uintptr_t)&reg->spi_ctrl0, ctrl0);
+    spi_enable(reg, 1);
 }
 
 
@@ -21,6 +21,23 @@
 /* Transmit FiFO Threshold Level */
 #define SPI_TXFTLR 0xf
 
+/* ISR/IMR/RISR bits */
+#define SPI_INT_TXEI (1 << 0)   // tx fifo at or below txftlr
+#define SPI_INT_TXOI (1 << 1)
+#define SPI_INT_RXUI (1 << 2)
+#define SPI_INT_RXOI (1 << 3)
+#define SPI_INT_RXFI (1 << 4)   // rx fifo above rxftlr
+#define SPI_INT_MSTI (1 << 5)
+
+/* DMACR bits */
+#define SPI_DMA_RDMAE (1 << 0)
+#define SPI_DMA_TDMAE (1 << 1)
+
+/* transactions that can wait behind the one on the wire */
+#define SPI_QUEUE_LEN 16
+/* below this many bytes a segment is cheaper to shift from the irq */
+#define SPI_DMA_MIN_LEN 64
+
 #define SPI_CTRL0_DATA_FREAM_SHIFT 0  //frame size
 #define SPI_CTRL0_FREAM_FORMAT_SHIFT 4 
 #define SPI_CTRL0_CPHA_SHIFT 6   //phase
@@ -29,6 +46,41 @@
 #define SPI_CTRL0_LOOP_SHIFT 11
 #define SPI_CTRL0_CTRL_FREAM_SHIFT 12
 
+struct spi_message;
+
+/*
+ * Completion callback of an async transaction, called from the SPI
+ * interrupt with the first message of the chain; status is 0 or -1 on
+ * a receive overrun.
+ */
+typedef void (*spi_complete_t)(struct spi_message *message, int status, void *priv);
+
+/* optional chip select override, e.g. a gpio, for devices that need CS
+ * held across a whole chain even if the tx fifo runs dry */
+typedef void (*spi_cs_t)(uint8_t spi_id, bool assert);
+
+/*
+ * Optional sysdma backend. start() moves @len bytes between memory and
+ * the data register at @dr with the SSI handshakes (either buffer may be
+ * NULL, tx then sends zeroes and rx is discarded) and calls done() from
+ * its own interrupt once both directions have finished.
+ */
+struct spi_dma_ops {
+    int (*start)(uint8_t spi_id, uintptr_t dr, const void *tx, void *rx,
+                 uint32_t len, uint8_t width, void (*done)(void *arg), void *arg);
+};
+
+struct spi_stats {
+    uint32_t transactions;
+    uint32_t segments;
+    uint32_t bytes;
+    uint32_t irqs;
+    uint32_t dma_segments;
+    uint32_t overruns;
+    uint32_t queue_full;
+    uint32_t queue_high_water;
+};
+
 struct cv1800_spi {
     uint8_t spi_id;
 
@@ -42,13 +94,39 @@ struct cv1800_spi {
     void *recv_end;
 
     struct spi_regs *reg;
+
+    /* async state, see hal_spi_async_init() */
+    int irq;
+    uint32_t tx_left;       // frames still to write from tx_seg
+    uint32_t rx_left;       // frames still to read into rx_seg
+    uint32_t inflight;      // frames written but not read back yet
+    struct spi_message *cur;    // head of the chain on the wire
+    struct spi_message *tx_seg;
+    struct spi_message *rx_seg;
+    bool use_dma;
+    int status;
+
+    struct spi_message *queue[SPI_QUEUE_LEN];
+    uint32_t q_head;
+    uint32_t q_tail;
+
+    spi_cs_t cs;
+    const struct spi_dma_ops *dma;
+    struct spi_stats stats;
 };
 
+/*
+ * One segment of a transaction. Segments linked through next are shifted
+ * back to back as a single chip select assertion; complete and priv are
+ * only looked at on the first message of a chain.
+ */
 struct spi_message{
     const void *send_buf;
     void *recv_buf;
     uint16_t length;
     struct spi_message *next;
+    spi_complete_t complete;
+    void *priv;
 };
 
 struct spi_cfg{
@@ -130,4 +208,14 @@ void hal_spi_init(uint8_t spi_id, struct spi_cfg *cfg);
 void spixfer(uint8_t spi_id, struct spi_message *message);
 void test_spi(void);
 
+int hal_spi_async_init(uint8_t spi_id);
+void hal_spi_set_cs(uint8_t spi_id, spi_cs_t cs);
+void hal_spi_set_dma(uint8_t spi_id, const struct spi_dma_ops *ops);
+int spi_submit(uint8_t spi_id, struct spi_message *message);
+int spixfer_poll(uint8_t spi_id, struct spi_message *message);
+void spi_get_stats(uint8_t spi_id, struct spi_stats *stats);
+void spi_set_loopback(uint8_t spi_id, bool enable);
+
+void spi_bench_start(uint8_t spi_id);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,193 @@
+/*
+ * SPI throughput and CPU occupancy benchmark.
+ *
+ * Runs the controller in internal loopback (no device needed) and moves
+ * the same amount of data with spixfer_poll() and with spi_submit() at a
+ * few message sizes. CPU occupancy is measured with a spinner task at
+ * the lowest non idle priority: whatever it does not get was spent in
+ * the transfer path, the benchmark task itself or the SPI interrupt.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "timebase.h"
+#include "drv_spi.h"
+
+#define BENCH_BYTES     (64 * 1024)
+#define BENCH_DEPTH     4       // async transactions kept in flight
+#define BENCH_MAX_LEN   4096
+#define BENCH_FREQ      25000000
+
+static const uint16_t bench_sizes[] = { 16, 64, 256, 1024, 4096 };
+
+static uint8_t tx_buf[BENCH_DEPTH][BENCH_MAX_LEN];
+static uint8_t rx_buf[BENCH_DEPTH][BENCH_MAX_LEN];
+static struct spi_message bench_msg[BENCH_DEPTH];
+
+static volatile uint32_t spin_count;
+static volatile uint32_t done_count;
+static volatile int bench_errors;
+static SemaphoreHandle_t done_sem;
+
+static void spin_task(void *arg)
+{
+    (void)arg;
+    for (;;)
+        spin_count++;
+}
+
+static void bench_done(struct spi_message *message, int status, void *priv)
+{
+    BaseType_t woken = pdFALSE;
+
+    (void)message;
+    (void)priv;
+    if (status)
+        bench_errors++;
+    done_count++;
+    xSemaphoreGiveFromISR(done_sem, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+/* spinner iterations per millisecond with nothing else running */
+static uint32_t spin_rate(void)
+{
+    uint32_t count = spin_count;
+    uint64_t t0 = timebase_now_us();
+
+    vTaskDelay(pdMS_TO_TICKS(100));
+    count = spin_count - count;
+
+    return (uint32_t)(count * 1000ULL / (timebase_now_us() - t0 + 1));
+}
+
+static void bench_report(const char *mode, uint16_t len, uint32_t count,
+                         uint64_t us, uint32_t spins, uint32_t idle_rate)
+{
+    uint32_t kbps = (uint32_t)((uint64_t)count * len * 1000000ULL / 1024 / (us + 1));
+    uint32_t free_rate = (uint32_t)(spins * 1000ULL / (us + 1));
+    uint32_t busy = free_rate >= idle_rate ? 0 : 100 - free_rate * 100 / idle_rate;
+
+    printf("spi bench %-5s len %4u: %5u KB/s, %4u us/msg, cpu %3u%%\n",
+           mode, len, kbps, (uint32_t)(us / count), busy);
+}
+
+static void bench_prepare(uint16_t len)
+{
+    int i, j;
+
+    for (i = 0; i < BENCH_DEPTH; i++)
+    {
+        for (j = 0; j < len; j++)
+            tx_buf[i][j] = (uint8_t)(i * 31 + j);
+        memset(rx_buf[i], 0, len);
+
+        bench_msg[i].send_buf = tx_buf[i];
+        bench_msg[i].recv_buf = rx_buf[i];
+        bench_msg[i].length = len;
+        bench_msg[i].next = NULL;
+        bench_msg[i].complete = bench_done;
+        bench_msg[i].priv = NULL;
+    }
+}
+
+static void bench_check(uint16_t len)
+{
+    int i;
+
+    for (i = 0; i < BENCH_DEPTH; i++)
+        if (memcmp(tx_buf[i], rx_buf[i], len))
+            bench_errors++;
+}
+
+static void bench_poll(uint8_t spi_id, uint16_t len, uint32_t idle_rate)
+{
+    uint32_t count = BENCH_BYTES / len;
+    uint32_t spins = spin_count;
+    uint64_t t0 = timebase_now_us();
+    uint32_t i;
+
+    for (i = 0; i < count; i++)
+        spixfer_poll(spi_id, &bench_msg[i % BENCH_DEPTH]);
+
+    bench_report("poll", len, count, timebase_now_us() - t0,
+                 spin_count - spins, idle_rate);
+}
+
+static void bench_async(uint8_t spi_id, uint16_t len, uint32_t idle_rate)
+{
+    uint32_t count = BENCH_BYTES / len;
+    uint32_t submitted = 0;
+    uint32_t spins = spin_count;
+    uint64_t t0 = timebase_now_us();
+
+    done_count = 0;
+    while (done_count < count)
+    {
+        while (submitted < count && submitted - done_count < BENCH_DEPTH)
+        {
+            if (spi_submit(spi_id, &bench_msg[submitted % BENCH_DEPTH]))
+                break;
+            submitted++;
+        }
+        xSemaphoreTake(done_sem, portMAX_DELAY);
+    }
+
+    bench_report("async", len, count, timebase_now_us() - t0,
+                 spin_count - spins, idle_rate);
+}
+
+static void spi_bench_task(void *arg)
+{
+    uint8_t spi_id = (uint8_t)(uintptr_t)arg;
+    struct spi_cfg cfg = { .tmode = 0, .data_width = 8, .freq = BENCH_FREQ };
+    struct spi_stats stats;
+    TaskHandle_t spinner;
+    uint32_t idle_rate;
+    unsigned int i;
+
+    done_sem = xSemaphoreCreateBinary();
+    hal_spi_init(spi_id, &cfg);
+    if (!done_sem || hal_spi_async_init(spi_id))
+    {
+        printf("spi bench: init failed\n");
+        vTaskDelete(NULL);
+        return;
+    }
+    spi_set_loopback(spi_id, true);
+
+    xTaskCreate(spin_task, "spi_spin", configMINIMAL_STACK_SIZE, NULL,
+                tskIDLE_PRIORITY + 1, &spinner);
+    idle_rate = spin_rate();
+    printf("spi bench: spi%u at %u Hz, %u bytes per run\n",
+           spi_id, BENCH_FREQ, BENCH_BYTES);
+
+    for (i = 0; i < sizeof(bench_sizes) / sizeof(bench_sizes[0]); i++)
+    {
+        bench_prepare(bench_sizes[i]);
+        bench_poll(spi_id, bench_sizes[i], idle_rate);
+        bench_check(bench_sizes[i]);
+
+        bench_prepare(bench_sizes[i]);
+        bench_async(spi_id, bench_sizes[i], idle_rate);
+        bench_check(bench_sizes[i]);
+    }
+
+    spi_get_stats(spi_id, &stats);
+    printf("spi bench: %u irqs for %u transactions, %u overruns, queue high water %u\n",
+           stats.irqs, stats.transactions, stats.overruns, stats.queue_high_water);
+    printf("spi bench: %s\n", bench_errors ? "FAILED" : "PASSED");
+
+    spi_set_loopback(spi_id, false);
+    vTaskDelete(spinner);
+    vTaskDelete(NULL);
+}
+
+/* the benchmark task must outrank the spinner, and anything it competes with */
+void spi_bench_start(uint8_t spi_id)
+{
+    xTaskCreate(spi_bench_task, "spi_bench", configMINIMAL_STACK_SIZE * 4,
+                (void *)(uintptr_t)spi_id, configMAX_PRIORITIES - 2, NULL);
+}
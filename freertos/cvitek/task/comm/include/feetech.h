@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "imu.h"
 
 // Servo commands
 #define SERVO_CMD_PING 0x01
@@ -29,7 +30,7 @@
 
 typedef struct {
     uint8_t id;
-    uint32_t last_read_ms;
+    uint32_t last_read_ms;         // timebase_now_ms()
     uint8_t torque_switch;         // 0x28 (1 byte)
     uint8_t acceleration;          // 0x29 (1 byte)
     int16_t target_location;       // 0x2A (2 bytes)
@@ -67,8 +68,10 @@ typedef struct {
     uint32_t read_count;
     uint32_t loop_count;
     uint32_t fault_count;
-    uint32_t last_read_ms;
+    uint32_t last_read_ms;         // timebase_now_ms()
     ServoInfo servos[MAX_SERVOS];
+    uint64_t last_read_us;         // timebase_now_us(), see rtos_timebase_us_to_mono_ns()
+    ImuState imu;                  // imu_service_start()
 } ServoInfoBuffer;
 
 typedef struct {
@@ -0,0 +1,59 @@
+#ifndef IMU_H
+#define IMU_H
+
+#include <stdint.h>
+
+/*
+ * IMU service on the small core: an ICM-426xx on the SPI HAL is read in
+ * FIFO watermark sized bursts, every sample is stamped in the
+ * timebase_now_us() domain and fed to a Mahony filter at the sensor ODR.
+ * The result is published in ServoInfoBuffer.imu next to the servo state.
+ *
+ * Linux reads ImuState like a seqcount: retry while seq is odd or has
+ * changed across the copy.
+ */
+
+#define IMU_RAW_DEPTH 32            // raw samples kept in the snapshot
+#define IMU_ODR_HZ 1000
+#define IMU_WATERMARK_SAMPLES 5     // FIFO burst, one service period
+
+#define IMU_STATUS_PRESENT (1 << 0)
+#define IMU_STATUS_RUNNING (1 << 1)
+#define IMU_STATUS_CONVERGED (1 << 2)
+
+typedef struct {
+    uint64_t timestamp_us;          // timebase_now_us()
+    int16_t accel[3];               // accel_lsb_per_g
+    int16_t gyro[3];                // gyro_lsb_per_dps
+    int8_t temperature;             // degC = temperature / 2.07 + 25
+    uint8_t reserved;
+} ImuSample;
+
+typedef struct {
+    uint32_t seq;                   // odd while the RTOS is writing
+    uint32_t status;                // IMU_STATUS_*
+    uint32_t sample_count;
+    uint32_t overflow_count;        // FIFO filled up, samples lost
+    uint32_t error_count;           // bad WHO_AM_I or invalid packets
+    uint16_t odr_hz;
+    uint16_t accel_lsb_per_g;
+    float gyro_lsb_per_dps;
+    float quat[4];                  // w x y z, sensor frame to world
+    float euler[3];                 // roll pitch yaw, rad
+    float gyro_bias[3];             // rad/s, filter integral term
+    uint64_t last_sample_us;        // timestamp of quat
+    uint32_t max_latency_us;        // newest sample to publish, worst case
+    uint32_t head;                  // samples written, newest at (head - 1) % IMU_RAW_DEPTH
+    ImuSample samples[IMU_RAW_DEPTH];
+} ImuState;
+
+typedef struct {
+    uint8_t spi_id;
+    uint32_t spi_freq;
+    float kp;                       // Mahony proportional gain
+    float ki;                       // Mahony integral gain
+} ImuConfig;
+
+int imu_service_start(const ImuConfig *cfg, ImuState *state);
+
+#endif
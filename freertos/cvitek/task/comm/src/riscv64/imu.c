@@ -0,0 +1,416 @@
+/*
+ * IMU service: ICM-426xx FIFO reader and Mahony attitude filter.
+ *
+ * The sensor runs at IMU_ODR_HZ with accel, gyro, temperature and the
+ * ODR timestamp in every FIFO packet. The task wakes once per watermark
+ * (IMU_WATERMARK_SAMPLES samples), reads the interrupt status and FIFO
+ * count in one transfer and the whole batch in a second one, so the bus
+ * cost per sample is a fraction of a register read. INT1 is set up for
+ * the watermark as well, for boards that route it to a gpio interrupt.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "dcache.h"
+#include "drv_spi.h"
+#include "timebase.h"
+#include "boot_log.h"
+#include "rtos_trace.h"
+#include "imu.h"
+
+#define ICM_REG_DEVICE_CONFIG       0x11
+#define ICM_REG_FIFO_CONFIG         0x16
+#define ICM_REG_INT_STATUS          0x2D
+#define ICM_REG_FIFO_DATA           0x30
+#define ICM_REG_SIGNAL_PATH_RESET   0x4B
+#define ICM_REG_PWR_MGMT0           0x4E
+#define ICM_REG_GYRO_CONFIG0        0x4F
+#define ICM_REG_ACCEL_CONFIG0       0x50
+#define ICM_REG_FIFO_CONFIG1        0x5F
+#define ICM_REG_FIFO_WATERMARK      0x60
+#define ICM_REG_INT_SOURCE0         0x65
+#define ICM_REG_WHOAMI              0x75
+
+#define ICM_SPI_READ                0x80
+#define ICM_SOFT_RESET              0x01
+#define ICM_FIFO_STREAM             0x40
+#define ICM_FIFO_FLUSH              0x02
+#define ICM_FIFO_PACKET3            0x0F    // accel + gyro + temp + timestamp
+#define ICM_INT_FIFO_THS            0x04
+#define ICM_INT_FIFO_FULL           0x02
+#define ICM_PWR_LN                  0x0F    // accel and gyro low noise
+#define ICM_FS_2000DPS_1KHZ         0x06
+#define ICM_FS_16G_1KHZ             0x06
+#define ICM_HEADER_MSG              0x80
+#define ICM_HEADER_ACCEL            0x40
+#define ICM_HEADER_GYRO             0x20
+#define ICM_DATA_INVALID            -32768
+
+#define ICM_PACKET_SIZE             16
+#define ICM_FIFO_MAX_PACKETS        32      // per burst, the rest waits a period
+
+#define IMU_ACCEL_LSB_PER_G         2048
+#define IMU_GYRO_LSB_PER_DPS        16.4f
+#define IMU_PERIOD_US               (1000000 / IMU_ODR_HZ)
+#define IMU_CONVERGE_SAMPLES        IMU_ODR_HZ
+
+#define DEG_TO_RAD                  0.017453292f
+
+struct imu_filter {
+    float q[4];
+    float bias[3];
+    float kp;
+    float ki;
+    bool init;
+};
+
+static struct {
+    uint8_t spi_id;
+    ImuState *state;
+    struct imu_filter filter;
+    uint64_t last_us;
+    uint8_t fifo[ICM_FIFO_MAX_PACKETS * ICM_PACKET_SIZE];
+} imu;
+
+static void icm_read(uint8_t reg, uint8_t *buf, uint16_t len)
+{
+    uint8_t cmd = reg | ICM_SPI_READ;
+    struct spi_message data = { .send_buf = NULL, .recv_buf = buf, .length = len };
+    struct spi_message addr = { .send_buf = &cmd, .length = 1, .next = &data };
+
+    // one chip select for address and data
+    spixfer(imu.spi_id, &addr);
+}
+
+static void icm_write(uint8_t reg, uint8_t val)
+{
+    uint8_t buf[2] = { reg, val };
+    struct spi_message msg = { .send_buf = buf, .length = sizeof(buf) };
+
+    spixfer(imu.spi_id, &msg);
+}
+
+static int icm_setup(void)
+{
+    uint8_t id;
+
+    icm_write(ICM_REG_DEVICE_CONFIG, ICM_SOFT_RESET);
+    vTaskDelay(pdMS_TO_TICKS(2));
+
+    icm_read(ICM_REG_WHOAMI, &id, 1);
+    switch (id) {
+    case 0x40:  // ICM-42600
+    case 0x41:  // ICM-42602
+    case 0x42:  // ICM-42605
+    case 0x46:  // ICM-42622
+    case 0x47:  // ICM-42688-P
+        break;
+    default:
+        printf("imu: unknown WHO_AM_I 0x%x\n", id);
+        return -1;
+    }
+
+    icm_write(ICM_REG_GYRO_CONFIG0, ICM_FS_2000DPS_1KHZ);
+    icm_write(ICM_REG_ACCEL_CONFIG0, ICM_FS_16G_1KHZ);
+    icm_write(ICM_REG_FIFO_CONFIG1, ICM_FIFO_PACKET3);
+    // watermark in bytes, 12 bits little endian
+    icm_write(ICM_REG_FIFO_WATERMARK, (IMU_WATERMARK_SAMPLES * ICM_PACKET_SIZE) & 0xff);
+    icm_write(ICM_REG_FIFO_WATERMARK + 1, (IMU_WATERMARK_SAMPLES * ICM_PACKET_SIZE) >> 8);
+    icm_write(ICM_REG_INT_SOURCE0, ICM_INT_FIFO_THS);
+    icm_write(ICM_REG_FIFO_CONFIG, ICM_FIFO_STREAM);
+    icm_write(ICM_REG_PWR_MGMT0, ICM_PWR_LN);
+
+    // gyro start up time, then drop whatever settled in meanwhile
+    vTaskDelay(pdMS_TO_TICKS(50));
+    icm_write(ICM_REG_SIGNAL_PATH_RESET, ICM_FIFO_FLUSH);
+
+    return 0;
+}
+
+static void quat_normalize(float *q)
+{
+    float n = sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+
+    if (n > 0.0f) {
+        q[0] /= n;
+        q[1] /= n;
+        q[2] /= n;
+        q[3] /= n;
+    }
+}
+
+/* start from the gravity direction instead of waiting for kp to get there */
+static void filter_init(struct imu_filter *f, float ax, float ay, float az)
+{
+    float roll = atan2f(ay, az);
+    float pitch = atan2f(-ax, sqrtf(ay * ay + az * az));
+    float cr = cosf(roll * 0.5f), sr = sinf(roll * 0.5f);
+    float cp = cosf(pitch * 0.5f), sp = sinf(pitch * 0.5f);
+
+    f->q[0] = cr * cp;
+    f->q[1] = sr * cp;
+    f->q[2] = cr * sp;
+    f->q[3] = -sr * sp;
+    f->bias[0] = f->bias[1] = f->bias[2] = 0.0f;
+    f->init = true;
+}
+
+/* Mahony: gyro rates in rad/s, accel in any unit, dt in seconds */
+static void filter_update(struct imu_filter *f, float gx, float gy, float gz,
+                          float ax, float ay, float az, float dt)
+{
+    float *q = f->q;
+    float norm = sqrtf(ax * ax + ay * ay + az * az);
+    float vx, vy, vz, ex, ey, ez;
+    float qa, qb, qc;
+
+    /*
+     * Only trust the accelerometer as a gravity reference while it reads
+     * close to 1g; during hard manoeuvres integrate the gyro alone.
+     */
+    if (norm > IMU_ACCEL_LSB_PER_G * 0.75f && norm < IMU_ACCEL_LSB_PER_G * 1.25f) {
+        ax /= norm;
+        ay /= norm;
+        az /= norm;
+
+        // gravity direction predicted by the current attitude
+        vx = 2.0f * (q[1] * q[3] - q[0] * q[2]);
+        vy = 2.0f * (q[0] * q[1] + q[2] * q[3]);
+        vz = q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3];
+
+        ex = ay * vz - az * vy;
+        ey = az * vx - ax * vz;
+        ez = ax * vy - ay * vx;
+
+        if (f->ki > 0.0f) {
+            f->bias[0] += f->ki * ex * dt;
+            f->bias[1] += f->ki * ey * dt;
+            f->bias[2] += f->ki * ez * dt;
+        }
+        gx += f->kp * ex + f->bias[0];
+        gy += f->kp * ey + f->bias[1];
+        gz += f->kp * ez + f->bias[2];
+    }
+
+    gx *= 0.5f * dt;
+    gy *= 0.5f * dt;
+    gz *= 0.5f * dt;
+    qa = q[0];
+    qb = q[1];
+    qc = q[2];
+    q[0] += -qb * gx - qc * gy - q[3] * gz;
+    q[1] += qa * gx + qc * gz - q[3] * gy;
+    q[2] += qa * gy - qb * gz + q[3] * gx;
+    q[3] += qa * gz + qb * gy - qc * gx;
+    quat_normalize(q);
+}
+
+static void filter_euler(const float *q, float *euler)
+{
+    float sinp = 2.0f * (q[0] * q[2] - q[3] * q[1]);
+
+    if (sinp > 1.0f)
+        sinp = 1.0f;
+    else if (sinp < -1.0f)
+        sinp = -1.0f;
+
+    euler[0] = atan2f(2.0f * (q[0] * q[1] + q[2] * q[3]),
+                      1.0f - 2.0f * (q[1] * q[1] + q[2] * q[2]));
+    euler[1] = asinf(sinp);
+    euler[2] = atan2f(2.0f * (q[0] * q[3] + q[1] * q[2]),
+                      1.0f - 2.0f * (q[2] * q[2] + q[3] * q[3]));
+}
+
+static inline int16_t be16(const uint8_t *p)
+{
+    return (int16_t)((p[0] << 8) | p[1]);
+}
+
+/*
+ * Stamp @count packets read at @now_us. The newest one is taken as
+ * sampled at @now_us, older ones are spaced by the sensor's own ODR
+ * timestamps so jitter in when this task ran does not leak into dt.
+ */
+static void imu_stamp(const uint8_t *fifo, int count, uint64_t now_us, uint64_t *stamps)
+{
+    uint16_t ts, prev_ts;
+    uint32_t delta;
+    int i;
+
+    stamps[count - 1] = now_us;
+    prev_ts = (uint16_t)be16(&fifo[(count - 1) * ICM_PACKET_SIZE + 14]);
+    for (i = count - 2; i >= 0; i--) {
+        ts = (uint16_t)be16(&fifo[i * ICM_PACKET_SIZE + 14]);
+        delta = (uint16_t)(prev_ts - ts);
+        if (!delta || delta > 4 * IMU_PERIOD_US)
+            delta = IMU_PERIOD_US;
+        stamps[i] = stamps[i + 1] - delta;
+        prev_ts = ts;
+    }
+}
+
+/*
+ * Linux reads the state through its own, non-coherent mapping and retries
+ * while seq is odd or changed. Cleaning is done in address order, so the
+ * odd seq has to reach DRAM before any data line, and the even seq only
+ * after all of them.
+ */
+static void imu_write_begin(ImuState *st)
+{
+    st->seq++;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    dcache_clean_range(&st->seq, sizeof(st->seq));
+}
+
+static void imu_write_end(ImuState *st)
+{
+    dcache_clean_range(st, sizeof(*st));
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    st->seq++;
+    dcache_clean_range(&st->seq, sizeof(st->seq));
+}
+
+static void imu_process(int count, uint64_t now_us)
+{
+    ImuState *st = imu.state;
+    struct imu_filter *f = &imu.filter;
+    uint64_t stamps[ICM_FIFO_MAX_PACKETS];
+    float gscale = DEG_TO_RAD / IMU_GYRO_LSB_PER_DPS;
+    const uint8_t *p;
+    ImuSample *s;
+    float dt;
+    int i;
+
+    imu_stamp(imu.fifo, count, now_us, stamps);
+
+    imu_write_begin(st);
+
+    for (i = 0; i < count; i++) {
+        p = &imu.fifo[i * ICM_PACKET_SIZE];
+        if ((p[0] & ICM_HEADER_MSG) ||
+            (p[0] & (ICM_HEADER_ACCEL | ICM_HEADER_GYRO)) != (ICM_HEADER_ACCEL | ICM_HEADER_GYRO) ||
+            be16(&p[1]) == ICM_DATA_INVALID || be16(&p[7]) == ICM_DATA_INVALID) {
+            st->error_count++;
+            continue;
+        }
+
+        // never step backwards across bursts
+        if (stamps[i] <= imu.last_us)
+            stamps[i] = imu.last_us + 1;
+
+        s = &st->samples[st->head % IMU_RAW_DEPTH];
+        s->timestamp_us = stamps[i];
+        s->accel[0] = be16(&p[1]);
+        s->accel[1] = be16(&p[3]);
+        s->accel[2] = be16(&p[5]);
+        s->gyro[0] = be16(&p[7]);
+        s->gyro[1] = be16(&p[9]);
+        s->gyro[2] = be16(&p[11]);
+        s->temperature = (int8_t)p[13];
+        st->head++;
+
+        if (!f->init) {
+            filter_init(f, s->accel[0], s->accel[1], s->accel[2]);
+        } else {
+            dt = (float)(stamps[i] - imu.last_us) * 1e-6f;
+            filter_update(f, s->gyro[0] * gscale, s->gyro[1] * gscale, s->gyro[2] * gscale,
+                          s->accel[0], s->accel[1], s->accel[2], dt);
+        }
+        imu.last_us = stamps[i];
+        st->sample_count++;
+    }
+
+    memcpy(st->quat, f->q, sizeof(st->quat));
+    memcpy(st->gyro_bias, f->bias, sizeof(st->gyro_bias));
+    filter_euler(f->q, st->euler);
+    st->last_sample_us = imu.last_us;
+    if (st->sample_count >= IMU_CONVERGE_SAMPLES)
+        st->status |= IMU_STATUS_CONVERGED;
+
+    now_us = timebase_now_us();
+    if (now_us - imu.last_us > st->max_latency_us)
+        st->max_latency_us = now_us - imu.last_us;
+
+    imu_write_end(st);
+}
+
+static void imu_task(void *arg)
+{
+    TickType_t wake = xTaskGetTickCount();
+    uint8_t head[3];
+    uint64_t now_us;
+    int count;
+
+    (void)arg;
+    for (;;) {
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(IMU_WATERMARK_SAMPLES * 1000 / IMU_ODR_HZ));
+
+        // INT_STATUS (clear on read) and FIFO_COUNT in one go
+        icm_read(ICM_REG_INT_STATUS, head, sizeof(head));
+        now_us = timebase_now_us();
+        if (head[0] & ICM_INT_FIFO_FULL)
+            imu.state->overflow_count++;
+
+        count = ((head[1] << 8) | head[2]) / ICM_PACKET_SIZE;
+        if (!count)
+            continue;
+        if (count > ICM_FIFO_MAX_PACKETS)
+            count = ICM_FIFO_MAX_PACKETS;
+
+        rtos_trace_begin("imu_batch");
+        icm_read(ICM_REG_FIFO_DATA, imu.fifo, count * ICM_PACKET_SIZE);
+        imu_process(count, now_us);
+        rtos_trace_end("imu_batch");
+        rtos_trace_counter("imu_fifo", count);
+    }
+}
+
+int imu_service_start(const ImuConfig *cfg, ImuState *state)
+{
+    struct spi_cfg spi = {
+        .tmode = 3,         // CPOL = 1, CPHA = 1
+        .data_width = 8,
+        .freq = cfg->spi_freq,
+    };
+
+    memset(state, 0, sizeof(*state));
+    state->odr_hz = IMU_ODR_HZ;
+    state->accel_lsb_per_g = IMU_ACCEL_LSB_PER_G;
+    state->gyro_lsb_per_dps = IMU_GYRO_LSB_PER_DPS;
+    state->quat[0] = 1.0f;
+
+    imu.spi_id = cfg->spi_id;
+    imu.state = state;
+    imu.filter.kp = cfg->kp;
+    imu.filter.ki = cfg->ki;
+    imu.filter.init = false;
+    imu.last_us = 0;
+
+    hal_spi_init(cfg->spi_id, &spi);
+    hal_spi_async_init(cfg->spi_id);
+
+    if (icm_setup()) {
+        state->error_count++;
+        dcache_clean_range(state, sizeof(*state));
+        return -1;
+    }
+    state->status = IMU_STATUS_PRESENT;
+    dcache_clean_range(state, sizeof(*state));
+
+    // above the servo loop: a late IMU period costs filter accuracy
+    if (xTaskCreate(imu_task, "imu", configMINIMAL_STACK_SIZE * 4, NULL,
+                    configMAX_PRIORITIES - 2, NULL) != pdPASS) {
+        printf("imu: task create failed\n");
+        return -1;
+    }
+
+    // the task sleeps a watermark period first, nothing else writes yet
+    imu_write_begin(state);
+    state->status |= IMU_STATUS_RUNNING;
+    imu_write_end(state);
+    boot_log_mark("imu_running");
+
+    return 0;
+}
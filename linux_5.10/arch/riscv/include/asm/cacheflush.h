@@ -45,6 +45,22 @@ void flush_icache_mm(struct mm_struct *mm, bool local);
 void dma_wbinv_range(unsigned long start, unsigned long end);
 void dma_wb_range(unsigned long start, unsigned long end);
 
+/*
+ * D-cache maintenance by physical address for non-coherent DMA, built on
+ * the T-Head dcache.{c,i,ci}pa line ops. thead_dcache_sync() switches to
+ * the whole-cache op at or above thead_dcache_whole_threshold() bytes.
+ */
+enum thead_dcache_op {
+	THEAD_DCACHE_CLEAN,	/* write back, lines stay valid */
+	THEAD_DCACHE_INVAL,	/* discard, partial edge lines are written back */
+	THEAD_DCACHE_FLUSH,	/* write back and discard */
+};
+
+void thead_dcache_range(phys_addr_t start, size_t size, enum thead_dcache_op op);
+bool thead_dcache_all(enum thead_dcache_op op);
+void thead_dcache_sync(phys_addr_t start, size_t size, enum thead_dcache_op op);
+size_t thead_dcache_whole_threshold(void);
+
 /*
  * Bits in sys_riscv_flush_icache()'s flags argument.
  */
@@ -9,6 +9,7 @@
 #define _ASM_RISCV_UACCESS_H
 
 #include <asm/pgtable.h>		/* for TASK_SIZE */
+#include <asm/vector.h>
 
 #ifdef CONFIG_SET_FS
 /*
@@ -386,12 +387,22 @@ unsigned long __must_check __asm_copy_from_user(void *to,
 static inline unsigned long
 raw_copy_from_user(void *to, const void __user *from, unsigned long n)
 {
+#ifdef RISCV_VECTOR_STRING
+	if (n >= RISCV_VECTOR_USERCOPY_MIN)
+		return riscv_copy_user_vector(to, (__force const void *)from,
+					      n, false);
+#endif
 	return __asm_copy_from_user(to, from, n);
 }
 
 static inline unsigned long
 raw_copy_to_user(void __user *to, const void *from, unsigned long n)
 {
+#ifdef RISCV_VECTOR_STRING
+	if (n >= RISCV_VECTOR_USERCOPY_MIN)
+		return riscv_copy_user_vector((__force void *)to, from,
+					      n, true);
+#endif
 	return __asm_copy_to_user(to, from, n);
 }
 
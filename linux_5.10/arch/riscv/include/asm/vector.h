@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Kernel mode use of the vector unit and the vector string routines.
+ */
+
+#ifndef _ASM_RISCV_VECTOR_H
+#define _ASM_RISCV_VECTOR_H
+
+#include <linux/types.h>
+
+/*
+ * The string routines are written for RVV 0.7.1 (C906/C910). KASAN
+ * supplies its own memcpy/memset, which would clash with the dispatch.
+ */
+#if defined(CONFIG_VECTOR_0_7) && !defined(CONFIG_KASAN)
+#define RISCV_VECTOR_STRING
+#endif
+
+/* below this the vector context switch costs more than it saves */
+#define RISCV_VECTOR_USERCOPY_MIN	256
+
+#ifdef CONFIG_VECTOR
+bool may_use_vector(void);
+void kernel_vector_begin(void);
+void kernel_vector_end(void);
+#else
+static inline bool may_use_vector(void) { return false; }
+static inline void kernel_vector_begin(void) { }
+static inline void kernel_vector_end(void) { }
+#endif
+
+#ifdef RISCV_VECTOR_STRING
+/* raw routines, only valid between kernel_vector_begin()/end() */
+void *__memcpy_vector(void *dst, const void *src, size_t n);
+void *__memset_vector(void *s, int c, size_t n);
+unsigned long __asm_vector_usercopy(void *dst, const void *src,
+				    unsigned long n);
+
+bool riscv_vector_string_enabled(void);
+unsigned long riscv_copy_user_vector(void *to, const void *from,
+				     unsigned long n, bool to_user);
+#endif
+
+#endif /* _ASM_RISCV_VECTOR_H */
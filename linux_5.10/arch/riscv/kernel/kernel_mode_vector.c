@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Borrowing the vector unit from the current task for kernel code.
+ *
+ * The user vector state is saved to the task if it is live in the
+ * registers and reloaded afterwards, so a kernel section can clobber
+ * every vector register, vl and vtype. Sections must not sleep; page
+ * faults have to be disabled around any user access inside them.
+ */
+
+#include <linux/export.h>
+#include <linux/hardirq.h>
+#include <linux/irqflags.h>
+#include <linux/preempt.h>
+#include <linux/sched.h>
+#include <asm/csr.h>
+#include <asm/switch_to.h>
+#include <asm/vector.h>
+
+static DEFINE_PER_CPU(bool, vector_context_busy);
+
+/*
+ * Interrupt handlers may run on top of a kernel vector section, with
+ * the task state half saved, so they always take the scalar path.
+ */
+bool may_use_vector(void)
+{
+	return has_vector && !in_interrupt() && !irqs_disabled() &&
+	       !this_cpu_read(vector_context_busy);
+}
+EXPORT_SYMBOL_GPL(may_use_vector);
+
+void kernel_vector_begin(void)
+{
+	struct pt_regs *regs = task_pt_regs(current);
+
+	WARN_ON(!may_use_vector());
+
+	preempt_disable();
+	this_cpu_write(vector_context_busy, true);
+
+	csr_set(CSR_STATUS, SR_VS);
+	vstate_save(current, regs);
+}
+EXPORT_SYMBOL_GPL(kernel_vector_begin);
+
+void kernel_vector_end(void)
+{
+	struct pt_regs *regs = task_pt_regs(current);
+
+	/* the saved copy is current again; nothing to restore if never used */
+	vstate_restore(current, regs);
+	csr_clear(CSR_STATUS, SR_VS);
+
+	this_cpu_write(vector_context_busy, false);
+	preempt_enable();
+}
+EXPORT_SYMBOL_GPL(kernel_vector_end);
@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Boot time selection between the scalar and the RVV 0.7.1 string
+ * routines.
+ *
+ * memcpy and memset are weak aliases of __memcpy/__memset in the scalar
+ * implementations; these override them and take the vector path for
+ * large buffers once the boot CPU has reported the V extension. Small
+ * copies, interrupt context and CPUs without V stay scalar.
+ */
+
+#include <linux/init.h>
+#include <linux/jump_label.h>
+#include <linux/moduleparam.h>
+#include <linux/printk.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+#include <asm/switch_to.h>
+#include <asm/vector.h>
+
+static DEFINE_STATIC_KEY_FALSE(riscv_vector_string);
+
+static bool enable = true;
+module_param(enable, bool, 0444);
+MODULE_PARM_DESC(enable, "Use the vector string routines when the CPU has V");
+
+/*
+ * Saving a dirty user vector context costs about as much as a 1 KiB
+ * scalar copy on C906; test_string_vector reports the crossover.
+ */
+static unsigned int threshold = 1024;
+module_param(threshold, uint, 0644);
+MODULE_PARM_DESC(threshold, "Smallest size handled by the vector routines");
+
+/*
+ * Cutover of the user copy, timed on its own by test_string_vector.
+ * raw_copy_{to,from}_user() only call in from RISCV_VECTOR_USERCOPY_MIN,
+ * so smaller values act as that minimum.
+ */
+static unsigned int usercopy_threshold = RISCV_VECTOR_USERCOPY_MIN;
+module_param(usercopy_threshold, uint, 0644);
+MODULE_PARM_DESC(usercopy_threshold, "Smallest user copy handled by the vector routine");
+
+bool riscv_vector_string_enabled(void)
+{
+	return static_branch_likely(&riscv_vector_string);
+}
+EXPORT_SYMBOL_GPL(riscv_vector_string_enabled);
+
+/* for test_string_vector, which times each path on its own */
+EXPORT_SYMBOL_GPL(__memcpy_vector);
+EXPORT_SYMBOL_GPL(__memset_vector);
+EXPORT_SYMBOL_GPL(__asm_vector_usercopy);
+
+static __always_inline bool use_vector(size_t n)
+{
+	return static_branch_unlikely(&riscv_vector_string) &&
+	       n >= READ_ONCE(threshold) && may_use_vector();
+}
+
+static __always_inline bool use_vector_usercopy(size_t n)
+{
+	return static_branch_unlikely(&riscv_vector_string) &&
+	       n >= READ_ONCE(usercopy_threshold) && may_use_vector();
+}
+
+void *memcpy(void *dst, const void *src, size_t n)
+{
+	if (!use_vector(n))
+		return __memcpy(dst, src, n);
+
+	kernel_vector_begin();
+	__memcpy_vector(dst, src, n);
+	kernel_vector_end();
+
+	return dst;
+}
+
+void *memset(void *s, int c, size_t n)
+{
+	if (!use_vector(n))
+		return __memset(s, c, n);
+
+	kernel_vector_begin();
+	__memset_vector(s, c, n);
+	kernel_vector_end();
+
+	return s;
+}
+
+/*
+ * raw_copy_{to,from}_user() for n >= RISCV_VECTOR_USERCOPY_MIN, vector
+ * from usercopy_threshold on. Faults are not taken inside the vector
+ * section, where the task can not sleep; the vector loop stops at the
+ * first one and the scalar copy redoes the rest with faults enabled.
+ */
+unsigned long riscv_copy_user_vector(void *to, const void *from,
+				     unsigned long n, bool to_user)
+{
+	unsigned long left, done;
+
+	if (use_vector_usercopy(n)) {
+		pagefault_disable();
+		kernel_vector_begin();
+		left = __asm_vector_usercopy(to, from, n);
+		kernel_vector_end();
+		pagefault_enable();
+
+		if (!left)
+			return 0;
+		done = n - left;
+		to += done;
+		from += done;
+		n = left;
+	}
+
+	if (to_user)
+		return __asm_copy_to_user((void __user *)to, from, n);
+
+	return __asm_copy_from_user(to, (const void __user *)from, n);
+}
+EXPORT_SYMBOL(riscv_copy_user_vector);
+
+static int __init riscv_vector_string_init(void)
+{
+	if (!has_vector || !enable)
+		return 0;
+
+	static_branch_enable(&riscv_vector_string);
+	pr_info("vector string routines enabled, threshold %u bytes, user copy %u bytes\n",
+		threshold, usercopy_threshold);
+
+	return 0;
+}
+arch_initcall(riscv_vector_string_init);
@@ -0,0 +1,222 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Non-coherent DMA cache maintenance for T-Head cores.
+ *
+ * The C906 does not snoop DMA, so every streaming mapping and every ION
+ * cache ioctl ends up here. Ranges are walked a line at a time with the
+ * physical address ops of the T-Head cache extension; past a size measured
+ * at boot one whole-cache op is cheaper than the walk and is used instead.
+ */
+
+#include <linux/cache.h>
+#include <linux/cpumask.h>
+#include <linux/dma-map-ops.h>
+#include <linux/export.h>
+#include <linux/gfp.h>
+#include <linux/init.h>
+#include <linux/ktime.h>
+#include <linux/mm.h>
+#include <linux/moduleparam.h>
+#include <linux/sizes.h>
+#include <asm/cacheflush.h>
+
+#ifdef CONFIG_RISCV_ISA_THEAD
+/* register a0 is hard coded in the encodings below */
+#define THEAD_DCACHE_PA_OP(name, insn)					\
+static inline void name(phys_addr_t addr)				\
+{									\
+	register unsigned long a0 asm("a0") = addr;			\
+									\
+	asm volatile(".long " #insn : : "r"(a0) : "memory");		\
+}
+
+THEAD_DCACHE_PA_OP(dcache_cpa, 0x0295000b)	/* dcache.cpa a0 */
+THEAD_DCACHE_PA_OP(dcache_ipa, 0x02a5000b)	/* dcache.ipa a0 */
+THEAD_DCACHE_PA_OP(dcache_cipa, 0x02b5000b)	/* dcache.cipa a0 */
+
+static inline void sync_s(void)
+{
+	asm volatile(".long 0x0190000b" ::: "memory");	/* sync.s */
+}
+
+static inline void dcache_call(void)
+{
+	asm volatile(".long 0x0010000b" ::: "memory");	/* dcache.call */
+}
+
+static inline void dcache_ciall(void)
+{
+	asm volatile(".long 0x0030000b" ::: "memory");	/* dcache.ciall */
+}
+#endif
+
+/* 0 until calibrated, never switches to the whole-cache op */
+static unsigned long whole_threshold;
+module_param(whole_threshold, ulong, 0644);
+MODULE_PARM_DESC(whole_threshold, "DMA sync size in bytes from which the whole D-cache is maintained, 0 to never");
+
+size_t thead_dcache_whole_threshold(void)
+{
+	return READ_ONCE(whole_threshold);
+}
+EXPORT_SYMBOL_GPL(thead_dcache_whole_threshold);
+
+void thead_dcache_range(phys_addr_t start, size_t size, enum thead_dcache_op op)
+{
+#ifdef CONFIG_RISCV_ISA_THEAD
+	phys_addr_t end = start + size;
+	phys_addr_t addr = start & ~(phys_addr_t)(L1_CACHE_BYTES - 1);
+
+	if (!size)
+		return;
+
+	switch (op) {
+	case THEAD_DCACHE_CLEAN:
+		for (; addr < end; addr += L1_CACHE_BYTES)
+			dcache_cpa(addr);
+		break;
+	case THEAD_DCACHE_INVAL:
+		/* don't drop what the CPU wrote next to the buffer */
+		if (start & (L1_CACHE_BYTES - 1)) {
+			dcache_cipa(addr);
+			addr += L1_CACHE_BYTES;
+		}
+		for (; addr + L1_CACHE_BYTES <= end; addr += L1_CACHE_BYTES)
+			dcache_ipa(addr);
+		if (addr < end)
+			dcache_cipa(addr);
+		break;
+	case THEAD_DCACHE_FLUSH:
+		for (; addr < end; addr += L1_CACHE_BYTES)
+			dcache_cipa(addr);
+		break;
+	}
+	sync_s();
+#else
+	unsigned long va = (unsigned long)phys_to_virt(start);
+
+	if (op == THEAD_DCACHE_CLEAN)
+		dma_wb_range(va, va + size);
+	else
+		dma_wbinv_range(va, va + size);
+#endif
+}
+EXPORT_SYMBOL_GPL(thead_dcache_range);
+
+/*
+ * The whole-cache ops only reach the local hart, so they are limited to
+ * a single online CPU. There is no whole-cache invalidate that keeps
+ * unrelated dirty lines, INVAL uses clean+invalidate.
+ */
+bool thead_dcache_all(enum thead_dcache_op op)
+{
+#ifdef CONFIG_RISCV_ISA_THEAD
+	if (num_online_cpus() > 1)
+		return false;
+
+	if (op == THEAD_DCACHE_CLEAN)
+		dcache_call();
+	else
+		dcache_ciall();
+	sync_s();
+
+	return true;
+#else
+	return false;
+#endif
+}
+EXPORT_SYMBOL_GPL(thead_dcache_all);
+
+void thead_dcache_sync(phys_addr_t start, size_t size, enum thead_dcache_op op)
+{
+	size_t threshold = READ_ONCE(whole_threshold);
+
+	if (threshold && size >= threshold && thead_dcache_all(op))
+		return;
+
+	thead_dcache_range(start, size, op);
+}
+EXPORT_SYMBOL_GPL(thead_dcache_sync);
+
+void arch_sync_dma_for_device(phys_addr_t paddr, size_t size,
+			      enum dma_data_direction dir)
+{
+	switch (dir) {
+	case DMA_TO_DEVICE:
+		thead_dcache_sync(paddr, size, THEAD_DCACHE_CLEAN);
+		break;
+	case DMA_FROM_DEVICE:
+	case DMA_BIDIRECTIONAL:
+		thead_dcache_sync(paddr, size, THEAD_DCACHE_FLUSH);
+		break;
+	default:
+		break;
+	}
+}
+
+void arch_sync_dma_for_cpu(phys_addr_t paddr, size_t size,
+			   enum dma_data_direction dir)
+{
+	switch (dir) {
+	case DMA_FROM_DEVICE:
+	case DMA_BIDIRECTIONAL:
+		/* drop lines speculatively fetched while the device owned it */
+		thead_dcache_sync(paddr, size, THEAD_DCACHE_INVAL);
+		break;
+	default:
+		break;
+	}
+}
+
+void arch_dma_prep_coherent(struct page *page, size_t size)
+{
+	thead_dcache_sync(page_to_phys(page), size, THEAD_DCACHE_FLUSH);
+}
+
+#define CALIB_SIZE	SZ_256K
+
+/*
+ * Time a line walk over a buffer larger than the D-cache against one
+ * whole-cache flush, both with the cache full of dirty lines. The range
+ * cost grows with the size and the whole-cache cost does not, so their
+ * ratio gives the size where they break even.
+ */
+static int __init thead_dcache_calibrate(void)
+{
+	unsigned long flags;
+	struct page *page;
+	u64 t0, range_ns, all_ns;
+	void *buf;
+
+	if (whole_threshold || !thead_dcache_all(THEAD_DCACHE_FLUSH))
+		return 0;
+
+	page = alloc_pages(GFP_KERNEL, get_order(CALIB_SIZE));
+	if (!page)
+		return 0;
+	buf = page_address(page);
+
+	local_irq_save(flags);
+
+	memset(buf, 0x5a, CALIB_SIZE);
+	t0 = ktime_get_ns();
+	thead_dcache_range(page_to_phys(page), CALIB_SIZE, THEAD_DCACHE_FLUSH);
+	range_ns = ktime_get_ns() - t0;
+
+	memset(buf, 0xa5, CALIB_SIZE);
+	t0 = ktime_get_ns();
+	thead_dcache_all(THEAD_DCACHE_FLUSH);
+	all_ns = ktime_get_ns() - t0;
+
+	local_irq_restore(flags);
+	__free_pages(page, get_order(CALIB_SIZE));
+
+	whole_threshold = clamp_t(u64,
+				  div64_u64(all_ns * CALIB_SIZE, range_ns ?: 1),
+				  L1_CACHE_BYTES, SZ_4M);
+	pr_info("dma: whole D-cache op from %lu bytes (range %llu ns/256K, whole %llu ns)\n",
+		whole_threshold, range_ns, all_ns);
+
+	return 0;
+}
+late_initcall(thead_dcache_calibrate);
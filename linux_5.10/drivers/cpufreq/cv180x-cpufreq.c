@@ -0,0 +1,503 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * CPU frequency scaling for the CVITEK CV180X C906 core
+ *
+ * The C906 clock is a divider behind the clk_c906_0 mux in clk-cv180x.
+ * Operating points come from the device tree when the cpu node has an
+ * operating-points-v2 table, otherwise they are derived from the clock
+ * tree: every rate the divider can produce from the current PLL, down to
+ * min_freq_khz. There is no CPU voltage rail on this SoC, so scaling is
+ * frequency only.
+ *
+ * The driver registers as a cpufreq cooling device, so a thermal zone
+ * fed by cv180x_thermal can throttle the core through a cooling-map on
+ * the cpu node instead of everything being hard limited.
+ *
+ * Real-time deadline mode: writing the pid of a SCHED_FIFO/SCHED_RR
+ * thread pinned to one CPU into rt_pid makes the driver sample that
+ * thread's runtime every rt_period_us and hold a frequency floor high
+ * enough for its runtime to fit rt_deadline_us with rt_margin_pct
+ * percent slack. The floor is a FREQ_QOS_MIN request, so it works under
+ * any governor and the thermal ceiling still wins; periods in which the
+ * ceiling was below the floor are counted as at-risk in rt_stats.
+ *
+ * The driver binds to a platform node, which the board device tree has to
+ * provide together with CONFIG_CV180X_CPUFREQ in its defconfig:
+ *
+ *	cpufreq {
+ *		compatible = "cvitek,cv180x-cpufreq";
+ *	};
+ */
+
+#include <linux/clk.h>
+#include <linux/cpu.h>
+#include <linux/cpufreq.h>
+#include <linux/err.h>
+#include <linux/module.h>
+#include <linux/of.h>
+#include <linux/platform_device.h>
+#include <linux/pm_opp.h>
+#include <linux/pm_qos.h>
+#include <linux/sched.h>
+#include <linux/sched/rt.h>
+#include <linux/sched/task.h>
+#include <linux/slab.h>
+#include <linux/thermal.h>
+#include <linux/workqueue.h>
+
+#define CV180X_CPU_CLK_NAME	"clk_c906_0"
+#define CV180X_CPU_DIV_MAX	16
+
+static unsigned int min_freq_khz = 100000;
+module_param(min_freq_khz, uint, 0444);
+MODULE_PARM_DESC(min_freq_khz, "Lowest derived operating point in kHz");
+
+static char *tz_name;
+module_param(tz_name, charp, 0444);
+MODULE_PARM_DESC(tz_name, "Thermal zone reported in rt_stats, its node name under thermal-zones");
+
+struct cv180x_rt_mon {
+	struct mutex lock;
+	struct delayed_work work;
+	struct freq_qos_request floor;
+	struct pid *pid;
+	unsigned int period_us;
+	unsigned int deadline_us;
+	unsigned int margin_pct;
+	u64 last_runtime;
+	u64 last_sample;
+	unsigned int req_khz;
+	unsigned long periods;
+	unsigned long boosted;
+	unsigned long at_risk;
+	u64 max_runtime_ns;
+};
+
+struct cv180x_cpufreq {
+	struct device *cpu_dev;
+	struct clk *clk;
+	struct cpufreq_frequency_table *freq_table;
+	struct thermal_zone_device *tz;
+	bool opp_of;
+	struct cv180x_rt_mon rt;
+};
+
+static struct cv180x_cpufreq *cv180x_cpufreq;
+
+static int cv180x_cpufreq_target_index(struct cpufreq_policy *policy,
+				       unsigned int index)
+{
+	struct cv180x_cpufreq *priv = policy->driver_data;
+	unsigned long rate = policy->freq_table[index].frequency * 1000UL;
+
+	return clk_set_rate(priv->clk, rate);
+}
+
+static unsigned int cv180x_cpufreq_get(unsigned int cpu)
+{
+	if (!cv180x_cpufreq)
+		return 0;
+
+	return clk_get_rate(cv180x_cpufreq->clk) / 1000;
+}
+
+/*
+ * Walk the divider range of the CPU clock below its current parent and
+ * register every distinct rate the clock driver accepts as an OPP.
+ */
+static int cv180x_cpufreq_derive_opps(struct cv180x_cpufreq *priv)
+{
+	unsigned long prate, rate, last = 0;
+	struct clk *parent;
+	int div, count = 0, ret;
+
+	parent = clk_get_parent(priv->clk);
+	if (!parent)
+		return -ENODEV;
+
+	prate = clk_get_rate(parent);
+	if (!prate)
+		return -EINVAL;
+
+	for (div = 1; div <= CV180X_CPU_DIV_MAX; div++) {
+		long r = clk_round_rate(priv->clk, prate / div);
+
+		if (r <= 0)
+			continue;
+		rate = r;
+		if (rate < min_freq_khz * 1000UL)
+			break;
+		if (rate == last)
+			continue;
+
+		ret = dev_pm_opp_add(priv->cpu_dev, rate, 0);
+		if (ret && ret != -EEXIST)
+			return ret;
+		last = rate;
+		count++;
+	}
+
+	dev_info(priv->cpu_dev, "%d operating points from %s at %lu Hz\n",
+		 count, __clk_get_name(parent), prate);
+
+	return count ? 0 : -ENODEV;
+}
+
+/* Real-time deadline mode */
+
+static void cv180x_rt_sample(struct cv180x_cpufreq *priv,
+			     struct cpufreq_policy *policy)
+{
+	struct cv180x_rt_mon *rt = &priv->rt;
+	struct task_struct *p;
+	u64 now, runtime, busy, window, need;
+	unsigned int cur, req;
+
+	p = get_pid_task(rt->pid, PIDTYPE_PID);
+	if (!p) {
+		/* thread is gone, drop the floor */
+		put_pid(rt->pid);
+		rt->pid = NULL;
+		freq_qos_update_request(&rt->floor, FREQ_QOS_MIN_DEFAULT_VALUE);
+		return;
+	}
+
+	now = ktime_get_ns();
+	runtime = READ_ONCE(p->se.sum_exec_runtime);
+	put_task_struct(p);
+
+	busy = runtime - rt->last_runtime;
+	window = now - rt->last_sample;
+	rt->last_runtime = runtime;
+	rt->last_sample = now;
+	if (!window)
+		return;
+
+	/* runtime the thread used per period at the current frequency */
+	busy = div64_u64(busy * rt->period_us * NSEC_PER_USEC, window);
+	rt->max_runtime_ns = max(rt->max_runtime_ns, busy);
+
+	/*
+	 * Runtime scales inversely with frequency, so the frequency that
+	 * makes busy fit the deadline minus the margin is cur * busy /
+	 * budget.
+	 */
+	cur = policy->cur;
+	need = (u64)rt->deadline_us * NSEC_PER_USEC * (100 - rt->margin_pct) / 100;
+	req = need ? min_t(u64, div64_u64((u64)cur * busy, need),
+			   policy->cpuinfo.max_freq) : policy->cpuinfo.max_freq;
+
+	rt->periods++;
+	if (req > policy->min)
+		rt->boosted++;
+	if (req > policy->max)
+		rt->at_risk++;
+
+	rt->req_khz = req;
+	freq_qos_update_request(&rt->floor, req);
+}
+
+static void cv180x_rt_work(struct work_struct *work)
+{
+	struct cv180x_cpufreq *priv = container_of(to_delayed_work(work),
+						   struct cv180x_cpufreq,
+						   rt.work);
+	struct cv180x_rt_mon *rt = &priv->rt;
+	struct cpufreq_policy *policy;
+
+	policy = cpufreq_cpu_get(0);
+	if (!policy)
+		return;
+
+	mutex_lock(&rt->lock);
+	if (rt->pid) {
+		cv180x_rt_sample(priv, policy);
+		if (rt->pid)
+			schedule_delayed_work(&rt->work,
+					      usecs_to_jiffies(rt->period_us) ?: 1);
+	}
+	mutex_unlock(&rt->lock);
+
+	cpufreq_cpu_put(policy);
+}
+
+static ssize_t show_rt_pid(struct cpufreq_policy *policy, char *buf)
+{
+	struct cv180x_rt_mon *rt = &cv180x_cpufreq->rt;
+	ssize_t ret;
+
+	mutex_lock(&rt->lock);
+	ret = sprintf(buf, "%d\n", rt->pid ? pid_nr(rt->pid) : 0);
+	mutex_unlock(&rt->lock);
+
+	return ret;
+}
+
+static ssize_t store_rt_pid(struct cpufreq_policy *policy, const char *buf,
+			    size_t count)
+{
+	struct cv180x_rt_mon *rt = &cv180x_cpufreq->rt;
+	struct task_struct *p;
+	struct pid *pid = NULL;
+	int nr, ret;
+
+	ret = kstrtoint(buf, 0, &nr);
+	if (ret)
+		return ret;
+
+	if (nr > 0) {
+		pid = find_get_pid(nr);
+		p = get_pid_task(pid, PIDTYPE_PID);
+		if (!p) {
+			put_pid(pid);
+			return -ESRCH;
+		}
+		ret = rt_task(p) && p->nr_cpus_allowed == 1 ? 0 : -EINVAL;
+		put_task_struct(p);
+		if (ret) {
+			put_pid(pid);
+			return ret;
+		}
+	}
+
+	cancel_delayed_work_sync(&rt->work);
+
+	mutex_lock(&rt->lock);
+	put_pid(rt->pid);
+	rt->pid = pid;
+	rt->periods = rt->boosted = rt->at_risk = 0;
+	rt->max_runtime_ns = 0;
+	rt->req_khz = 0;
+	if (pid) {
+		p = get_pid_task(pid, PIDTYPE_PID);
+		rt->last_runtime = p ? READ_ONCE(p->se.sum_exec_runtime) : 0;
+		if (p)
+			put_task_struct(p);
+		rt->last_sample = ktime_get_ns();
+		schedule_delayed_work(&rt->work,
+				      usecs_to_jiffies(rt->period_us) ?: 1);
+	} else {
+		freq_qos_update_request(&rt->floor, FREQ_QOS_MIN_DEFAULT_VALUE);
+	}
+	mutex_unlock(&rt->lock);
+
+	return count;
+}
+
+#define CV180X_RT_ATTR(_name, _field, _min, _max)				\
+static ssize_t show_##_name(struct cpufreq_policy *policy, char *buf)		\
+{										\
+	return sprintf(buf, "%u\n", cv180x_cpufreq->rt._field);			\
+}										\
+static ssize_t store_##_name(struct cpufreq_policy *policy,			\
+			     const char *buf, size_t count)			\
+{										\
+	unsigned int val;							\
+	int ret = kstrtouint(buf, 0, &val);					\
+										\
+	if (ret)								\
+		return ret;							\
+	if (val < (_min) || val > (_max))					\
+		return -EINVAL;							\
+	mutex_lock(&cv180x_cpufreq->rt.lock);					\
+	cv180x_cpufreq->rt._field = val;					\
+	mutex_unlock(&cv180x_cpufreq->rt.lock);					\
+	return count;								\
+}										\
+cpufreq_freq_attr_rw(_name)
+
+CV180X_RT_ATTR(rt_period_us, period_us, 100, 1000000);
+CV180X_RT_ATTR(rt_deadline_us, deadline_us, 50, 1000000);
+CV180X_RT_ATTR(rt_margin_pct, margin_pct, 0, 90);
+
+static ssize_t show_rt_stats(struct cpufreq_policy *policy, char *buf)
+{
+	struct cv180x_rt_mon *rt = &cv180x_cpufreq->rt;
+	struct thermal_zone_device *tz = cv180x_cpufreq->tz;
+	int temp = 0;
+	ssize_t ret;
+
+	/* the sensor may probe after us, look the zone up on first use */
+	if (!tz && tz_name && *tz_name) {
+		tz = thermal_zone_get_zone_by_name(tz_name);
+		if (IS_ERR(tz))
+			tz = NULL;
+		cv180x_cpufreq->tz = tz;
+	}
+	if (tz && thermal_zone_get_temp(tz, &temp))
+		temp = 0;
+
+	mutex_lock(&rt->lock);
+	ret = sprintf(buf,
+		      "pid %d periods %lu boosted %lu at_risk %lu max_runtime_us %llu req_khz %u temp %d\n",
+		      rt->pid ? pid_nr(rt->pid) : 0, rt->periods, rt->boosted,
+		      rt->at_risk, div_u64(rt->max_runtime_ns, NSEC_PER_USEC),
+		      rt->req_khz, temp);
+	mutex_unlock(&rt->lock);
+
+	return ret;
+}
+cpufreq_freq_attr_rw(rt_pid);
+cpufreq_freq_attr_ro(rt_stats);
+
+static struct freq_attr *cv180x_cpufreq_attr[] = {
+	&cpufreq_freq_attr_scaling_available_freqs,
+	&rt_pid,
+	&rt_period_us,
+	&rt_deadline_us,
+	&rt_margin_pct,
+	&rt_stats,
+	NULL,
+};
+
+static int cv180x_cpufreq_init(struct cpufreq_policy *policy)
+{
+	struct cv180x_cpufreq *priv = cv180x_cpufreq;
+	int ret;
+
+	if (policy->cpu != 0)
+		return -ENODEV;
+
+	policy->driver_data = priv;
+	policy->clk = priv->clk;
+	policy->freq_table = priv->freq_table;
+	cpumask_setall(policy->cpus);
+	/* divider switch, no PLL relock */
+	policy->cpuinfo.transition_latency = 10 * NSEC_PER_USEC;
+	policy->suspend_freq = clk_get_rate(priv->clk) / 1000;
+
+	ret = freq_qos_add_request(&policy->constraints, &priv->rt.floor,
+				   FREQ_QOS_MIN, FREQ_QOS_MIN_DEFAULT_VALUE);
+	if (ret < 0)
+		return ret;
+
+	return 0;
+}
+
+static int cv180x_cpufreq_exit(struct cpufreq_policy *policy)
+{
+	struct cv180x_cpufreq *priv = policy->driver_data;
+
+	cancel_delayed_work_sync(&priv->rt.work);
+	mutex_lock(&priv->rt.lock);
+	put_pid(priv->rt.pid);
+	priv->rt.pid = NULL;
+	mutex_unlock(&priv->rt.lock);
+	freq_qos_remove_request(&priv->rt.floor);
+
+	return 0;
+}
+
+static struct cpufreq_driver cv180x_cpufreq_driver = {
+	.name		= "cv180x-cpufreq",
+	.flags		= CPUFREQ_NEED_INITIAL_FREQ_CHECK |
+			  CPUFREQ_IS_COOLING_DEV,
+	.verify		= cpufreq_generic_frequency_table_verify,
+	.target_index	= cv180x_cpufreq_target_index,
+	.get		= cv180x_cpufreq_get,
+	.init		= cv180x_cpufreq_init,
+	.exit		= cv180x_cpufreq_exit,
+	.suspend	= cpufreq_generic_suspend,
+	.attr		= cv180x_cpufreq_attr,
+};
+
+static int cv180x_cpufreq_probe(struct platform_device *pdev)
+{
+	struct cv180x_cpufreq *priv;
+	int ret;
+
+	priv = devm_kzalloc(&pdev->dev, sizeof(*priv), GFP_KERNEL);
+	if (!priv)
+		return -ENOMEM;
+
+	priv->cpu_dev = get_cpu_device(0);
+	if (!priv->cpu_dev)
+		return -ENODEV;
+
+	priv->clk = clk_get(priv->cpu_dev, NULL);
+	if (IS_ERR(priv->clk))
+		priv->clk = clk_get(NULL, CV180X_CPU_CLK_NAME);
+	if (IS_ERR(priv->clk)) {
+		dev_err(&pdev->dev, "failed to get cpu clock\n");
+		return PTR_ERR(priv->clk);
+	}
+
+	if (!dev_pm_opp_of_add_table(priv->cpu_dev)) {
+		priv->opp_of = true;
+	} else {
+		ret = cv180x_cpufreq_derive_opps(priv);
+		if (ret) {
+			dev_err(&pdev->dev, "no operating points: %d\n", ret);
+			goto err_clk;
+		}
+	}
+
+	ret = dev_pm_opp_init_cpufreq_table(priv->cpu_dev, &priv->freq_table);
+	if (ret)
+		goto err_opp;
+
+	mutex_init(&priv->rt.lock);
+	INIT_DELAYED_WORK(&priv->rt.work, cv180x_rt_work);
+	priv->rt.period_us = 1000;
+	priv->rt.deadline_us = 1000;
+	priv->rt.margin_pct = 20;
+
+	cv180x_cpufreq = priv;
+	platform_set_drvdata(pdev, priv);
+
+	ret = cpufreq_register_driver(&cv180x_cpufreq_driver);
+	if (ret) {
+		dev_err(&pdev->dev, "failed to register driver: %d\n", ret);
+		cv180x_cpufreq = NULL;
+		goto err_table;
+	}
+
+	return 0;
+
+err_table:
+	dev_pm_opp_free_cpufreq_table(priv->cpu_dev, &priv->freq_table);
+err_opp:
+	if (priv->opp_of)
+		dev_pm_opp_of_remove_table(priv->cpu_dev);
+	else
+		dev_pm_opp_remove_all_dynamic(priv->cpu_dev);
+err_clk:
+	clk_put(priv->clk);
+	return ret;
+}
+
+static int cv180x_cpufreq_remove(struct platform_device *pdev)
+{
+	struct cv180x_cpufreq *priv = platform_get_drvdata(pdev);
+
+	cpufreq_unregister_driver(&cv180x_cpufreq_driver);
+	cv180x_cpufreq = NULL;
+
+	dev_pm_opp_free_cpufreq_table(priv->cpu_dev, &priv->freq_table);
+	if (priv->opp_of)
+		dev_pm_opp_of_remove_table(priv->cpu_dev);
+	else
+		dev_pm_opp_remove_all_dynamic(priv->cpu_dev);
+	clk_put(priv->clk);
+
+	return 0;
+}
+
+static const struct of_device_id cv180x_cpufreq_of_match[] = {
+	{ .compatible = "cvitek,cv180x-cpufreq" },
+	{},
+};
+MODULE_DEVICE_TABLE(of, cv180x_cpufreq_of_match);
+
+static struct platform_driver cv180x_cpufreq_platdrv = {
+	.driver = {
+		.name		= "cv180x-cpufreq",
+		.of_match_table	= cv180x_cpufreq_of_match,
+	},
+	.probe		= cv180x_cpufreq_probe,
+	.remove		= cv180x_cpufreq_remove,
+};
+module_platform_driver(cv180x_cpufreq_platdrv);
+
+MODULE_DESCRIPTION("CVITEK CV180X CPU frequency scaling driver");
+MODULE_LICENSE("GPL v2");
@@ -71,6 +71,14 @@
 
 static struct proc_dir_entry *proc_cvi_dir;
 
+/*
+ * Merge physically contiguous segments into one ADMA descriptor instead
+ * of writing one descriptor per segment.
+ */
+static bool adma_coalesce;
+module_param(adma_coalesce, bool, 0644);
+MODULE_PARM_DESC(adma_coalesce, "merge contiguous segments into one ADMA descriptor");
+
 static char *card_type[MAX_CARD_TYPE + 1] = {
 	"MMC card", "SD card", "SDIO card", "SD combo (IO+mem) card", "unknown"
 };
@@ -181,6 +189,104 @@ static void cvi_stats_seq_printout(struct seq_file *s)
 	}
 }
 
+static const char *const cvi_stats_size_class[CVI_STATS_SIZE_CLASSES] = {
+	"<=4K", "<=16K", "<=64K", "<=256K", ">256K",
+};
+
+static int cvi_stats_size_index(unsigned int bytes)
+{
+	if (bytes <= SZ_4K)
+		return 0;
+	if (bytes <= SZ_16K)
+		return 1;
+	if (bytes <= SZ_64K)
+		return 2;
+	if (bytes <= SZ_256K)
+		return 3;
+	return 4;
+}
+
+static void cvi_stats_seq_print_requests(struct seq_file *s,
+					 struct sdhci_cvi_host *cvi_host)
+{
+	struct cvi_req_stats *st = &cvi_host->stats;
+	static const char *const dir_name[2] = { "read", "write" };
+	unsigned long flags;
+	u64 nr = 0, kbps;
+	int dir, i;
+
+	spin_lock_irqsave(&st->lock, flags);
+
+	for (dir = 0; dir < 2; dir++) {
+		seq_printf(s, "\t%s requests:\n", dir_name[dir]);
+		seq_printf(s, "\t%8s %10s %12s %10s %10s\n",
+			   "size", "count", "bytes", "avg(us)", "KB/s");
+		for (i = 0; i < CVI_STATS_SIZE_CLASSES; i++) {
+			if (!st->count[dir][i])
+				continue;
+			nr += st->count[dir][i];
+			kbps = st->time_ns[dir][i] ?
+			       div64_u64(st->bytes[dir][i] * (NSEC_PER_SEC / SZ_1K),
+					 st->time_ns[dir][i]) : 0;
+			seq_printf(s, "\t%8s %10llu %12llu %10llu %10llu\n",
+				   cvi_stats_size_class[i], st->count[dir][i],
+				   st->bytes[dir][i],
+				   div64_u64(st->time_ns[dir][i],
+					     st->count[dir][i] * NSEC_PER_USEC),
+				   kbps);
+		}
+		seq_printf(s, "\tlatency histogram (us), max %llu us:\n",
+			   div_u64(st->max_lat_ns[dir], NSEC_PER_USEC));
+		for (i = 0; i < CVI_STATS_LAT_BUCKETS; i++) {
+			if (!st->lat_hist[dir][i])
+				continue;
+			if (i == CVI_STATS_LAT_BUCKETS - 1)
+				seq_printf(s, "\t%8s%-8u %10u\n", ">=", 1U << i,
+					   st->lat_hist[dir][i]);
+			else
+				seq_printf(s, "\t%8u-%-8u %10u\n", i ? 1U << i : 0,
+					   (2U << i) - 1, st->lat_hist[dir][i]);
+		}
+	}
+
+	seq_printf(s, "\terrors: %llu\n", st->errors);
+	if (nr) {
+		seq_printf(s, "\tsegments/request: avg %llu.%02llu max %u\n",
+			   div64_u64(st->segs, nr),
+			   div64_u64((st->segs * 100), nr) % 100, st->max_segs);
+		seq_printf(s, "\tadma descriptors/request: avg %llu.%02llu max %u coalesced %llu (%s)\n",
+			   div64_u64(st->descs, nr),
+			   div64_u64((st->descs * 100), nr) % 100, st->max_descs,
+			   st->coalesced, adma_coalesce ? "on" : "off");
+		seq_printf(s, "\tqueued (back-to-back) requests: %llu of %llu, idle %llu ms\n",
+			   st->queued, nr, div_u64(st->idle_ns, NSEC_PER_MSEC));
+	}
+
+	spin_unlock_irqrestore(&st->lock, flags);
+}
+
+static void cvi_stats_reset(struct sdhci_cvi_host *cvi_host)
+{
+	struct cvi_req_stats *st = &cvi_host->stats;
+	unsigned long flags;
+
+	spin_lock_irqsave(&st->lock, flags);
+	memset(st->count, 0, sizeof(st->count));
+	memset(st->bytes, 0, sizeof(st->bytes));
+	memset(st->time_ns, 0, sizeof(st->time_ns));
+	memset(st->lat_hist, 0, sizeof(st->lat_hist));
+	memset(st->max_lat_ns, 0, sizeof(st->max_lat_ns));
+	st->errors = 0;
+	st->segs = 0;
+	st->max_segs = 0;
+	st->queued = 0;
+	st->idle_ns = 0;
+	st->descs = 0;
+	st->max_descs = 0;
+	st->coalesced = 0;
+	spin_unlock_irqrestore(&st->lock, flags);
+}
+
 /* proc interface setup */
 static void *cvi_seq_start(struct seq_file *s, loff_t *pos)
 {
@@ -202,6 +308,8 @@ static void *cvi_seq_start(struct seq_file *s, loff_t *pos)
 static int cvi_stats_seq_show(struct seq_file *s, void *v)
 {
 	cvi_stats_seq_printout(s);
+	if (s->private)
+		cvi_stats_seq_print_requests(s, s->private);
 	return 0;
 }
 
@@ -222,10 +330,23 @@ static int cvi_stats_proc_open(struct inode *inode, struct file *file)
 	return single_open(file, cvi_stats_seq_show, PDE_DATA(inode));
 };
 
+/* any write clears the request statistics */
+static ssize_t cvi_stats_proc_write(struct file *file, const char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	struct sdhci_cvi_host *cvi_host = PDE_DATA(file_inode(file));
+
+	if (cvi_host)
+		cvi_stats_reset(cvi_host);
+
+	return count;
+}
+
 /* proc file operation */
 static const struct proc_ops cvi_stats_proc_ops = {
 	.proc_open = cvi_stats_proc_open,
 	.proc_read = seq_read,
+	.proc_write = cvi_stats_proc_write,
 	.proc_release = single_release,
 };
 
@@ -242,7 +363,7 @@ int cvi_proc_init(struct sdhci_cvi_host *cvi_host)
 		return 1;
 	}
 
-	proc_stats_entry = proc_create_data(CVI_STATS_PROC, 0400, proc_cvi_dir, &cvi_stats_proc_ops,
+	proc_stats_entry = proc_create_data(CVI_STATS_PROC, 0600, proc_cvi_dir, &cvi_stats_proc_ops,
 					    (void *)cvi_host);
 
 	if (!proc_stats_entry) {
@@ -1027,23 +1148,147 @@ static void sdhci_cv180x_sd_dump_vendor_regs(struct sdhci_host *host)
 		SDHCI_DUMP(": clk_sd0 %d MHz\n", FPLL_MHZ/4);
 }
 
+static inline struct sdhci_cvi_host *to_cvi_host(struct sdhci_host *host)
+{
+	return sdhci_pltfm_priv(sdhci_priv(host));
+}
+
+/*
+ * Extend the previous descriptor when this segment directly follows it.
+ * Only done within one table, for plain transfer descriptors and while
+ * the merged length still fits a descriptor and a 128M window.
+ */
+static bool cvi_adma_coalesce(struct sdhci_host *host, void **desc,
+			      dma_addr_t addr, int len, unsigned int cmd)
+{
+	struct cvi_req_stats *st = &to_cvi_host(host)->stats;
+	struct sdhci_adma2_64_desc *prev;
+	int max_len = host->mmc->max_seg_size < SZ_64K ?
+		      host->mmc->max_seg_size : SZ_64K;
+
+	if (*desc == host->adma_table)
+		st->last_desc = NULL;
+
+	if (!adma_coalesce || cmd != ADMA2_TRAN_VALID || !len ||
+	    !st->last_desc || st->last_desc != *desc - host->desc_sz ||
+	    st->last_end != addr || st->last_len + len > max_len ||
+	    !BOUNDARY_OK(addr - st->last_len, st->last_len + len))
+		return false;
+
+	prev = st->last_desc;
+	st->last_len += len;
+	st->last_end += len;
+	prev->len = cpu_to_le16(st->last_len);
+	st->coalesced++;
+
+	return true;
+}
+
+static void cvi_adma_write_one(struct sdhci_host *host, void **desc,
+			       dma_addr_t addr, int len, unsigned int cmd)
+{
+	struct cvi_req_stats *st = &to_cvi_host(host)->stats;
+
+	if (cvi_adma_coalesce(host, desc, addr, len, cmd))
+		return;
+
+	st->last_desc = *desc;
+	st->last_end = addr + len;
+	st->last_len = len;
+	st->cur_descs++;
+	sdhci_adma_write_desc(host, desc, addr, len, cmd);
+}
+
 static void cvi_adma_write_desc(struct sdhci_host *host, void **desc,
 		dma_addr_t addr, int len, unsigned int cmd)
 {
 	int tmplen, offset;
 
 	if (likely(!len || BOUNDARY_OK(addr, len))) {
-		sdhci_adma_write_desc(host, desc, addr, len, cmd);
+		cvi_adma_write_one(host, desc, addr, len, cmd);
 		return;
 	}
 
 	offset = addr & (SZ_128M - 1);
 	tmplen = SZ_128M - offset;
-	sdhci_adma_write_desc(host, desc, addr, tmplen, cmd);
+	cvi_adma_write_one(host, desc, addr, tmplen, cmd);
 
 	addr += tmplen;
 	len -= tmplen;
-	sdhci_adma_write_desc(host, desc, addr, len, cmd);
+	cvi_adma_write_one(host, desc, addr, len, cmd);
+}
+
+static void cvi_sdhci_request(struct mmc_host *mmc, struct mmc_request *mrq)
+{
+	struct sdhci_host *host = mmc_priv(mmc);
+	struct cvi_req_stats *st = &to_cvi_host(host)->stats;
+	unsigned long flags;
+	ktime_t now;
+
+	if (mrq->data) {
+		now = ktime_get();
+		spin_lock_irqsave(&st->lock, flags);
+		if (st->last_done) {
+			if (ktime_to_ns(ktime_sub(now, st->last_done)) <
+			    CVI_STATS_QUEUED_GAP_NS)
+				st->queued++;
+			else
+				st->idle_ns += ktime_to_ns(ktime_sub(now, st->last_done));
+		}
+		st->cur_mrq = mrq;
+		st->cur_start = now;
+		st->cur_descs = 0;
+		spin_unlock_irqrestore(&st->lock, flags);
+	}
+
+	sdhci_request(mmc, mrq);
+}
+
+static void cvi_sdhci_request_done(struct sdhci_host *host,
+				   struct mmc_request *mrq)
+{
+	struct cvi_req_stats *st = &to_cvi_host(host)->stats;
+	struct mmc_data *data = mrq->data;
+	unsigned long flags;
+	unsigned int bytes;
+	int dir, idx, bucket;
+	ktime_t now;
+	u64 lat;
+
+	if (data && st->cur_mrq == mrq) {
+		now = ktime_get();
+		lat = ktime_to_ns(ktime_sub(now, st->cur_start));
+		bytes = data->blocks * data->blksz;
+		dir = !!(data->flags & MMC_DATA_WRITE);
+		idx = cvi_stats_size_index(bytes);
+		bucket = lat >= NSEC_PER_USEC ?
+			 ilog2(div_u64(lat, NSEC_PER_USEC)) : 0;
+		if (bucket >= CVI_STATS_LAT_BUCKETS)
+			bucket = CVI_STATS_LAT_BUCKETS - 1;
+
+		spin_lock_irqsave(&st->lock, flags);
+		st->cur_mrq = NULL;
+		st->last_done = now;
+		if (mrq->cmd->error || data->error) {
+			st->errors++;
+		} else {
+			st->count[dir][idx]++;
+			st->bytes[dir][idx] += bytes;
+			st->time_ns[dir][idx] += lat;
+			st->lat_hist[dir][bucket]++;
+			if (lat > st->max_lat_ns[dir])
+				st->max_lat_ns[dir] = lat;
+			st->segs += data->sg_len;
+			if (data->sg_len > st->max_segs)
+				st->max_segs = data->sg_len;
+			st->descs += st->cur_descs;
+			if (st->cur_descs > st->max_descs)
+				st->max_descs = st->cur_descs;
+		}
+		spin_unlock_irqrestore(&st->lock, flags);
+	}
+
+	mmc_request_done(host->mmc, mrq);
 }
 
 static const struct sdhci_ops sdhci_cv180x_emmc_ops = {
@@ -1057,6 +1302,7 @@ static const struct sdhci_ops sdhci_cv180x_emmc_ops = {
 	.select_drive_strength = sdhci_cv180x_general_select_drive_strength,
 	.dump_vendor_regs = sdhci_cv180x_emmc_dump_vendor_regs,
 	.adma_write_desc = cvi_adma_write_desc,
+	.request_done = cvi_sdhci_request_done,
 };
 
 static const struct sdhci_ops sdhci_cv180x_sd_ops = {
@@ -1071,6 +1317,7 @@ static const struct sdhci_ops sdhci_cv180x_sd_ops = {
 	.select_drive_strength = sdhci_cv180x_general_select_drive_strength,
 	.dump_vendor_regs = sdhci_cv180x_sd_dump_vendor_regs,
 	.adma_write_desc = cvi_adma_write_desc,
+	.request_done = cvi_sdhci_request_done,
 };
 
 static const struct sdhci_ops sdhci_cv180x_sdio_ops = {
@@ -1083,6 +1330,7 @@ static const struct sdhci_ops sdhci_cv180x_sdio_ops = {
 	.select_drive_strength = sdhci_cv180x_general_select_drive_strength,
 	.platform_execute_tuning = sdhci_cv180x_general_execute_tuning,
 	.adma_write_desc = cvi_adma_write_desc,
+	.request_done = cvi_sdhci_request_done,
 };
 
 static const struct sdhci_ops sdhci_cv180x_fpga_emmc_ops = {
@@ -1296,6 +1544,9 @@ static int sdhci_cvi_probe(struct platform_device *pdev)
 		extra = SDHCI_MAX_SEGS;
 	host->adma_table_cnt += extra;
 
+	spin_lock_init(&cvi_host->stats.lock);
+	host->mmc_host_ops.request = cvi_sdhci_request;
+
 	ret = sdhci_add_host(host);
 	if (ret)
 		goto err_add_host;
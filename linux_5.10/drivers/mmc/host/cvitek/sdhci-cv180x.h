@@ -22,6 +22,8 @@
 #include <linux/delay.h>
 #include <linux/mmc/mmc.h>
 #include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
 
 #define MAX_TUNING_CMD_RETRY_COUNT 50
 #define TUNE_MAX_PHCODE	128
@@ -67,6 +69,39 @@ struct cvi_rtc_sdhci_reg_context {};
 #endif
 #endif
 
+#define CVI_STATS_LAT_BUCKETS	16	/* log2(us) buckets, the last one is open ended */
+#define CVI_STATS_SIZE_CLASSES	5	/* <=4K, <=16K, <=64K, <=256K, larger */
+#define CVI_STATS_QUEUED_GAP_NS	(100 * NSEC_PER_USEC)
+
+struct cvi_req_stats {
+	spinlock_t lock;
+	/* [0] read, [1] write */
+	u64 count[2][CVI_STATS_SIZE_CLASSES];
+	u64 bytes[2][CVI_STATS_SIZE_CLASSES];
+	u64 time_ns[2][CVI_STATS_SIZE_CLASSES];
+	u32 lat_hist[2][CVI_STATS_LAT_BUCKETS];
+	u64 max_lat_ns[2];
+	u64 errors;
+	/* block layer merging and queueing */
+	u64 segs;
+	u32 max_segs;
+	u64 queued;
+	u64 idle_ns;
+	/* ADMA descriptors */
+	u64 descs;
+	u32 max_descs;
+	u64 coalesced;
+	/* request in flight */
+	struct mmc_request *cur_mrq;
+	ktime_t cur_start;
+	ktime_t last_done;
+	u32 cur_descs;
+	/* last descriptor written, for coalescing */
+	void *last_desc;
+	dma_addr_t last_end;
+	int last_len;
+};
+
 struct sdhci_cvi_host {
 	struct sdhci_host *host;
 	struct platform_device *pdev;
@@ -99,6 +134,6 @@ struct sdhci_cvi_host {
 #ifdef CONFIG_PM_SLEEP
 	struct cvi_rtc_sdhci_reg_context *rtc_reg_ctx;
 #endif
-
+	struct cvi_req_stats stats;
 };
 #endif
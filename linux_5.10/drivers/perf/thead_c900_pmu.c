@@ -109,6 +109,7 @@ static struct thead_pmu_t {
 #define EVENT_STALLED_CYCLES_BACKEND		40
 #define EVENT_SYNC_STALL			41
 #define EVENT_FLOAT_POINT_INSTRUCTION		42
+#define EVENT_MAX				EVENT_FLOAT_POINT_INSTRUCTION
 
 static const int hw_event_map[] = {
 	[PERF_COUNT_HW_CPU_CYCLES]			= -EOPNOTSUPP,
@@ -199,8 +200,8 @@ static const int thead_cache_event_map[PERF_COUNT_HW_CACHE_MAX]
 	},
 	[C(BPU)] = {
 		[C(OP_READ)] = {
-			[C(RESULT_ACCESS)] = -EOPNOTSUPP,
-			[C(RESULT_MISS)] = -EOPNOTSUPP,
+			[C(RESULT_ACCESS)] = EVENT_BRANCH,
+			[C(RESULT_MISS)] = EVENT_BRANCH_MISS,
 		},
 		[C(OP_WRITE)] = {
 			[C(RESULT_ACCESS)] = -EOPNOTSUPP,
@@ -424,19 +425,26 @@ static int thead_pmu_event_init(struct perf_event *event)
 			break;
 		}
 
+		/* everything else needs a programmable counter */
+		if (event_id <= EVENT_NONE)
+			return -ENOENT;
+
+		hwc->config_base = event_id;
 		break;
 	case PERF_TYPE_HW_CACHE:
 		event_id = thead_pmu_cache_event(event->attr.config);
-		if (event_id == -EOPNOTSUPP)
+		if (event_id <= EVENT_NONE)
 			return -ENOENT;
 
 		hwc->config_base = event_id;
 		break;
 	case PERF_TYPE_RAW:
-		event_id = event->attr.config;
-		if (event_id < 0)
+		if (event->attr.config == EVENT_NONE ||
+		    event->attr.config > EVENT_MAX)
 			return -ENOENT;
 
+		event_id = event->attr.config;
+
 		hwc->config_base = event_id;
 		break;
 	default:
@@ -544,6 +552,9 @@ static int thead_pmu_add(struct perf_event *event, int flags)
 		sbi_ecall(0x09000001, 0, 2, idx, hwc->config_base, 0, 0, 0);
 
 		hwc->idx = idx;
+	} else if (hw_events->events[hwc->idx]) {
+		/* cycle and instret are single counters, not shareable */
+		return -EAGAIN;
 	}
 
 	hw_events->events[hwc->idx] = event;
@@ -637,6 +648,7 @@ static int thead_pmu_request_irq(irq_handler_t handler)
 	if (err) {
 		pr_err("unable to request IRQ%d for c9xx PMU counters\n",
 		       thead_pmu.irq);
+		thead_pmu.irq = -1;
 		return err;
 	}
 
@@ -645,14 +657,124 @@ static int thead_pmu_request_irq(irq_handler_t handler)
 
 static void thead_pmu_free_irq(void)
 {
-	int irq;
-	struct platform_device *pmu_device = thead_pmu.plat_device;
+	if (thead_pmu.irq >= 0)
+		free_percpu_irq(thead_pmu.irq, &thead_pmu);
+	thead_pmu.irq = -1;
+}
 
-	irq = platform_get_irq(pmu_device, 0);
-	if (irq >= 0)
-		free_percpu_irq(irq, this_cpu_ptr(thead_pmu.hw_events));
+static ssize_t thead_pmu_event_show(struct device *dev,
+				    struct device_attribute *attr, char *page)
+{
+	struct perf_pmu_events_attr *pmu_attr =
+		container_of(attr, struct perf_pmu_events_attr, attr);
+
+	return sprintf(page, "event=0x%02llx\n", pmu_attr->id);
 }
 
+#define THEAD_EVENT_ATTR(_name, _id)					\
+	PMU_EVENT_ATTR(_name, thead_event_attr_##_name, _id,		\
+		       thead_pmu_event_show)
+#define THEAD_EVENT_PTR(_name)	(&thead_event_attr_##_name.attr.attr)
+
+/* named raw events for perf list and -e thead_xt_pmu/<name>/ */
+THEAD_EVENT_ATTR(l1_icache_access, EVENT_L1_ICACHE_ACCESS);
+THEAD_EVENT_ATTR(l1_icache_miss, EVENT_L1_ICACHE_MISS);
+THEAD_EVENT_ATTR(itlb_miss, EVENT_ITLB_MISS);
+THEAD_EVENT_ATTR(dtlb_miss, EVENT_DTLB_MISS);
+THEAD_EVENT_ATTR(jtlb_miss, EVENT_JTLB_MISS);
+THEAD_EVENT_ATTR(branch_mispredict, EVENT_BRANCH_MISS);
+THEAD_EVENT_ATTR(branch, EVENT_BRANCH);
+THEAD_EVENT_ATTR(indirect_branch_mispredict, EVENT_INDIRECT_BRANCH_MISS);
+THEAD_EVENT_ATTR(indirect_branch, EVENT_INDIRECT_BRANCH);
+THEAD_EVENT_ATTR(lsu_spec_fail, EVENT_LSU_SPEC_FAIL);
+THEAD_EVENT_ATTR(store_instruction, EVENT_STORE_INSTRUCTION);
+THEAD_EVENT_ATTR(l1_dcache_load_access, EVENT_L1_DCACHE_LOAD_ACCESS);
+THEAD_EVENT_ATTR(l1_dcache_load_miss, EVENT_L1_DCACHE_LOAD_MISS);
+THEAD_EVENT_ATTR(l1_dcache_store_access, EVENT_L1_DCACHE_STORE_ACCESS);
+THEAD_EVENT_ATTR(l1_dcache_store_miss, EVENT_L1_DCACHE_STORE_MISS);
+THEAD_EVENT_ATTR(l2_load_access, EVENT_L2_LOAD_ACCESS);
+THEAD_EVENT_ATTR(l2_load_miss, EVENT_L2_LOAD_MISS);
+THEAD_EVENT_ATTR(l2_store_access, EVENT_L2_STORE_ACCESS);
+THEAD_EVENT_ATTR(l2_store_miss, EVENT_L2_STORE_MISS);
+THEAD_EVENT_ATTR(lsu_cross_4k_stall, EVENT_LSU_CROSS_4K_STALL);
+THEAD_EVENT_ATTR(lsu_other_stall, EVENT_LSU_OTHER_STALL);
+THEAD_EVENT_ATTR(alu_instruction, EVENT_ALU_INSTRUCTION);
+THEAD_EVENT_ATTR(ldst_instruction, EVENT_LDST_INSTRUCTION);
+THEAD_EVENT_ATTR(vector_simd_instruction, EVENT_VECTOR_SIMD_INSTRUCTION);
+THEAD_EVENT_ATTR(csr_instruction, EVENT_CSR_INSTRUCTION);
+THEAD_EVENT_ATTR(sync_instruction, EVENT_SYNC_INSTRUCTION);
+THEAD_EVENT_ATTR(ldst_unaligned_access, EVENT_LDST_UNALIGNED_ACCESS);
+THEAD_EVENT_ATTR(interrupt_number, EVENT_INTERRUPT_NUMBER);
+THEAD_EVENT_ATTR(interrupt_off_cycle, EVENT_INTERRUPT_OFF_CYCLE);
+THEAD_EVENT_ATTR(environment_call, EVENT_ENVIRONMENT_CALL);
+THEAD_EVENT_ATTR(long_jump, EVENT_LONG_JUMP);
+THEAD_EVENT_ATTR(stalled_cycles_frontend, EVENT_STALLED_CYCLES_FRONTEND);
+THEAD_EVENT_ATTR(stalled_cycles_backend, EVENT_STALLED_CYCLES_BACKEND);
+THEAD_EVENT_ATTR(sync_stall, EVENT_SYNC_STALL);
+THEAD_EVENT_ATTR(float_point_instruction, EVENT_FLOAT_POINT_INSTRUCTION);
+
+static struct attribute *thead_pmu_event_attrs[] = {
+	THEAD_EVENT_PTR(l1_icache_access),
+	THEAD_EVENT_PTR(l1_icache_miss),
+	THEAD_EVENT_PTR(itlb_miss),
+	THEAD_EVENT_PTR(dtlb_miss),
+	THEAD_EVENT_PTR(jtlb_miss),
+	THEAD_EVENT_PTR(branch_mispredict),
+	THEAD_EVENT_PTR(branch),
+	THEAD_EVENT_PTR(indirect_branch_mispredict),
+	THEAD_EVENT_PTR(indirect_branch),
+	THEAD_EVENT_PTR(lsu_spec_fail),
+	THEAD_EVENT_PTR(store_instruction),
+	THEAD_EVENT_PTR(l1_dcache_load_access),
+	THEAD_EVENT_PTR(l1_dcache_load_miss),
+	THEAD_EVENT_PTR(l1_dcache_store_access),
+	THEAD_EVENT_PTR(l1_dcache_store_miss),
+	THEAD_EVENT_PTR(l2_load_access),
+	THEAD_EVENT_PTR(l2_load_miss),
+	THEAD_EVENT_PTR(l2_store_access),
+	THEAD_EVENT_PTR(l2_store_miss),
+	THEAD_EVENT_PTR(lsu_cross_4k_stall),
+	THEAD_EVENT_PTR(lsu_other_stall),
+	THEAD_EVENT_PTR(alu_instruction),
+	THEAD_EVENT_PTR(ldst_instruction),
+	THEAD_EVENT_PTR(vector_simd_instruction),
+	THEAD_EVENT_PTR(csr_instruction),
+	THEAD_EVENT_PTR(sync_instruction),
+	THEAD_EVENT_PTR(ldst_unaligned_access),
+	THEAD_EVENT_PTR(interrupt_number),
+	THEAD_EVENT_PTR(interrupt_off_cycle),
+	THEAD_EVENT_PTR(environment_call),
+	THEAD_EVENT_PTR(long_jump),
+	THEAD_EVENT_PTR(stalled_cycles_frontend),
+	THEAD_EVENT_PTR(stalled_cycles_backend),
+	THEAD_EVENT_PTR(sync_stall),
+	THEAD_EVENT_PTR(float_point_instruction),
+	NULL,
+};
+
+static const struct attribute_group thead_pmu_events_group = {
+	.name = "events",
+	.attrs = thead_pmu_event_attrs,
+};
+
+PMU_FORMAT_ATTR(event, "config:0-7");
+
+static struct attribute *thead_pmu_format_attrs[] = {
+	&format_attr_event.attr,
+	NULL,
+};
+
+static const struct attribute_group thead_pmu_format_group = {
+	.name = "format",
+	.attrs = thead_pmu_format_attrs,
+};
+
+static const struct attribute_group *thead_pmu_attr_groups[] = {
+	&thead_pmu_events_group,
+	&thead_pmu_format_group,
+	NULL,
+};
+
 static int init_hw_perf_events(void)
 {
 	thead_pmu.hw_events = alloc_percpu_gfp(struct pmu_hw_events,
@@ -671,6 +793,7 @@ static int init_hw_perf_events(void)
 		.start		= thead_pmu_start,
 		.stop		= thead_pmu_stop,
 		.read		= thead_pmu_read,
+		.attr_groups	= thead_pmu_attr_groups,
 	};
 
 	return 0;
@@ -680,13 +803,15 @@ static int thead_pmu_starting_cpu(unsigned int cpu)
 {
 	sbi_ecall(0x09000001, 0, 1, 0, 0, 0, 0, 0);
 
-	enable_percpu_irq(thead_pmu.irq, 0);
+	if (thead_pmu.irq >= 0)
+		enable_percpu_irq(thead_pmu.irq, 0);
 	return 0;
 }
 
 static int thead_pmu_dying_cpu(unsigned int cpu)
 {
-	disable_percpu_irq(thead_pmu.irq);
+	if (thead_pmu.irq >= 0)
+		disable_percpu_irq(thead_pmu.irq);
 	return 0;
 }
 
@@ -705,6 +830,11 @@ static int thead_pmu_device_probe(struct platform_device *pdev,
 
 	ret = thead_pmu_request_irq(thead_pmu_handle_irq);
 	if (ret) {
+		/*
+		 * Counting still works; sampling needs the overflow
+		 * interrupt, i.e. interrupts-extended = <&cpu0_intc 17>.
+		 */
+		thead_pmu.irq = -1;
 		thead_pmu.pmu.capabilities |= PERF_PMU_CAP_NO_INTERRUPT;
 		pr_notice("[perf] PMU request irq fail!\n");
 	}
@@ -722,11 +852,13 @@ static int thead_pmu_device_probe(struct platform_device *pdev,
 	if (ret) {
 		thead_pmu_free_irq();
 		free_percpu(thead_pmu.hw_events);
+		return ret;
 	}
 
-	pr_notice("[perf] T-HEAD C900 PMU probed\n");
+	pr_notice("[perf] T-HEAD C900 PMU probed%s\n",
+		  thead_pmu.irq < 0 ? ", counting only" : "");
 
-	return ret;
+	return 0;
 }
 
 const static struct of_device_id thead_pmu_of_device_ids[] = {
@@ -0,0 +1,231 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * CVITEK boot stage log
+ *
+ * Collects the marks the RTOS (and, once they write theirs, FSBL and
+ * U-Boot) left in the shared boot log page, adds the linux ones and shows all of them on one time line
+ * in /sys/devices/platform/<node>/marks. Userspace adds its own marks
+ * (init started, control stack up) by writing a name to "mark".
+ */
+#include <linux/io.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/of.h>
+#include <linux/of_address.h>
+#include <linux/platform_device.h>
+#include <linux/sort.h>
+#include <linux/string.h>
+#include <linux/timekeeping.h>
+#include <asm/delay.h>
+#include <asm/timex.h>
+
+#include "cvi_boot_log.h"
+
+static const char * const stage_names[BOOT_STAGE_NUM] = {
+	[BOOT_STAGE_FSBL] = "fsbl",
+	[BOOT_STAGE_OPENSBI] = "opensbi",
+	[BOOT_STAGE_UBOOT] = "u-boot",
+	[BOOT_STAGE_LINUX] = "linux",
+	[BOOT_STAGE_RTOS] = "rtos",
+};
+
+struct boot_log_entry {
+	u64 ticks;
+	int stage;
+	char name[BOOT_LOG_NAME_LEN];
+};
+
+static struct boot_log __iomem *boot_log;
+static DEFINE_MUTEX(boot_log_lock);
+
+static struct boot_log_stage __iomem *linux_stage(void)
+{
+	return &boot_log->stage[BOOT_STAGE_LINUX];
+}
+
+static int boot_log_add(const char *name, u64 ticks)
+{
+	struct boot_log_stage __iomem *st;
+	struct boot_log_mark mark = { .ticks = ticks };
+	u32 count;
+	int ret = 0;
+
+	if (!boot_log)
+		return -ENODEV;
+
+	strscpy(mark.name, name, sizeof(mark.name));
+
+	mutex_lock(&boot_log_lock);
+	st = linux_stage();
+	count = readl(&st->count);
+	if (count < BOOT_LOG_MARKS) {
+		memcpy_toio(&st->mark[count], &mark, sizeof(mark));
+		writel(count + 1, &st->count);
+	} else {
+		ret = -ENOSPC;
+	}
+	mutex_unlock(&boot_log_lock);
+
+	return ret;
+}
+
+int cvi_boot_log_mark(const char *name)
+{
+	return boot_log_add(name, get_cycles64());
+}
+EXPORT_SYMBOL_GPL(cvi_boot_log_mark);
+
+static u64 ticks_to_us(u64 ticks)
+{
+	return div_u64(ticks, riscv_timebase / USEC_PER_SEC);
+}
+
+static int boot_log_entry_cmp(const void *a, const void *b)
+{
+	const struct boot_log_entry *ea = a, *eb = b;
+
+	if (ea->ticks == eb->ticks)
+		return 0;
+	return ea->ticks < eb->ticks ? -1 : 1;
+}
+
+/* every mark of this boot, oldest first */
+static int boot_log_collect(struct boot_log_entry *entries)
+{
+	struct boot_log_stage st;
+	u64 now = get_cycles64();
+	int s, i, n = 0;
+
+	for (s = 0; s < BOOT_STAGE_NUM; s++) {
+		memcpy_fromio(&st, &boot_log->stage[s], sizeof(st));
+		if (st.magic != BOOT_LOG_MAGIC)
+			continue;
+
+		for (i = 0; i < min_t(u32, st.count, BOOT_LOG_MARKS); i++) {
+			if (st.mark[i].ticks > now)
+				continue;	/* from before a warm reset */
+			entries[n].ticks = st.mark[i].ticks;
+			entries[n].stage = s;
+			memcpy(entries[n].name, st.mark[i].name, BOOT_LOG_NAME_LEN);
+			entries[n].name[BOOT_LOG_NAME_LEN - 1] = '\0';
+			n++;
+		}
+	}
+
+	sort(entries, n, sizeof(*entries), boot_log_entry_cmp, NULL);
+	return n;
+}
+
+static ssize_t marks_show(struct device *dev, struct device_attribute *attr,
+			  char *buf)
+{
+	struct boot_log_entry *entries;
+	u64 prev = 0, us;
+	ssize_t len = 0;
+	int i, n;
+
+	entries = kcalloc(BOOT_STAGE_NUM * BOOT_LOG_MARKS, sizeof(*entries),
+			  GFP_KERNEL);
+	if (!entries)
+		return -ENOMEM;
+
+	n = boot_log_collect(entries);
+	for (i = 0; i < n; i++) {
+		us = ticks_to_us(entries[i].ticks);
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+				 "%10llu us  +%8llu  %-8s %s\n", us, us - prev,
+				 stage_names[entries[i].stage], entries[i].name);
+		prev = us;
+	}
+
+	kfree(entries);
+	return len;
+}
+static DEVICE_ATTR_RO(marks);
+
+static ssize_t mark_store(struct device *dev, struct device_attribute *attr,
+			  const char *buf, size_t count)
+{
+	char name[BOOT_LOG_NAME_LEN];
+	int ret;
+
+	strscpy(name, buf, sizeof(name));
+	strim(name);
+	if (!name[0])
+		return -EINVAL;
+
+	ret = cvi_boot_log_mark(name);
+	return ret ? ret : count;
+}
+static DEVICE_ATTR_WO(mark);
+
+static struct attribute *cvi_boot_log_attrs[] = {
+	&dev_attr_marks.attr,
+	&dev_attr_mark.attr,
+	NULL,
+};
+ATTRIBUTE_GROUPS(cvi_boot_log);
+
+static int cvi_boot_log_probe(struct platform_device *pdev)
+{
+	struct device_node *np;
+	struct boot_log_stage __iomem *st;
+	struct resource res;
+	u64 now;
+	int ret;
+
+	np = of_parse_phandle(pdev->dev.of_node, "memory-region", 0);
+	if (!np) {
+		dev_err(&pdev->dev, "no memory-region\n");
+		return -EINVAL;
+	}
+	ret = of_address_to_resource(np, 0, &res);
+	of_node_put(np);
+	if (ret)
+		return ret;
+	if (resource_size(&res) < sizeof(struct boot_log))
+		return -EINVAL;
+
+	/* written by the other stages with their caches cleaned */
+	boot_log = devm_ioremap(&pdev->dev, res.start, sizeof(struct boot_log));
+	if (!boot_log)
+		return -ENOMEM;
+
+	st = linux_stage();
+	writel(0, &st->count);
+	writel(riscv_timebase, &st->tick_hz);
+	writel(BOOT_LOG_MAGIC, &st->magic);
+
+	/* timekeeping started at zero, place that on the counter */
+	now = get_cycles64();
+	boot_log_add("time_init", now - div_u64(ktime_get_ns() *
+			(riscv_timebase / USEC_PER_SEC), NSEC_PER_USEC));
+	boot_log_add("boot_log_probe", now);
+
+	dev_info(&pdev->dev, "boot log at %pa\n", &res.start);
+	return 0;
+}
+
+static const struct of_device_id cvi_boot_log_match[] = {
+	{ .compatible = "cvitek,boot-log" },
+	{},
+};
+MODULE_DEVICE_TABLE(of, cvi_boot_log_match);
+
+static struct platform_driver cvi_boot_log_driver = {
+	.probe = cvi_boot_log_probe,
+	.driver = {
+		.name = "cvi-boot-log",
+		.of_match_table = cvi_boot_log_match,
+		.dev_groups = cvi_boot_log_groups,
+	},
+};
+builtin_platform_driver(cvi_boot_log_driver);
+
+static int __init cvi_boot_log_initcalls_done(void)
+{
+	cvi_boot_log_mark("initcalls_done");
+	return 0;
+}
+late_initcall_sync(cvi_boot_log_initcalls_done);
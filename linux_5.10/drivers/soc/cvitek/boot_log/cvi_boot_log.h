@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#ifndef __CVI_BOOT_LOG_H__
+#define __CVI_BOOT_LOG_H__
+
+#include <linux/types.h>
+
+/*
+ * Boot stage log shared by linux and the RTOS, with entries kept for FSBL
+ * and U-Boot, which have no writer yet.
+ *
+ * Each stage owns one struct boot_log_stage in a page reserved (no-map)
+ * in the device tree and appends named marks stamped with the RISC-V time
+ * counter, which runs from reset and reads the same on both cores. A
+ * stage only writes its own cache lines, so the two non-coherent cores
+ * never need a lock; writers clean their lines after each update.
+ *
+ * Entries without the magic are empty. Marks with ticks past the current
+ * time are left over from before a warm reset and are ignored.
+ *
+ * The layout must match freertos driver/bootlog.
+ */
+#define BOOT_LOG_MAGIC		0x424f4f54	/* "BOOT" */
+#define BOOT_LOG_MARKS		7
+#define BOOT_LOG_NAME_LEN	24
+
+enum boot_log_stage_id {
+	BOOT_STAGE_FSBL,
+	BOOT_STAGE_OPENSBI,
+	BOOT_STAGE_UBOOT,
+	BOOT_STAGE_LINUX,
+	BOOT_STAGE_RTOS,
+	BOOT_STAGE_NUM,
+};
+
+struct boot_log_mark {
+	__u64 ticks;
+	char name[BOOT_LOG_NAME_LEN];
+};
+
+struct boot_log_stage {
+	__u32 magic;
+	__u32 count;
+	__u32 tick_hz;
+	__u32 reserved[5];
+	struct boot_log_mark mark[BOOT_LOG_MARKS];
+} __attribute__((aligned(64)));
+
+struct boot_log {
+	struct boot_log_stage stage[BOOT_STAGE_NUM];
+};
+
+int cvi_boot_log_mark(const char *name);
+
+#endif /* __CVI_BOOT_LOG_H__ */
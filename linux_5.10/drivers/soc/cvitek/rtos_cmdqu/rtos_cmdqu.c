@@ -17,6 +17,7 @@
 #include <linux/delay.h>
 
 #include "rtos_cmdqu.h"
+#include "rtos_timebase.h"
 #include "cvi_mailbox.h"
 #include "cvi_spinlock.h"
 
@@ -375,6 +376,16 @@ static long cvi_rtos_cmdqu_ioctl(struct file *filp, unsigned int cmd, unsigned l
 					&cmdq,
 					sizeof(struct cmdqu_t));
 			break;
+		case RTOS_CMDQU_GET_TIMEBASE: {
+			struct rtos_timebase_shm tb;
+
+			ret = rtos_timebase_get(&tb);
+			if (ret)
+				break;
+			if (copy_to_user((void __user *)arg, &tb, sizeof(tb)))
+				ret = -EFAULT;
+			break;
+		}
 		default:
 			ret = -EFAULT;
 			break;
@@ -459,6 +470,9 @@ static int cvi_rtos_cmdqu_probe(struct platform_device *pdev)
 		return -1;
 	}
 
+	if (rtos_timebase_init(dev))
+		pr_err("rtos timebase init failed\n");
+
 	pr_info("%s DONE\n", __func__);
 	return 0;
 
@@ -473,6 +487,7 @@ static int cvi_rtos_cmdqu_remove(struct platform_device *pdev)
 	misc_deregister(&ndev->miscdev);
 	platform_set_drvdata(pdev, NULL);
 	/* remove irq handler*/
+	rtos_timebase_deinit();
 	free_irq(mailbox_irq, ndev);
 	rtos_cmdqu_deinit();
 	pr_debug("%s DONE\n", __func__);
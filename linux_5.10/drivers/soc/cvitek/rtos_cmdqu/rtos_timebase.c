@@ -0,0 +1,178 @@
+#include <linux/clocksource.h>
+#include <linux/delay.h>
+#include <linux/dma-mapping.h>
+#include <linux/export.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/timekeeping.h>
+#include <linux/workqueue.h>
+#include <asm/delay.h>
+#include <asm/timex.h>
+
+#include "rtos_cmdqu.h"
+#include "rtos_timebase.h"
+
+/*
+ * CLOCK_MONOTONIC is slewed by NTP, so the tick to monotonic mapping is
+ * refreshed periodically; between refreshes the error is the slew rate
+ * times the period.
+ */
+static unsigned int timebase_refresh_ms = 1000;
+module_param(timebase_refresh_ms, uint, 0644);
+
+static struct rtos_timebase_shm *tb_shm;
+static dma_addr_t tb_phys;
+static struct device *tb_dev;
+static struct delayed_work tb_work;
+
+/* sample the counter and CLOCK_MONOTONIC as close together as possible */
+static void rtos_timebase_sample(u64 *ticks, u64 *mono_ns)
+{
+	u64 t0, t1, ns, best = U64_MAX;
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		t0 = get_cycles64();
+		ns = ktime_get_ns();
+		t1 = get_cycles64();
+		if (t1 - t0 < best) {
+			best = t1 - t0;
+			*ticks = t0 + (t1 - t0) / 2;
+			*mono_ns = ns;
+		}
+	}
+}
+
+static void rtos_timebase_update(void)
+{
+	u64 ticks, mono_ns;
+
+	rtos_timebase_sample(&ticks, &mono_ns);
+
+	WRITE_ONCE(tb_shm->seq, tb_shm->seq + 1);
+	wmb();
+	tb_shm->offset_ns = mono_ns -
+		mul_u64_u32_shr(ticks, tb_shm->mult, tb_shm->shift);
+	tb_shm->update_ticks = ticks;
+	tb_shm->update_mono_ns = mono_ns;
+	wmb();
+	WRITE_ONCE(tb_shm->seq, tb_shm->seq + 1);
+}
+
+static void rtos_timebase_work(struct work_struct *work)
+{
+	rtos_timebase_update();
+	schedule_delayed_work(&tb_work,
+			      msecs_to_jiffies(max(timebase_refresh_ms, 10U)));
+}
+
+int rtos_timebase_get(struct rtos_timebase_shm *tb)
+{
+	u32 seq;
+
+	if (!tb_shm)
+		return -ENODEV;
+
+	do {
+		seq = READ_ONCE(tb_shm->seq);
+		rmb();
+		*tb = *tb_shm;
+		rmb();
+	} while ((seq & 1) || seq != READ_ONCE(tb_shm->seq));
+
+	return 0;
+}
+EXPORT_SYMBOL(rtos_timebase_get);
+
+u64 rtos_timebase_ticks_to_mono_ns(u64 ticks)
+{
+	struct rtos_timebase_shm tb;
+
+	if (rtos_timebase_get(&tb))
+		return 0;
+
+	return mul_u64_u32_shr(ticks, tb.mult, tb.shift) + tb.offset_ns;
+}
+EXPORT_SYMBOL(rtos_timebase_ticks_to_mono_ns);
+
+/* RTOS microsecond timestamps, see timebase_now_us() on the RTOS side */
+u64 rtos_timebase_us_to_mono_ns(u64 rtos_us)
+{
+	if (!tb_shm)
+		return 0;
+
+	return rtos_timebase_ticks_to_mono_ns(mul_u64_u32_div(rtos_us,
+					      tb_shm->tick_hz, USEC_PER_SEC));
+}
+EXPORT_SYMBOL(rtos_timebase_us_to_mono_ns);
+
+/*
+ * 32 bit RTOS millisecond stamps such as ServoInfoBuffer.last_read_ms
+ * wrap after 49 days; the stamp is assumed to lie in the past, so the
+ * missing high bits are taken from the current counter.
+ */
+u64 rtos_timebase_ms_to_mono_ns(u32 rtos_ms)
+{
+	u64 now_ms, full_ms;
+
+	if (!tb_shm)
+		return 0;
+
+	now_ms = div_u64(get_cycles64(), div_u64(tb_shm->tick_hz, MSEC_PER_SEC));
+	full_ms = now_ms - (u32)((u32)now_ms - rtos_ms);
+
+	return rtos_timebase_us_to_mono_ns(full_ms * USEC_PER_MSEC);
+}
+EXPORT_SYMBOL(rtos_timebase_ms_to_mono_ns);
+
+int rtos_timebase_init(struct device *dev)
+{
+	cmdqu_t cmdq = { 0 };
+	int ret;
+
+	tb_shm = dma_alloc_coherent(dev, PAGE_SIZE, &tb_phys, GFP_KERNEL);
+	if (!tb_shm)
+		return -ENOMEM;
+	tb_dev = dev;
+
+	tb_shm->tick_hz = riscv_timebase;
+	clocks_calc_mult_shift(&tb_shm->mult, &tb_shm->shift, riscv_timebase,
+			       NSEC_PER_SEC, 3600);
+	tb_shm->seq = 0;
+	rtos_timebase_update();
+	tb_shm->magic = RTOS_TIMEBASE_MAGIC;
+
+	INIT_DELAYED_WORK(&tb_work, rtos_timebase_work);
+	schedule_delayed_work(&tb_work, msecs_to_jiffies(timebase_refresh_ms));
+
+	/* hand the page to the RTOS; it keeps reading it from then on */
+	cmdq.ip_id = RTOS_TIMEBASE_IP_ID;
+	cmdq.cmd_id = RTOS_TIMEBASE_CMD_ID;
+	cmdq.param_ptr = (unsigned int)tb_phys;
+	ret = rtos_cmdqu_send(&cmdq);
+	if (ret)
+		pr_warn("rtos timebase: page not sent to rtos (%d)\n", ret);
+
+	pr_info("rtos timebase: %lu Hz mult %u shift %u at %pad\n",
+		riscv_timebase, tb_shm->mult, tb_shm->shift, &tb_phys);
+
+	return 0;
+}
+
+void rtos_timebase_deinit(void)
+{
+	cmdqu_t cmdq = { 0 };
+
+	if (!tb_shm)
+		return;
+
+	cancel_delayed_work_sync(&tb_work);
+
+	/* a zero address tells the RTOS to stop reading the page */
+	cmdq.ip_id = RTOS_TIMEBASE_IP_ID;
+	cmdq.cmd_id = RTOS_TIMEBASE_CMD_ID;
+	rtos_cmdqu_send(&cmdq);
+	tb_shm->magic = 0;
+	dma_free_coherent(tb_dev, PAGE_SIZE, tb_shm, tb_phys);
+	tb_shm = NULL;
+}
@@ -0,0 +1,47 @@
+#ifndef __RTOS_TIMEBASE__
+#define __RTOS_TIMEBASE__
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+struct device;
+
+/*
+ * Linux and the RTOS both read the RISC-V time CSR, which counts the
+ * same always-on timer on both cores. RTOS timestamps are that counter
+ * in microseconds; linux keeps a mapping from counter ticks to
+ * CLOCK_MONOTONIC in a page shared with the RTOS:
+ *
+ *   mono_ns = ((ticks * mult) >> shift) + offset_ns
+ *
+ * The page is written by linux only, under a sequence count (odd while
+ * an update is in progress). The layout must match
+ * freertos/cvitek/driver/timebase/include/timebase.h.
+ */
+#define RTOS_TIMEBASE_MAGIC	0x54494d45	/* "TIME" */
+
+/* sent to the RTOS with the physical address of the page in param_ptr */
+#define RTOS_TIMEBASE_IP_ID	6	/* IP_SYSTEM */
+#define RTOS_TIMEBASE_CMD_ID	0x20
+
+struct rtos_timebase_shm {
+	__u32 magic;
+	__u32 seq;
+	__u64 tick_hz;
+	__u32 mult;
+	__u32 shift;
+	__s64 offset_ns;
+	__u64 update_ticks;
+	__u64 update_mono_ns;
+} __attribute__((aligned(64)));
+
+#define RTOS_CMDQU_GET_TIMEBASE	_IOR('r', 0x10, struct rtos_timebase_shm)
+
+int rtos_timebase_init(struct device *dev);
+void rtos_timebase_deinit(void);
+int rtos_timebase_get(struct rtos_timebase_shm *tb);
+u64 rtos_timebase_ticks_to_mono_ns(u64 ticks);
+u64 rtos_timebase_us_to_mono_ns(u64 rtos_us);
+u64 rtos_timebase_ms_to_mono_ns(u32 rtos_ms);
+
+#endif  // end of __RTOS_TIMEBASE__
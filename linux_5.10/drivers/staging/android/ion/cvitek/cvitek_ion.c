@@ -25,8 +25,13 @@
 #include <linux/dma-map-ops.h>
 #endif
 
+#include <linux/module.h>
+#include <linux/dma-buf.h>
+#include <linux/sort.h>
+
 #include "../ion.h"
 #include "../../uapi/ion_cvitek.h"
+#include "../../uapi/ion_cvitek_cache.h"
 
 struct ion_of_heap {
 	const char *compat;
@@ -278,6 +283,202 @@ exit:
 }
 #endif
 
+/*
+ * Above this many bytes in one batch a whole D-cache clean+invalidate is
+ * cheaper than walking the ranges line by line. 0 follows the break-even
+ * size the arch code measures at boot.
+ */
+static unsigned long cache_whole_threshold;
+module_param(cache_whole_threshold, ulong, 0644);
+MODULE_PARM_DESC(cache_whole_threshold, "batch size in bytes above which the whole D-cache is maintained, 0 for the arch default");
+
+#define CVITEK_CACHE_BATCH_MAX_RANGES	(CVITEK_CACHE_BATCH_MAX * 4)
+
+struct cvi_cache_range {
+	phys_addr_t start;
+	size_t size;
+	u32 op;
+};
+
+static int cvi_cache_range_cmp(const void *a, const void *b)
+{
+	const struct cvi_cache_range *ra = a, *rb = b;
+
+	if (ra->op != rb->op)
+		return ra->op < rb->op ? -1 : 1;
+	if (ra->start != rb->start)
+		return ra->start < rb->start ? -1 : 1;
+	return 0;
+}
+
+static bool cvi_ion_sync_whole_dcache(u64 bytes)
+{
+#if defined(__riscv)
+	unsigned long threshold = READ_ONCE(cache_whole_threshold) ?:
+				  thead_dcache_whole_threshold();
+
+	if (bytes != U64_MAX && (!threshold || bytes < threshold))
+		return false;
+	return thead_dcache_all(THEAD_DCACHE_FLUSH);
+#else
+	return false;
+#endif
+}
+
+/*
+ * Always a line walk: the whole-cache decision is cvi_ion_sync_whole_dcache()'s,
+ * on riscv arch_sync_dma_for_device() would take it again with its own
+ * threshold and turn a forced range into a whole-cache flush.
+ */
+static void cvi_ion_sync_range(phys_addr_t start, size_t size, u32 op)
+{
+#if defined(__riscv)
+	thead_dcache_range(start, size, (op == CVITEK_CACHE_OP_FLUSH) ?
+			   THEAD_DCACHE_CLEAN : THEAD_DCACHE_FLUSH);
+#else
+	enum dma_data_direction dir = (op == CVITEK_CACHE_OP_FLUSH) ?
+				      DMA_TO_DEVICE : DMA_FROM_DEVICE;
+
+#if defined(__arm__) || defined(__aarch64__)
+	__dma_map_area(phys_to_virt(start), size, dir);
+#else
+	arch_sync_dma_for_device(start, size, dir);
+#endif
+#endif
+}
+
+/* expand one batch entry into physical ranges, returns ranges added */
+static int cvi_cache_batch_resolve(struct cvitek_cache_batch_entry *entry,
+				   struct cvi_cache_range *ranges, int room)
+{
+	struct ion_buffer *buffer;
+	struct dma_buf *dmabuf;
+	struct scatterlist *sg;
+	u64 skip = entry->offset, len = entry->len;
+	u64 chunk;
+	int i, n = 0;
+
+	if (entry->op != CVITEK_CACHE_OP_FLUSH &&
+	    entry->op != CVITEK_CACHE_OP_INVALIDATE)
+		return -EINVAL;
+
+	if (entry->fd < 0) {
+		if (!len || !room)
+			return len ? -E2BIG : -EINVAL;
+		ranges[0].start = entry->paddr + entry->offset;
+		ranges[0].size = len;
+		ranges[0].op = entry->op;
+		return 1;
+	}
+
+	dmabuf = dma_buf_get(entry->fd);
+	if (IS_ERR(dmabuf))
+		return PTR_ERR(dmabuf);
+
+	buffer = ion_dma_buf_to_buffer(dmabuf);
+	if (IS_ERR(buffer) || skip >= buffer->size) {
+		n = -EINVAL;
+		goto out;
+	}
+	if (!len || len > buffer->size - skip)
+		len = buffer->size - skip;
+
+	for_each_sgtable_sg(buffer->sg_table, sg, i) {
+		if (!len)
+			break;
+		if (skip >= sg->length) {
+			skip -= sg->length;
+			continue;
+		}
+		if (n >= room) {
+			n = -E2BIG;
+			goto out;
+		}
+		chunk = min_t(u64, sg->length - skip, len);
+		ranges[n].start = sg_phys(sg) + skip;
+		ranges[n].size = chunk;
+		ranges[n].op = entry->op;
+		len -= chunk;
+		skip = 0;
+		n++;
+	}
+out:
+	dma_buf_put(dmabuf);
+	return n;
+}
+
+static long cvitek_ion_cache_batch(struct cvitek_cache_batch *batch)
+{
+	struct cvitek_cache_batch_entry *entries;
+	struct cvi_cache_range *ranges;
+	bool whole = false;
+	u64 bytes = 0;
+	int i, n = 0, ret;
+
+	if (!batch->count || batch->count > CVITEK_CACHE_BATCH_MAX)
+		return -EINVAL;
+
+	entries = kmalloc_array(batch->count, sizeof(*entries), GFP_KERNEL);
+	ranges = kmalloc_array(CVITEK_CACHE_BATCH_MAX_RANGES, sizeof(*ranges),
+			       GFP_KERNEL);
+	if (!entries || !ranges) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	if (copy_from_user(entries, u64_to_user_ptr(batch->entries),
+			   batch->count * sizeof(*entries))) {
+		ret = -EFAULT;
+		goto out;
+	}
+
+	for (i = 0; i < batch->count; i++) {
+		ret = cvi_cache_batch_resolve(&entries[i], &ranges[n],
+					      CVITEK_CACHE_BATCH_MAX_RANGES - n);
+		if (ret < 0)
+			goto out;
+		n += ret;
+	}
+
+	/* merge overlapping or adjacent ranges of the same operation */
+	sort(ranges, n, sizeof(*ranges), cvi_cache_range_cmp, NULL);
+	for (i = 1, ret = 0; i < n; i++) {
+		struct cvi_cache_range *cur = &ranges[ret];
+
+		if (ranges[i].op == cur->op &&
+		    ranges[i].start <= cur->start + cur->size) {
+			cur->size = max_t(phys_addr_t, cur->start + cur->size,
+					  ranges[i].start + ranges[i].size) -
+				    cur->start;
+		} else {
+			ranges[++ret] = ranges[i];
+		}
+	}
+	n = n ? ret + 1 : 0;
+
+	for (i = 0; i < n; i++)
+		bytes += ranges[i].size;
+
+	if (!(batch->flags & CVITEK_CACHE_BATCH_FORCE_RANGE))
+		whole = cvi_ion_sync_whole_dcache(
+			batch->flags & CVITEK_CACHE_BATCH_FORCE_WHOLE ?
+			U64_MAX : bytes);
+
+	if (!whole)
+		for (i = 0; i < n; i++)
+			cvi_ion_sync_range(ranges[i].start, ranges[i].size,
+					   ranges[i].op);
+
+	batch->nr_ranges = n;
+	batch->whole = whole;
+	batch->bytes = bytes;
+	ret = 0;
+out:
+	kfree(ranges);
+	kfree(entries);
+	return ret;
+}
+
 long cvitek_ion_ioctl(struct ion_device *dev, unsigned int cmd, unsigned long arg)
 {
 	long ret = 0;
@@ -393,6 +594,21 @@ long cvitek_ion_ioctl(struct ion_device *dev, unsigned int cmd, unsigned long ar
 #endif
 		break;
 	}
+	case ION_IOC_CVITEK_CACHE_BATCH:
+	{
+		struct cvitek_cache_batch data;
+
+		if (copy_from_user(&data, (void __user *)arg, sizeof(data)))
+			return -EFAULT;
+
+		ret = cvitek_ion_cache_batch(&data);
+		if (ret)
+			return ret;
+
+		if (copy_to_user((void __user *)arg, &data, sizeof(data)))
+			return -EFAULT;
+		break;
+	}
 	default:
 		pr_debug("cvitek_ion_ioctl fail cmd=%x\n", cmd);
 		return -ENOTTY;
@@ -466,6 +682,8 @@ show_heap:
 		if (!ipdev->idev) {
 			ipdev->idev = ipdev->heaps[i]->dev;
 			ipdev->idev->custom_ioctl = cvitek_ion_ioctl;
+			if (cvi_ion_recycle_init(ipdev->idev))
+				dev_warn(dev, "ion recycle shrinker register fail\n");
 		}
 		dev_info(dev, "[ion] add heap id %d, type %d, base 0x%llx, size 0x%lx\n",
 			 ipdev->heaps[i]->id, ipdev->heaps[i]->type,
@@ -8,6 +8,11 @@
 #include <linux/vmalloc.h>
 #include <linux/mm.h>
 #include <linux/uaccess.h>
+#include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/shrinker.h>
+#include <linux/workqueue.h>
 
 #include "../ion.h"
 #include "cvitek_ion_alloc.h"
@@ -19,6 +24,248 @@ struct cvi_ion_alloc_info {
 	struct ion_buffer *buf;
 };
 
+/*
+ * Recycling cache for buffers allocated with ION_FLAG_CVITEK_RECYCLE.
+ * Freed buffers are parked on an LRU list instead of going back to the
+ * heap, and handed out again to the next allocation with the same size,
+ * flags and a matching heap. A reused buffer is cleared before it is handed
+ * out, so what is saved is the heap allocation and the sg_table setup.
+ * Parked buffers do not count in the heap's num_of_alloc_bytes, are dropped
+ * after recycle_max_age_ms and on memory pressure.
+ */
+static unsigned long recycle_max_bytes = SZ_4M;
+module_param(recycle_max_bytes, ulong, 0644);
+MODULE_PARM_DESC(recycle_max_bytes, "upper bound of memory parked in the ion recycle cache");
+
+static unsigned int recycle_max_age_ms = 2000;
+module_param(recycle_max_age_ms, uint, 0644);
+MODULE_PARM_DESC(recycle_max_age_ms, "time a buffer stays in the ion recycle cache");
+
+struct cvi_ion_recycle {
+	struct mutex lock;
+	struct list_head lru;
+	size_t bytes;
+	unsigned int count;
+	u64 hits;
+	u64 misses;
+	u64 evicts;
+	struct shrinker shrinker;
+	struct delayed_work aging;
+};
+
+static struct cvi_ion_recycle recycle = {
+	.lock = __MUTEX_INITIALIZER(recycle.lock),
+	.lru = LIST_HEAD_INIT(recycle.lru),
+};
+
+/* parked memory is free as far as the heap usage stats are concerned */
+static void cvi_ion_recycle_account(struct ion_buffer *buffer, bool parked)
+{
+	spin_lock(&buffer->heap->stat_lock);
+	if (parked)
+		buffer->heap->num_of_alloc_bytes -= buffer->size;
+	else
+		buffer->heap->num_of_alloc_bytes += buffer->size;
+	spin_unlock(&buffer->heap->stat_lock);
+}
+
+struct ion_buffer *cvi_ion_recycle_get(size_t len, unsigned int heap_id_mask,
+				       unsigned int flags)
+{
+	struct ion_buffer *buffer;
+
+	mutex_lock(&recycle.lock);
+	list_for_each_entry(buffer, &recycle.lru, list) {
+		if (buffer->size == len && buffer->flags == flags &&
+		    ((1 << buffer->heap->id) & heap_id_mask)) {
+			list_del(&buffer->list);
+			recycle.bytes -= buffer->size;
+			recycle.count--;
+			recycle.hits++;
+			mutex_unlock(&recycle.lock);
+
+			cvi_ion_recycle_account(buffer, false);
+			/* never hand out what another user left behind */
+			if (ion_heap_buffer_zero(buffer)) {
+				ion_buffer_destroy(buffer);
+				return NULL;
+			}
+			return buffer;
+		}
+	}
+	recycle.misses++;
+	mutex_unlock(&recycle.lock);
+
+	return NULL;
+}
+
+/*
+ * oldest entries sit at the tail; drop them until bytes are freed and
+ * everything older than the age limit is gone. Called with recycle.lock held.
+ */
+static size_t cvi_ion_recycle_evict(size_t bytes, struct list_head *victims)
+{
+	unsigned long max_age = msecs_to_jiffies(READ_ONCE(recycle_max_age_ms));
+	struct ion_buffer *buffer;
+	size_t freed = 0;
+
+	while (!list_empty(&recycle.lru)) {
+		buffer = list_last_entry(&recycle.lru, struct ion_buffer, list);
+		if (freed >= bytes &&
+		    time_before(jiffies, buffer->recycle_jiffies + max_age))
+			break;
+		list_move(&buffer->list, victims);
+		recycle.bytes -= buffer->size;
+		recycle.count--;
+		recycle.evicts++;
+		freed += buffer->size;
+	}
+
+	return freed;
+}
+
+static void cvi_ion_recycle_destroy(struct list_head *victims)
+{
+	struct ion_buffer *buffer, *tmp;
+
+	list_for_each_entry_safe(buffer, tmp, victims, list) {
+		list_del(&buffer->list);
+		cvi_ion_recycle_account(buffer, false);
+		ion_buffer_destroy(buffer);
+	}
+}
+
+static void cvi_ion_recycle_aging(struct work_struct *work)
+{
+	LIST_HEAD(victims);
+	bool again;
+
+	mutex_lock(&recycle.lock);
+	cvi_ion_recycle_evict(0, &victims);
+	again = !list_empty(&recycle.lru);
+	mutex_unlock(&recycle.lock);
+
+	cvi_ion_recycle_destroy(&victims);
+
+	if (again)
+		schedule_delayed_work(&recycle.aging,
+				      msecs_to_jiffies(READ_ONCE(recycle_max_age_ms)));
+}
+
+bool cvi_ion_recycle_put(struct ion_buffer *buffer)
+{
+	LIST_HEAD(victims);
+
+	if (buffer->kmap_cnt || !list_empty(&buffer->attachments) ||
+	    buffer->size > recycle_max_bytes)
+		return false;
+
+	if (buffer->name) {
+		vfree(buffer->name);
+		buffer->name = NULL;
+	}
+
+	cvi_ion_recycle_account(buffer, true);
+	buffer->recycle_jiffies = jiffies;
+
+	mutex_lock(&recycle.lock);
+	cvi_ion_recycle_evict(recycle.bytes + buffer->size > recycle_max_bytes ?
+			      recycle.bytes + buffer->size - recycle_max_bytes : 0,
+			      &victims);
+	list_add(&buffer->list, &recycle.lru);
+	recycle.bytes += buffer->size;
+	recycle.count++;
+	mutex_unlock(&recycle.lock);
+
+	cvi_ion_recycle_destroy(&victims);
+	/* no-op while a pass is already pending */
+	schedule_delayed_work(&recycle.aging,
+			      msecs_to_jiffies(READ_ONCE(recycle_max_age_ms)));
+
+	return true;
+}
+
+size_t cvi_ion_recycle_drain(size_t bytes)
+{
+	LIST_HEAD(victims);
+	size_t freed;
+
+	mutex_lock(&recycle.lock);
+	freed = cvi_ion_recycle_evict(bytes, &victims);
+	mutex_unlock(&recycle.lock);
+
+	cvi_ion_recycle_destroy(&victims);
+
+	return freed;
+}
+
+static unsigned long cvi_ion_recycle_count(struct shrinker *shrinker,
+					   struct shrink_control *sc)
+{
+	return READ_ONCE(recycle.bytes) >> PAGE_SHIFT;
+}
+
+static unsigned long cvi_ion_recycle_scan(struct shrinker *shrinker,
+					  struct shrink_control *sc)
+{
+	return cvi_ion_recycle_drain(sc->nr_to_scan << PAGE_SHIFT) >> PAGE_SHIFT;
+}
+
+static int cvi_ion_recycle_show(struct seq_file *s, void *unused)
+{
+	u64 lookups, rate = 0;
+
+	mutex_lock(&recycle.lock);
+	lookups = recycle.hits + recycle.misses;
+	if (lookups) {
+		rate = recycle.hits * 100;
+		do_div(rate, lookups);
+	}
+	seq_printf(s, "cached:%u buffers %zu bytes, limit %lu bytes %u ms\n",
+		   recycle.count, recycle.bytes, recycle_max_bytes,
+		   recycle_max_age_ms);
+	seq_printf(s, "hits:%llu misses:%llu hit rate:%llu%% evicts:%llu\n",
+		   recycle.hits, recycle.misses, rate, recycle.evicts);
+	mutex_unlock(&recycle.lock);
+
+	return 0;
+}
+
+static int cvi_ion_recycle_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, cvi_ion_recycle_show, inode->i_private);
+}
+
+/* any write drops every cached buffer */
+static ssize_t cvi_ion_recycle_write(struct file *file, const char __user *buf,
+				     size_t count, loff_t *ppos)
+{
+	cvi_ion_recycle_drain(SIZE_MAX);
+
+	return count;
+}
+
+static const struct file_operations cvi_ion_recycle_fops = {
+	.open = cvi_ion_recycle_open,
+	.read = seq_read,
+	.write = cvi_ion_recycle_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+int cvi_ion_recycle_init(struct ion_device *dev)
+{
+	recycle.shrinker.count_objects = cvi_ion_recycle_count;
+	recycle.shrinker.scan_objects = cvi_ion_recycle_scan;
+	recycle.shrinker.seeks = DEFAULT_SEEKS;
+	INIT_DELAYED_WORK(&recycle.aging, cvi_ion_recycle_aging);
+
+	debugfs_create_file("cvi_recycle", 0644, dev->debug_root, NULL,
+			    &cvi_ion_recycle_fops);
+
+	return register_shrinker(&recycle.shrinker);
+}
+
 int _cvi_ion_alloc(enum ion_heap_type type, size_t len, bool mmap_cache, struct cvi_ion_alloc_info *ion_alloc_info)
 {
 	struct ion_heap_query query;
@@ -89,6 +336,25 @@ cvi_ion_alloc_nofd(enum ion_heap_type type, size_t len, bool mmap_cache)
 }
 EXPORT_SYMBOL(cvi_ion_alloc_nofd);
 
+/*
+ * Same as cvi_ion_alloc_nofd, but the buffer is recycled on free. Only for
+ * callers that do not rely on the buffer content being cleared.
+ */
+struct ion_buffer *
+cvi_ion_alloc_nofd_recycle(enum ion_heap_type type, size_t len, bool mmap_cache)
+{
+	int ret;
+	struct cvi_ion_alloc_info ion_alloc_info;
+
+	ret = _cvi_ion_alloc(type, len, mmap_cache, &ion_alloc_info);
+	if (ret)
+		return ERR_PTR(ret);
+
+	return ion_alloc_nofd(ion_alloc_info.len, ion_alloc_info.heap_id_mask,
+			      ion_alloc_info.flags | ION_FLAG_CVITEK_RECYCLE);
+}
+EXPORT_SYMBOL(cvi_ion_alloc_nofd_recycle);
+
 int cvi_ion_alloc(enum ion_heap_type type, size_t len, bool mmap_cache)
 {
 	int ret;
@@ -18,6 +18,8 @@ void cvi_ion_free(pid_t fd_pid, int fd);
 struct ion_buffer *
 cvi_ion_alloc_nofd(enum ion_heap_type type, size_t len, bool mmap_cache);
 void cvi_ion_free_nofd(struct ion_buffer *buffer);
+struct ion_buffer *
+cvi_ion_alloc_nofd_recycle(enum ion_heap_type type, size_t len, bool mmap_cache);
 
 void cvi_ion_dump(struct ion_heap *heap);
 
@@ -17,12 +17,6 @@
 #include <linux/genalloc.h>
 #include <linux/types.h>
 
-struct ion_carveout_heap {
-	struct ion_heap heap;
-	struct gen_pool *pool;
-	phys_addr_t base;
-};
-
 static inline size_t chunk_size(const struct gen_pool_chunk *chunk)
 {
 	return chunk->end_addr - chunk->start_addr + 1;
@@ -196,6 +190,62 @@ static int cvi_clear_peak(void *data, u64 val)
 }
 DEFINE_SIMPLE_ATTRIBUTE(heap_peak, cvi_get_peak, cvi_clear_peak, "%llu\n");
 
+#ifdef CONFIG_ION_CARVEOUT_HEAP
+static int cvi_ion_debug_frag_show(struct seq_file *s, void *unused)
+{
+	struct ion_heap *heap = s->private;
+	struct ion_carveout_frag_stats stats;
+	u64 frag_index = 0;
+	u64 tmp;
+	int i;
+
+	ion_carveout_heap_frag_stats(heap, &stats);
+
+	/* 0: all free memory is one extent, 1000: fully fragmented */
+	if (stats.free_bytes) {
+		tmp = stats.largest_free * 1000;
+		do_div(tmp, stats.free_bytes);
+		frag_index = 1000 - tmp;
+	}
+
+	seq_printf(s, "free bytes:%llu, largest free extent:%llu, free extents:%u\n",
+		   stats.free_bytes, stats.largest_free, stats.free_extents);
+	seq_printf(s, "fragmentation index:%llu/1000, class cached bytes:%llu\n",
+		   frag_index, stats.class_bytes);
+
+	seq_printf(s, "\n%16s %16s\n", "extent >= bytes", "count");
+	for (i = 0; i < ION_CARVEOUT_NR_ORDERS; i++)
+		seq_printf(s, "%16lu %16u\n", PAGE_SIZE << i, stats.extents[i]);
+
+	return 0;
+}
+
+static int cvi_ion_debug_frag_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, cvi_ion_debug_frag_show, inode->i_private);
+}
+
+/* any write returns the cached class blocks to the pool */
+static ssize_t cvi_ion_debug_frag_write(struct file *file,
+					const char __user *buf,
+					size_t count, loff_t *ppos)
+{
+	struct ion_heap *heap = ((struct seq_file *)file->private_data)->private;
+
+	ion_carveout_heap_drain_classes(heap);
+
+	return count;
+}
+
+static const struct file_operations debug_frag_fops = {
+	.open = cvi_ion_debug_frag_open,
+	.read = seq_read,
+	.write = cvi_ion_debug_frag_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+#endif
+
 void cvi_ion_create_debug_info(struct ion_heap *heap)
 {
 	struct dentry *debug_file;
@@ -254,4 +304,20 @@ void cvi_ion_create_debug_info(struct ion_heap *heap)
 		pr_err("Failed to create all_mem heap debugfs at %s/%s\n",
 			   path, debug_heap_name);
 	}
+
+#ifdef CONFIG_ION_CARVEOUT_HEAP
+	if (heap->type != ION_HEAP_TYPE_CARVEOUT)
+		return;
+
+	debug_file = debugfs_create_file("fragmentation", 0644,
+					 heap->heap_dfs_root, heap,
+					 &debug_frag_fops);
+	if (!debug_file) {
+		char buf[256], *path;
+
+		path = dentry_path(heap->heap_dfs_root, buf, 256);
+		pr_err("Failed to create fragmentation heap debugfs at %s/%s\n",
+			   path, debug_heap_name);
+	}
+#endif
 }
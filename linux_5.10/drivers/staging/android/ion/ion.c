@@ -159,6 +159,12 @@ static void _ion_buffer_destroy(struct ion_buffer *buffer)
 	rb_erase(&buffer->node, &dev->buffers);
 	mutex_unlock(&dev->buffer_lock);
 
+#ifdef CONFIG_ION_CVITEK
+	if ((buffer->flags & ION_FLAG_CVITEK_RECYCLE) &&
+	    cvi_ion_recycle_put(buffer))
+		return;
+#endif
+
 	if (heap->flags & ION_HEAP_FLAG_DEFER_FREE)
 		ion_heap_freelist_add(heap, buffer);
 	else
@@ -456,11 +462,39 @@ static const struct dma_buf_ops dma_buf_ops = {
 };
 
 #ifdef CONFIG_ION_CVITEK
+struct ion_buffer *ion_dma_buf_to_buffer(struct dma_buf *dmabuf)
+{
+	if (dmabuf->ops != &dma_buf_ops)
+		return ERR_PTR(-EINVAL);
+
+	return dmabuf->priv;
+}
+
+static struct ion_buffer *_ion_alloc_heaps(struct ion_device *dev, size_t len,
+					   unsigned int heap_id_mask,
+					   unsigned int flags)
+{
+	struct ion_buffer *buffer = NULL;
+	struct ion_heap *heap;
+
+	down_read(&dev->lock);
+	plist_for_each_entry(heap, &dev->heaps, node) {
+		/* if the caller didn't specify this heap id */
+		if (!((1 << heap->id) & heap_id_mask))
+			continue;
+		buffer = ion_buffer_create(heap, dev, len, flags);
+		if (!IS_ERR(buffer))
+			break;
+	}
+	up_read(&dev->lock);
+
+	return buffer;
+}
+
 static void *_ion_alloc(size_t len, unsigned int heap_id_mask, unsigned int flags)
 {
 	struct ion_device *dev = internal_dev;
 	struct ion_buffer *buffer;
-	struct ion_heap *heap;
 
 	pr_debug("%s: len %zu heap_id_mask %u flags %x\n", __func__,
 		 len, heap_id_mask, flags);
@@ -475,16 +509,20 @@ static void *_ion_alloc(size_t len, unsigned int heap_id_mask, unsigned int flag
 	if (!len)
 		return ERR_PTR(-EINVAL);
 
-	down_read(&dev->lock);
-	plist_for_each_entry(heap, &dev->heaps, node) {
-		/* if the caller didn't specify this heap id */
-		if (!((1 << heap->id) & heap_id_mask))
-			continue;
-		buffer = ion_buffer_create(heap, dev, len, flags);
-		if (!IS_ERR(buffer))
-			break;
+	if (flags & ION_FLAG_CVITEK_RECYCLE) {
+		buffer = cvi_ion_recycle_get(len, heap_id_mask, flags);
+		if (buffer) {
+			mutex_lock(&dev->buffer_lock);
+			ion_buffer_add(dev, buffer);
+			mutex_unlock(&dev->buffer_lock);
+			return buffer;
+		}
 	}
-	up_read(&dev->lock);
+
+	buffer = _ion_alloc_heaps(dev, len, heap_id_mask, flags);
+	/* recycled buffers still hold heap memory, give it back and retry */
+	if (IS_ERR(buffer) && cvi_ion_recycle_drain(SIZE_MAX))
+		buffer = _ion_alloc_heaps(dev, len, heap_id_mask, flags);
 
 	if (!buffer)
 		return ERR_PTR(-ENODEV);
@@ -79,6 +79,7 @@ struct ion_buffer {
 #ifdef CONFIG_ION_CVITEK
 	phys_addr_t paddr;
 	const char *name;
+	unsigned long recycle_jiffies;
 #endif
 };
 
@@ -348,6 +349,72 @@ static inline struct ion_heap
 	return ERR_PTR(-EINVAL);
 }
 #endif
+
+/**
+ * carveout size classes - small carveout allocations are rounded up to
+ * (PAGE_SIZE << order) and recycled through per-order free lists, so
+ * that short-lived small buffers do not punch holes into the regions
+ * used by large frame buffers.
+ */
+#define ION_CARVEOUT_NR_CLASSES		6
+#define ION_CARVEOUT_NR_ORDERS		16
+
+/**
+ * struct ion_carveout_class - free list of one carveout size class
+ * @free:		cached free blocks of (PAGE_SIZE << order) bytes
+ * @count:		number of blocks on @free
+ * @hits:		allocations served from @free
+ * @misses:		allocations that had to go to the gen_pool
+ */
+struct ion_carveout_class {
+	struct list_head free;
+	unsigned int count;
+	u64 hits;
+	u64 misses;
+};
+
+/**
+ * struct ion_carveout_heap - carveout heap backed by a gen_pool
+ * @heap:		the ion heap
+ * @pool:		gen_pool managing the carveout
+ * @base:		physical base address of the carveout
+ * @class_lock:		protects @classes and @class_bytes
+ * @classes:		per-order free lists for small allocations
+ * @class_bytes:	bytes currently cached on the class free lists
+ * @class_limit:	upper bound for @class_bytes
+ */
+struct ion_carveout_heap {
+	struct ion_heap heap;
+	struct gen_pool *pool;
+	phys_addr_t base;
+	spinlock_t class_lock;
+	struct ion_carveout_class classes[ION_CARVEOUT_NR_CLASSES];
+	size_t class_bytes;
+	size_t class_limit;
+};
+
+/**
+ * struct ion_carveout_frag_stats - carveout fragmentation snapshot
+ * @free_bytes:		bytes free in the gen_pool
+ * @largest_free:	largest contiguous free extent in bytes
+ * @free_extents:	number of free extents
+ * @extents:		free extents per order (PAGE_SIZE << order),
+ *			the last entry also counts all larger extents
+ * @class_bytes:	bytes parked on the class free lists
+ */
+struct ion_carveout_frag_stats {
+	u64 free_bytes;
+	u64 largest_free;
+	u32 free_extents;
+	u32 extents[ION_CARVEOUT_NR_ORDERS];
+	u64 class_bytes;
+};
+
+#ifdef CONFIG_ION_CARVEOUT_HEAP
+void ion_carveout_heap_frag_stats(struct ion_heap *heap,
+				  struct ion_carveout_frag_stats *stats);
+size_t ion_carveout_heap_drain_classes(struct ion_heap *heap);
+#endif
 /** ion_page_pool_shrink - shrinks the size of the memory cached in the pool
  * @pool:		the pool
  * @gfp_mask:		the memory type to reclaim
@@ -367,6 +434,20 @@ void ion_free(pid_t fd_pid, int fd);
 void ion_free_nofd(struct ion_buffer *buffer);
 int ion_buf_begin_cpu_access(struct ion_buffer *buffer);
 int ion_buf_end_cpu_access(struct ion_buffer *buffer);
+struct ion_buffer *ion_dma_buf_to_buffer(struct dma_buf *dmabuf);
+
+/*
+ * Allocation flag: on free the buffer is parked in the recycle cache and
+ * handed, cleared, to the next allocation of the same size and flags.
+ * Mirrors the value exported to userspace.
+ */
+#define ION_FLAG_CVITEK_RECYCLE BIT(16)
+
+struct ion_buffer *cvi_ion_recycle_get(size_t len, unsigned int heap_id_mask,
+				       unsigned int flags);
+bool cvi_ion_recycle_put(struct ion_buffer *buffer);
+size_t cvi_ion_recycle_drain(size_t bytes);
+int cvi_ion_recycle_init(struct ion_device *dev);
 
 #ifdef CONFIG_ION_CARVEOUT_HEAP
 struct ion_heap *ion_carveout_heap_create(struct ion_platform_heap *heap_data);
@@ -11,26 +11,184 @@
 #include <linux/io.h>
 #include <linux/mm.h>
 #include <linux/scatterlist.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
 #include <linux/of.h>
 #include "ion.h"
 
 #define ION_CARVEOUT_ALLOCATE_FAIL	-1
+/* at most 1/16 of the carveout may sit on the class free lists */
+#define ION_CARVEOUT_CLASS_LIMIT_SHIFT	4
 
-struct ion_carveout_heap {
-	struct ion_heap heap;
-	struct gen_pool *pool;
-	phys_addr_t base;
+struct ion_carveout_block {
+	struct list_head list;
+	phys_addr_t paddr;
 };
 
+static int ion_carveout_class_order(unsigned long size)
+{
+	int order = get_order(size);
+
+	return order < ION_CARVEOUT_NR_CLASSES ? order : -1;
+}
+
+/*
+ * Best fit, but small blocks are packed from the bottom of the carveout
+ * and large blocks from the top. Keeping the two populations apart lets
+ * freed frame buffers coalesce into large extents again instead of being
+ * pinned apart by small long-lived buffers.
+ */
+static unsigned long ion_carveout_class_fit(unsigned long *map,
+					    unsigned long size,
+					    unsigned long start,
+					    unsigned int nr, void *data,
+					    struct gen_pool *pool,
+					    unsigned long start_addr)
+{
+	unsigned long small_nr = (unsigned long)data;
+	bool top_down = nr > small_nr;
+	unsigned long start_bit = size;
+	unsigned long len = size + 1;
+	unsigned long index, next_bit;
+
+	index = bitmap_find_next_zero_area(map, size, start, nr, 0);
+
+	while (index < size) {
+		next_bit = find_next_bit(map, size, index + nr);
+		if ((next_bit - index) < len ||
+		    (top_down && (next_bit - index) == len)) {
+			len = next_bit - index;
+			start_bit = top_down ? next_bit - nr : index;
+			if (len == nr && !top_down)
+				return start_bit;
+		}
+		index = bitmap_find_next_zero_area(map, size,
+						   next_bit + 1, nr, 0);
+	}
+
+	return start_bit;
+}
+
+static bool ion_carveout_class_put(struct ion_carveout_heap *carveout_heap,
+				   phys_addr_t paddr, int order)
+{
+	struct ion_carveout_class *class = &carveout_heap->classes[order];
+	struct ion_carveout_block *block;
+	size_t size = PAGE_SIZE << order;
+
+	block = kmalloc(sizeof(*block), GFP_KERNEL);
+	if (!block)
+		return false;
+	block->paddr = paddr;
+
+	spin_lock(&carveout_heap->class_lock);
+	if (carveout_heap->class_bytes + size > carveout_heap->class_limit) {
+		spin_unlock(&carveout_heap->class_lock);
+		kfree(block);
+		return false;
+	}
+	/* lowest addresses first, they are the ones we want to keep busy */
+	if (list_empty(&class->free) ||
+	    paddr < list_first_entry(&class->free, struct ion_carveout_block,
+				     list)->paddr)
+		list_add(&block->list, &class->free);
+	else
+		list_add_tail(&block->list, &class->free);
+	class->count++;
+	carveout_heap->class_bytes += size;
+	spin_unlock(&carveout_heap->class_lock);
+
+	return true;
+}
+
+static phys_addr_t ion_carveout_class_get(struct ion_carveout_heap *carveout_heap,
+					  int order)
+{
+	struct ion_carveout_class *class = &carveout_heap->classes[order];
+	struct ion_carveout_block *block;
+	phys_addr_t paddr;
+
+	spin_lock(&carveout_heap->class_lock);
+	block = list_first_entry_or_null(&class->free,
+					 struct ion_carveout_block, list);
+	if (!block) {
+		class->misses++;
+		spin_unlock(&carveout_heap->class_lock);
+		return ION_CARVEOUT_ALLOCATE_FAIL;
+	}
+	list_del(&block->list);
+	class->count--;
+	class->hits++;
+	carveout_heap->class_bytes -= PAGE_SIZE << order;
+	spin_unlock(&carveout_heap->class_lock);
+
+	paddr = block->paddr;
+	kfree(block);
+
+	return paddr;
+}
+
+/* give every cached class block back to the gen_pool, returns bytes freed */
+static size_t ion_carveout_class_drain(struct ion_carveout_heap *carveout_heap)
+{
+	struct ion_carveout_block *block, *tmp;
+	struct list_head blocks[ION_CARVEOUT_NR_CLASSES];
+	size_t freed;
+	int order;
+
+	spin_lock(&carveout_heap->class_lock);
+	for (order = 0; order < ION_CARVEOUT_NR_CLASSES; order++) {
+		INIT_LIST_HEAD(&blocks[order]);
+		list_splice_init(&carveout_heap->classes[order].free,
+				 &blocks[order]);
+		carveout_heap->classes[order].count = 0;
+	}
+	freed = carveout_heap->class_bytes;
+	carveout_heap->class_bytes = 0;
+	spin_unlock(&carveout_heap->class_lock);
+
+	for (order = 0; order < ION_CARVEOUT_NR_CLASSES; order++) {
+		list_for_each_entry_safe(block, tmp, &blocks[order], list) {
+			gen_pool_free(carveout_heap->pool, block->paddr,
+				      PAGE_SIZE << order);
+			kfree(block);
+		}
+	}
+
+	return freed;
+}
+
+size_t ion_carveout_heap_drain_classes(struct ion_heap *heap)
+{
+	if (heap->type != ION_HEAP_TYPE_CARVEOUT)
+		return 0;
+
+	return ion_carveout_class_drain(container_of(heap,
+						     struct ion_carveout_heap,
+						     heap));
+}
+
 static phys_addr_t ion_carveout_allocate(struct ion_heap *heap,
 					 unsigned long size)
 {
 	struct ion_carveout_heap *carveout_heap =
 		container_of(heap, struct ion_carveout_heap, heap);
-	unsigned long offset = gen_pool_alloc(carveout_heap->pool, size);
+	int order = ion_carveout_class_order(size);
+	unsigned long offset;
+
+	if (order >= 0) {
+		phys_addr_t paddr = ion_carveout_class_get(carveout_heap, order);
+
+		if (paddr != ION_CARVEOUT_ALLOCATE_FAIL)
+			return paddr;
+		size = PAGE_SIZE << order;
+	}
 
+	offset = gen_pool_alloc(carveout_heap->pool, size);
+	/* cached class blocks may be what splits the extent we need */
+	if (!offset && ion_carveout_class_drain(carveout_heap))
+		offset = gen_pool_alloc(carveout_heap->pool, size);
 	if (!offset)
 		return ION_CARVEOUT_ALLOCATE_FAIL;
 
@@ -42,12 +200,90 @@ static void ion_carveout_free(struct ion_heap *heap, phys_addr_t addr,
 {
 	struct ion_carveout_heap *carveout_heap =
 		container_of(heap, struct ion_carveout_heap, heap);
+	int order;
 
 	if (addr == ION_CARVEOUT_ALLOCATE_FAIL)
 		return;
+
+	order = ion_carveout_class_order(size);
+	if (order >= 0) {
+		if (ion_carveout_class_put(carveout_heap, addr, order))
+			return;
+		size = PAGE_SIZE << order;
+	}
 	gen_pool_free(carveout_heap->pool, addr, size);
 }
 
+static inline size_t ion_carveout_chunk_size(const struct gen_pool_chunk *chunk)
+{
+	return chunk->end_addr - chunk->start_addr + 1;
+}
+
+void ion_carveout_heap_frag_stats(struct ion_heap *heap,
+				  struct ion_carveout_frag_stats *stats)
+{
+	struct ion_carveout_heap *carveout_heap =
+		container_of(heap, struct ion_carveout_heap, heap);
+	struct gen_pool *pool = carveout_heap->pool;
+	int order = pool->min_alloc_order;
+	struct gen_pool_chunk *chunk;
+	unsigned long nbits, start, end;
+	u64 len;
+	int idx;
+
+	memset(stats, 0, sizeof(*stats));
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(chunk, &pool->chunks, next_chunk) {
+		nbits = ion_carveout_chunk_size(chunk) >> order;
+		end = 0;
+		while (end < nbits) {
+			start = find_next_zero_bit(chunk->bits, nbits, end);
+			if (start >= nbits)
+				break;
+			end = find_next_bit(chunk->bits, nbits, start);
+			len = (u64)(end - start) << order;
+
+			stats->free_bytes += len;
+			stats->free_extents++;
+			if (len > stats->largest_free)
+				stats->largest_free = len;
+			idx = ilog2(len >> PAGE_SHIFT);
+			if (idx >= ION_CARVEOUT_NR_ORDERS)
+				idx = ION_CARVEOUT_NR_ORDERS - 1;
+			stats->extents[idx]++;
+		}
+	}
+	rcu_read_unlock();
+
+	spin_lock(&carveout_heap->class_lock);
+	stats->class_bytes = carveout_heap->class_bytes;
+	spin_unlock(&carveout_heap->class_lock);
+}
+
+static int ion_carveout_heap_debug_show(struct ion_heap *heap,
+					struct seq_file *s, void *unused)
+{
+	struct ion_carveout_heap *carveout_heap =
+		container_of(heap, struct ion_carveout_heap, heap);
+	struct ion_carveout_class *class;
+	int order;
+
+	spin_lock(&carveout_heap->class_lock);
+	for (order = 0; order < ION_CARVEOUT_NR_CLASSES; order++) {
+		class = &carveout_heap->classes[order];
+		seq_printf(s, "class order %d: %u cached %lu bytes, hits %llu misses %llu\n",
+			   order, class->count,
+			   (PAGE_SIZE << order) * class->count,
+			   class->hits, class->misses);
+	}
+	seq_printf(s, "class cache %zu of %zu bytes\n",
+		   carveout_heap->class_bytes, carveout_heap->class_limit);
+	spin_unlock(&carveout_heap->class_lock);
+
+	return 0;
+}
+
 static int ion_carveout_heap_allocate(struct ion_heap *heap,
 				      struct ion_buffer *buffer,
 				      unsigned long size,
@@ -137,7 +373,7 @@ void cvi_get_rtos_ion_size(size_t *psize)
 struct ion_heap *ion_carveout_heap_create(struct ion_platform_heap *heap_data)
 {
 	struct ion_carveout_heap *carveout_heap;
-	int ret;
+	int ret, order;
 
 	struct page *page;
 	size_t size;
@@ -178,12 +414,20 @@ struct ion_heap *ion_carveout_heap_create(struct ion_platform_heap *heap_data)
 		return ERR_PTR(-ENOMEM);
 	}
 
-	gen_pool_set_algo(carveout_heap->pool, gen_pool_best_fit, NULL);
+	/* class sized blocks are placed bottom-up, anything larger top-down */
+	gen_pool_set_algo(carveout_heap->pool, ion_carveout_class_fit,
+			  (void *)(1UL << (ION_CARVEOUT_NR_CLASSES - 1)));
+	spin_lock_init(&carveout_heap->class_lock);
+	for (order = 0; order < ION_CARVEOUT_NR_CLASSES; order++)
+		INIT_LIST_HEAD(&carveout_heap->classes[order].free);
+	carveout_heap->class_limit =
+		heap_data->size >> ION_CARVEOUT_CLASS_LIMIT_SHIFT;
 	carveout_heap->base = heap_data->base;
 	gen_pool_add(carveout_heap->pool, carveout_heap->base, heap_data->size,
 		     -1);
 	carveout_heap->heap.ops = &carveout_heap_ops;
 	carveout_heap->heap.type = ION_HEAP_TYPE_CARVEOUT;
+	carveout_heap->heap.debug_show = ion_carveout_heap_debug_show;
 #ifndef CONFIG_ION_CVITEK
 	carveout_heap->heap.flags = ION_HEAP_FLAG_DEFER_FREE;
 #endif
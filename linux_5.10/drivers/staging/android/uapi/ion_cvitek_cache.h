@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * Copyright (C) Cvitek Co., Ltd. 2019-2020. All rights reserved.
+ *
+ * File Name: ion_cvitek_cache.h
+ * Description: batched cache maintenance for ION buffers
+ */
+
+#ifndef _UAPI_LINUX_ION_CVITEK_CACHE_H
+#define _UAPI_LINUX_ION_CVITEK_CACHE_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define CVITEK_CACHE_OP_FLUSH		0
+#define CVITEK_CACHE_OP_INVALIDATE	1
+
+/* maximum number of entries in one batch */
+#define CVITEK_CACHE_BATCH_MAX		64
+
+/* flags of struct cvitek_cache_batch */
+#define CVITEK_CACHE_BATCH_FORCE_RANGE	(1 << 0)
+#define CVITEK_CACHE_BATCH_FORCE_WHOLE	(1 << 1)
+
+/**
+ * struct cvitek_cache_batch_entry - one range of a batch
+ * @fd:		ion buffer fd, or -1 to use @paddr
+ * @op:		CVITEK_CACHE_OP_*
+ * @paddr:	physical address when @fd is -1
+ * @offset:	offset into the buffer (or from @paddr)
+ * @len:	length of the range, 0 means up to the end of the buffer
+ */
+struct cvitek_cache_batch_entry {
+	__s32 fd;
+	__u32 op;
+	__u64 paddr;
+	__u64 offset;
+	__u64 len;
+};
+
+/**
+ * struct cvitek_cache_batch - batch of cache maintenance operations
+ * @entries:	user pointer to an array of struct cvitek_cache_batch_entry
+ * @count:	number of entries, at most CVITEK_CACHE_BATCH_MAX
+ * @flags:	CVITEK_CACHE_BATCH_*
+ * @nr_ranges:	returned, ranges left after merging
+ * @whole:	returned, 1 if a whole cache operation was used
+ * @bytes:	returned, total bytes covered by the merged ranges
+ */
+struct cvitek_cache_batch {
+	__u64 entries;
+	__u32 count;
+	__u32 flags;
+	__u32 nr_ranges;
+	__u32 whole;
+	__u64 bytes;
+};
+
+#define ION_IOC_CVITEK_CACHE_BATCH	_IOWR('I', 0x20, struct cvitek_cache_batch)
+
+#endif /* _UAPI_LINUX_ION_CVITEK_CACHE_H */
@@ -0,0 +1,143 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Time non-coherent DMA cache maintenance on T-Head RISC-V cores.
+ *
+ * For sizes from 64 B to 4 MiB the module dirties a buffer from the CPU
+ * and times the per-line range walk, the whole-cache op and the
+ * dma_sync_single_*() calls drivers use, which pick one of the two.
+ * The smallest size at which "whole" beats "range" is where the arch
+ * whole_threshold should sit; the value found at boot is printed first.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/dma-mapping.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/platform_device.h>
+#include <linux/sizes.h>
+#include <linux/string.h>
+#include <asm/cacheflush.h>
+
+#define MAX_SIZE	SZ_4M
+#define ITERS		16
+
+enum bench_path { RANGE, WHOLE, DMA_SYNC };
+
+static const char * const path_name[] = { "range", "whole", "dma_sync" };
+
+static void do_sync(struct device *dev, enum bench_path p, dma_addr_t dma,
+		    phys_addr_t phys, size_t size, enum dma_data_direction dir)
+{
+	enum thead_dcache_op op = dir == DMA_TO_DEVICE ?
+				  THEAD_DCACHE_CLEAN : THEAD_DCACHE_FLUSH;
+
+	switch (p) {
+	case RANGE:
+		thead_dcache_range(phys, size, op);
+		break;
+	case WHOLE:
+		thead_dcache_all(op);
+		break;
+	case DMA_SYNC:
+		dma_sync_single_for_device(dev, dma, size, dir);
+		if (dir != DMA_TO_DEVICE)
+			dma_sync_single_for_cpu(dev, dma, size, dir);
+		break;
+	}
+}
+
+/* average ns per sync of @size freshly dirtied bytes */
+static u64 bench_one(struct device *dev, enum bench_path p, void *buf,
+		     dma_addr_t dma, size_t size, enum dma_data_direction dir)
+{
+	u64 total = 0, t0;
+	int i;
+
+	for (i = 0; i < ITERS; i++) {
+		memset(buf, i, size);
+		t0 = ktime_get_ns();
+		do_sync(dev, p, dma, virt_to_phys(buf), size, dir);
+		total += ktime_get_ns() - t0;
+	}
+
+	return div_u64(total, ITERS);
+}
+
+static void bench_dir(struct device *dev, void *buf, dma_addr_t dma,
+		      enum dma_data_direction dir)
+{
+	bool whole = thead_dcache_all(THEAD_DCACHE_FLUSH);
+	u64 ns[3];
+	size_t size;
+	int p;
+
+	for (size = 64; size <= MAX_SIZE; size *= 4) {
+		for (p = RANGE; p <= DMA_SYNC; p++)
+			ns[p] = p == WHOLE && !whole ? 0 :
+				bench_one(dev, p, buf, dma, size, dir);
+
+		pr_info("%-9s %8zu: %s %8llu ns, %s %8llu ns, %s %8llu ns\n",
+			dir == DMA_TO_DEVICE ? "to_device" : "bidir", size,
+			path_name[RANGE], ns[RANGE], path_name[WHOLE], ns[WHOLE],
+			path_name[DMA_SYNC], ns[DMA_SYNC]);
+		cond_resched();
+	}
+}
+
+static int __init test_dma_cache_init(void)
+{
+	struct platform_device *pdev;
+	struct device *dev;
+	struct page *page;
+	dma_addr_t dma;
+	void *buf;
+	int ret;
+
+	pr_info("whole D-cache threshold %zu bytes%s\n",
+		thead_dcache_whole_threshold(),
+		thead_dcache_all(THEAD_DCACHE_FLUSH) ? "" :
+		", whole-cache op not available");
+
+	pdev = platform_device_register_simple(KBUILD_MODNAME, -1, NULL, 0);
+	if (IS_ERR(pdev))
+		return PTR_ERR(pdev);
+	dev = &pdev->dev;
+
+	ret = dma_coerce_mask_and_coherent(dev, DMA_BIT_MASK(64));
+	if (ret)
+		goto out_unregister;
+
+	ret = -ENOMEM;
+	page = alloc_pages(GFP_KERNEL, get_order(MAX_SIZE));
+	if (!page)
+		goto out_unregister;
+	buf = page_address(page);
+
+	dma = dma_map_single(dev, buf, MAX_SIZE, DMA_BIDIRECTIONAL);
+	if (dma_mapping_error(dev, dma))
+		goto out_free;
+
+	bench_dir(dev, buf, dma, DMA_TO_DEVICE);
+	bench_dir(dev, buf, dma, DMA_BIDIRECTIONAL);
+
+	dma_unmap_single(dev, dma, MAX_SIZE, DMA_BIDIRECTIONAL);
+	ret = 0;
+out_free:
+	__free_pages(page, get_order(MAX_SIZE));
+out_unregister:
+	platform_device_unregister(pdev);
+
+	return ret;
+}
+
+module_init(test_dma_cache_init);
+
+static void __exit test_dma_cache_exit(void)
+{
+}
+
+module_exit(test_dma_cache_exit);
+
+MODULE_DESCRIPTION("T-Head non-coherent DMA cache maintenance benchmark");
+MODULE_LICENSE("GPL");
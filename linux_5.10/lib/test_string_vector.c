@@ -0,0 +1,294 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Compare the scalar and the RVV string routines on RISC-V.
+ *
+ * For every size and (destination, source) misalignment the module times
+ * the scalar routine, the raw vector routine including the vector context
+ * save, and the memcpy()/memset()/copy_to_user() entry points that pick
+ * one of the two at run time. Results are checked against the scalar
+ * copy and reported in MB/s; loading fails if any of them differ.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/ktime.h>
+#include <linux/mman.h>
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/sizes.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <asm/vector.h>
+
+#define MAX_SIZE	SZ_1M
+#define MIN_BYTES	SZ_8M	/* moved per measurement, at least */
+
+static const size_t sizes[] = {
+	64, 256, 1024, 4096, 16384, 65536, 262144, MAX_SIZE,
+};
+
+static const struct {
+	unsigned int dst, src;
+} aligns[] = {
+	{ 0, 0 }, { 1, 0 }, { 0, 3 }, { 7, 5 },
+};
+
+static unsigned int loops_for(size_t size)
+{
+	return max_t(size_t, MIN_BYTES / size, 4);
+}
+
+static u64 mbps(size_t size, unsigned int loops, u64 ns)
+{
+	return div64_u64((u64)size * loops * NSEC_PER_SEC, (ns ?: 1) * SZ_1M);
+}
+
+enum path { SCALAR, VECTOR, DISPATCH };
+
+static void do_memcpy(enum path p, void *dst, const void *src, size_t n)
+{
+	switch (p) {
+	case SCALAR:
+		__memcpy(dst, src, n);
+		break;
+#ifdef RISCV_VECTOR_STRING
+	case VECTOR:
+		kernel_vector_begin();
+		__memcpy_vector(dst, src, n);
+		kernel_vector_end();
+		break;
+#endif
+	default:
+		memcpy(dst, src, n);
+		break;
+	}
+}
+
+static void do_memset(enum path p, void *s, size_t n)
+{
+	switch (p) {
+	case SCALAR:
+		__memset(s, 0x5a, n);
+		break;
+#ifdef RISCV_VECTOR_STRING
+	case VECTOR:
+		kernel_vector_begin();
+		__memset_vector(s, 0x5a, n);
+		kernel_vector_end();
+		break;
+#endif
+	default:
+		memset(s, 0x5a, n);
+		break;
+	}
+}
+
+static unsigned long do_copy_to_user(enum path p, void __user *to,
+				     const void *from, size_t n)
+{
+	unsigned long left;
+
+	switch (p) {
+	case SCALAR:
+		return __asm_copy_to_user(to, from, n);
+#ifdef RISCV_VECTOR_STRING
+	case VECTOR:
+		pagefault_disable();
+		kernel_vector_begin();
+		left = __asm_vector_usercopy((void __force *)to, from, n);
+		kernel_vector_end();
+		pagefault_enable();
+		return left;
+#endif
+	default:
+		left = copy_to_user(to, from, n);
+		return left;
+	}
+}
+
+static const char * const path_name[] = { "scalar", "vector", "dispatch" };
+
+static bool path_available(enum path p)
+{
+#ifdef RISCV_VECTOR_STRING
+	return p != VECTOR || may_use_vector();
+#else
+	return p != VECTOR;
+#endif
+}
+
+static int bench_memcpy(u8 *dst, u8 *src, u8 *ref, size_t size,
+			unsigned int da, unsigned int sa)
+{
+	unsigned int loops = loops_for(size), i;
+	u64 rate[3] = { };
+	enum path p;
+	u64 t0;
+
+	__memcpy(ref, src + sa, size);
+
+	for (p = SCALAR; p <= DISPATCH; p++) {
+		if (!path_available(p))
+			continue;
+
+		memset(dst, 0, size + da);
+		t0 = ktime_get_ns();
+		for (i = 0; i < loops; i++)
+			do_memcpy(p, dst + da, src + sa, size);
+		rate[p] = mbps(size, loops, ktime_get_ns() - t0);
+
+		if (memcmp(dst + da, ref, size)) {
+			pr_err("memcpy %s size %zu align %u/%u: mismatch\n",
+			       path_name[p], size, da, sa);
+			return -EINVAL;
+		}
+		cond_resched();
+	}
+
+	pr_info("memcpy   %7zu %u/%u: scalar %5llu vector %5llu dispatch %5llu MB/s\n",
+		size, da, sa, rate[SCALAR], rate[VECTOR], rate[DISPATCH]);
+	return 0;
+}
+
+static int bench_memset(u8 *dst, size_t size, unsigned int da)
+{
+	unsigned int loops = loops_for(size), i;
+	u64 rate[3] = { };
+	enum path p;
+	u64 t0;
+
+	for (p = SCALAR; p <= DISPATCH; p++) {
+		if (!path_available(p))
+			continue;
+
+		__memset(dst, 0, size + da + 1);
+		t0 = ktime_get_ns();
+		for (i = 0; i < loops; i++)
+			do_memset(p, dst + da, size);
+		rate[p] = mbps(size, loops, ktime_get_ns() - t0);
+
+		if (memchr_inv(dst + da, 0x5a, size) ||
+		    memchr_inv(dst, 0, da) || dst[da + size]) {
+			pr_err("memset %s size %zu align %u: mismatch\n",
+			       path_name[p], size, da);
+			return -EINVAL;
+		}
+		cond_resched();
+	}
+
+	pr_info("memset   %7zu %u/-: scalar %5llu vector %5llu dispatch %5llu MB/s\n",
+		size, da, rate[SCALAR], rate[VECTOR], rate[DISPATCH]);
+	return 0;
+}
+
+static int bench_copy_to_user(u8 __user *umem, u8 *src, u8 *check,
+			      size_t size, unsigned int da, unsigned int sa)
+{
+	unsigned int loops = loops_for(size), i;
+	unsigned long left = 0;
+	u64 rate[3] = { };
+	enum path p;
+	u64 t0;
+
+	for (p = SCALAR; p <= DISPATCH; p++) {
+		if (!path_available(p))
+			continue;
+
+		if (clear_user(umem, size + da))
+			return -EFAULT;
+		t0 = ktime_get_ns();
+		for (i = 0; i < loops && !left; i++)
+			left = do_copy_to_user(p, umem + da, src + sa, size);
+		rate[p] = mbps(size, loops, ktime_get_ns() - t0);
+
+		if (left || copy_from_user(check, umem + da, size) ||
+		    memcmp(check, src + sa, size)) {
+			pr_err("copy_to_user %s size %zu align %u/%u: %s\n",
+			       path_name[p], size, da, sa,
+			       left ? "fault" : "mismatch");
+			return -EINVAL;
+		}
+		cond_resched();
+	}
+
+	pr_info("to_user  %7zu %u/%u: scalar %5llu vector %5llu dispatch %5llu MB/s\n",
+		size, da, sa, rate[SCALAR], rate[VECTOR], rate[DISPATCH]);
+	return 0;
+}
+
+static int __init test_string_vector_init(void)
+{
+	size_t len = MAX_SIZE + PAGE_SIZE;
+	unsigned long user_addr;
+	u8 *src, *dst, *ref;
+	u8 __user *umem;
+	unsigned int s, a;
+	int ret = -ENOMEM;
+
+#ifdef RISCV_VECTOR_STRING
+	pr_info("vector string routines %s\n",
+		riscv_vector_string_enabled() ? "enabled" : "disabled");
+	if (!may_use_vector())
+		pr_info("no usable vector unit, timing the scalar path only\n");
+#else
+	pr_info("built without vector string routines\n");
+#endif
+
+	src = vmalloc(len);
+	dst = vmalloc(len);
+	ref = vmalloc(len);
+	if (!src || !dst || !ref)
+		goto out_free;
+
+	user_addr = vm_mmap(NULL, 0, len, PROT_READ | PROT_WRITE,
+			    MAP_ANONYMOUS | MAP_PRIVATE, 0);
+	if (user_addr >= (unsigned long)(TASK_SIZE)) {
+		pr_warn("Failed to allocate user memory\n");
+		goto out_free;
+	}
+	umem = (u8 __user *)user_addr;
+
+	get_random_bytes(src, len);
+
+	for (s = 0; s < ARRAY_SIZE(sizes); s++) {
+		for (a = 0; a < ARRAY_SIZE(aligns); a++) {
+			ret = bench_memcpy(dst, src, ref, sizes[s],
+					   aligns[a].dst, aligns[a].src);
+			if (!ret)
+				ret = bench_copy_to_user(umem, src, ref, sizes[s],
+							 aligns[a].dst,
+							 aligns[a].src);
+			if (ret)
+				goto out_unmap;
+		}
+		ret = bench_memset(dst, sizes[s], 0);
+		if (!ret)
+			ret = bench_memset(dst, sizes[s], 3);
+		if (ret)
+			goto out_unmap;
+	}
+
+	pr_info("all tests passed\n");
+
+out_unmap:
+	vm_munmap(user_addr, len);
+out_free:
+	vfree(ref);
+	vfree(dst);
+	vfree(src);
+
+	return ret;
+}
+
+module_init(test_string_vector_init);
+
+static void __exit test_string_vector_exit(void)
+{
+}
+
+module_exit(test_string_vector_exit);
+
+MODULE_DESCRIPTION("RISC-V vector string routine benchmark");
+MODULE_LICENSE("GPL");
@@ -30,6 +30,34 @@
 #include <linux/version.h>
 
 struct proc_dir_entry *proc_audio_dir;
+
+/*
+ * Let userspace pick periods down to 64 bytes (1 ms of 16 kHz stereo S16)
+ * instead of the 256 bytes floor of the generic dmaengine PCM, and keep the
+ * preallocated buffer small since deep buffering is what this mode avoids.
+ */
+static bool low_latency;
+module_param(low_latency, bool, 0444);
+MODULE_PARM_DESC(low_latency, "allow small DMA periods for low latency capture/playback");
+
+static const struct snd_pcm_hardware cvi_i2s_ll_pcm_hardware = {
+	.info = SNDRV_PCM_INFO_MMAP | SNDRV_PCM_INFO_MMAP_VALID |
+		SNDRV_PCM_INFO_INTERLEAVED | SNDRV_PCM_INFO_PAUSE |
+		SNDRV_PCM_INFO_RESUME,
+	.period_bytes_min = 64,
+	.period_bytes_max = 4096,
+	.periods_min = 2,
+	.periods_max = 64,
+	.buffer_bytes_max = 64 * 1024,
+	.fifo_size = I2STDM_FIFO_DEPTH * I2STDM_FIFO_WIDTH,
+};
+
+static const struct snd_dmaengine_pcm_config cvi_i2s_ll_dmaengine_config = {
+	.prepare_slave_config = snd_dmaengine_pcm_prepare_slave_config,
+	.pcm_hardware = &cvi_i2s_ll_pcm_hardware,
+	.prealloc_buffer_size = 64 * 1024,
+};
+
 static int cvi_i2s_suspend(struct snd_soc_dai *dai);
 static int cvi_i2s_resume(struct snd_soc_dai *dai);
 
@@ -138,6 +166,10 @@ static irqreturn_t i2s_irq_handler(int irq, void *dev_id)
 	if (dev->active >= 1) { /* If I2S is really active */
 		if (val & (I2S_INT_RXFO | I2S_INT_RXFU)) {
 			dev_dbg(dev->dev, "WARNING!!! I2S RX FIFO exception occur int_status=0x%x\n", val);
+			if (val & I2S_INT_RXFO)
+				dev->rx_overrun++;
+			if (val & I2S_INT_RXFU)
+				dev->rx_underrun++;
 			i2s_write_reg(dev->i2s_base, I2S_ENABLE, I2S_OFF);
 			i2s_write_reg(dev->i2s_base, I2S_CLK_CTRL0,
 				      (i2s_read_reg(dev->i2s_base, I2S_CLK_CTRL0) | AUD_ENABLE));
@@ -146,6 +178,10 @@ static irqreturn_t i2s_irq_handler(int irq, void *dev_id)
 			i2s_write_reg(dev->i2s_base, I2S_ENABLE, I2S_ON);
 		} else if (val & (I2S_INT_TXFO | I2S_INT_TXFU)) {
 			dev_dbg(dev->dev, "WARNING!!! I2S TX FIFO exception occur int_status=0x%x\n", val);
+			if (val & I2S_INT_TXFO)
+				dev->tx_overrun++;
+			if (val & I2S_INT_TXFU)
+				dev->tx_underrun++;
 			i2s_write_reg(dev->i2s_base, I2S_ENABLE, I2S_OFF);
 			i2s_write_reg(dev->i2s_base, I2S_CLK_CTRL0,
 				      (i2s_read_reg(dev->i2s_base, I2S_CLK_CTRL0) | AUD_ENABLE));
@@ -1074,6 +1110,11 @@ static int i2s_proc_show(struct seq_file *m, void *v)
 		   i2s_read_reg(dev->i2s_base, I2S_CLK_CTRL0),
 		   i2s_read_reg(dev->i2s_base, I2S_CLK_CTRL1));
 
+	seq_printf(m, "\nrx_overrun=%u,  rx_underrun=%u,  tx_overrun=%u,  tx_underrun=%u\n",
+		   dev->rx_overrun, dev->rx_underrun, dev->tx_overrun, dev->tx_underrun);
+
+	seq_printf(m, "\nlow_latency=%d\n", low_latency);
+
 	return 0;
 }
 
@@ -1203,7 +1244,8 @@ static int cvi_i2s_probe(struct platform_device *pdev)
 	}
 
 	if (!pdata) {
-		ret = devm_snd_dmaengine_pcm_register(&pdev->dev, NULL, 0);
+		ret = devm_snd_dmaengine_pcm_register(&pdev->dev,
+						      low_latency ? &cvi_i2s_ll_dmaengine_config : NULL, 0);
 
 		if (ret == -EPROBE_DEFER) {
 			dev_err(&pdev->dev,
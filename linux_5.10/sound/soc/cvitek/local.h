@@ -256,6 +256,11 @@ struct cvi_i2s_dev {
 			bool *period_elapsed);
 	unsigned int tx_ptr;
 	bool mclk_out;
+	/* FIFO exceptions recovered by i2s_irq_handler, shown in /proc/audio_debug/i2sN */
+	u32 rx_overrun;
+	u32 rx_underrun;
+	u32 tx_overrun;
+	u32 tx_underrun;
 #ifdef CONFIG_PM_SLEEP
 	struct cvi_i2s_reg_context *reg_ctx;
 #endif
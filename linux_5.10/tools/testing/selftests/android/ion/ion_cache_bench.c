@@ -0,0 +1,163 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * ion_cache_bench - compare range and whole cache maintenance
+ *
+ * Dirties an ION carveout buffer from the CPU and times
+ * ION_IOC_CVITEK_CACHE_BATCH over a range of sizes, once forcing the
+ * per-line range walk and once forcing the whole D-cache operation.
+ * The smallest size at which the whole cache operation wins is the
+ * value to write into the cache_whole_threshold module parameter.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "ion.h"
+#include "ion_cvitek_cache.h"
+#include "../../kselftest.h"
+
+#define BENCH_BUF_SIZE	(4 << 20)
+#define BENCH_MIN_SIZE	64
+#define BENCH_ITERS	64
+#define MAX_HEAPS	16
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int find_carveout_heap(int ionfd)
+{
+	struct ion_heap_data heaps[MAX_HEAPS];
+	struct ion_heap_query query;
+	unsigned int i;
+
+	memset(&query, 0, sizeof(query));
+	memset(heaps, 0, sizeof(heaps));
+	query.cnt = MAX_HEAPS;
+	query.heaps = (unsigned long)heaps;
+	if (ioctl(ionfd, ION_IOC_HEAP_QUERY, &query) < 0)
+		return -errno;
+
+	for (i = 0; i < query.cnt; i++)
+		if (heaps[i].type == ION_HEAP_TYPE_CARVEOUT)
+			return heaps[i].heap_id;
+
+	return -ENODEV;
+}
+
+static int cache_batch(int ionfd, struct cvitek_cache_batch_entry *entries,
+		       unsigned int count, unsigned int flags)
+{
+	struct cvitek_cache_batch batch;
+	struct ion_custom_data custom;
+
+	memset(&batch, 0, sizeof(batch));
+	batch.entries = (unsigned long)entries;
+	batch.count = count;
+	batch.flags = flags;
+
+	custom.cmd = ION_IOC_CVITEK_CACHE_BATCH;
+	custom.arg = (unsigned long)&batch;
+
+	return ioctl(ionfd, ION_IOC_CUSTOM, &custom);
+}
+
+/* average ns of one flush of @size bytes after dirtying them */
+static uint64_t bench_one(int ionfd, int buf_fd, uint8_t *va, size_t size,
+			  unsigned int flags)
+{
+	struct cvitek_cache_batch_entry entry;
+	uint64_t total = 0, t0;
+	int i;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.fd = buf_fd;
+	entry.op = CVITEK_CACHE_OP_FLUSH;
+	entry.len = size;
+
+	for (i = 0; i < BENCH_ITERS; i++) {
+		memset(va, i, size);
+		t0 = now_ns();
+		if (cache_batch(ionfd, &entry, 1, flags) < 0)
+			return 0;
+		total += now_ns() - t0;
+	}
+
+	return total / BENCH_ITERS;
+}
+
+int main(void)
+{
+	struct ion_allocation_data alloc;
+	size_t size, crossover = 0;
+	uint64_t range_ns, whole_ns;
+	int ionfd, heap_id;
+	uint8_t *va;
+
+	ionfd = open("/dev/ion", O_RDWR);
+	if (ionfd < 0) {
+		printf("/dev/ion not available, skipping\n");
+		return KSFT_SKIP;
+	}
+
+	heap_id = find_carveout_heap(ionfd);
+	if (heap_id < 0) {
+		printf("no carveout heap, skipping\n");
+		close(ionfd);
+		return KSFT_SKIP;
+	}
+
+	memset(&alloc, 0, sizeof(alloc));
+	alloc.len = BENCH_BUF_SIZE;
+	alloc.heap_id_mask = 1 << heap_id;
+	alloc.flags = ION_FLAG_CACHED;
+	snprintf(alloc.name, sizeof(alloc.name), "cache_bench");
+	if (ioctl(ionfd, ION_IOC_ALLOC, &alloc) < 0) {
+		perror("ION_IOC_ALLOC");
+		close(ionfd);
+		return KSFT_FAIL;
+	}
+
+	va = mmap(NULL, BENCH_BUF_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+		  alloc.fd, 0);
+	if (va == MAP_FAILED) {
+		perror("mmap");
+		close(alloc.fd);
+		close(ionfd);
+		return KSFT_FAIL;
+	}
+
+	printf("%10s %12s %12s\n", "bytes", "range ns", "whole ns");
+	for (size = BENCH_MIN_SIZE; size <= BENCH_BUF_SIZE; size <<= 1) {
+		range_ns = bench_one(ionfd, alloc.fd, va, size,
+				     CVITEK_CACHE_BATCH_FORCE_RANGE);
+		whole_ns = bench_one(ionfd, alloc.fd, va, size,
+				     CVITEK_CACHE_BATCH_FORCE_WHOLE);
+		printf("%10zu %12llu %12llu\n", size,
+		       (unsigned long long)range_ns,
+		       (unsigned long long)whole_ns);
+		if (!crossover && whole_ns && whole_ns < range_ns)
+			crossover = size;
+	}
+
+	if (crossover)
+		printf("suggested cache_whole_threshold: %zu\n", crossover);
+	else
+		printf("whole cache operation never won\n");
+
+	munmap(va, BENCH_BUF_SIZE);
+	close(alloc.fd);
+	close(ionfd);
+	return KSFT_PASS;
+}
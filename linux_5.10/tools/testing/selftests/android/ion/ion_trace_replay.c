@@ -0,0 +1,271 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * ion_trace_replay - replay or fuzz ION carveout allocation traces
+ *
+ * Trace format, one operation per line:
+ *   a <slot> <len>	allocate <len> bytes into <slot>
+ *   f <slot>		free the buffer held in <slot>
+ *
+ * Without a trace file a random trace is generated from a seed, mixing
+ * small scratch buffers with frame sized buffers. After the run the
+ * heap's debugfs fragmentation report is printed so placement policies
+ * can be compared on the same trace.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "ion.h"
+#include "../../kselftest.h"
+
+#define MAX_SLOTS	1024
+#define MAX_HEAPS	16
+#define DEBUGFS_ION	"/sys/kernel/debug/ion"
+
+struct slot {
+	int fd;
+	size_t len;
+};
+
+static struct slot slots[MAX_SLOTS];
+
+struct replay_stats {
+	unsigned long allocs;
+	unsigned long frees;
+	unsigned long failures;
+	uint64_t alloc_ns;
+	uint64_t alloc_max_ns;
+	uint64_t free_ns;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int find_carveout_heap(int ionfd, char *name, size_t name_len)
+{
+	struct ion_heap_data heaps[MAX_HEAPS];
+	struct ion_heap_query query;
+	unsigned int i;
+
+	memset(&query, 0, sizeof(query));
+	memset(heaps, 0, sizeof(heaps));
+	query.cnt = MAX_HEAPS;
+	query.heaps = (unsigned long)heaps;
+	if (ioctl(ionfd, ION_IOC_HEAP_QUERY, &query) < 0)
+		return -errno;
+
+	for (i = 0; i < query.cnt; i++) {
+		if (heaps[i].type == ION_HEAP_TYPE_CARVEOUT) {
+			snprintf(name, name_len, "%s", heaps[i].name);
+			return heaps[i].heap_id;
+		}
+	}
+
+	return -ENODEV;
+}
+
+static void do_alloc(int ionfd, int heap_id, int idx, size_t len,
+		     struct replay_stats *st)
+{
+	struct ion_allocation_data data;
+	uint64_t t0, dt;
+
+	if (idx < 0 || idx >= MAX_SLOTS || slots[idx].fd >= 0)
+		return;
+
+	memset(&data, 0, sizeof(data));
+	data.len = len;
+	data.heap_id_mask = 1 << heap_id;
+	snprintf(data.name, sizeof(data.name), "replay_%d", idx);
+
+	t0 = now_ns();
+	if (ioctl(ionfd, ION_IOC_ALLOC, &data) < 0) {
+		st->failures++;
+		return;
+	}
+	dt = now_ns() - t0;
+
+	st->allocs++;
+	st->alloc_ns += dt;
+	if (dt > st->alloc_max_ns)
+		st->alloc_max_ns = dt;
+	slots[idx].fd = data.fd;
+	slots[idx].len = len;
+}
+
+static void do_free(int idx, struct replay_stats *st)
+{
+	uint64_t t0;
+
+	if (idx < 0 || idx >= MAX_SLOTS || slots[idx].fd < 0)
+		return;
+
+	t0 = now_ns();
+	close(slots[idx].fd);
+	st->free_ns += now_ns() - t0;
+	st->frees++;
+	slots[idx].fd = -1;
+}
+
+static int replay_file(int ionfd, int heap_id, const char *path,
+		       struct replay_stats *st)
+{
+	char line[128];
+	FILE *fp;
+	int idx;
+	size_t len;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		perror(path);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "a %d %zu", &idx, &len) == 2)
+			do_alloc(ionfd, heap_id, idx, len, st);
+		else if (sscanf(line, "f %d", &idx) == 1)
+			do_free(idx, st);
+	}
+
+	fclose(fp);
+	return 0;
+}
+
+/* 3/4 small scratch buffers, 1/4 frame sized buffers */
+static size_t random_len(void)
+{
+	if (rand() % 4)
+		return 4096UL << (rand() % 6);
+
+	return (size_t)(64 + rand() % 1024) * 1024;
+}
+
+static void replay_random(int ionfd, int heap_id, unsigned long ops,
+			  struct replay_stats *st)
+{
+	unsigned long i;
+	int idx;
+
+	for (i = 0; i < ops; i++) {
+		idx = rand() % MAX_SLOTS;
+		if (slots[idx].fd >= 0)
+			do_free(idx, st);
+		else
+			do_alloc(ionfd, heap_id, idx, random_len(), st);
+	}
+}
+
+static void dump_fragmentation(const char *heap_name)
+{
+	char path[256], line[256];
+	FILE *fp;
+
+	snprintf(path, sizeof(path), DEBUGFS_ION "/cvi_%s_heap_dump/fragmentation",
+		 heap_name);
+	fp = fopen(path, "r");
+	if (!fp) {
+		printf("no fragmentation report at %s\n", path);
+		return;
+	}
+	while (fgets(line, sizeof(line), fp))
+		fputs(line, stdout);
+	fclose(fp);
+}
+
+static void usage(const char *prog)
+{
+	printf("usage: %s [-t trace] [-n ops] [-s seed] [-k]\n", prog);
+	printf("  -t trace  replay the given trace file\n");
+	printf("  -n ops    number of random operations (default 100000)\n");
+	printf("  -s seed   random seed (default 1)\n");
+	printf("  -k        keep buffers allocated at exit for inspection\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct replay_stats st;
+	const char *trace = NULL;
+	unsigned long ops = 100000;
+	unsigned int seed = 1;
+	char heap_name[MAX_HEAP_NAME];
+	int keep = 0;
+	int ionfd, heap_id, opt, i;
+
+	while ((opt = getopt(argc, argv, "t:n:s:kh")) != -1) {
+		switch (opt) {
+		case 't':
+			trace = optarg;
+			break;
+		case 'n':
+			ops = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'k':
+			keep = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return KSFT_FAIL;
+		}
+	}
+
+	ionfd = open("/dev/ion", O_RDWR);
+	if (ionfd < 0) {
+		printf("/dev/ion not available, skipping\n");
+		return KSFT_SKIP;
+	}
+
+	heap_id = find_carveout_heap(ionfd, heap_name, sizeof(heap_name));
+	if (heap_id < 0) {
+		printf("no carveout heap, skipping\n");
+		close(ionfd);
+		return KSFT_SKIP;
+	}
+
+	for (i = 0; i < MAX_SLOTS; i++)
+		slots[i].fd = -1;
+	memset(&st, 0, sizeof(st));
+
+	if (trace) {
+		if (replay_file(ionfd, heap_id, trace, &st)) {
+			close(ionfd);
+			return KSFT_FAIL;
+		}
+	} else {
+		srand(seed);
+		replay_random(ionfd, heap_id, ops, &st);
+	}
+
+	printf("heap %s: %lu allocs, %lu frees, %lu failures\n",
+	       heap_name, st.allocs, st.frees, st.failures);
+	if (st.allocs)
+		printf("alloc avg %llu ns, max %llu ns\n",
+		       (unsigned long long)(st.alloc_ns / st.allocs),
+		       (unsigned long long)st.alloc_max_ns);
+	if (st.frees)
+		printf("free avg %llu ns\n",
+		       (unsigned long long)(st.free_ns / st.frees));
+
+	dump_fragmentation(heap_name);
+
+	if (!keep)
+		for (i = 0; i < MAX_SLOTS; i++)
+			do_free(i, &st);
+
+	close(ionfd);
+	return KSFT_PASS;
+}
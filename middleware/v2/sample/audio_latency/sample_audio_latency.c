@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) Cvitek Co., Ltd. 2019-2020. All rights reserved.
+ *
+ * File Name: sample/audio_latency/sample_audio_latency.c
+ * Description:
+ *   Acoustic loopback measurement of the mic to application latency.
+ *
+ *   A click is played on AO while the low latency AI capture is running.
+ *   The time from CVI_AO_SendFrame to the consumer getting the frame with
+ *   the click is the round trip; the playback queue ahead of the click and
+ *   the speaker to mic distance are taken out of it, which leaves the
+ *   capture side. The AO DMA buffer cannot be queried from here, so the
+ *   result is an upper bound of the mic to application latency.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "sample_comm.h"
+
+#define LAT_CLICK_SAMPLES	32
+#define LAT_CLICK_LEVEL		20000
+#define LAT_TIMEOUT_MS		1000
+#define LAT_GAP_MS		300
+
+static void lat_usage(const char *prog)
+{
+	printf("Usage: %s [-r rate] [-p points] [-n trials] [-d distance_cm] [-t threshold] [-P priority]\n", prog);
+	printf("\t-r: sample rate, default 16000\n");
+	printf("\t-p: points per period, default 80\n");
+	printf("\t-n: number of clicks, default 10\n");
+	printf("\t-d: speaker to mic distance in cm, default 0\n");
+	printf("\t-t: minimum detection level, default 3000\n");
+	printf("\t-P: SCHED_FIFO priority of the capture thread, default 0\n");
+}
+
+/* consume frames for u32Ms and return the peak level seen */
+static CVI_U32 lat_drain(SAMPLE_AUDIO_LL_S *pstLL, CVI_U32 u32Ms)
+{
+	CVI_U64 u64End = SAMPLE_COMM_SYS_GetNowUs() + (CVI_U64)u32Ms * 1000;
+	SAMPLE_AUDIO_LL_FRAME_S *pstFrame;
+	CVI_U32 u32Peak = 0;
+
+	while (SAMPLE_COMM_SYS_GetNowUs() < u64End) {
+		if (SAMPLE_COMM_AUDIO_LL_GetFrame(pstLL, &pstFrame, 50) != CVI_SUCCESS)
+			continue;
+		for (CVI_U32 i = 0; i < pstFrame->u32Len / 2; i++) {
+			CVI_S32 s32Val = abs(((CVI_S16 *)pstFrame->pu8Data)[i]);
+
+			if ((CVI_U32)s32Val > u32Peak)
+				u32Peak = s32Val;
+		}
+		SAMPLE_COMM_AUDIO_LL_ReleaseFrame(pstLL);
+	}
+	return u32Peak;
+}
+
+static CVI_S32 lat_start_ao(AUDIO_SAMPLE_RATE_E enRate, CVI_U32 u32PtNum)
+{
+	AIO_ATTR_S stAioAttr;
+	CVI_S32 s32Ret;
+
+	memset(&stAioAttr, 0, sizeof(stAioAttr));
+	stAioAttr.enSamplerate = enRate;
+	stAioAttr.enBitwidth = AUDIO_BIT_WIDTH_16;
+	stAioAttr.enWorkmode = AIO_MODE_I2S_MASTER;
+	stAioAttr.enSoundmode = AUDIO_SOUND_MODE_MONO;
+	stAioAttr.u32FrmNum = 4;
+	stAioAttr.u32PtNumPerFrm = u32PtNum;
+	stAioAttr.u32ChnCnt = 1;
+	stAioAttr.enI2sType = AIO_I2STYPE_INNERCODEC;
+
+	s32Ret = CVI_AO_SetPubAttr(SAMPLE_AUDIO_INNER_AO_DEV, &stAioAttr);
+	if (s32Ret != CVI_SUCCESS) {
+		SAMPLE_PRT("CVI_AO_SetPubAttr failed with %#x\n", s32Ret);
+		return s32Ret;
+	}
+	s32Ret = CVI_AO_Enable(SAMPLE_AUDIO_INNER_AO_DEV);
+	if (s32Ret != CVI_SUCCESS) {
+		SAMPLE_PRT("CVI_AO_Enable failed with %#x\n", s32Ret);
+		return s32Ret;
+	}
+	s32Ret = CVI_AO_EnableChn(SAMPLE_AUDIO_INNER_AO_DEV, 0);
+	if (s32Ret != CVI_SUCCESS) {
+		SAMPLE_PRT("CVI_AO_EnableChn failed with %#x\n", s32Ret);
+		CVI_AO_Disable(SAMPLE_AUDIO_INNER_AO_DEV);
+		return s32Ret;
+	}
+	return CVI_SUCCESS;
+}
+
+static void lat_print_i2s_xrun(void)
+{
+	char szLine[256];
+	FILE *fp = fopen("/proc/audio_debug/i2s0", "r");
+
+	if (!fp)
+		return;
+	while (fgets(szLine, sizeof(szLine), fp)) {
+		if (strstr(szLine, "overrun") || strstr(szLine, "low_latency"))
+			printf("i2s0: %s", szLine);
+	}
+	fclose(fp);
+}
+
+int main(int argc, char **argv)
+{
+	SAMPLE_AUDIO_LL_ATTR_S stAttr;
+	SAMPLE_AUDIO_LL_STAT_S stStat;
+	SAMPLE_AUDIO_LL_S *pstLL = NULL;
+	SAMPLE_AUDIO_LL_FRAME_S *pstFrame;
+	AO_CHN_STATE_S stAoStat;
+	AUDIO_FRAME_S stClick;
+	CVI_S16 *ps16Click;
+	CVI_U32 u32Rate = 16000, u32PtNum = 80, u32Trials = 10, u32DistCm = 0, u32Level = 3000;
+	CVI_U32 u32Threshold, u32Found = 0, u32MinUs = ~0U, u32MaxUs = 0;
+	CVI_U64 u64SumUs = 0;
+	CVI_S32 s32Priority = 0, s32Ret, c;
+
+	while ((c = getopt(argc, argv, "r:p:n:d:t:P:h")) != -1) {
+		switch (c) {
+		case 'r':
+			u32Rate = atoi(optarg);
+			break;
+		case 'p':
+			u32PtNum = atoi(optarg);
+			break;
+		case 'n':
+			u32Trials = atoi(optarg);
+			break;
+		case 'd':
+			u32DistCm = atoi(optarg);
+			break;
+		case 't':
+			u32Level = atoi(optarg);
+			break;
+		case 'P':
+			s32Priority = atoi(optarg);
+			break;
+		default:
+			lat_usage(argv[0]);
+			return CVI_FAILURE;
+		}
+	}
+	if (!u32PtNum || u32PtNum < LAT_CLICK_SAMPLES || !u32Rate) {
+		lat_usage(argv[0]);
+		return CVI_FAILURE;
+	}
+
+	ps16Click = calloc(u32PtNum, sizeof(*ps16Click));
+	if (!ps16Click)
+		return CVI_FAILURE;
+	for (CVI_U32 i = 0; i < LAT_CLICK_SAMPLES; i++)
+		ps16Click[i] = (i & 2) ? -LAT_CLICK_LEVEL : LAT_CLICK_LEVEL;
+
+	CVI_AUDIO_INIT();
+
+	s32Ret = lat_start_ao((AUDIO_SAMPLE_RATE_E)u32Rate, u32PtNum);
+	if (s32Ret != CVI_SUCCESS)
+		goto out;
+
+	memset(&stAttr, 0, sizeof(stAttr));
+	stAttr.AiDev = SAMPLE_AUDIO_INNER_AI_DEV;
+	stAttr.AiChn = 0;
+	stAttr.enSamplerate = (AUDIO_SAMPLE_RATE_E)u32Rate;
+	stAttr.u32ChnCnt = 1;
+	stAttr.u32PtNumPerFrm = u32PtNum;
+	stAttr.s32Priority = s32Priority;
+	s32Ret = SAMPLE_COMM_AUDIO_LL_Start(&stAttr, &pstLL);
+	if (s32Ret != CVI_SUCCESS)
+		goto out_ao;
+
+	u32Threshold = lat_drain(pstLL, LAT_GAP_MS) * 4;
+	if (u32Threshold < u32Level)
+		u32Threshold = u32Level;
+	printf("period %u us, detection level %u\n", u32PtNum * 1000000 / u32Rate, u32Threshold);
+	printf("%5s %10s %10s %10s %10s %10s\n", "click", "round(us)", "ao_q(us)", "air(us)", "fill(us)", "mic2app(us)");
+
+	memset(&stClick, 0, sizeof(stClick));
+	stClick.enBitwidth = AUDIO_BIT_WIDTH_16;
+	stClick.enSoundmode = AUDIO_SOUND_MODE_MONO;
+	stClick.u64VirAddr[0] = (CVI_U8 *)ps16Click;
+	stClick.u32Len = u32PtNum * sizeof(*ps16Click);
+
+	for (CVI_U32 n = 0; n < u32Trials; n++) {
+		CVI_U32 u32AoQueueUs, u32AirUs, u32FillUs, u32RoundUs, u32Mic2AppUs;
+		CVI_BOOL bHit = CVI_FALSE;
+		CVI_U64 u64Send, u64End;
+
+		lat_drain(pstLL, LAT_GAP_MS);
+
+		memset(&stAoStat, 0, sizeof(stAoStat));
+		CVI_AO_QueryChnStat(SAMPLE_AUDIO_INNER_AO_DEV, 0, &stAoStat);
+		stClick.u32Seq = n;
+		u64Send = SAMPLE_COMM_SYS_GetNowUs();
+		stClick.u64TimeStamp = u64Send;
+		s32Ret = CVI_AO_SendFrame(SAMPLE_AUDIO_INNER_AO_DEV, 0, &stClick, 1000);
+		if (s32Ret != CVI_SUCCESS) {
+			SAMPLE_PRT("CVI_AO_SendFrame failed with %#x\n", s32Ret);
+			continue;
+		}
+
+		u64End = u64Send + LAT_TIMEOUT_MS * 1000;
+		while (!bHit && SAMPLE_COMM_SYS_GetNowUs() < u64End) {
+			const CVI_S16 *ps16;
+			CVI_U32 k;
+
+			if (SAMPLE_COMM_AUDIO_LL_GetFrame(pstLL, &pstFrame, 50) != CVI_SUCCESS)
+				continue;
+			ps16 = (const CVI_S16 *)pstFrame->pu8Data;
+			for (k = 0; k < pstFrame->u32Samples; k++) {
+				if ((CVI_U32)abs(ps16[k]) >= u32Threshold)
+					break;
+			}
+			if (k < pstFrame->u32Samples) {
+				bHit = CVI_TRUE;
+				u32RoundUs = (CVI_U32)(pstFrame->u64ReadUs - u64Send);
+				u32AoQueueUs = stAoStat.u32ChnBusyNum * u32PtNum * 1000000 / u32Rate;
+				u32AirUs = u32DistCm * 1000000 / 34300;
+				u32FillUs = (pstFrame->u32Samples - k) * 1000000 / u32Rate;
+				u32Mic2AppUs = u32RoundUs > u32AoQueueUs + u32AirUs ?
+					       u32RoundUs - u32AoQueueUs - u32AirUs : 0;
+				printf("%5u %10u %10u %10u %10u %10u\n", n, u32RoundUs, u32AoQueueUs,
+				       u32AirUs, u32FillUs, u32Mic2AppUs);
+
+				u32Found++;
+				u64SumUs += u32Mic2AppUs;
+				if (u32Mic2AppUs < u32MinUs)
+					u32MinUs = u32Mic2AppUs;
+				if (u32Mic2AppUs > u32MaxUs)
+					u32MaxUs = u32Mic2AppUs;
+			}
+			SAMPLE_COMM_AUDIO_LL_ReleaseFrame(pstLL);
+		}
+		if (!bHit)
+			printf("%5u %10s\n", n, "missed");
+	}
+
+	if (u32Found)
+		printf("mic2app: min %u us, avg %llu us, max %u us over %u/%u clicks\n",
+		       u32MinUs, (unsigned long long)(u64SumUs / u32Found), u32MaxUs, u32Found, u32Trials);
+
+	SAMPLE_COMM_AUDIO_LL_GetStat(pstLL, &stStat);
+	printf("frames %u, lost %u, overrun %u, ring max %u, queue avg/max %u/%u us, handoff avg/max %u/%u us\n",
+	       stStat.u32Frames, stStat.u32Lost, stStat.u32Overrun, stStat.u32DepthMax,
+	       stStat.u32QueueAvgUs, stStat.u32QueueMaxUs, stStat.u32HandoffAvgUs, stStat.u32HandoffMaxUs);
+	lat_print_i2s_xrun();
+
+	SAMPLE_COMM_AUDIO_LL_Stop(pstLL);
+out_ao:
+	CVI_AO_DisableChn(SAMPLE_AUDIO_INNER_AO_DEV, 0);
+	CVI_AO_Disable(SAMPLE_AUDIO_INNER_AO_DEV);
+out:
+	CVI_AUDIO_DEINIT();
+	free(ps16Click);
+	return s32Ret;
+}
@@ -798,6 +798,7 @@ CVI_S32 SAMPLE_COMM_SYS_MemConfig(void);
 CVI_VOID SAMPLE_COMM_SYS_Exit(void);
 CVI_S32 SAMPLE_COMM_SYS_Init(VB_CONFIG_S *pstVbConfig);
 CVI_S32 SAMPLE_COMM_SYS_InitWithVbSupplement(VB_CONFIG_S *pstVbConf, CVI_U32 u32SupplementConfig);
+CVI_U64 SAMPLE_COMM_SYS_GetNowUs(void);
 
 CVI_S32 SAMPLE_COMM_VI_CreateIsp(SAMPLE_VI_CONFIG_S *pstViConfig);
 CVI_S32 SAMPLE_COMM_VI_DestroyIsp(SAMPLE_VI_CONFIG_S *pstViConfig);
@@ -862,6 +863,35 @@ CVI_S32 SAMPLE_COMM_VI_DefaultConfig(void);
 CVI_S32 SAMPLE_COMM_VI_IniToViCfg(SAMPLE_INI_CFG_S *pstIniCfg, SAMPLE_VI_CONFIG_S *pstViConfig);
 CVI_CHAR *SAMPLE_COMM_VI_GetSnsrTypeName(void);
 
+/* time spent in each step of SAMPLE_COMM_VI_SwitchMode, us */
+typedef struct _SAMPLE_VI_SWITCH_STAT_S {
+	CVI_U32 u32StopUs;
+	CVI_U32 u32SensorUs;
+	CVI_U32 u32DevUs;
+	CVI_U32 u32IspUs;
+	CVI_U32 u32StartUs;
+	CVI_U32 u32FirstFrameUs;
+	CVI_U32 u32TotalUs;
+} SAMPLE_VI_SWITCH_STAT_S;
+
+/* SAMPLE_COMM_VI_SwitchMode:
+ *   Change a running VI to another mode of the same sensor without the
+ *   DestroyIsp/StopViPipe/DestroyVi round trip. VI dev, pipes, VB pools and the
+ *   ISP context stay; the sensor is reprogrammed from standby and AE/AWB start
+ *   from the exposure and gains of the old mode. The new frame must fit the
+ *   max size the pipe was created with. Bound VPSS groups have to follow the
+ *   new size with CVI_VPSS_SetGrpAttr.
+ *
+ * [in]s32ViNum: index in astViInfo.
+ * [in]enSnsType: the new mode.
+ * [out]pstStat: step timings, may be NULL.
+ * return: CVI_FAILURE without touching the stream if the mode needs a full restart.
+ *   A failure once the stream is stopped puts the old mode, pipes and 3A attr
+ *   back; if that fails too, the VI has to be restarted.
+ */
+CVI_S32 SAMPLE_COMM_VI_SwitchMode(SAMPLE_VI_CONFIG_S *pstViConfig, CVI_S32 s32ViNum,
+		SAMPLE_SNS_TYPE_E enSnsType, SAMPLE_VI_SWITCH_STAT_S *pstStat);
+
 CVI_VOID *SAMPLE_COMM_SNS_GetSnsObj(SAMPLE_SNS_TYPE_E enSnsType);
 CVI_S32 SAMPLE_COMM_SNS_GetIspAttrBySns(SAMPLE_SNS_TYPE_E enSnsType, ISP_PUB_ATTR_S *pstPubAttr);
 CVI_S32 SAMPLE_COMM_SNS_GetYuvBypassSts(SAMPLE_SNS_TYPE_E enSnsType);
@@ -1062,6 +1092,341 @@ CVI_BOOL SAMPLE_COMM_FRAME_CompareWithFile(const CVI_CHAR *filename, VIDEO_FRAME
 CVI_S32 SAMPLE_COMM_FRAME_LoadFromFile(const CVI_CHAR *filename, VIDEO_FRAME_INFO_S *pstVideoFrame,
 	SIZE_S *stSize, PIXEL_FORMAT_E enPixelFormat);
 
+/*
+ * Frame dispatcher: one thread waits on the fds of many VPSS channels and
+ * VENC channels in a single epoll and hands every ready frame/stream to
+ * the callback registered for its channel.
+ */
+#define SAMPLE_DISPATCH_MAX_CHN 16
+
+typedef struct _SAMPLE_DISPATCH_S SAMPLE_DISPATCH_S;
+
+/* frame/stream is released by the dispatcher once the callback returns */
+typedef CVI_S32 (*SAMPLE_DISPATCH_VPSS_CB)(VPSS_GRP VpssGrp, VPSS_CHN VpssChn,
+	VIDEO_FRAME_INFO_S *pstFrame, CVI_VOID *pvData);
+typedef CVI_S32 (*SAMPLE_DISPATCH_VENC_CB)(VENC_CHN VencChn, VENC_STREAM_S *pstStream, CVI_VOID *pvData);
+
+typedef struct _SAMPLE_DISPATCH_CHN_ATTR_S {
+	CVI_U32 u32Budget;	// max frames handled per wakeup before the next channel, 0 for 1
+	CVI_BOOL bDropOldest;	// VPSS only: skip queued frames and deliver the newest
+	CVI_VOID *pvData;	// passed to the callback
+} SAMPLE_DISPATCH_CHN_ATTR_S;
+
+typedef struct _SAMPLE_DISPATCH_STAT_S {
+	CVI_U64 u64Frames;	// delivered to the callback
+	CVI_U64 u64Dropped;	// released unseen by bDropOldest
+	CVI_U64 u64Errors;	// get frame/stream or callback failures
+	CVI_U64 u64LatFrames;	// frames with a usable PTS
+	CVI_U32 u32LatMinUs;	// PTS to callback
+	CVI_U32 u32LatMaxUs;
+	CVI_U64 u64LatSumUs;
+	CVI_U32 u32CbMaxUs;	// time spent in the callback
+	CVI_U64 u64CbSumUs;
+} SAMPLE_DISPATCH_STAT_S;
+
+/* SAMPLE_COMM_DISPATCH_Create:
+ *   Create an empty dispatcher.
+ *
+ * [out]ppstDisp: the new dispatcher.
+ * return: CVI_SUCCESS if no problem.
+ */
+CVI_S32 SAMPLE_COMM_DISPATCH_Create(SAMPLE_DISPATCH_S **ppstDisp);
+
+/* SAMPLE_COMM_DISPATCH_AddVpssChn/AddVencChn:
+ *   Register a started channel. Must be called before Run.
+ *   VPSS channels share the VPSS device fd: a VPSS channel with user depth
+ *   that is not registered keeps it readable, so register all of them.
+ *
+ * [in]pstAttr: per channel policy, NULL for budget 1 and no drop.
+ * return: index of the channel for GetStat, negative on error.
+ */
+CVI_S32 SAMPLE_COMM_DISPATCH_AddVpssChn(SAMPLE_DISPATCH_S *pstDisp, VPSS_GRP VpssGrp, VPSS_CHN VpssChn,
+	SAMPLE_DISPATCH_VPSS_CB pfnCb, const SAMPLE_DISPATCH_CHN_ATTR_S *pstAttr);
+CVI_S32 SAMPLE_COMM_DISPATCH_AddVencChn(SAMPLE_DISPATCH_S *pstDisp, VENC_CHN VencChn,
+	SAMPLE_DISPATCH_VENC_CB pfnCb, const SAMPLE_DISPATCH_CHN_ATTR_S *pstAttr);
+
+/* SAMPLE_COMM_DISPATCH_Run:
+ *   Dispatch frames on the calling thread until Stop is called.
+ */
+CVI_S32 SAMPLE_COMM_DISPATCH_Run(SAMPLE_DISPATCH_S *pstDisp);
+
+/* SAMPLE_COMM_DISPATCH_Stop:
+ *   Make Run return. Safe from another thread or a signal handler.
+ */
+CVI_VOID SAMPLE_COMM_DISPATCH_Stop(SAMPLE_DISPATCH_S *pstDisp);
+
+CVI_S32 SAMPLE_COMM_DISPATCH_GetStat(SAMPLE_DISPATCH_S *pstDisp, CVI_S32 s32Idx, SAMPLE_DISPATCH_STAT_S *pstStat);
+CVI_VOID SAMPLE_COMM_DISPATCH_PrintStat(SAMPLE_DISPATCH_S *pstDisp);
+CVI_VOID SAMPLE_COMM_DISPATCH_Destroy(SAMPLE_DISPATCH_S *pstDisp);
+
+/*
+ * VB planner: one node per frame producer of the pipeline.
+ *   VI/VPSS: blocks = 2 in flight + u32Depth held downstream.
+ *   VENC: only for channels on the common pools, u32Depth frame buffers (0 for 3).
+ */
+typedef struct _SAMPLE_VB_PLAN_NODE_S {
+	MOD_ID_E enModId;	// CVI_ID_VI, CVI_ID_VPSS or CVI_ID_VENC
+	CVI_S32 s32DevId;	// VI pipe / VPSS grp
+	CVI_S32 s32ChnId;
+	SIZE_S stSize;
+	PIXEL_FORMAT_E enPixelFormat;
+	DATA_BITWIDTH_E enBitWidth;
+	COMPRESS_MODE_E enCompressMode;
+	PAYLOAD_TYPE_E enType;	// VENC only
+	CVI_U32 u32Align;	// 0: CVI_VPSS_GetChnAlign if the chn exists, else DEFAULT_ALIGN
+	CVI_U32 u32Depth;
+} SAMPLE_VB_PLAN_NODE_S;
+
+typedef struct _SAMPLE_VB_MON_S SAMPLE_VB_MON_S;
+
+/* SAMPLE_COMM_VB_Plan:
+ *   Minimal common pools for the given nodes, same sized nodes share a pool.
+ *
+ * [in]pastNode: the frame producers of the pipeline.
+ * [out]pstVbConfig: config for SAMPLE_COMM_SYS_Init.
+ * return: CVI_SUCCESS if no problem.
+ */
+CVI_S32 SAMPLE_COMM_VB_Plan(const SAMPLE_VB_PLAN_NODE_S *pastNode, CVI_U32 u32NodeNum, VB_CONFIG_S *pstVbConfig);
+
+/* SAMPLE_COMM_VB_MonStart:
+ *   Track the block usage of every common pool. Call after SAMPLE_COMM_SYS_Init and
+ *   before the pipeline starts, blocks in use at this point count as always used.
+ *
+ * [in]u32IntervalMs: sampling period of the monitor thread, 0 to call MonSample by hand.
+ * return: CVI_SUCCESS if no problem.
+ */
+CVI_S32 SAMPLE_COMM_VB_MonStart(CVI_U32 u32IntervalMs, SAMPLE_VB_MON_S **ppstMon);
+CVI_VOID SAMPLE_COMM_VB_MonSample(SAMPLE_VB_MON_S *pstMon);
+
+/* SAMPLE_COMM_VB_MonReport:
+ *   Print current/peak blocks per pool and the config they call for.
+ *
+ * [in]u32Headroom: blocks added to the peak of each pool.
+ * [out]pstSuggest: the suggested config, may be NULL.
+ */
+CVI_S32 SAMPLE_COMM_VB_MonReport(SAMPLE_VB_MON_S *pstMon, CVI_U32 u32Headroom, VB_CONFIG_S *pstSuggest);
+CVI_VOID SAMPLE_COMM_VB_MonStop(SAMPLE_VB_MON_S *pstMon);
+
+/*
+ * 2D strided copy on TDMA or the CPU. Give physical addresses for TDMA,
+ * virtual ones for the CPU, both to let the size decide.
+ */
+typedef struct _SAMPLE_COPY_2D_S {
+	CVI_U64 u64PhySrc;
+	CVI_U64 u64PhyDst;
+	CVI_VOID *pSrc;
+	CVI_VOID *pDst;
+	CVI_BOOL bCached;	// CPU mappings are cached, TDMA flushes/invalidates them
+	CVI_U32 u32WidthBytes;
+	CVI_U32 u32Height;
+	CVI_U32 u32SrcStride;
+	CVI_U32 u32DstStride;
+} SAMPLE_COPY_2D_S;
+
+CVI_S32 SAMPLE_COMM_COPY_2D(const SAMPLE_COPY_2D_S *pstCopy);
+
+/* SAMPLE_COMM_COPY_Crop:
+ *   Copy a ROI of every plane into the buffers of pstDst, which set the strides.
+ *   Fails without writing if a pstDst stride or length can't hold its plane.
+ *   Width/height/format of pstDst are updated.
+ */
+CVI_S32 SAMPLE_COMM_COPY_Crop(const VIDEO_FRAME_INFO_S *pstSrc, const RECT_S *pstRect, VIDEO_FRAME_INFO_S *pstDst);
+
+/* SAMPLE_COMM_COPY_Pack:
+ *   Strip the stride padding and put the planes back to back, e.g. NV21 for inference.
+ *
+ * return: bytes written, negative on error.
+ */
+CVI_S32 SAMPLE_COMM_COPY_Pack(const VIDEO_FRAME_INFO_S *pstSrc, CVI_U64 u64PhyDst, CVI_VOID *pDst,
+			      CVI_U32 u32DstLen);
+
+/* SAMPLE_COMM_COPY_Calibrate:
+ *   Time CPU and TDMA copies from 4 KB to 512 KB and keep the size from which
+ *   TDMA wins. Runs by itself before the first copy if not called.
+ *
+ * [in]bVerbose: print the timings.
+ */
+CVI_S32 SAMPLE_COMM_COPY_Calibrate(CVI_BOOL bVerbose);
+/* 0 forces the CPU */
+CVI_VOID SAMPLE_COMM_COPY_SetTdmaThreshold(CVI_U32 u32Bytes);
+/* 0 when TDMA never wins or is missing */
+CVI_U32 SAMPLE_COMM_COPY_GetTdmaThreshold(CVI_VOID);
+
+/*
+ * Pre-trigger ring of an H.264/H.265 channel: the last u32PreSec seconds stay in
+ * memory, a trigger stores them plus the following seconds to one file.
+ */
+typedef struct _SAMPLE_VENC_RING_S SAMPLE_VENC_RING_S;
+
+typedef struct _SAMPLE_VENC_RING_ATTR_S {
+	PAYLOAD_TYPE_E enType;
+	CVI_U32 u32BufSize;	// bytes, allocated once from ION; holds pre + post seconds at the max bitrate
+	CVI_U32 u32PreSec;
+	CVI_U32 u32MaxFrames;	// frame index entries, 0 for the default 4096
+} SAMPLE_VENC_RING_ATTR_S;
+
+typedef struct _SAMPLE_VENC_RING_STAT_S {
+	CVI_U32 u32Frames;	// in the ring now
+	CVI_U32 u32Bytes;
+	CVI_U64 u64SpanUs;
+	CVI_U64 u64Frames;	// totals since create
+	CVI_U64 u64Dropped;	// no room or waiting for an IDR
+	CVI_U64 u64Evicted;
+	CVI_U32 u32Events;
+	CVI_U32 u32Failed;
+	CVI_BOOL bRecording;
+} SAMPLE_VENC_RING_STAT_S;
+
+CVI_S32 SAMPLE_COMM_VENC_RING_Create(const SAMPLE_VENC_RING_ATTR_S *pstAttr, SAMPLE_VENC_RING_S **ppstRing);
+/* copy one frame in; the stream can be released right after */
+CVI_S32 SAMPLE_COMM_VENC_RING_Push(SAMPLE_VENC_RING_S *pstRing, const VENC_STREAM_S *pstStream);
+/* GetStream, Push and ReleaseStream on VencChn */
+CVI_S32 SAMPLE_COMM_VENC_RING_PushChn(SAMPLE_VENC_RING_S *pstRing, VENC_CHN VencChn, CVI_S32 s32MilliSec);
+
+/* SAMPLE_COMM_VENC_RING_Trigger:
+ *   Pin the ring and store it with the next u32PostSec seconds to pszPath from the
+ *   writer thread. Fails while the previous event is still being recorded.
+ */
+CVI_S32 SAMPLE_COMM_VENC_RING_Trigger(SAMPLE_VENC_RING_S *pstRing, CVI_U32 u32PostSec, const char *pszPath);
+/* until the event in progress is stored */
+CVI_S32 SAMPLE_COMM_VENC_RING_Wait(SAMPLE_VENC_RING_S *pstRing);
+CVI_S32 SAMPLE_COMM_VENC_RING_GetStat(SAMPLE_VENC_RING_S *pstRing, SAMPLE_VENC_RING_STAT_S *pstStat);
+CVI_VOID SAMPLE_COMM_VENC_RING_Destroy(SAMPLE_VENC_RING_S *pstRing);
+
+/* persistent LDC mesh cache, see sample_common_mesh.c */
+typedef struct _SAMPLE_MESH_CACHE_S SAMPLE_MESH_CACHE_S;
+
+typedef struct _SAMPLE_MESH_KEY_S {
+	LDC_ATTR_S stLDCAttr;
+	CVI_U32 u32Width;	/* channel output size */
+	CVI_U32 u32Height;
+	CVI_U32 u32MeshHor;	/* 0: library default */
+	CVI_U32 u32MeshVer;
+	ROTATION_E enRotation;
+} SAMPLE_MESH_KEY_S;
+
+typedef struct _SAMPLE_MESH_CACHE_STAT_S {
+	CVI_U32 u32Entries;
+	CVI_U32 u32Hits;
+	CVI_U32 u32Misses;
+	CVI_U32 u32Generated;
+	CVI_U32 u32Failed;
+	CVI_U32 u32Pending;
+} SAMPLE_MESH_CACHE_STAT_S;
+
+/* pszDir up to 75 chars, the mesh file names have to fit in a 128 byte path */
+CVI_S32 SAMPLE_COMM_MESH_CacheOpen(const char *pszDir, SAMPLE_MESH_CACHE_S **ppstCache);
+/* CVI_GDC_SetMeshSize, remembered as part of the key */
+CVI_S32 SAMPLE_COMM_MESH_CacheSetMeshSize(SAMPLE_MESH_CACHE_S *pstCache, CVI_U32 u32MeshHor, CVI_U32 u32MeshVer);
+/* CVI_SUCCESS and the mesh file on a hit, CVI_FAILURE on a miss */
+CVI_S32 SAMPLE_COMM_MESH_CacheLookup(SAMPLE_MESH_CACHE_S *pstCache, const SAMPLE_MESH_KEY_S *pstKey,
+	char *pszPath, CVI_U32 u32Len, CVI_U32 *pu32Size);
+/* read-only mapping of a cached table, released with SAMPLE_COMM_MESH_CacheUnmap */
+CVI_S32 SAMPLE_COMM_MESH_CacheMap(SAMPLE_MESH_CACHE_S *pstCache, const SAMPLE_MESH_KEY_S *pstKey,
+	const CVI_VOID **ppData, CVI_U32 *pu32Size);
+CVI_VOID SAMPLE_COMM_MESH_CacheUnmap(const CVI_VOID *pData, CVI_U32 u32Size);
+
+/* SAMPLE_COMM_MESH_SetVpssLDC/SetViLDC:
+ *   Drop-in for CVI_VPSS_SetChnLDCAttr/CVI_VI_SetChnLDCAttr, to be called
+ *   after the channel attribute and rotation are set. A cached mesh is
+ *   loaded as is; on a miss the mesh is built and stored inline when bWait,
+ *   otherwise by the worker thread while the channel runs uncorrected.
+ */
+CVI_S32 SAMPLE_COMM_MESH_SetVpssLDC(SAMPLE_MESH_CACHE_S *pstCache, VPSS_GRP VpssGrp, VPSS_CHN VpssChn,
+	const VPSS_LDC_ATTR_S *pstLDCAttr, CVI_BOOL bWait);
+CVI_S32 SAMPLE_COMM_MESH_SetViLDC(SAMPLE_MESH_CACHE_S *pstCache, VI_PIPE ViPipe, VI_CHN ViChn,
+	const VI_LDC_ATTR_S *pstLDCAttr, CVI_BOOL bWait);
+/* until the worker has nothing queued */
+CVI_S32 SAMPLE_COMM_MESH_CacheWait(SAMPLE_MESH_CACHE_S *pstCache);
+CVI_S32 SAMPLE_COMM_MESH_CacheGetStat(SAMPLE_MESH_CACHE_S *pstCache, SAMPLE_MESH_CACHE_STAT_S *pstStat);
+CVI_VOID SAMPLE_COMM_MESH_CacheClose(SAMPLE_MESH_CACHE_S *pstCache);
+
+/* low latency AI capture, see sample_common_audio_ll.c */
+typedef struct _SAMPLE_AUDIO_LL_S SAMPLE_AUDIO_LL_S;
+
+typedef struct _SAMPLE_AUDIO_LL_ATTR_S {
+	AUDIO_DEV AiDev;
+	AI_CHN AiChn;
+	AUDIO_SAMPLE_RATE_E enSamplerate;	/* 0: 16 kHz */
+	CVI_U32 u32ChnCnt;		/* 1 or 2, S16 interleaved */
+	CVI_U32 u32PtNumPerFrm;		/* period, 0: 80 */
+	CVI_U32 u32FrmNum;		/* periods queued in the driver, 0: 4 */
+	CVI_U32 u32RingFrames;		/* handoff ring, rounded up to a power of two, 0: 16 */
+	CVI_S32 s32Priority;		/* SCHED_FIFO priority of the capture thread, 0: normal */
+} SAMPLE_AUDIO_LL_ATTR_S;
+
+typedef struct _SAMPLE_AUDIO_LL_FRAME_S {
+	CVI_U8 *pu8Data;
+	CVI_U32 u32Len;			/* bytes */
+	CVI_U32 u32Samples;		/* per channel */
+	CVI_U32 u32Seq;
+	CVI_U64 u64TimeStamp;		/* from the AI frame */
+	CVI_U64 u64GetUs;		/* CLOCK_MONOTONIC when CVI_AI_GetFrame returned it */
+	CVI_U64 u64ReadUs;		/* CLOCK_MONOTONIC when handed to the consumer */
+} SAMPLE_AUDIO_LL_FRAME_S;
+
+typedef struct _SAMPLE_AUDIO_LL_STAT_S {
+	CVI_U32 u32Frames;		/* handed to the consumer */
+	CVI_U32 u32Lost;		/* gaps in the AI sequence: xruns below us */
+	CVI_U32 u32Overrun;		/* ring full, the consumer fell behind */
+	CVI_U32 u32PeriodUs;
+	CVI_U32 u32DepthMax;		/* frames in the ring */
+	CVI_U32 u32QueueAvgUs;		/* held in driver/library beyond the best frame */
+	CVI_U32 u32QueueMaxUs;
+	CVI_U32 u32HandoffAvgUs;	/* GetFrame return to the consumer */
+	CVI_U32 u32HandoffMaxUs;
+} SAMPLE_AUDIO_LL_STAT_S;
+
+CVI_S32 SAMPLE_COMM_AUDIO_LL_Start(const SAMPLE_AUDIO_LL_ATTR_S *pstAttr, SAMPLE_AUDIO_LL_S **ppstLL);
+/* single consumer; the frame stays valid until SAMPLE_COMM_AUDIO_LL_ReleaseFrame */
+CVI_S32 SAMPLE_COMM_AUDIO_LL_GetFrame(SAMPLE_AUDIO_LL_S *pstLL, SAMPLE_AUDIO_LL_FRAME_S **ppstFrame,
+	CVI_S32 s32MilliSec);
+CVI_S32 SAMPLE_COMM_AUDIO_LL_ReleaseFrame(SAMPLE_AUDIO_LL_S *pstLL);
+CVI_S32 SAMPLE_COMM_AUDIO_LL_GetStat(SAMPLE_AUDIO_LL_S *pstLL, SAMPLE_AUDIO_LL_STAT_S *pstStat);
+CVI_VOID SAMPLE_COMM_AUDIO_LL_Stop(SAMPLE_AUDIO_LL_S *pstLL);
+
+/* batched overlay updates, see sample_common_region_batch.c */
+typedef struct _SAMPLE_REGION_BATCH_S SAMPLE_REGION_BATCH_S;
+
+typedef struct _SAMPLE_REGION_BATCH_ATTR_S {
+	CVI_U32 u32MaxRegion;		/* canvases per batch, 0: 32 */
+	CVI_BOOL bFrameSync;		/* commit right after a frame of the VPSS channel below, u32Depth >= 1 */
+	VPSS_GRP SyncVpssGrp;
+	VPSS_CHN SyncVpssChn;
+	CVI_U32 u32SyncTimeoutMs;	/* 0: 40 */
+} SAMPLE_REGION_BATCH_ATTR_S;
+
+/* all but u32Commits and the averages describe the last commit */
+typedef struct _SAMPLE_REGION_BATCH_STAT_S {
+	CVI_U32 u32Commits;
+	CVI_U32 u32Canvases;		/* CVI_RGN_UpdateCanvas calls */
+	CVI_U32 u32DisplayAttrs;	/* CVI_RGN_SetDisplayAttr calls */
+	CVI_U32 u32Skipped;		/* display attributes equal to the applied ones */
+	CVI_U32 u32FlushRanges;		/* CVI_SYS_IonFlushCache calls */
+	CVI_U32 u32FlushBytes;
+	CVI_U32 u32Ioctls;		/* region ioctls, GetCanvasInfo included */
+	CVI_U32 u32BurstUs;		/* first UpdateCanvas to last SetDisplayAttr */
+	CVI_U32 u32CommitUs;		/* flush, frame sync and burst */
+	CVI_U32 u32CommitAvgUs;
+	CVI_U32 u32CommitMaxUs;
+	CVI_U32 u32SyncTimeouts;
+} SAMPLE_REGION_BATCH_STAT_S;
+
+CVI_S32 SAMPLE_COMM_REGION_BatchCreate(const SAMPLE_REGION_BATCH_ATTR_S *pstAttr,
+	SAMPLE_REGION_BATCH_S **ppstBatch);
+CVI_S32 SAMPLE_COMM_REGION_BatchBegin(SAMPLE_REGION_BATCH_S *pstBatch);
+/* the canvas stays the same until commit, pu8VirtAddr is a cached mapping */
+CVI_S32 SAMPLE_COMM_REGION_BatchGetCanvas(SAMPLE_REGION_BATCH_S *pstBatch, RGN_HANDLE Handle,
+	RGN_CANVAS_INFO_S *pstCanvasInfo);
+CVI_S32 SAMPLE_COMM_REGION_BatchSetBitMap(SAMPLE_REGION_BATCH_S *pstBatch, RGN_HANDLE Handle,
+	const BITMAP_S *pstBitmap);
+CVI_S32 SAMPLE_COMM_REGION_BatchSetDisplayAttr(SAMPLE_REGION_BATCH_S *pstBatch, RGN_HANDLE Handle,
+	const MMF_CHN_S *pstChn, const RGN_CHN_ATTR_S *pstChnAttr);
+CVI_S32 SAMPLE_COMM_REGION_BatchCommit(SAMPLE_REGION_BATCH_S *pstBatch);
+CVI_S32 SAMPLE_COMM_REGION_BatchAbort(SAMPLE_REGION_BATCH_S *pstBatch);
+CVI_S32 SAMPLE_COMM_REGION_BatchGetStat(SAMPLE_REGION_BATCH_S *pstBatch, SAMPLE_REGION_BATCH_STAT_S *pstStat);
+CVI_VOID SAMPLE_COMM_REGION_BatchDestroy(SAMPLE_REGION_BATCH_S *pstBatch);
+
 #ifdef __cplusplus
 #if __cplusplus
 }
@@ -0,0 +1,376 @@
+/*
+ * Copyright (C) Cvitek Co., Ltd. 2019-2020. All rights reserved.
+ *
+ * File Name: sample/common/sample_common_audio_ll.c
+ * Description:
+ *   Low latency AI capture.
+ *
+ *   The AI device runs with small periods, a short driver queue and no
+ *   VQE/resampling. A capture thread calls CVI_AI_GetFrame back to back,
+ *   copies each period into a single-producer single-consumer ring and
+ *   hands it over with a release store plus an eventfd kick, so the
+ *   consumer never shares a lock with the capture path. Lost AI frames,
+ *   ring overruns and the queueing/handoff delays are counted on the way.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+
+#include "sample_comm.h"
+
+#define AUDIO_LL_DEF_PTNUM	80	/* 5 ms at 16 kHz */
+#define AUDIO_LL_DEF_FRMNUM	4
+#define AUDIO_LL_DEF_RING	16
+
+#define AUDIO_LL_LOAD(p)	__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define AUDIO_LL_STORE(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define AUDIO_LL_ADD(p, v)	__atomic_add_fetch((p), (v), __ATOMIC_RELAXED)
+
+struct _SAMPLE_AUDIO_LL_S {
+	SAMPLE_AUDIO_LL_ATTR_S stAttr;
+	CVI_U32 u32PeriodUs;
+
+	/* ring, u32Head is written by the capture thread only, u32Tail by the consumer only */
+	SAMPLE_AUDIO_LL_FRAME_S *pastSlot;
+	CVI_U8 *pu8Data;
+	CVI_U32 u32SlotBytes;
+	CVI_U32 u32Mask;
+	CVI_U32 u32Head;
+	CVI_U32 u32Tail;
+	CVI_BOOL bHeld;		/* the consumer holds the frame at u32Tail */
+	int s32EventFd;
+
+	/* capture thread side */
+	CVI_BOOL bSeqValid;
+	CVI_U32 u32LastSeq;
+	CVI_U64 u64FirstUs;
+	CVI_U64 u64Periods;
+	CVI_S64 s64MinOffUs;
+	CVI_U64 u64QueueSumUs;
+
+	/* consumer side */
+	CVI_U64 u64HandoffSumUs;
+
+	SAMPLE_AUDIO_LL_STAT_S stStat;	/* see AUDIO_LL_ADD/LOAD */
+
+	pthread_t thread;
+	CVI_BOOL bExit;
+};
+
+static CVI_VOID audio_ll_max(CVI_U32 *pu32Max, CVI_U32 u32Val)
+{
+	if (u32Val > AUDIO_LL_LOAD(pu32Max))
+		AUDIO_LL_STORE(pu32Max, u32Val);
+}
+
+/* How late a frame comes out of CVI_AI_GetFrame compared to the earliest
+ * frame seen so far on the sample clock. The earliest one is as close to
+ * "period just completed" as we can get without a hardware timestamp, so
+ * this is the time spent queued in the driver and library.
+ */
+static CVI_VOID audio_ll_account_queue(SAMPLE_AUDIO_LL_S *pstLL, CVI_U64 u64Now, CVI_U32 u32Lost)
+{
+	CVI_S64 s64OffUs;
+	CVI_U32 u32QueueUs;
+
+	if (!pstLL->u64FirstUs)
+		pstLL->u64FirstUs = u64Now;
+	pstLL->u64Periods += u32Lost;
+	s64OffUs = (CVI_S64)(u64Now - pstLL->u64FirstUs) -
+		   (CVI_S64)(pstLL->u64Periods * pstLL->u32PeriodUs);
+	pstLL->u64Periods++;
+	if (pstLL->u64Periods == 1 || s64OffUs < pstLL->s64MinOffUs)
+		pstLL->s64MinOffUs = s64OffUs;
+
+	u32QueueUs = (CVI_U32)(s64OffUs - pstLL->s64MinOffUs);
+	pstLL->u64QueueSumUs += u32QueueUs;
+	AUDIO_LL_STORE(&pstLL->stStat.u32QueueAvgUs, (CVI_U32)(pstLL->u64QueueSumUs / pstLL->u64Periods));
+	audio_ll_max(&pstLL->stStat.u32QueueMaxUs, u32QueueUs);
+}
+
+static void *audio_ll_thread(void *arg)
+{
+	SAMPLE_AUDIO_LL_S *pstLL = (SAMPLE_AUDIO_LL_S *)arg;
+	const SAMPLE_AUDIO_LL_ATTR_S *pstAttr = &pstLL->stAttr;
+	AUDIO_FRAME_S stFrame;
+	AEC_FRAME_S stAecFrm;
+	CVI_U64 u64Kick = 1;
+	CVI_S32 s32Ret;
+
+	prctl(PR_SET_NAME, "audio_ll");
+
+	while (!AUDIO_LL_LOAD(&pstLL->bExit)) {
+		SAMPLE_AUDIO_LL_FRAME_S *pstSlot;
+		CVI_U32 u32Head, u32Lost = 0, u32Len;
+		CVI_U64 u64Now;
+
+		memset(&stAecFrm, 0, sizeof(stAecFrm));
+		s32Ret = CVI_AI_GetFrame(pstAttr->AiDev, pstAttr->AiChn, &stFrame, &stAecFrm, 100);
+		if (s32Ret != CVI_SUCCESS)
+			continue;
+		u64Now = SAMPLE_COMM_SYS_GetNowUs();
+
+		if (pstLL->bSeqValid && stFrame.u32Seq != pstLL->u32LastSeq + 1) {
+			u32Lost = stFrame.u32Seq - pstLL->u32LastSeq - 1;
+			/* a sequence restart after a reset is not a loss */
+			if (u32Lost > CVI_MAX_AUDIO_FRAME_NUM)
+				u32Lost = 0;
+			AUDIO_LL_ADD(&pstLL->stStat.u32Lost, u32Lost);
+		}
+		pstLL->bSeqValid = CVI_TRUE;
+		pstLL->u32LastSeq = stFrame.u32Seq;
+		audio_ll_account_queue(pstLL, u64Now, u32Lost);
+
+		u32Head = pstLL->u32Head;
+		if (u32Head - AUDIO_LL_LOAD(&pstLL->u32Tail) > pstLL->u32Mask) {
+			/* the consumer fell behind: drop the newest, the tail is not ours */
+			AUDIO_LL_ADD(&pstLL->stStat.u32Overrun, 1);
+			CVI_AI_ReleaseFrame(pstAttr->AiDev, pstAttr->AiChn, &stFrame, &stAecFrm);
+			continue;
+		}
+
+		/* interleaved in the first plane as the AI library hands it out */
+		u32Len = stFrame.u32Len * pstAttr->u32ChnCnt;
+		if (u32Len > pstLL->u32SlotBytes)
+			u32Len = pstLL->u32SlotBytes;
+		pstSlot = &pstLL->pastSlot[u32Head & pstLL->u32Mask];
+		memcpy(pstSlot->pu8Data, stFrame.u64VirAddr[0], u32Len);
+		pstSlot->u32Len = u32Len;
+		pstSlot->u32Samples = u32Len / (2 * pstAttr->u32ChnCnt);
+		pstSlot->u32Seq = stFrame.u32Seq;
+		pstSlot->u64TimeStamp = stFrame.u64TimeStamp;
+		pstSlot->u64GetUs = u64Now;
+		CVI_AI_ReleaseFrame(pstAttr->AiDev, pstAttr->AiChn, &stFrame, &stAecFrm);
+
+		AUDIO_LL_STORE(&pstLL->u32Head, u32Head + 1);
+		audio_ll_max(&pstLL->stStat.u32DepthMax, u32Head + 1 - AUDIO_LL_LOAD(&pstLL->u32Tail));
+		if (write(pstLL->s32EventFd, &u64Kick, sizeof(u64Kick)) < 0 && errno != EAGAIN)
+			SAMPLE_PRT("eventfd write failed, %s\n", strerror(errno));
+	}
+
+	return NULL;
+}
+
+static CVI_S32 audio_ll_start_ai(const SAMPLE_AUDIO_LL_ATTR_S *pstAttr)
+{
+	AI_CHN_PARAM_S stChnParam;
+	AIO_ATTR_S stAioAttr;
+	CVI_S32 s32Ret;
+
+	memset(&stAioAttr, 0, sizeof(stAioAttr));
+	stAioAttr.enSamplerate = pstAttr->enSamplerate;
+	stAioAttr.enBitwidth = AUDIO_BIT_WIDTH_16;
+	stAioAttr.enWorkmode = AIO_MODE_I2S_MASTER;
+	stAioAttr.enSoundmode = pstAttr->u32ChnCnt == 2 ? AUDIO_SOUND_MODE_STEREO : AUDIO_SOUND_MODE_MONO;
+	stAioAttr.u32FrmNum = pstAttr->u32FrmNum;
+	stAioAttr.u32PtNumPerFrm = pstAttr->u32PtNumPerFrm;
+	stAioAttr.u32ChnCnt = pstAttr->u32ChnCnt;
+	stAioAttr.u32ClkSel = 0;
+	stAioAttr.enI2sType = AIO_I2STYPE_INNERCODEC;
+
+	s32Ret = CVI_AI_SetPubAttr(pstAttr->AiDev, &stAioAttr);
+	if (s32Ret != CVI_SUCCESS) {
+		SAMPLE_PRT("CVI_AI_SetPubAttr(%d) failed with %#x\n", pstAttr->AiDev, s32Ret);
+		return s32Ret;
+	}
+	s32Ret = CVI_AI_Enable(pstAttr->AiDev);
+	if (s32Ret != CVI_SUCCESS) {
+		SAMPLE_PRT("CVI_AI_Enable(%d) failed with %#x\n", pstAttr->AiDev, s32Ret);
+		return s32Ret;
+	}
+	s32Ret = CVI_AI_EnableChn(pstAttr->AiDev, pstAttr->AiChn);
+	if (s32Ret != CVI_SUCCESS) {
+		SAMPLE_PRT("CVI_AI_EnableChn(%d,%d) failed with %#x\n", pstAttr->AiDev, pstAttr->AiChn, s32Ret);
+		CVI_AI_Disable(pstAttr->AiDev);
+		return s32Ret;
+	}
+
+	/* one frame may wait for us in the library, the rest is our ring */
+	stChnParam.u32UsrFrmDepth = 1;
+	s32Ret = CVI_AI_SetChnParam(pstAttr->AiDev, pstAttr->AiChn, &stChnParam);
+	if (s32Ret != CVI_SUCCESS) {
+		SAMPLE_PRT("CVI_AI_SetChnParam(%d,%d) failed with %#x\n", pstAttr->AiDev, pstAttr->AiChn, s32Ret);
+		CVI_AI_DisableChn(pstAttr->AiDev, pstAttr->AiChn);
+		CVI_AI_Disable(pstAttr->AiDev);
+		return s32Ret;
+	}
+
+	return CVI_SUCCESS;
+}
+
+CVI_S32 SAMPLE_COMM_AUDIO_LL_Start(const SAMPLE_AUDIO_LL_ATTR_S *pstAttr, SAMPLE_AUDIO_LL_S **ppstLL)
+{
+	SAMPLE_AUDIO_LL_S *pstLL;
+	struct sched_param param;
+	pthread_attr_t attr;
+	CVI_U32 u32Slots;
+	CVI_S32 s32Ret;
+
+	CHECK_NULL_PTR(pstAttr);
+	CHECK_NULL_PTR(ppstLL);
+
+	pstLL = calloc(1, sizeof(*pstLL));
+	if (!pstLL)
+		return CVI_FAILURE;
+	pstLL->stAttr = *pstAttr;
+	if (!pstLL->stAttr.enSamplerate)
+		pstLL->stAttr.enSamplerate = AUDIO_SAMPLE_RATE_16000;
+	if (!pstLL->stAttr.u32PtNumPerFrm)
+		pstLL->stAttr.u32PtNumPerFrm = AUDIO_LL_DEF_PTNUM;
+	if (!pstLL->stAttr.u32FrmNum)
+		pstLL->stAttr.u32FrmNum = AUDIO_LL_DEF_FRMNUM;
+	if (pstLL->stAttr.u32ChnCnt != 2)
+		pstLL->stAttr.u32ChnCnt = 1;
+	if (!pstLL->stAttr.u32RingFrames)
+		pstLL->stAttr.u32RingFrames = AUDIO_LL_DEF_RING;
+
+	for (u32Slots = 2; u32Slots < pstLL->stAttr.u32RingFrames; u32Slots <<= 1)
+		;
+	pstLL->u32Mask = u32Slots - 1;
+	pstLL->u32PeriodUs = (CVI_U32)((CVI_U64)pstLL->stAttr.u32PtNumPerFrm * 1000000 /
+				       pstLL->stAttr.enSamplerate);
+	pstLL->stStat.u32PeriodUs = pstLL->u32PeriodUs;
+	pstLL->u32SlotBytes = pstLL->stAttr.u32PtNumPerFrm * pstLL->stAttr.u32ChnCnt * 2;
+	pstLL->s32EventFd = -1;
+
+	pstLL->pastSlot = calloc(u32Slots, sizeof(*pstLL->pastSlot));
+	pstLL->pu8Data = malloc((size_t)u32Slots * pstLL->u32SlotBytes);
+	if (!pstLL->pastSlot || !pstLL->pu8Data) {
+		s32Ret = CVI_FAILURE;
+		goto err_free;
+	}
+	for (CVI_U32 i = 0; i < u32Slots; i++)
+		pstLL->pastSlot[i].pu8Data = pstLL->pu8Data + (size_t)i * pstLL->u32SlotBytes;
+
+	pstLL->s32EventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (pstLL->s32EventFd < 0) {
+		SAMPLE_PRT("eventfd failed, %s\n", strerror(errno));
+		s32Ret = CVI_FAILURE;
+		goto err_free;
+	}
+
+	s32Ret = audio_ll_start_ai(&pstLL->stAttr);
+	if (s32Ret != CVI_SUCCESS)
+		goto err_free;
+
+	pthread_attr_init(&attr);
+	if (pstLL->stAttr.s32Priority > 0) {
+		param.sched_priority = pstLL->stAttr.s32Priority;
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		pthread_attr_setschedparam(&attr, &param);
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	}
+	s32Ret = pthread_create(&pstLL->thread, &attr, audio_ll_thread, pstLL);
+	pthread_attr_destroy(&attr);
+	if (s32Ret != 0) {
+		SAMPLE_PRT("create audio_ll thread failed, %s\n", strerror(s32Ret));
+		CVI_AI_DisableChn(pstLL->stAttr.AiDev, pstLL->stAttr.AiChn);
+		CVI_AI_Disable(pstLL->stAttr.AiDev);
+		s32Ret = CVI_FAILURE;
+		goto err_free;
+	}
+
+	*ppstLL = pstLL;
+	return CVI_SUCCESS;
+
+err_free:
+	if (pstLL->s32EventFd >= 0)
+		close(pstLL->s32EventFd);
+	free(pstLL->pu8Data);
+	free(pstLL->pastSlot);
+	free(pstLL);
+	return s32Ret;
+}
+
+CVI_S32 SAMPLE_COMM_AUDIO_LL_GetFrame(SAMPLE_AUDIO_LL_S *pstLL, SAMPLE_AUDIO_LL_FRAME_S **ppstFrame,
+	CVI_S32 s32MilliSec)
+{
+	struct pollfd pfd;
+	CVI_U64 u64Kick, u64Now;
+	CVI_U32 u32HandoffUs, u32Tail;
+	SAMPLE_AUDIO_LL_FRAME_S *pstSlot;
+
+	CHECK_NULL_PTR(pstLL);
+	CHECK_NULL_PTR(ppstFrame);
+
+	if (pstLL->bHeld) {
+		SAMPLE_PRT("release the previous frame first\n");
+		return CVI_FAILURE;
+	}
+
+	u32Tail = pstLL->u32Tail;
+	while (AUDIO_LL_LOAD(&pstLL->u32Head) == u32Tail) {
+		pfd.fd = pstLL->s32EventFd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, s32MilliSec) <= 0)
+			return CVI_FAILURE;
+		if (read(pstLL->s32EventFd, &u64Kick, sizeof(u64Kick)) < 0 && errno != EAGAIN)
+			return CVI_FAILURE;
+	}
+
+	pstSlot = &pstLL->pastSlot[u32Tail & pstLL->u32Mask];
+	u64Now = SAMPLE_COMM_SYS_GetNowUs();
+	u32HandoffUs = (CVI_U32)(u64Now - pstSlot->u64GetUs);
+	pstSlot->u64ReadUs = u64Now;
+
+	pstLL->u64HandoffSumUs += u32HandoffUs;
+	AUDIO_LL_ADD(&pstLL->stStat.u32Frames, 1);
+	AUDIO_LL_STORE(&pstLL->stStat.u32HandoffAvgUs,
+		       (CVI_U32)(pstLL->u64HandoffSumUs / AUDIO_LL_LOAD(&pstLL->stStat.u32Frames)));
+	audio_ll_max(&pstLL->stStat.u32HandoffMaxUs, u32HandoffUs);
+
+	pstLL->bHeld = CVI_TRUE;
+	*ppstFrame = pstSlot;
+	return CVI_SUCCESS;
+}
+
+CVI_S32 SAMPLE_COMM_AUDIO_LL_ReleaseFrame(SAMPLE_AUDIO_LL_S *pstLL)
+{
+	CHECK_NULL_PTR(pstLL);
+
+	if (!pstLL->bHeld)
+		return CVI_FAILURE;
+	pstLL->bHeld = CVI_FALSE;
+	AUDIO_LL_STORE(&pstLL->u32Tail, pstLL->u32Tail + 1);
+	return CVI_SUCCESS;
+}
+
+CVI_S32 SAMPLE_COMM_AUDIO_LL_GetStat(SAMPLE_AUDIO_LL_S *pstLL, SAMPLE_AUDIO_LL_STAT_S *pstStat)
+{
+	CHECK_NULL_PTR(pstLL);
+	CHECK_NULL_PTR(pstStat);
+
+	pstStat->u32Frames = AUDIO_LL_LOAD(&pstLL->stStat.u32Frames);
+	pstStat->u32Lost = AUDIO_LL_LOAD(&pstLL->stStat.u32Lost);
+	pstStat->u32Overrun = AUDIO_LL_LOAD(&pstLL->stStat.u32Overrun);
+	pstStat->u32PeriodUs = pstLL->u32PeriodUs;
+	pstStat->u32DepthMax = AUDIO_LL_LOAD(&pstLL->stStat.u32DepthMax);
+	pstStat->u32QueueAvgUs = AUDIO_LL_LOAD(&pstLL->stStat.u32QueueAvgUs);
+	pstStat->u32QueueMaxUs = AUDIO_LL_LOAD(&pstLL->stStat.u32QueueMaxUs);
+	pstStat->u32HandoffAvgUs = AUDIO_LL_LOAD(&pstLL->stStat.u32HandoffAvgUs);
+	pstStat->u32HandoffMaxUs = AUDIO_LL_LOAD(&pstLL->stStat.u32HandoffMaxUs);
+	return CVI_SUCCESS;
+}
+
+CVI_VOID SAMPLE_COMM_AUDIO_LL_Stop(SAMPLE_AUDIO_LL_S *pstLL)
+{
+	if (!pstLL)
+		return;
+
+	AUDIO_LL_STORE(&pstLL->bExit, CVI_TRUE);
+	pthread_join(pstLL->thread, NULL);
+	CVI_AI_DisableChn(pstLL->stAttr.AiDev, pstLL->stAttr.AiChn);
+	CVI_AI_Disable(pstLL->stAttr.AiDev);
+
+	close(pstLL->s32EventFd);
+	free(pstLL->pu8Data);
+	free(pstLL->pastSlot);
+	free(pstLL);
+}
@@ -0,0 +1,409 @@
+/*
+ * Copyright (C) Cvitek Co., Ltd. 2019-2020. All rights reserved.
+ *
+ * File Name: sample/common/sample_common_copy.c
+ * Description:
+ *   2D strided copies (ROI crop, stride padding removal, plane packing)
+ *   on the TPU DMA engine or the CPU, whichever is faster for the size.
+ *
+ *   TDMA needs physical addresses and, for cached mappings, a cache flush
+ *   of the source and an invalidate of the destination; for small copies
+ *   that overhead is more than the CPU copy itself. The crossover is
+ *   measured once on ION buffers (SAMPLE_COMM_COPY_Calibrate, or lazily on
+ *   the first copy). Chips without a TPU always take the CPU path.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "sample_comm.h"
+
+#define COPY_CAL_MIN		(4 * 1024)
+#define COPY_CAL_MAX		(512 * 1024)
+#define COPY_CAL_ROW		1024	/* bytes per row, source stride twice that */
+#define COPY_CAL_ITERS		8
+#define COPY_NO_TDMA		0xFFFFFFFFU
+
+static CVI_U32 g_u32TdmaThreshold = COPY_NO_TDMA;
+static pthread_once_t g_copyCalOnce = PTHREAD_ONCE_INIT;
+static CVI_BOOL g_bCopyCalibrated;
+
+/* bytes from the first to the last byte touched */
+static CVI_U32 copy_span(CVI_U32 u32WidthBytes, CVI_U32 u32Height, CVI_U32 u32Stride)
+{
+	return u32Height ? (u32Height - 1) * u32Stride + u32WidthBytes : 0;
+}
+
+static CVI_VOID copy_cpu(const SAMPLE_COPY_2D_S *pstCopy)
+{
+	const CVI_U8 *src = pstCopy->pSrc;
+	CVI_U8 *dst = pstCopy->pDst;
+	CVI_U32 i;
+
+	if (pstCopy->u32SrcStride == pstCopy->u32WidthBytes &&
+	    pstCopy->u32DstStride == pstCopy->u32WidthBytes) {
+		memcpy(dst, src, (size_t)pstCopy->u32WidthBytes * pstCopy->u32Height);
+		return;
+	}
+
+	for (i = 0; i < pstCopy->u32Height; i++) {
+		memcpy(dst, src, pstCopy->u32WidthBytes);
+		src += pstCopy->u32SrcStride;
+		dst += pstCopy->u32DstStride;
+	}
+}
+
+static CVI_S32 copy_tdma(const SAMPLE_COPY_2D_S *pstCopy)
+{
+	CVI_TDMA_2D_S stParam;
+	CVI_U32 u32SrcSpan = copy_span(pstCopy->u32WidthBytes, pstCopy->u32Height, pstCopy->u32SrcStride);
+	CVI_U32 u32DstSpan = copy_span(pstCopy->u32WidthBytes, pstCopy->u32Height, pstCopy->u32DstStride);
+	CVI_S32 s32Ret;
+
+	if (pstCopy->bCached && pstCopy->pSrc)
+		CVI_SYS_IonFlushCache(pstCopy->u64PhySrc, pstCopy->pSrc, u32SrcSpan);
+	/* dirty lines over the destination must not be written back later */
+	if (pstCopy->bCached && pstCopy->pDst)
+		CVI_SYS_IonFlushCache(pstCopy->u64PhyDst, pstCopy->pDst, u32DstSpan);
+
+	stParam.paddr_src = pstCopy->u64PhySrc;
+	stParam.paddr_dst = pstCopy->u64PhyDst;
+	stParam.w_bytes = pstCopy->u32WidthBytes;
+	stParam.h = pstCopy->u32Height;
+	stParam.stride_bytes_src = pstCopy->u32SrcStride;
+	stParam.stride_bytes_dst = pstCopy->u32DstStride;
+	s32Ret = CVI_SYS_TDMACopy2D(&stParam);
+	if (s32Ret != CVI_SUCCESS)
+		return s32Ret;
+
+	if (pstCopy->bCached && pstCopy->pDst)
+		CVI_SYS_IonInvalidateCache(pstCopy->u64PhyDst, pstCopy->pDst, u32DstSpan);
+
+	return CVI_SUCCESS;
+}
+
+static CVI_U64 copy_time(const SAMPLE_COPY_2D_S *pstCopy, CVI_BOOL bTdma)
+{
+	CVI_U64 u64Best = ~0ULL, t0, t;
+	CVI_S32 i;
+
+	for (i = 0; i < COPY_CAL_ITERS; i++) {
+		/* the source comes from hardware in real use, start with it cold */
+		CVI_SYS_IonFlushCache(pstCopy->u64PhySrc, pstCopy->pSrc,
+				      copy_span(pstCopy->u32WidthBytes, pstCopy->u32Height, pstCopy->u32SrcStride));
+		CVI_SYS_IonInvalidateCache(pstCopy->u64PhySrc, pstCopy->pSrc,
+				      copy_span(pstCopy->u32WidthBytes, pstCopy->u32Height, pstCopy->u32SrcStride));
+
+		t0 = SAMPLE_COMM_SYS_GetNowUs();
+		if (bTdma) {
+			if (copy_tdma(pstCopy) != CVI_SUCCESS)
+				return ~0ULL;
+		} else {
+			copy_cpu(pstCopy);
+		}
+		t = SAMPLE_COMM_SYS_GetNowUs() - t0;
+		if (t < u64Best)
+			u64Best = t;
+	}
+
+	return u64Best;
+}
+
+static CVI_VOID copy_calibrate(CVI_BOOL bVerbose)
+{
+	SAMPLE_COPY_2D_S stCopy;
+	CVI_U64 u64PhySrc, u64PhyDst, u64Cpu, u64Tdma;
+	CVI_VOID *pSrc, *pDst;
+	CVI_U32 u32Size, u32Threshold = COPY_NO_TDMA;
+
+	g_bCopyCalibrated = CVI_TRUE;
+
+	if (CVI_SYS_IonAlloc_Cached(&u64PhySrc, &pSrc, "copy_cal_src", COPY_CAL_MAX * 2) != CVI_SUCCESS)
+		return;
+	if (CVI_SYS_IonAlloc_Cached(&u64PhyDst, &pDst, "copy_cal_dst", COPY_CAL_MAX) != CVI_SUCCESS) {
+		CVI_SYS_IonFree(u64PhySrc, pSrc);
+		return;
+	}
+	memset(pSrc, 0x5a, COPY_CAL_MAX * 2);
+
+	memset(&stCopy, 0, sizeof(stCopy));
+	stCopy.u64PhySrc = u64PhySrc;
+	stCopy.u64PhyDst = u64PhyDst;
+	stCopy.pSrc = pSrc;
+	stCopy.pDst = pDst;
+	stCopy.bCached = CVI_TRUE;
+	stCopy.u32WidthBytes = COPY_CAL_ROW;
+	stCopy.u32SrcStride = COPY_CAL_ROW * 2;
+	stCopy.u32DstStride = COPY_CAL_ROW;
+
+	/* smallest size from which TDMA stays ahead */
+	for (u32Size = COPY_CAL_MIN; u32Size <= COPY_CAL_MAX; u32Size *= 2) {
+		stCopy.u32Height = u32Size / COPY_CAL_ROW;
+		u64Cpu = copy_time(&stCopy, CVI_FALSE);
+		u64Tdma = copy_time(&stCopy, CVI_TRUE);
+
+		if (bVerbose) {
+			if (u64Tdma == ~0ULL)
+				printf("copy %7u bytes: cpu %6llu us, tdma n/a\n", u32Size, (unsigned long long)u64Cpu);
+			else
+				printf("copy %7u bytes: cpu %6llu us, tdma %6llu us\n", u32Size,
+				       (unsigned long long)u64Cpu, (unsigned long long)u64Tdma);
+		}
+
+		if (u64Tdma == ~0ULL) {
+			u32Threshold = COPY_NO_TDMA;
+			break;
+		}
+		if (u64Tdma < u64Cpu) {
+			if (u32Threshold == COPY_NO_TDMA)
+				u32Threshold = u32Size;
+		} else {
+			u32Threshold = COPY_NO_TDMA;
+		}
+	}
+
+	CVI_SYS_IonFree(u64PhyDst, pDst);
+	CVI_SYS_IonFree(u64PhySrc, pSrc);
+
+	g_u32TdmaThreshold = u32Threshold;
+	if (bVerbose) {
+		if (u32Threshold == COPY_NO_TDMA)
+			printf("copy: cpu only\n");
+		else
+			printf("copy: tdma from %u bytes\n", u32Threshold);
+	}
+}
+
+static CVI_VOID copy_calibrate_once(CVI_VOID)
+{
+	if (!g_bCopyCalibrated)
+		copy_calibrate(CVI_FALSE);
+}
+
+CVI_S32 SAMPLE_COMM_COPY_Calibrate(CVI_BOOL bVerbose)
+{
+	copy_calibrate(bVerbose);
+	return CVI_SUCCESS;
+}
+
+CVI_VOID SAMPLE_COMM_COPY_SetTdmaThreshold(CVI_U32 u32Bytes)
+{
+	g_bCopyCalibrated = CVI_TRUE;
+	g_u32TdmaThreshold = u32Bytes ? u32Bytes : COPY_NO_TDMA;
+}
+
+CVI_U32 SAMPLE_COMM_COPY_GetTdmaThreshold(CVI_VOID)
+{
+	pthread_once(&g_copyCalOnce, copy_calibrate_once);
+	return g_u32TdmaThreshold == COPY_NO_TDMA ? 0 : g_u32TdmaThreshold;
+}
+
+CVI_S32 SAMPLE_COMM_COPY_2D(const SAMPLE_COPY_2D_S *pstCopy)
+{
+	CVI_BOOL bTdmaOk, bCpuOk;
+
+	CHECK_NULL_PTR(pstCopy);
+	if (!pstCopy->u32WidthBytes || !pstCopy->u32Height)
+		return CVI_SUCCESS;
+	if (pstCopy->u32SrcStride < pstCopy->u32WidthBytes || pstCopy->u32DstStride < pstCopy->u32WidthBytes) {
+		SAMPLE_PRT("stride smaller than width\n");
+		return CVI_FAILURE;
+	}
+
+	bTdmaOk = pstCopy->u64PhySrc && pstCopy->u64PhyDst;
+	bCpuOk = pstCopy->pSrc && pstCopy->pDst;
+
+	if (bTdmaOk) {
+		pthread_once(&g_copyCalOnce, copy_calibrate_once);
+		if ((!bCpuOk || pstCopy->u32WidthBytes * pstCopy->u32Height >= g_u32TdmaThreshold) &&
+		    copy_tdma(pstCopy) == CVI_SUCCESS)
+			return CVI_SUCCESS;
+	}
+
+	if (!bCpuOk) {
+		SAMPLE_PRT("no virtual address for the cpu copy\n");
+		return CVI_FAILURE;
+	}
+
+	copy_cpu(pstCopy);
+	return CVI_SUCCESS;
+}
+
+/* per plane: bytes per sample unit, horizontal and vertical subsampling */
+static CVI_S32 copy_planes(PIXEL_FORMAT_E enFmt, CVI_U32 au32Bpp[3], CVI_U32 au32HSub[3], CVI_U32 au32VSub[3])
+{
+	CVI_U32 i;
+
+	for (i = 0; i < 3; i++) {
+		au32Bpp[i] = 1;
+		au32HSub[i] = 1;
+		au32VSub[i] = 1;
+	}
+
+	switch (enFmt) {
+	case PIXEL_FORMAT_YUV_400:
+		return 1;
+	case PIXEL_FORMAT_RGB_888:
+	case PIXEL_FORMAT_BGR_888:
+		au32Bpp[0] = 3;
+		return 1;
+	case PIXEL_FORMAT_ARGB_8888:
+		au32Bpp[0] = 4;
+		return 1;
+	case PIXEL_FORMAT_ARGB_1555:
+	case PIXEL_FORMAT_ARGB_4444:
+		au32Bpp[0] = 2;
+		return 1;
+	case PIXEL_FORMAT_YUYV:
+	case PIXEL_FORMAT_UYVY:
+	case PIXEL_FORMAT_YVYU:
+	case PIXEL_FORMAT_VYUY:
+		/* one Y0 U Y1 V unit per two pixels */
+		au32Bpp[0] = 4;
+		au32HSub[0] = 2;
+		return 1;
+	case PIXEL_FORMAT_NV12:
+	case PIXEL_FORMAT_NV21:
+		au32Bpp[1] = 2;
+		au32HSub[1] = 2;
+		au32VSub[1] = 2;
+		return 2;
+	case PIXEL_FORMAT_NV16:
+	case PIXEL_FORMAT_NV61:
+		au32Bpp[1] = 2;
+		au32HSub[1] = 2;
+		return 2;
+	case PIXEL_FORMAT_YUV_PLANAR_420:
+		au32HSub[1] = au32HSub[2] = 2;
+		au32VSub[1] = au32VSub[2] = 2;
+		return 3;
+	case PIXEL_FORMAT_YUV_PLANAR_422:
+		au32HSub[1] = au32HSub[2] = 2;
+		return 3;
+	case PIXEL_FORMAT_YUV_PLANAR_444:
+	case PIXEL_FORMAT_RGB_888_PLANAR:
+	case PIXEL_FORMAT_BGR_888_PLANAR:
+		return 3;
+	default:
+		return 0;
+	}
+}
+
+CVI_S32 SAMPLE_COMM_COPY_Crop(const VIDEO_FRAME_INFO_S *pstSrc, const RECT_S *pstRect, VIDEO_FRAME_INFO_S *pstDst)
+{
+	const VIDEO_FRAME_S *s;
+	VIDEO_FRAME_S *d;
+	SAMPLE_COPY_2D_S stCopy;
+	CVI_U32 au32Bpp[3], au32HSub[3], au32VSub[3];
+	CVI_U32 u32X, u32Y, u32Off, u32WidthBytes, u32Height;
+	CVI_S32 i, s32Planes;
+
+	CHECK_NULL_PTR(pstSrc);
+	CHECK_NULL_PTR(pstRect);
+	CHECK_NULL_PTR(pstDst);
+	s = &pstSrc->stVFrame;
+	d = &pstDst->stVFrame;
+
+	s32Planes = copy_planes(s->enPixelFormat, au32Bpp, au32HSub, au32VSub);
+	if (!s32Planes || s->enCompressMode != COMPRESS_MODE_NONE) {
+		SAMPLE_PRT("pixel format %d not supported\n", s->enPixelFormat);
+		return CVI_FAILURE;
+	}
+	if (pstRect->s32X < 0 || pstRect->s32Y < 0 ||
+	    pstRect->s32X + pstRect->u32Width > s->u32Width ||
+	    pstRect->s32Y + pstRect->u32Height > s->u32Height) {
+		SAMPLE_PRT("crop (%d,%d %ux%u) outside the frame\n", pstRect->s32X, pstRect->s32Y,
+			   pstRect->u32Width, pstRect->u32Height);
+		return CVI_FAILURE;
+	}
+	for (i = 0; i < s32Planes; i++) {
+		if ((pstRect->s32X | pstRect->u32Width) % au32HSub[i] ||
+		    (pstRect->s32Y | pstRect->u32Height) % au32VSub[i]) {
+			SAMPLE_PRT("crop not aligned to the chroma subsampling\n");
+			return CVI_FAILURE;
+		}
+	}
+	/* check every destination plane before any is written */
+	for (i = 0; i < s32Planes && pstRect->u32Height; i++) {
+		u32WidthBytes = pstRect->u32Width / au32HSub[i] * au32Bpp[i];
+		u32Height = pstRect->u32Height / au32VSub[i];
+		if (d->u32Stride[i] < u32WidthBytes ||
+		    (CVI_U64)(u32Height - 1) * d->u32Stride[i] + u32WidthBytes > d->u32Length[i]) {
+			SAMPLE_PRT("destination plane %d too small, stride %u length %u for %ux%u bytes\n",
+				   i, d->u32Stride[i], d->u32Length[i], u32WidthBytes, u32Height);
+			return CVI_FAILURE;
+		}
+	}
+
+	for (i = 0; i < s32Planes; i++) {
+		u32X = pstRect->s32X / au32HSub[i] * au32Bpp[i];
+		u32Y = pstRect->s32Y / au32VSub[i];
+		u32Off = u32Y * s->u32Stride[i] + u32X;
+
+		memset(&stCopy, 0, sizeof(stCopy));
+		stCopy.u32WidthBytes = pstRect->u32Width / au32HSub[i] * au32Bpp[i];
+		stCopy.u32Height = pstRect->u32Height / au32VSub[i];
+		stCopy.u32SrcStride = s->u32Stride[i];
+		stCopy.u32DstStride = d->u32Stride[i];
+		stCopy.u64PhySrc = s->u64PhyAddr[i] ? s->u64PhyAddr[i] + u32Off : 0;
+		stCopy.u64PhyDst = d->u64PhyAddr[i];
+		stCopy.pSrc = s->pu8VirAddr[i] ? s->pu8VirAddr[i] + u32Off : NULL;
+		stCopy.pDst = d->pu8VirAddr[i];
+		stCopy.bCached = CVI_TRUE;
+
+		if (SAMPLE_COMM_COPY_2D(&stCopy) != CVI_SUCCESS)
+			return CVI_FAILURE;
+	}
+
+	d->enPixelFormat = s->enPixelFormat;
+	d->u32Width = pstRect->u32Width;
+	d->u32Height = pstRect->u32Height;
+	d->u64PTS = s->u64PTS;
+
+	return CVI_SUCCESS;
+}
+
+CVI_S32 SAMPLE_COMM_COPY_Pack(const VIDEO_FRAME_INFO_S *pstSrc, CVI_U64 u64PhyDst, CVI_VOID *pDst,
+			      CVI_U32 u32DstLen)
+{
+	const VIDEO_FRAME_S *s;
+	SAMPLE_COPY_2D_S stCopy;
+	CVI_U32 au32Bpp[3], au32HSub[3], au32VSub[3];
+	CVI_U32 u32Off = 0, u32Len;
+	CVI_S32 i, s32Planes;
+
+	CHECK_NULL_PTR(pstSrc);
+	s = &pstSrc->stVFrame;
+
+	s32Planes = copy_planes(s->enPixelFormat, au32Bpp, au32HSub, au32VSub);
+	if (!s32Planes || s->enCompressMode != COMPRESS_MODE_NONE) {
+		SAMPLE_PRT("pixel format %d not supported\n", s->enPixelFormat);
+		return CVI_FAILURE;
+	}
+
+	for (i = 0; i < s32Planes; i++) {
+		memset(&stCopy, 0, sizeof(stCopy));
+		stCopy.u32WidthBytes = (s->u32Width + au32HSub[i] - 1) / au32HSub[i] * au32Bpp[i];
+		stCopy.u32Height = (s->u32Height + au32VSub[i] - 1) / au32VSub[i];
+		stCopy.u32SrcStride = s->u32Stride[i];
+		stCopy.u32DstStride = stCopy.u32WidthBytes;
+		stCopy.u64PhySrc = s->u64PhyAddr[i];
+		stCopy.u64PhyDst = u64PhyDst ? u64PhyDst + u32Off : 0;
+		stCopy.pSrc = s->pu8VirAddr[i];
+		stCopy.pDst = pDst ? (CVI_U8 *)pDst + u32Off : NULL;
+		stCopy.bCached = CVI_TRUE;
+
+		u32Len = stCopy.u32WidthBytes * stCopy.u32Height;
+		if (u32Off + u32Len > u32DstLen) {
+			SAMPLE_PRT("destination too small, %u bytes needed\n", u32Off + u32Len);
+			return CVI_FAILURE;
+		}
+		if (SAMPLE_COMM_COPY_2D(&stCopy) != CVI_SUCCESS)
+			return CVI_FAILURE;
+		u32Off += u32Len;
+	}
+
+	return u32Off;
+}
@@ -0,0 +1,404 @@
+/*
+ * Copyright (C) Cvitek Co., Ltd. 2019-2020. All rights reserved.
+ *
+ * File Name: sample/common/sample_common_dispatch.c
+ * Description:
+ *   Single thread frame dispatcher for VPSS and VENC channels.
+ *
+ *   Instead of one thread per channel blocking in CVI_VPSS_GetChnFrame or
+ *   CVI_VENC_GetStream, all channel fds go into one level-triggered epoll.
+ *   VENC has an fd per channel, VPSS one device fd for all of them, so each
+ *   distinct fd is registered once and wakes every channel behind it; a
+ *   channel without a frame is skipped by the non-blocking get.
+ *   Each wakeup serves the ready channels round robin, at most u32Budget
+ *   frames each, starting one channel further every time so a busy channel
+ *   cannot starve the others. Frame PTS are CLOCK_MONOTONIC microseconds,
+ *   which gives the capture to callback latency of every channel.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "sample_comm.h"
+
+typedef enum _SAMPLE_DISPATCH_TYPE_E {
+	SAMPLE_DISPATCH_VPSS = 0,
+	SAMPLE_DISPATCH_VENC,
+} SAMPLE_DISPATCH_TYPE_E;
+
+typedef struct _SAMPLE_DISPATCH_CHN_S {
+	SAMPLE_DISPATCH_TYPE_E enType;
+	VPSS_GRP VpssGrp;
+	CVI_S32 s32Chn;
+	CVI_S32 s32Fd;
+	CVI_BOOL bReady;
+	SAMPLE_DISPATCH_VPSS_CB pfnVpssCb;
+	SAMPLE_DISPATCH_VENC_CB pfnVencCb;
+	SAMPLE_DISPATCH_CHN_ATTR_S stAttr;
+	SAMPLE_DISPATCH_STAT_S stStat;
+} SAMPLE_DISPATCH_CHN_S;
+
+struct _SAMPLE_DISPATCH_S {
+	CVI_S32 s32EpollFd;
+	CVI_S32 s32StopFd;
+	CVI_S32 s32ChnNum;
+	CVI_S32 s32Cursor;
+	SAMPLE_DISPATCH_CHN_S astChn[SAMPLE_DISPATCH_MAX_CHN];
+	/* distinct fds in the epoll set, epoll data is the index in here */
+	CVI_S32 as32Fd[SAMPLE_DISPATCH_MAX_CHN];
+	CVI_S32 s32FdNum;
+	CVI_BOOL bVpssFd;
+};
+
+static void dispatch_account(SAMPLE_DISPATCH_STAT_S *pstStat, CVI_U64 u64Pts, CVI_U64 u64Start, CVI_U64 u64End)
+{
+	CVI_U32 u32Us;
+
+	pstStat->u64Frames++;
+
+	/* frames sent by the user or from a stale clock carry no usable PTS */
+	if (u64Pts && u64Pts <= u64Start) {
+		u32Us = (CVI_U32)(u64Start - u64Pts);
+		if (!pstStat->u64LatFrames++ || u32Us < pstStat->u32LatMinUs)
+			pstStat->u32LatMinUs = u32Us;
+		if (u32Us > pstStat->u32LatMaxUs)
+			pstStat->u32LatMaxUs = u32Us;
+		pstStat->u64LatSumUs += u32Us;
+	}
+
+	u32Us = (CVI_U32)(u64End - u64Start);
+	if (u32Us > pstStat->u32CbMaxUs)
+		pstStat->u32CbMaxUs = u32Us;
+	pstStat->u64CbSumUs += u32Us;
+}
+
+CVI_S32 SAMPLE_COMM_DISPATCH_Create(SAMPLE_DISPATCH_S **ppstDisp)
+{
+	SAMPLE_DISPATCH_S *pstDisp;
+	struct epoll_event ev;
+
+	CHECK_NULL_PTR(ppstDisp);
+
+	pstDisp = calloc(1, sizeof(*pstDisp));
+	if (!pstDisp) {
+		SAMPLE_PRT("dispatcher alloc failed\n");
+		return CVI_FAILURE;
+	}
+
+	pstDisp->s32EpollFd = epoll_create1(EPOLL_CLOEXEC);
+	pstDisp->s32StopFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (pstDisp->s32EpollFd < 0 || pstDisp->s32StopFd < 0) {
+		SAMPLE_PRT("epoll/eventfd failed, %s\n", strerror(errno));
+		goto err;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u32 = SAMPLE_DISPATCH_MAX_CHN;
+	if (epoll_ctl(pstDisp->s32EpollFd, EPOLL_CTL_ADD, pstDisp->s32StopFd, &ev) < 0) {
+		SAMPLE_PRT("epoll_ctl stop fd failed, %s\n", strerror(errno));
+		goto err;
+	}
+
+	*ppstDisp = pstDisp;
+	return CVI_SUCCESS;
+
+err:
+	if (pstDisp->s32EpollFd >= 0)
+		close(pstDisp->s32EpollFd);
+	if (pstDisp->s32StopFd >= 0)
+		close(pstDisp->s32StopFd);
+	free(pstDisp);
+	return CVI_FAILURE;
+}
+
+static CVI_S32 dispatch_add(SAMPLE_DISPATCH_S *pstDisp, SAMPLE_DISPATCH_CHN_S *pstChn,
+			    const SAMPLE_DISPATCH_CHN_ATTR_S *pstAttr)
+{
+	struct epoll_event ev;
+	CVI_S32 s32Idx = pstDisp->s32ChnNum;
+	CVI_S32 i;
+
+	if (pstChn->s32Fd < 0) {
+		SAMPLE_PRT("get fd of chn %d failed with %#x\n", pstChn->s32Chn, pstChn->s32Fd);
+		return CVI_FAILURE;
+	}
+
+	if (pstAttr)
+		pstChn->stAttr = *pstAttr;
+	if (!pstChn->stAttr.u32Budget)
+		pstChn->stAttr.u32Budget = 1;
+	if (pstChn->enType == SAMPLE_DISPATCH_VENC && pstChn->stAttr.bDropOldest) {
+		/* skipping encoded frames would break the GOP */
+		SAMPLE_PRT("bDropOldest ignored on venc chn %d\n", pstChn->s32Chn);
+		pstChn->stAttr.bDropOldest = CVI_FALSE;
+	}
+
+	for (i = 0; i < pstDisp->s32FdNum; i++) {
+		if (pstDisp->as32Fd[i] == pstChn->s32Fd)
+			break;
+	}
+	if (i == pstDisp->s32FdNum) {
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.u32 = i;
+		if (epoll_ctl(pstDisp->s32EpollFd, EPOLL_CTL_ADD, pstChn->s32Fd, &ev) < 0) {
+			SAMPLE_PRT("epoll_ctl fd %d failed, %s\n", pstChn->s32Fd, strerror(errno));
+			return CVI_FAILURE;
+		}
+		pstDisp->as32Fd[pstDisp->s32FdNum++] = pstChn->s32Fd;
+	}
+	if (pstChn->enType == SAMPLE_DISPATCH_VPSS)
+		pstDisp->bVpssFd = CVI_TRUE;
+
+	pstDisp->astChn[s32Idx] = *pstChn;
+	pstDisp->s32ChnNum++;
+
+	return s32Idx;
+}
+
+CVI_S32 SAMPLE_COMM_DISPATCH_AddVpssChn(SAMPLE_DISPATCH_S *pstDisp, VPSS_GRP VpssGrp, VPSS_CHN VpssChn,
+	SAMPLE_DISPATCH_VPSS_CB pfnCb, const SAMPLE_DISPATCH_CHN_ATTR_S *pstAttr)
+{
+	SAMPLE_DISPATCH_CHN_S stChn;
+
+	CHECK_NULL_PTR(pstDisp);
+	CHECK_NULL_PTR(pfnCb);
+	if (pstDisp->s32ChnNum >= SAMPLE_DISPATCH_MAX_CHN)
+		return CVI_FAILURE;
+
+	memset(&stChn, 0, sizeof(stChn));
+	stChn.enType = SAMPLE_DISPATCH_VPSS;
+	stChn.VpssGrp = VpssGrp;
+	stChn.s32Chn = VpssChn;
+	stChn.s32Fd = CVI_VPSS_GetChnFd(VpssGrp, VpssChn);
+	stChn.pfnVpssCb = pfnCb;
+
+	return dispatch_add(pstDisp, &stChn, pstAttr);
+}
+
+CVI_S32 SAMPLE_COMM_DISPATCH_AddVencChn(SAMPLE_DISPATCH_S *pstDisp, VENC_CHN VencChn,
+	SAMPLE_DISPATCH_VENC_CB pfnCb, const SAMPLE_DISPATCH_CHN_ATTR_S *pstAttr)
+{
+	SAMPLE_DISPATCH_CHN_S stChn;
+
+	CHECK_NULL_PTR(pstDisp);
+	CHECK_NULL_PTR(pfnCb);
+	if (pstDisp->s32ChnNum >= SAMPLE_DISPATCH_MAX_CHN)
+		return CVI_FAILURE;
+
+	memset(&stChn, 0, sizeof(stChn));
+	stChn.enType = SAMPLE_DISPATCH_VENC;
+	stChn.s32Chn = VencChn;
+	stChn.s32Fd = CVI_VENC_GetFd(VencChn);
+	stChn.pfnVencCb = pfnCb;
+
+	return dispatch_add(pstDisp, &stChn, pstAttr);
+}
+
+/* returns CVI_TRUE if a frame was handled, CVI_FALSE once the channel is empty */
+static CVI_BOOL dispatch_vpss_one(SAMPLE_DISPATCH_CHN_S *pstChn)
+{
+	VIDEO_FRAME_INFO_S astFrame[2];
+	CVI_S32 cur = 0;
+	CVI_U64 u64Start;
+	CVI_S32 s32Ret;
+
+	if (CVI_VPSS_GetChnFrame(pstChn->VpssGrp, pstChn->s32Chn, &astFrame[cur], 0) != CVI_SUCCESS)
+		return CVI_FALSE;
+
+	/* only the newest frame matters, give the rest back to the pool */
+	while (pstChn->stAttr.bDropOldest &&
+	       CVI_VPSS_GetChnFrame(pstChn->VpssGrp, pstChn->s32Chn, &astFrame[!cur], 0) == CVI_SUCCESS) {
+		CVI_VPSS_ReleaseChnFrame(pstChn->VpssGrp, pstChn->s32Chn, &astFrame[cur]);
+		pstChn->stStat.u64Dropped++;
+		cur = !cur;
+	}
+
+	u64Start = SAMPLE_COMM_SYS_GetNowUs();
+	s32Ret = pstChn->pfnVpssCb(pstChn->VpssGrp, pstChn->s32Chn, &astFrame[cur], pstChn->stAttr.pvData);
+	dispatch_account(&pstChn->stStat, astFrame[cur].stVFrame.u64PTS, u64Start, SAMPLE_COMM_SYS_GetNowUs());
+	if (s32Ret != CVI_SUCCESS)
+		pstChn->stStat.u64Errors++;
+
+	CVI_VPSS_ReleaseChnFrame(pstChn->VpssGrp, pstChn->s32Chn, &astFrame[cur]);
+
+	return CVI_TRUE;
+}
+
+static CVI_BOOL dispatch_venc_one(SAMPLE_DISPATCH_CHN_S *pstChn)
+{
+	VENC_CHN_STATUS_S stStat;
+	VENC_STREAM_S stStream;
+	CVI_U64 u64Start;
+	CVI_S32 s32Ret;
+
+	if (CVI_VENC_QueryStatus(pstChn->s32Chn, &stStat) != CVI_SUCCESS || !stStat.u32CurPacks)
+		return CVI_FALSE;
+
+	memset(&stStream, 0, sizeof(stStream));
+	stStream.pstPack = (VENC_PACK_S *)malloc(sizeof(VENC_PACK_S) * stStat.u32CurPacks);
+	if (!stStream.pstPack) {
+		pstChn->stStat.u64Errors++;
+		return CVI_FALSE;
+	}
+
+	s32Ret = CVI_VENC_GetStream(pstChn->s32Chn, &stStream, 0);
+	if (s32Ret != CVI_SUCCESS) {
+		if (s32Ret != CVI_ERR_VENC_BUSY)
+			pstChn->stStat.u64Errors++;
+		free(stStream.pstPack);
+		return CVI_FALSE;
+	}
+
+	u64Start = SAMPLE_COMM_SYS_GetNowUs();
+	s32Ret = pstChn->pfnVencCb(pstChn->s32Chn, &stStream, pstChn->stAttr.pvData);
+	dispatch_account(&pstChn->stStat, stStream.u32PackCount ? stStream.pstPack[0].u64PTS : 0,
+			 u64Start, SAMPLE_COMM_SYS_GetNowUs());
+	if (s32Ret != CVI_SUCCESS)
+		pstChn->stStat.u64Errors++;
+
+	CVI_VENC_ReleaseStream(pstChn->s32Chn, &stStream);
+	free(stStream.pstPack);
+
+	return CVI_TRUE;
+}
+
+static CVI_VOID dispatch_serve(SAMPLE_DISPATCH_S *pstDisp)
+{
+	SAMPLE_DISPATCH_CHN_S *pstChn;
+	CVI_S32 i, n = pstDisp->s32ChnNum;
+	CVI_U32 j;
+	CVI_BOOL bGot;
+
+	for (i = 0; i < n; i++) {
+		pstChn = &pstDisp->astChn[(pstDisp->s32Cursor + i) % n];
+		if (!pstChn->bReady)
+			continue;
+		pstChn->bReady = CVI_FALSE;
+
+		/* whatever is left over keeps the fd readable for the next wakeup */
+		for (j = 0; j < pstChn->stAttr.u32Budget; j++) {
+			if (pstChn->enType == SAMPLE_DISPATCH_VPSS)
+				bGot = dispatch_vpss_one(pstChn);
+			else
+				bGot = dispatch_venc_one(pstChn);
+			if (!bGot)
+				break;
+		}
+	}
+
+	pstDisp->s32Cursor = (pstDisp->s32Cursor + 1) % n;
+}
+
+/* every channel behind a readable fd gets a look */
+static CVI_VOID dispatch_mark_ready(SAMPLE_DISPATCH_S *pstDisp, CVI_S32 s32Fd)
+{
+	for (CVI_S32 i = 0; i < pstDisp->s32ChnNum; i++) {
+		if (pstDisp->astChn[i].s32Fd == s32Fd)
+			pstDisp->astChn[i].bReady = CVI_TRUE;
+	}
+}
+
+CVI_S32 SAMPLE_COMM_DISPATCH_Run(SAMPLE_DISPATCH_S *pstDisp)
+{
+	struct epoll_event aev[SAMPLE_DISPATCH_MAX_CHN + 1];
+	CVI_U64 u64Val;
+	CVI_S32 i, s32Num;
+	CVI_BOOL bStop = CVI_FALSE;
+
+	CHECK_NULL_PTR(pstDisp);
+	if (!pstDisp->s32ChnNum)
+		return CVI_FAILURE;
+
+	while (!bStop) {
+		s32Num = epoll_wait(pstDisp->s32EpollFd, aev, SAMPLE_DISPATCH_MAX_CHN + 1, -1);
+		if (s32Num < 0) {
+			if (errno == EINTR)
+				continue;
+			SAMPLE_PRT("epoll_wait failed, %s\n", strerror(errno));
+			return CVI_FAILURE;
+		}
+
+		for (i = 0; i < s32Num; i++) {
+			if (aev[i].data.u32 == SAMPLE_DISPATCH_MAX_CHN) {
+				if (read(pstDisp->s32StopFd, &u64Val, sizeof(u64Val)) < 0)
+					SAMPLE_PRT("read stop fd, %s\n", strerror(errno));
+				bStop = CVI_TRUE;
+			} else {
+				dispatch_mark_ready(pstDisp, pstDisp->as32Fd[aev[i].data.u32]);
+			}
+		}
+
+		if (!bStop)
+			dispatch_serve(pstDisp);
+	}
+
+	return CVI_SUCCESS;
+}
+
+CVI_VOID SAMPLE_COMM_DISPATCH_Stop(SAMPLE_DISPATCH_S *pstDisp)
+{
+	CVI_U64 u64Val = 1;
+
+	if (!pstDisp)
+		return;
+
+	if (write(pstDisp->s32StopFd, &u64Val, sizeof(u64Val)) < 0)
+		SAMPLE_PRT("write stop fd, %s\n", strerror(errno));
+}
+
+CVI_S32 SAMPLE_COMM_DISPATCH_GetStat(SAMPLE_DISPATCH_S *pstDisp, CVI_S32 s32Idx, SAMPLE_DISPATCH_STAT_S *pstStat)
+{
+	CHECK_NULL_PTR(pstDisp);
+	CHECK_NULL_PTR(pstStat);
+	if (s32Idx < 0 || s32Idx >= pstDisp->s32ChnNum)
+		return CVI_FAILURE;
+
+	*pstStat = pstDisp->astChn[s32Idx].stStat;
+	return CVI_SUCCESS;
+}
+
+CVI_VOID SAMPLE_COMM_DISPATCH_PrintStat(SAMPLE_DISPATCH_S *pstDisp)
+{
+	SAMPLE_DISPATCH_CHN_S *pstChn;
+	SAMPLE_DISPATCH_STAT_S *st;
+	CVI_S32 i;
+
+	if (!pstDisp)
+		return;
+
+	printf("%-10s %10s %8s %6s %8s %8s %8s %8s %8s\n", "chn", "frames", "dropped", "errors",
+	       "lat_min", "lat_avg", "lat_max", "cb_avg", "cb_max");
+	for (i = 0; i < pstDisp->s32ChnNum; i++) {
+		pstChn = &pstDisp->astChn[i];
+		st = &pstChn->stStat;
+		if (pstChn->enType == SAMPLE_DISPATCH_VPSS)
+			printf("vpss%d-%d   ", pstChn->VpssGrp, pstChn->s32Chn);
+		else
+			printf("venc%-2d    ", pstChn->s32Chn);
+		printf(" %10" PRIu64 " %8" PRIu64 " %6" PRIu64 " %8u %8" PRIu64 " %8u %8" PRIu64 " %8u\n",
+		       st->u64Frames, st->u64Dropped, st->u64Errors, st->u32LatMinUs,
+		       st->u64LatFrames ? st->u64LatSumUs / st->u64LatFrames : 0, st->u32LatMaxUs,
+		       st->u64Frames ? st->u64CbSumUs / st->u64Frames : 0, st->u32CbMaxUs);
+	}
+}
+
+CVI_VOID SAMPLE_COMM_DISPATCH_Destroy(SAMPLE_DISPATCH_S *pstDisp)
+{
+	if (!pstDisp)
+		return;
+
+	/* the VENC channel fds belong to the VENC library */
+	if (pstDisp->bVpssFd)
+		CVI_VPSS_CloseFd();
+	close(pstDisp->s32StopFd);
+	close(pstDisp->s32EpollFd);
+	free(pstDisp);
+}
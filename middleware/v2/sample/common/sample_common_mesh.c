@@ -0,0 +1,671 @@
+/*
+ * Copyright (C) Cvitek Co., Ltd. 2019-2020. All rights reserved.
+ *
+ * File Name: sample/common/sample_common_mesh.c
+ * Description:
+ *   Persistent cache of LDC mesh tables.
+ *
+ *   A VI/VPSS channel with LDC enabled gets its mesh built on the CPU from
+ *   the lens attributes every time the pipeline is configured. The cache
+ *   keeps the tables as dumped by CVI_GDC_DumpMesh in one directory on
+ *   flash, next to a small index of fixed-size records keyed by lens
+ *   attributes, output size, rotation and mesh size. The index is mmap'ed
+ *   at open; a hit is attached with CVI_GDC_LoadMesh, a miss is built
+ *   and stored by the worker thread so bring-up does not wait for it
+ *   unless asked to.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+
+#include "sample_comm.h"
+
+#define MESH_CACHE_MAGIC	0x4853454d	/* "MESH" */
+#define MESH_CACHE_VERSION	1
+#define MESH_CACHE_MAX_ENTRY	32
+#define MESH_CACHE_MAX_JOB	8
+#define MESH_CACHE_INDEX	"mesh.idx"
+/* the dump path goes to MESH_DUMP_ATTR_S.binFileName, so every path fits that */
+#define MESH_CACHE_PATH_LEN	sizeof(((MESH_DUMP_ATTR_S *)0)->binFileName)
+#define MESH_CACHE_NAME_MAX	sizeof("/ldc_4294967295x4294967295_0123456789abcdef.mesh.tmp")
+
+typedef struct _MESH_CACHE_ENTRY_S {
+	CVI_U64 u64Hash;
+	SAMPLE_MESH_KEY_S stKey;
+	CVI_U32 u32Size;	/* of the mesh file, checked on lookup */
+	CVI_U32 u32Rsv;
+} MESH_CACHE_ENTRY_S;
+
+typedef struct _MESH_CACHE_INDEX_S {
+	CVI_U32 u32Magic;
+	CVI_U32 u32Version;
+	CVI_U32 u32EntrySize;	/* catches a key layout change between releases */
+	CVI_U32 u32Count;	/* oldest first */
+	MESH_CACHE_ENTRY_S astEntry[];
+} MESH_CACHE_INDEX_S;
+
+typedef struct _MESH_CACHE_JOB_S {
+	SAMPLE_MESH_KEY_S stKey;
+	MOD_ID_E enModId;
+	CVI_S32 s32Dev;		/* VI pipe or VPSS group */
+	CVI_S32 s32Chn;
+} MESH_CACHE_JOB_S;
+
+struct _SAMPLE_MESH_CACHE_S {
+	char szDir[MESH_CACHE_PATH_LEN - MESH_CACHE_NAME_MAX + 1];
+	CVI_U32 u32MeshHor;
+	CVI_U32 u32MeshVer;
+
+	const MESH_CACHE_INDEX_S *pstIndex;	/* read-only mapping, NULL while empty */
+	size_t szIndex;
+
+	MESH_CACHE_JOB_S astJob[MESH_CACHE_MAX_JOB];
+	CVI_U32 u32JobFirst;
+	CVI_U32 u32JobCount;
+	CVI_BOOL bBusy;
+
+	SAMPLE_MESH_CACHE_STAT_S stStat;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	pthread_cond_t condIdle;
+	pthread_t worker;
+	CVI_BOOL bExit;
+};
+
+static CVI_VOID mesh_key_init(SAMPLE_MESH_KEY_S *pstKey, const LDC_ATTR_S *pstLDCAttr,
+	CVI_U32 u32Width, CVI_U32 u32Height, ROTATION_E enRotation, CVI_U32 u32MeshHor, CVI_U32 u32MeshVer)
+{
+	/* field by field, so the padding behind bAspect hashes the same every time */
+	memset(pstKey, 0, sizeof(*pstKey));
+	pstKey->stLDCAttr.bAspect = pstLDCAttr->bAspect ? CVI_TRUE : CVI_FALSE;
+	pstKey->stLDCAttr.s32XRatio = pstLDCAttr->s32XRatio;
+	pstKey->stLDCAttr.s32YRatio = pstLDCAttr->s32YRatio;
+	pstKey->stLDCAttr.s32XYRatio = pstLDCAttr->s32XYRatio;
+	pstKey->stLDCAttr.s32CenterXOffset = pstLDCAttr->s32CenterXOffset;
+	pstKey->stLDCAttr.s32CenterYOffset = pstLDCAttr->s32CenterYOffset;
+	pstKey->stLDCAttr.s32DistortionRatio = pstLDCAttr->s32DistortionRatio;
+	pstKey->u32Width = u32Width;
+	pstKey->u32Height = u32Height;
+	pstKey->u32MeshHor = u32MeshHor;
+	pstKey->u32MeshVer = u32MeshVer;
+	pstKey->enRotation = enRotation;
+}
+
+/* FNV-1a */
+static CVI_U64 mesh_key_hash(const SAMPLE_MESH_KEY_S *pstKey)
+{
+	const CVI_U8 *pu8 = (const CVI_U8 *)pstKey;
+	CVI_U64 u64Hash = 0xcbf29ce484222325ULL;
+
+	for (size_t i = 0; i < sizeof(*pstKey); i++) {
+		u64Hash ^= pu8[i];
+		u64Hash *= 0x100000001b3ULL;
+	}
+	return u64Hash;
+}
+
+static CVI_VOID mesh_cache_path(const SAMPLE_MESH_CACHE_S *pstCache, const SAMPLE_MESH_KEY_S *pstKey,
+	CVI_U64 u64Hash, char *pszPath, CVI_U32 u32Len)
+{
+	snprintf(pszPath, u32Len, "%s/ldc_%ux%u_%016llx.mesh", pstCache->szDir,
+		 pstKey->u32Width, pstKey->u32Height, (unsigned long long)u64Hash);
+}
+
+static CVI_VOID mesh_cache_sync_dir(const SAMPLE_MESH_CACHE_S *pstCache)
+{
+	int fd = open(pstCache->szDir, O_RDONLY | O_DIRECTORY);
+
+	if (fd >= 0) {
+		fsync(fd);
+		close(fd);
+	}
+}
+
+/* called with the mutex held, or before the worker is up */
+static CVI_VOID mesh_cache_map(SAMPLE_MESH_CACHE_S *pstCache)
+{
+	const MESH_CACHE_INDEX_S *pstIndex;
+	char szPath[MESH_CACHE_PATH_LEN];
+	struct stat st;
+	void *pMap;
+	int fd;
+
+	if (pstCache->pstIndex) {
+		munmap((void *)pstCache->pstIndex, pstCache->szIndex);
+		pstCache->pstIndex = NULL;
+		pstCache->szIndex = 0;
+	}
+	pstCache->stStat.u32Entries = 0;
+
+	snprintf(szPath, sizeof(szPath), "%s/%s", pstCache->szDir, MESH_CACHE_INDEX);
+	fd = open(szPath, O_RDONLY);
+	if (fd < 0)
+		return;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(MESH_CACHE_INDEX_S)) {
+		close(fd);
+		return;
+	}
+	pMap = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (pMap == MAP_FAILED) {
+		SAMPLE_PRT("mmap %s failed, %s\n", szPath, strerror(errno));
+		return;
+	}
+
+	pstIndex = (const MESH_CACHE_INDEX_S *)pMap;
+	if (pstIndex->u32Magic != MESH_CACHE_MAGIC || pstIndex->u32Version != MESH_CACHE_VERSION ||
+	    pstIndex->u32EntrySize != sizeof(MESH_CACHE_ENTRY_S) ||
+	    pstIndex->u32Count > MESH_CACHE_MAX_ENTRY ||
+	    sizeof(*pstIndex) + pstIndex->u32Count * sizeof(MESH_CACHE_ENTRY_S) > (size_t)st.st_size) {
+		SAMPLE_PRT("%s is stale, meshes will be rebuilt\n", szPath);
+		munmap(pMap, st.st_size);
+		return;
+	}
+
+	pstCache->pstIndex = pstIndex;
+	pstCache->szIndex = st.st_size;
+	pstCache->stStat.u32Entries = pstIndex->u32Count;
+}
+
+static const MESH_CACHE_ENTRY_S *mesh_cache_find(const SAMPLE_MESH_CACHE_S *pstCache,
+	const SAMPLE_MESH_KEY_S *pstKey, CVI_U64 u64Hash)
+{
+	const MESH_CACHE_INDEX_S *pstIndex = pstCache->pstIndex;
+
+	if (!pstIndex)
+		return NULL;
+	for (CVI_U32 i = 0; i < pstIndex->u32Count; i++) {
+		const MESH_CACHE_ENTRY_S *pstEntry = &pstIndex->astEntry[i];
+
+		if (pstEntry->u64Hash == u64Hash && !memcmp(&pstEntry->stKey, pstKey, sizeof(*pstKey)))
+			return pstEntry;
+	}
+	return NULL;
+}
+
+/* Add the entry of a mesh file already in place. The index is rewritten
+ * whole and renamed over the old one, so a power cut leaves either index
+ * intact; when full the oldest entry and its file go.
+ */
+static CVI_S32 mesh_cache_commit(SAMPLE_MESH_CACHE_S *pstCache, const SAMPLE_MESH_KEY_S *pstKey,
+	CVI_U64 u64Hash, CVI_U32 u32Size)
+{
+	size_t szIndex = sizeof(MESH_CACHE_INDEX_S) + MESH_CACHE_MAX_ENTRY * sizeof(MESH_CACHE_ENTRY_S);
+	MESH_CACHE_INDEX_S *pstIndex;
+	char szPath[MESH_CACHE_PATH_LEN], szTmp[MESH_CACHE_PATH_LEN];
+	CVI_S32 s32Ret = CVI_SUCCESS;
+	CVI_U32 u32Count = 0;
+	int fd;
+
+	pstIndex = calloc(1, szIndex);
+	if (!pstIndex)
+		return CVI_FAILURE;
+
+	pthread_mutex_lock(&pstCache->mutex);
+	if (pstCache->pstIndex) {
+		const MESH_CACHE_INDEX_S *pstOld = pstCache->pstIndex;
+
+		for (CVI_U32 i = 0; i < pstOld->u32Count; i++) {
+			const MESH_CACHE_ENTRY_S *pstEntry = &pstOld->astEntry[i];
+
+			if (pstEntry->u64Hash == u64Hash && !memcmp(&pstEntry->stKey, pstKey, sizeof(*pstKey)))
+				continue;
+			if (pstOld->u32Count - i >= MESH_CACHE_MAX_ENTRY) {
+				mesh_cache_path(pstCache, &pstEntry->stKey, pstEntry->u64Hash, szPath, sizeof(szPath));
+				unlink(szPath);
+				continue;
+			}
+			pstIndex->astEntry[u32Count++] = *pstEntry;
+		}
+	}
+	pstIndex->astEntry[u32Count].u64Hash = u64Hash;
+	pstIndex->astEntry[u32Count].stKey = *pstKey;
+	pstIndex->astEntry[u32Count].u32Size = u32Size;
+	u32Count++;
+
+	pstIndex->u32Magic = MESH_CACHE_MAGIC;
+	pstIndex->u32Version = MESH_CACHE_VERSION;
+	pstIndex->u32EntrySize = sizeof(MESH_CACHE_ENTRY_S);
+	pstIndex->u32Count = u32Count;
+	szIndex = sizeof(MESH_CACHE_INDEX_S) + u32Count * sizeof(MESH_CACHE_ENTRY_S);
+
+	snprintf(szPath, sizeof(szPath), "%s/%s", pstCache->szDir, MESH_CACHE_INDEX);
+	snprintf(szTmp, sizeof(szTmp), "%s.tmp", szPath);
+	fd = open(szTmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || write(fd, pstIndex, szIndex) != (ssize_t)szIndex || fsync(fd) < 0) {
+		SAMPLE_PRT("write %s failed, %s\n", szTmp, strerror(errno));
+		s32Ret = CVI_FAILURE;
+	}
+	if (fd >= 0)
+		close(fd);
+	if (s32Ret == CVI_SUCCESS && rename(szTmp, szPath) < 0) {
+		SAMPLE_PRT("rename %s failed, %s\n", szTmp, strerror(errno));
+		s32Ret = CVI_FAILURE;
+	}
+	if (s32Ret == CVI_SUCCESS) {
+		mesh_cache_sync_dir(pstCache);
+		mesh_cache_map(pstCache);
+	} else {
+		unlink(szTmp);
+	}
+	pthread_mutex_unlock(&pstCache->mutex);
+
+	free(pstIndex);
+	return s32Ret;
+}
+
+static CVI_S32 mesh_cache_set_ldc(const MESH_CACHE_JOB_S *pstJob)
+{
+	if (pstJob->enModId == CVI_ID_VI) {
+		VI_LDC_ATTR_S stLDCAttr = { .bEnable = CVI_TRUE, .stAttr = pstJob->stKey.stLDCAttr };
+
+		return CVI_VI_SetChnLDCAttr(pstJob->s32Dev, pstJob->s32Chn, &stLDCAttr);
+	} else {
+		VPSS_LDC_ATTR_S stLDCAttr = { .bEnable = CVI_TRUE, .stAttr = pstJob->stKey.stLDCAttr };
+
+		return CVI_VPSS_SetChnLDCAttr(pstJob->s32Dev, pstJob->s32Chn, &stLDCAttr);
+	}
+}
+
+static CVI_VOID mesh_cache_dump_attr(const MESH_CACHE_JOB_S *pstJob, const char *pszPath,
+	MESH_DUMP_ATTR_S *pstDump)
+{
+	memset(pstDump, 0, sizeof(*pstDump));
+	snprintf(pstDump->binFileName, sizeof(pstDump->binFileName), "%s", pszPath);
+	pstDump->enModId = pstJob->enModId;
+	if (pstJob->enModId == CVI_ID_VI) {
+		pstDump->viMeshAttr.chn = pstJob->s32Chn;
+	} else {
+		pstDump->vpssMeshAttr.grp = pstJob->s32Dev;
+		pstDump->vpssMeshAttr.chn = pstJob->s32Chn;
+	}
+}
+
+/* Build the mesh the usual way by setting the LDC attribute, then dump it
+ * next to its final name and rename it in once it is on flash.
+ */
+static CVI_S32 mesh_cache_generate(SAMPLE_MESH_CACHE_S *pstCache, const MESH_CACHE_JOB_S *pstJob)
+{
+	CVI_U64 u64Hash = mesh_key_hash(&pstJob->stKey);
+	char szPath[MESH_CACHE_PATH_LEN], szTmp[MESH_CACHE_PATH_LEN];
+	MESH_DUMP_ATTR_S stDump;
+	struct stat st;
+	CVI_S32 s32Ret;
+	int fd;
+
+	s32Ret = mesh_cache_set_ldc(pstJob);
+	if (s32Ret != CVI_SUCCESS) {
+		SAMPLE_PRT("set LDC on mod(%d) %d-%d failed with %#x\n",
+			   pstJob->enModId, pstJob->s32Dev, pstJob->s32Chn, s32Ret);
+		return s32Ret;
+	}
+
+	mesh_cache_path(pstCache, &pstJob->stKey, u64Hash, szPath, sizeof(szPath));
+	snprintf(szTmp, sizeof(szTmp), "%s.tmp", szPath);
+	mesh_cache_dump_attr(pstJob, szTmp, &stDump);
+	s32Ret = CVI_GDC_DumpMesh(&stDump);
+	if (s32Ret != CVI_SUCCESS) {
+		SAMPLE_PRT("CVI_GDC_DumpMesh %s failed with %#x\n", szTmp, s32Ret);
+		unlink(szTmp);
+		return s32Ret;
+	}
+
+	fd = open(szTmp, O_RDONLY);
+	if (fd < 0 || fsync(fd) < 0 || fstat(fd, &st) < 0 || st.st_size <= 0 ||
+	    rename(szTmp, szPath) < 0) {
+		SAMPLE_PRT("store %s failed, %s\n", szPath, strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		unlink(szTmp);
+		return CVI_FAILURE;
+	}
+	close(fd);
+
+	return mesh_cache_commit(pstCache, &pstJob->stKey, u64Hash, (CVI_U32)st.st_size);
+}
+
+static void *mesh_cache_worker(void *arg)
+{
+	SAMPLE_MESH_CACHE_S *pstCache = (SAMPLE_MESH_CACHE_S *)arg;
+	MESH_CACHE_JOB_S stJob;
+	CVI_S32 s32Ret;
+
+	prctl(PR_SET_NAME, "mesh_cache");
+
+	pthread_mutex_lock(&pstCache->mutex);
+	for (;;) {
+		while (!pstCache->bExit && pstCache->u32JobCount == 0)
+			pthread_cond_wait(&pstCache->cond, &pstCache->mutex);
+		if (pstCache->bExit)
+			break;
+
+		stJob = pstCache->astJob[pstCache->u32JobFirst];
+		pstCache->bBusy = CVI_TRUE;
+		pthread_mutex_unlock(&pstCache->mutex);
+
+		s32Ret = mesh_cache_generate(pstCache, &stJob);
+
+		pthread_mutex_lock(&pstCache->mutex);
+		/* the slot stays queued while it is built so a second miss on it is not queued again */
+		pstCache->u32JobFirst = (pstCache->u32JobFirst + 1) % MESH_CACHE_MAX_JOB;
+		pstCache->u32JobCount--;
+		pstCache->bBusy = CVI_FALSE;
+		if (s32Ret == CVI_SUCCESS)
+			pstCache->stStat.u32Generated++;
+		else
+			pstCache->stStat.u32Failed++;
+		pthread_cond_broadcast(&pstCache->condIdle);
+	}
+	pthread_mutex_unlock(&pstCache->mutex);
+
+	return NULL;
+}
+
+CVI_S32 SAMPLE_COMM_MESH_CacheOpen(const char *pszDir, SAMPLE_MESH_CACHE_S **ppstCache)
+{
+	SAMPLE_MESH_CACHE_S *pstCache;
+
+	CHECK_NULL_PTR(pszDir);
+	CHECK_NULL_PTR(ppstCache);
+
+	if (strlen(pszDir) >= sizeof(pstCache->szDir)) {
+		SAMPLE_PRT("cache dir %s too long, max %zu\n", pszDir, sizeof(pstCache->szDir) - 1);
+		return CVI_FAILURE;
+	}
+	if (mkdir(pszDir, 0755) < 0 && errno != EEXIST) {
+		SAMPLE_PRT("mkdir %s failed, %s\n", pszDir, strerror(errno));
+		return CVI_FAILURE;
+	}
+
+	pstCache = calloc(1, sizeof(*pstCache));
+	if (!pstCache)
+		return CVI_FAILURE;
+	snprintf(pstCache->szDir, sizeof(pstCache->szDir), "%s", pszDir);
+	pthread_mutex_init(&pstCache->mutex, NULL);
+	pthread_cond_init(&pstCache->cond, NULL);
+	pthread_cond_init(&pstCache->condIdle, NULL);
+
+	mesh_cache_map(pstCache);
+
+	if (pthread_create(&pstCache->worker, NULL, mesh_cache_worker, pstCache) != 0) {
+		SAMPLE_PRT("create mesh cache worker failed\n");
+		if (pstCache->pstIndex)
+			munmap((void *)pstCache->pstIndex, pstCache->szIndex);
+		pthread_cond_destroy(&pstCache->condIdle);
+		pthread_cond_destroy(&pstCache->cond);
+		pthread_mutex_destroy(&pstCache->mutex);
+		free(pstCache);
+		return CVI_FAILURE;
+	}
+
+	*ppstCache = pstCache;
+	return CVI_SUCCESS;
+}
+
+CVI_S32 SAMPLE_COMM_MESH_CacheSetMeshSize(SAMPLE_MESH_CACHE_S *pstCache, CVI_U32 u32MeshHor, CVI_U32 u32MeshVer)
+{
+	CVI_S32 s32Ret;
+
+	CHECK_NULL_PTR(pstCache);
+
+	s32Ret = CVI_GDC_SetMeshSize(u32MeshHor, u32MeshVer);
+	if (s32Ret != CVI_SUCCESS) {
+		SAMPLE_PRT("CVI_GDC_SetMeshSize %ux%u failed with %#x\n", u32MeshHor, u32MeshVer, s32Ret);
+		return s32Ret;
+	}
+
+	pthread_mutex_lock(&pstCache->mutex);
+	pstCache->u32MeshHor = u32MeshHor;
+	pstCache->u32MeshVer = u32MeshVer;
+	pthread_mutex_unlock(&pstCache->mutex);
+	return CVI_SUCCESS;
+}
+
+CVI_S32 SAMPLE_COMM_MESH_CacheLookup(SAMPLE_MESH_CACHE_S *pstCache, const SAMPLE_MESH_KEY_S *pstKey,
+	char *pszPath, CVI_U32 u32Len, CVI_U32 *pu32Size)
+{
+	const MESH_CACHE_ENTRY_S *pstEntry;
+	SAMPLE_MESH_KEY_S stKey;
+	char szPath[MESH_CACHE_PATH_LEN];
+	CVI_U32 u32Size = 0;
+	CVI_U64 u64Hash;
+	struct stat st;
+
+	CHECK_NULL_PTR(pstCache);
+	CHECK_NULL_PTR(pstKey);
+
+	mesh_key_init(&stKey, &pstKey->stLDCAttr, pstKey->u32Width, pstKey->u32Height,
+		      pstKey->enRotation, pstKey->u32MeshHor, pstKey->u32MeshVer);
+	u64Hash = mesh_key_hash(&stKey);
+
+	pthread_mutex_lock(&pstCache->mutex);
+	pstEntry = mesh_cache_find(pstCache, &stKey, u64Hash);
+	if (pstEntry)
+		u32Size = pstEntry->u32Size;
+	pthread_mutex_unlock(&pstCache->mutex);
+	if (!pstEntry)
+		return CVI_FAILURE;
+
+	/* a file lost or cut short since the index was written is a miss */
+	mesh_cache_path(pstCache, &stKey, u64Hash, szPath, sizeof(szPath));
+	if (stat(szPath, &st) < 0 || st.st_size != u32Size)
+		return CVI_FAILURE;
+
+	if (pszPath)
+		snprintf(pszPath, u32Len, "%s", szPath);
+	if (pu32Size)
+		*pu32Size = u32Size;
+	return CVI_SUCCESS;
+}
+
+CVI_S32 SAMPLE_COMM_MESH_CacheMap(SAMPLE_MESH_CACHE_S *pstCache, const SAMPLE_MESH_KEY_S *pstKey,
+	const CVI_VOID **ppData, CVI_U32 *pu32Size)
+{
+	char szPath[MESH_CACHE_PATH_LEN];
+	CVI_U32 u32Size;
+	void *pMap;
+	int fd;
+
+	CHECK_NULL_PTR(ppData);
+	CHECK_NULL_PTR(pu32Size);
+
+	if (SAMPLE_COMM_MESH_CacheLookup(pstCache, pstKey, szPath, sizeof(szPath), &u32Size) != CVI_SUCCESS)
+		return CVI_FAILURE;
+
+	fd = open(szPath, O_RDONLY);
+	if (fd < 0)
+		return CVI_FAILURE;
+	pMap = mmap(NULL, u32Size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (pMap == MAP_FAILED) {
+		SAMPLE_PRT("mmap %s failed, %s\n", szPath, strerror(errno));
+		return CVI_FAILURE;
+	}
+
+	*ppData = pMap;
+	*pu32Size = u32Size;
+	return CVI_SUCCESS;
+}
+
+CVI_VOID SAMPLE_COMM_MESH_CacheUnmap(const CVI_VOID *pData, CVI_U32 u32Size)
+{
+	if (pData)
+		munmap((void *)pData, u32Size);
+}
+
+static CVI_S32 mesh_cache_apply(SAMPLE_MESH_CACHE_S *pstCache, const MESH_CACHE_JOB_S *pstJob, CVI_BOOL bWait)
+{
+	MESH_DUMP_ATTR_S stDump;
+	char szPath[MESH_CACHE_PATH_LEN];
+	CVI_S32 s32Ret;
+
+	if (SAMPLE_COMM_MESH_CacheLookup(pstCache, &pstJob->stKey, szPath, sizeof(szPath), NULL) == CVI_SUCCESS) {
+		mesh_cache_dump_attr(pstJob, szPath, &stDump);
+		s32Ret = CVI_GDC_LoadMesh(&stDump);
+		if (s32Ret == CVI_SUCCESS) {
+			pthread_mutex_lock(&pstCache->mutex);
+			pstCache->stStat.u32Hits++;
+			pthread_mutex_unlock(&pstCache->mutex);
+			return CVI_SUCCESS;
+		}
+		SAMPLE_PRT("CVI_GDC_LoadMesh %s failed with %#x, rebuild it\n", szPath, s32Ret);
+	}
+
+	if (bWait) {
+		s32Ret = mesh_cache_generate(pstCache, pstJob);
+		pthread_mutex_lock(&pstCache->mutex);
+		pstCache->stStat.u32Misses++;
+		if (s32Ret == CVI_SUCCESS)
+			pstCache->stStat.u32Generated++;
+		else
+			pstCache->stStat.u32Failed++;
+		pthread_mutex_unlock(&pstCache->mutex);
+		return s32Ret;
+	}
+
+	/* the channel runs uncorrected until the worker is done with it */
+	pthread_mutex_lock(&pstCache->mutex);
+	for (CVI_U32 i = 0; i < pstCache->u32JobCount; i++) {
+		const MESH_CACHE_JOB_S *pstQueued =
+			&pstCache->astJob[(pstCache->u32JobFirst + i) % MESH_CACHE_MAX_JOB];
+
+		if (pstQueued->enModId == pstJob->enModId && pstQueued->s32Dev == pstJob->s32Dev &&
+		    pstQueued->s32Chn == pstJob->s32Chn &&
+		    !memcmp(&pstQueued->stKey, &pstJob->stKey, sizeof(pstJob->stKey))) {
+			pthread_mutex_unlock(&pstCache->mutex);
+			return CVI_SUCCESS;
+		}
+	}
+	if (pstCache->u32JobCount == MESH_CACHE_MAX_JOB) {
+		pthread_mutex_unlock(&pstCache->mutex);
+		SAMPLE_PRT("mesh cache queue full\n");
+		return CVI_FAILURE;
+	}
+	pstCache->astJob[(pstCache->u32JobFirst + pstCache->u32JobCount) % MESH_CACHE_MAX_JOB] = *pstJob;
+	pstCache->u32JobCount++;
+	pstCache->stStat.u32Misses++;
+	pthread_cond_signal(&pstCache->cond);
+	pthread_mutex_unlock(&pstCache->mutex);
+
+	return CVI_SUCCESS;
+}
+
+CVI_S32 SAMPLE_COMM_MESH_SetVpssLDC(SAMPLE_MESH_CACHE_S *pstCache, VPSS_GRP VpssGrp, VPSS_CHN VpssChn,
+	const VPSS_LDC_ATTR_S *pstLDCAttr, CVI_BOOL bWait)
+{
+	VPSS_CHN_ATTR_S stChnAttr;
+	ROTATION_E enRotation = ROTATION_0;
+	MESH_CACHE_JOB_S stJob;
+	CVI_S32 s32Ret;
+
+	CHECK_NULL_PTR(pstCache);
+	CHECK_NULL_PTR(pstLDCAttr);
+
+	if (!pstLDCAttr->bEnable)
+		return CVI_VPSS_SetChnLDCAttr(VpssGrp, VpssChn, pstLDCAttr);
+
+	s32Ret = CVI_VPSS_GetChnAttr(VpssGrp, VpssChn, &stChnAttr);
+	if (s32Ret != CVI_SUCCESS) {
+		SAMPLE_PRT("CVI_VPSS_GetChnAttr grp(%d) chn(%d) failed with %#x\n", VpssGrp, VpssChn, s32Ret);
+		return s32Ret;
+	}
+	CVI_VPSS_GetChnRotation(VpssGrp, VpssChn, &enRotation);
+
+	memset(&stJob, 0, sizeof(stJob));
+	pthread_mutex_lock(&pstCache->mutex);
+	mesh_key_init(&stJob.stKey, &pstLDCAttr->stAttr, stChnAttr.u32Width, stChnAttr.u32Height,
+		      enRotation, pstCache->u32MeshHor, pstCache->u32MeshVer);
+	pthread_mutex_unlock(&pstCache->mutex);
+	stJob.enModId = CVI_ID_VPSS;
+	stJob.s32Dev = VpssGrp;
+	stJob.s32Chn = VpssChn;
+
+	return mesh_cache_apply(pstCache, &stJob, bWait);
+}
+
+CVI_S32 SAMPLE_COMM_MESH_SetViLDC(SAMPLE_MESH_CACHE_S *pstCache, VI_PIPE ViPipe, VI_CHN ViChn,
+	const VI_LDC_ATTR_S *pstLDCAttr, CVI_BOOL bWait)
+{
+	VI_CHN_ATTR_S stChnAttr;
+	ROTATION_E enRotation = ROTATION_0;
+	MESH_CACHE_JOB_S stJob;
+	CVI_S32 s32Ret;
+
+	CHECK_NULL_PTR(pstCache);
+	CHECK_NULL_PTR(pstLDCAttr);
+
+	if (!pstLDCAttr->bEnable)
+		return CVI_VI_SetChnLDCAttr(ViPipe, ViChn, pstLDCAttr);
+
+	s32Ret = CVI_VI_GetChnAttr(ViPipe, ViChn, &stChnAttr);
+	if (s32Ret != CVI_SUCCESS) {
+		SAMPLE_PRT("CVI_VI_GetChnAttr pipe(%d) chn(%d) failed with %#x\n", ViPipe, ViChn, s32Ret);
+		return s32Ret;
+	}
+	CVI_VI_GetChnRotation(ViPipe, ViChn, &enRotation);
+
+	memset(&stJob, 0, sizeof(stJob));
+	pthread_mutex_lock(&pstCache->mutex);
+	mesh_key_init(&stJob.stKey, &pstLDCAttr->stAttr, stChnAttr.stSize.u32Width, stChnAttr.stSize.u32Height,
+		      enRotation, pstCache->u32MeshHor, pstCache->u32MeshVer);
+	pthread_mutex_unlock(&pstCache->mutex);
+	stJob.enModId = CVI_ID_VI;
+	stJob.s32Dev = ViPipe;
+	stJob.s32Chn = ViChn;
+
+	return mesh_cache_apply(pstCache, &stJob, bWait);
+}
+
+CVI_S32 SAMPLE_COMM_MESH_CacheWait(SAMPLE_MESH_CACHE_S *pstCache)
+{
+	CHECK_NULL_PTR(pstCache);
+
+	pthread_mutex_lock(&pstCache->mutex);
+	while (pstCache->u32JobCount || pstCache->bBusy)
+		pthread_cond_wait(&pstCache->condIdle, &pstCache->mutex);
+	pthread_mutex_unlock(&pstCache->mutex);
+	return CVI_SUCCESS;
+}
+
+CVI_S32 SAMPLE_COMM_MESH_CacheGetStat(SAMPLE_MESH_CACHE_S *pstCache, SAMPLE_MESH_CACHE_STAT_S *pstStat)
+{
+	CHECK_NULL_PTR(pstCache);
+	CHECK_NULL_PTR(pstStat);
+
+	pthread_mutex_lock(&pstCache->mutex);
+	*pstStat = pstCache->stStat;
+	pstStat->u32Pending = pstCache->u32JobCount;
+	pthread_mutex_unlock(&pstCache->mutex);
+	return CVI_SUCCESS;
+}
+
+CVI_VOID SAMPLE_COMM_MESH_CacheClose(SAMPLE_MESH_CACHE_S *pstCache)
+{
+	if (!pstCache)
+		return;
+
+	/* a mesh being built is finished, the ones still queued are dropped */
+	pthread_mutex_lock(&pstCache->mutex);
+	pstCache->bExit = CVI_TRUE;
+	if (pstCache->u32JobCount > (pstCache->bBusy ? 1U : 0U))
+		SAMPLE_PRT("drop %u queued meshes\n", pstCache->u32JobCount - (pstCache->bBusy ? 1 : 0));
+	pthread_cond_signal(&pstCache->cond);
+	pthread_mutex_unlock(&pstCache->mutex);
+	pthread_join(pstCache->worker, NULL);
+
+	if (pstCache->pstIndex)
+		munmap((void *)pstCache->pstIndex, pstCache->szIndex);
+	pthread_cond_destroy(&pstCache->condIdle);
+	pthread_cond_destroy(&pstCache->cond);
+	pthread_mutex_destroy(&pstCache->mutex);
+	free(pstCache);
+}
@@ -0,0 +1,541 @@
+/*
+ * Copyright (C) Cvitek Co., Ltd. 2019-2020. All rights reserved.
+ *
+ * File Name: sample/common/sample_common_region_batch.c
+ * Description:
+ *   Batched overlay updates.
+ *
+ *   Updating N overlays one by one costs N rounds of GetCanvasInfo, draw,
+ *   cache flush, UpdateCanvas and SetDisplayAttr, and the hardware may pick
+ *   up a frame in the middle so that some regions show the new content and
+ *   others the old one. Here the updates are staged between Begin and
+ *   Commit: canvases are drawn through cached mappings kept across batches,
+ *   display attributes are kept per region and channel and dropped when
+ *   they match what is already applied. Commit does one flush pass over the
+ *   dirty canvases, merging adjacent ones, then issues all UpdateCanvas and
+ *   SetDisplayAttr calls back to back so that the region driver latches
+ *   them together on the next frame. Optionally the burst is aligned to
+ *   the frame done event of a VPSS channel.
+ *
+ *   A batch is not thread safe, keep it to one drawing thread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+
+#include "sample_comm.h"
+
+#define REGION_BATCH_DEF_MAX		32
+#define REGION_BATCH_DEF_SYNC_MS	40
+
+/* canvas mapping, kept until destroy or recycled; two per region for double buffered canvases */
+typedef struct _REGION_BATCH_MAP_S {
+	CVI_U64 u64PhyAddr;
+	CVI_U8 *pu8VirtAddr;
+	CVI_U32 u32Len;
+} REGION_BATCH_MAP_S;
+
+typedef struct _REGION_BATCH_CANVAS_S {
+	RGN_HANDLE Handle;
+	RGN_CANVAS_INFO_S stInfo;	/* pu8VirtAddr points to our mapping */
+	CVI_U32 u32Len;
+} REGION_BATCH_CANVAS_S;
+
+typedef struct _REGION_BATCH_DISP_S {
+	RGN_HANDLE Handle;
+	MMF_CHN_S stChn;
+	RGN_CHN_ATTR_S stApplied;
+	RGN_CHN_ATTR_S stStaged;
+	CVI_BOOL bApplied;
+	CVI_BOOL bStaged;
+} REGION_BATCH_DISP_S;
+
+typedef struct _REGION_BATCH_RANGE_S {
+	CVI_U64 u64PhyAddr;
+	CVI_U8 *pu8VirtAddr;
+	CVI_U32 u32Len;
+} REGION_BATCH_RANGE_S;
+
+struct _SAMPLE_REGION_BATCH_S {
+	SAMPLE_REGION_BATCH_ATTR_S stAttr;
+	CVI_BOOL bOpen;
+	CVI_S32 s32SyncFd;
+
+	REGION_BATCH_MAP_S *pastMap;
+	CVI_U32 u32MapNum;
+
+	/* this batch */
+	REGION_BATCH_CANVAS_S *pastCanvas;
+	CVI_U32 u32CanvasNum;
+
+	/* every region/channel pair seen so far */
+	REGION_BATCH_DISP_S *pastDisp;
+	CVI_U32 u32DispNum;
+
+	REGION_BATCH_RANGE_S *pastRange;
+
+	SAMPLE_REGION_BATCH_STAT_S stStat;
+	CVI_U64 u64CommitSumUs;
+};
+
+static CVI_U32 region_batch_bpp(PIXEL_FORMAT_E enPixelFormat)
+{
+	switch (enPixelFormat) {
+	case PIXEL_FORMAT_8BIT_MODE:
+		return 1;
+	case PIXEL_FORMAT_ARGB_1555:
+	case PIXEL_FORMAT_ARGB_4444:
+		return 2;
+	case PIXEL_FORMAT_ARGB_8888:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+/* a mapping drawn through by the open batch must stay until its commit */
+static CVI_BOOL region_batch_map_busy(SAMPLE_REGION_BATCH_S *pstBatch, const REGION_BATCH_MAP_S *pstMap)
+{
+	for (CVI_U32 i = 0; i < pstBatch->u32CanvasNum; i++) {
+		if (pstBatch->pastCanvas[i].stInfo.pu8VirtAddr == pstMap->pu8VirtAddr)
+			return CVI_TRUE;
+	}
+	return CVI_FALSE;
+}
+
+/* pastMap is kept least recently used first */
+static CVI_U8 *region_batch_map(SAMPLE_REGION_BATCH_S *pstBatch, CVI_U64 u64PhyAddr, CVI_U32 u32Len)
+{
+	REGION_BATCH_MAP_S *pstMap, stHit;
+	CVI_U32 i;
+
+	for (i = 0; i < pstBatch->u32MapNum; i++) {
+		pstMap = &pstBatch->pastMap[i];
+		if (pstMap->u64PhyAddr == u64PhyAddr && pstMap->u32Len >= u32Len) {
+			stHit = *pstMap;
+			memmove(&pstBatch->pastMap[i], &pstBatch->pastMap[i + 1],
+				(pstBatch->u32MapNum - i - 1) * sizeof(pstBatch->pastMap[0]));
+			pstBatch->pastMap[pstBatch->u32MapNum - 1] = stHit;
+			return stHit.pu8VirtAddr;
+		}
+	}
+
+	/*
+	 * a region was destroyed and recreated elsewhere, recycle the least recently
+	 * used mapping. At most u32MaxRegion of the 2 * u32MaxRegion are busy.
+	 */
+	if (pstBatch->u32MapNum == pstBatch->stAttr.u32MaxRegion * 2) {
+		for (i = 0; i < pstBatch->u32MapNum; i++) {
+			if (!region_batch_map_busy(pstBatch, &pstBatch->pastMap[i]))
+				break;
+		}
+		CVI_SYS_Munmap(pstBatch->pastMap[i].pu8VirtAddr, pstBatch->pastMap[i].u32Len);
+		memmove(&pstBatch->pastMap[i], &pstBatch->pastMap[i + 1],
+			(pstBatch->u32MapNum - i - 1) * sizeof(pstBatch->pastMap[0]));
+		pstBatch->u32MapNum--;
+	}
+
+	pstMap = &pstBatch->pastMap[pstBatch->u32MapNum];
+	pstMap->pu8VirtAddr = CVI_SYS_MmapCache(u64PhyAddr, u32Len);
+	if (pstMap->pu8VirtAddr == NULL) {
+		SAMPLE_PRT("CVI_SYS_MmapCache 0x%llx failed\n", (unsigned long long)u64PhyAddr);
+		return NULL;
+	}
+	pstMap->u64PhyAddr = u64PhyAddr;
+	pstMap->u32Len = u32Len;
+	pstBatch->u32MapNum++;
+
+	return pstMap->pu8VirtAddr;
+}
+
+static REGION_BATCH_CANVAS_S *region_batch_find_canvas(SAMPLE_REGION_BATCH_S *pstBatch, RGN_HANDLE Handle)
+{
+	for (CVI_U32 i = 0; i < pstBatch->u32CanvasNum; i++) {
+		if (pstBatch->pastCanvas[i].Handle == Handle)
+			return &pstBatch->pastCanvas[i];
+	}
+	return NULL;
+}
+
+static REGION_BATCH_DISP_S *region_batch_find_disp(SAMPLE_REGION_BATCH_S *pstBatch, RGN_HANDLE Handle,
+	const MMF_CHN_S *pstChn)
+{
+	REGION_BATCH_DISP_S *pstDisp;
+
+	for (CVI_U32 i = 0; i < pstBatch->u32DispNum; i++) {
+		pstDisp = &pstBatch->pastDisp[i];
+		if (pstDisp->Handle == Handle && pstDisp->stChn.enModId == pstChn->enModId &&
+		    pstDisp->stChn.s32DevId == pstChn->s32DevId && pstDisp->stChn.s32ChnId == pstChn->s32ChnId)
+			return pstDisp;
+	}
+	return NULL;
+}
+
+static int region_batch_range_cmp(const void *a, const void *b)
+{
+	const REGION_BATCH_RANGE_S *pstA = a, *pstB = b;
+
+	if (pstA->u64PhyAddr == pstB->u64PhyAddr)
+		return 0;
+	return pstA->u64PhyAddr < pstB->u64PhyAddr ? -1 : 1;
+}
+
+/* one pass over the dirty canvases, in address order, adjacent ones in a single call */
+static CVI_S32 region_batch_flush(SAMPLE_REGION_BATCH_S *pstBatch)
+{
+	REGION_BATCH_RANGE_S *pastRange = pstBatch->pastRange;
+	CVI_U32 u32Num = 0, i;
+	CVI_S32 s32Ret = CVI_SUCCESS;
+
+	for (i = 0; i < pstBatch->u32CanvasNum; i++) {
+		pastRange[i].u64PhyAddr = pstBatch->pastCanvas[i].stInfo.u64PhyAddr;
+		pastRange[i].pu8VirtAddr = pstBatch->pastCanvas[i].stInfo.pu8VirtAddr;
+		pastRange[i].u32Len = pstBatch->pastCanvas[i].u32Len;
+	}
+	qsort(pastRange, pstBatch->u32CanvasNum, sizeof(*pastRange), region_batch_range_cmp);
+
+	for (i = 0; i < pstBatch->u32CanvasNum; i++) {
+		REGION_BATCH_RANGE_S *pstLast = u32Num ? &pastRange[u32Num - 1] : NULL;
+
+		if (pstLast && pstLast->u64PhyAddr + pstLast->u32Len == pastRange[i].u64PhyAddr &&
+		    pstLast->pu8VirtAddr + pstLast->u32Len == pastRange[i].pu8VirtAddr) {
+			pstLast->u32Len += pastRange[i].u32Len;
+			continue;
+		}
+		pastRange[u32Num++] = pastRange[i];
+	}
+
+	for (i = 0; i < u32Num; i++) {
+		if (CVI_SYS_IonFlushCache(pastRange[i].u64PhyAddr, pastRange[i].pu8VirtAddr,
+					  pastRange[i].u32Len) != CVI_SUCCESS) {
+			SAMPLE_PRT("flush 0x%llx len %u failed\n", (unsigned long long)pastRange[i].u64PhyAddr,
+				   pastRange[i].u32Len);
+			s32Ret = CVI_FAILURE;
+		}
+		pstBatch->stStat.u32FlushBytes += pastRange[i].u32Len;
+	}
+	pstBatch->stStat.u32FlushRanges = u32Num;
+
+	return s32Ret;
+}
+
+/*
+ * wait for the sync channel to finish a frame, so the burst has a whole frame time to land.
+ * The frame is taken off the channel, else the fd stays readable from then on.
+ */
+static CVI_VOID region_batch_sync(SAMPLE_REGION_BATCH_S *pstBatch)
+{
+	VIDEO_FRAME_INFO_S stFrame;
+	struct pollfd stPfd;
+	CVI_S32 s32Ret;
+
+	if (pstBatch->s32SyncFd < 0)
+		return;
+
+	stPfd.fd = pstBatch->s32SyncFd;
+	stPfd.events = POLLIN;
+	do {
+		s32Ret = poll(&stPfd, 1, pstBatch->stAttr.u32SyncTimeoutMs);
+	} while (s32Ret < 0 && errno == EINTR);
+	if (s32Ret <= 0 || CVI_VPSS_GetChnFrame(pstBatch->stAttr.SyncVpssGrp, pstBatch->stAttr.SyncVpssChn,
+						&stFrame, 0) != CVI_SUCCESS) {
+		pstBatch->stStat.u32SyncTimeouts++;
+		return;
+	}
+	CVI_VPSS_ReleaseChnFrame(pstBatch->stAttr.SyncVpssGrp, pstBatch->stAttr.SyncVpssChn, &stFrame);
+}
+
+CVI_S32 SAMPLE_COMM_REGION_BatchCreate(const SAMPLE_REGION_BATCH_ATTR_S *pstAttr,
+	SAMPLE_REGION_BATCH_S **ppstBatch)
+{
+	SAMPLE_REGION_BATCH_S *pstBatch;
+	CVI_U32 u32Max;
+
+	CHECK_NULL_PTR(ppstBatch);
+
+	pstBatch = calloc(1, sizeof(*pstBatch));
+	if (!pstBatch)
+		return CVI_FAILURE;
+	if (pstAttr)
+		pstBatch->stAttr = *pstAttr;
+	if (!pstBatch->stAttr.u32MaxRegion)
+		pstBatch->stAttr.u32MaxRegion = REGION_BATCH_DEF_MAX;
+	if (pstBatch->stAttr.u32MaxRegion > RGN_MAX_NUM)
+		pstBatch->stAttr.u32MaxRegion = RGN_MAX_NUM;
+	if (!pstBatch->stAttr.u32SyncTimeoutMs)
+		pstBatch->stAttr.u32SyncTimeoutMs = REGION_BATCH_DEF_SYNC_MS;
+	u32Max = pstBatch->stAttr.u32MaxRegion;
+
+	pstBatch->pastMap = calloc(u32Max * 2, sizeof(*pstBatch->pastMap));
+	pstBatch->pastCanvas = calloc(u32Max, sizeof(*pstBatch->pastCanvas));
+	pstBatch->pastRange = calloc(u32Max, sizeof(*pstBatch->pastRange));
+	/* an overlay can be attached to a few channels */
+	pstBatch->pastDisp = calloc(u32Max * VPSS_MAX_PHY_CHN_NUM, sizeof(*pstBatch->pastDisp));
+	if (!pstBatch->pastMap || !pstBatch->pastCanvas || !pstBatch->pastRange || !pstBatch->pastDisp) {
+		SAMPLE_COMM_REGION_BatchDestroy(pstBatch);
+		return CVI_FAILURE;
+	}
+
+	pstBatch->s32SyncFd = -1;
+	if (pstBatch->stAttr.bFrameSync) {
+		VPSS_CHN_ATTR_S stChnAttr;
+
+		/* frames are only kept for GetChnFrame with a depth */
+		if (CVI_VPSS_GetChnAttr(pstBatch->stAttr.SyncVpssGrp, pstBatch->stAttr.SyncVpssChn,
+					&stChnAttr) != CVI_SUCCESS || stChnAttr.u32Depth < 1) {
+			SAMPLE_PRT("vpss grp %d chn %d has no frame depth\n",
+				   pstBatch->stAttr.SyncVpssGrp, pstBatch->stAttr.SyncVpssChn);
+			SAMPLE_COMM_REGION_BatchDestroy(pstBatch);
+			return CVI_FAILURE;
+		}
+		pstBatch->s32SyncFd = CVI_VPSS_GetChnFd(pstBatch->stAttr.SyncVpssGrp, pstBatch->stAttr.SyncVpssChn);
+		if (pstBatch->s32SyncFd < 0)
+			SAMPLE_PRT("no fd for vpss grp %d chn %d, commit without frame sync\n",
+				   pstBatch->stAttr.SyncVpssGrp, pstBatch->stAttr.SyncVpssChn);
+	}
+
+	*ppstBatch = pstBatch;
+	return CVI_SUCCESS;
+}
+
+CVI_S32 SAMPLE_COMM_REGION_BatchBegin(SAMPLE_REGION_BATCH_S *pstBatch)
+{
+	CHECK_NULL_PTR(pstBatch);
+
+	if (pstBatch->bOpen) {
+		SAMPLE_PRT("batch already open\n");
+		return CVI_FAILURE;
+	}
+	pstBatch->bOpen = CVI_TRUE;
+	pstBatch->u32CanvasNum = 0;
+
+	return CVI_SUCCESS;
+}
+
+CVI_S32 SAMPLE_COMM_REGION_BatchGetCanvas(SAMPLE_REGION_BATCH_S *pstBatch, RGN_HANDLE Handle,
+	RGN_CANVAS_INFO_S *pstCanvasInfo)
+{
+	REGION_BATCH_CANVAS_S *pstCanvas;
+	RGN_CANVAS_INFO_S stInfo;
+	CVI_S32 s32Ret;
+
+	CHECK_NULL_PTR(pstBatch);
+	CHECK_NULL_PTR(pstCanvasInfo);
+	if (!pstBatch->bOpen) {
+		SAMPLE_PRT("no batch open\n");
+		return CVI_FAILURE;
+	}
+
+	/* the same back buffer until commit */
+	pstCanvas = region_batch_find_canvas(pstBatch, Handle);
+	if (pstCanvas) {
+		*pstCanvasInfo = pstCanvas->stInfo;
+		return CVI_SUCCESS;
+	}
+	if (pstBatch->u32CanvasNum == pstBatch->stAttr.u32MaxRegion) {
+		SAMPLE_PRT("more than %u canvases in one batch\n", pstBatch->stAttr.u32MaxRegion);
+		return CVI_FAILURE;
+	}
+
+	s32Ret = CVI_RGN_GetCanvasInfo(Handle, &stInfo);
+	if (s32Ret != CVI_SUCCESS) {
+		SAMPLE_PRT("CVI_RGN_GetCanvasInfo failed with %#x!\n", s32Ret);
+		return CVI_FAILURE;
+	}
+	if (stInfo.bCompressed) {
+		SAMPLE_PRT("Handle %d: compressed canvases are not batched\n", Handle);
+		return CVI_FAILURE;
+	}
+
+	pstCanvas = &pstBatch->pastCanvas[pstBatch->u32CanvasNum];
+	pstCanvas->Handle = Handle;
+	pstCanvas->u32Len = stInfo.u32Stride * stInfo.stSize.u32Height;
+	pstCanvas->stInfo = stInfo;
+	pstCanvas->stInfo.pu8VirtAddr = region_batch_map(pstBatch, stInfo.u64PhyAddr, pstCanvas->u32Len);
+	if (!pstCanvas->stInfo.pu8VirtAddr)
+		return CVI_FAILURE;
+	pstBatch->u32CanvasNum++;
+
+	*pstCanvasInfo = pstCanvas->stInfo;
+	return CVI_SUCCESS;
+}
+
+CVI_S32 SAMPLE_COMM_REGION_BatchSetBitMap(SAMPLE_REGION_BATCH_S *pstBatch, RGN_HANDLE Handle,
+	const BITMAP_S *pstBitmap)
+{
+	RGN_CANVAS_INFO_S stInfo;
+	CVI_U32 u32Bpp, u32Row, u32Height;
+	const CVI_U8 *pu8Src;
+	CVI_S32 s32Ret;
+
+	CHECK_NULL_PTR(pstBitmap);
+	CHECK_NULL_PTR(pstBitmap->pData);
+
+	s32Ret = SAMPLE_COMM_REGION_BatchGetCanvas(pstBatch, Handle, &stInfo);
+	if (s32Ret != CVI_SUCCESS)
+		return s32Ret;
+
+	u32Bpp = region_batch_bpp(stInfo.enPixelFormat);
+	if (!u32Bpp || pstBitmap->enPixelFormat != stInfo.enPixelFormat) {
+		SAMPLE_PRT("Handle %d: bitmap format %d, canvas %d\n", Handle, pstBitmap->enPixelFormat,
+			   stInfo.enPixelFormat);
+		return CVI_FAILURE;
+	}
+
+	/* clipped to the canvas, like CVI_RGN_SetBitMap */
+	u32Row = MIN2(pstBitmap->u32Width, stInfo.stSize.u32Width) * u32Bpp;
+	u32Height = MIN2(pstBitmap->u32Height, stInfo.stSize.u32Height);
+	pu8Src = pstBitmap->pData;
+	for (CVI_U32 y = 0; y < u32Height; y++)
+		memcpy(stInfo.pu8VirtAddr + y * stInfo.u32Stride, pu8Src + y * pstBitmap->u32Width * u32Bpp, u32Row);
+
+	return CVI_SUCCESS;
+}
+
+CVI_S32 SAMPLE_COMM_REGION_BatchSetDisplayAttr(SAMPLE_REGION_BATCH_S *pstBatch, RGN_HANDLE Handle,
+	const MMF_CHN_S *pstChn, const RGN_CHN_ATTR_S *pstChnAttr)
+{
+	REGION_BATCH_DISP_S *pstDisp;
+
+	CHECK_NULL_PTR(pstBatch);
+	CHECK_NULL_PTR(pstChn);
+	CHECK_NULL_PTR(pstChnAttr);
+	if (!pstBatch->bOpen) {
+		SAMPLE_PRT("no batch open\n");
+		return CVI_FAILURE;
+	}
+
+	pstDisp = region_batch_find_disp(pstBatch, Handle, pstChn);
+	if (!pstDisp) {
+		if (pstBatch->u32DispNum == pstBatch->stAttr.u32MaxRegion * VPSS_MAX_PHY_CHN_NUM) {
+			SAMPLE_PRT("too many region/channel pairs\n");
+			return CVI_FAILURE;
+		}
+		pstDisp = &pstBatch->pastDisp[pstBatch->u32DispNum++];
+		memset(pstDisp, 0, sizeof(*pstDisp));
+		pstDisp->Handle = Handle;
+		pstDisp->stChn = *pstChn;
+	}
+
+	/* the last update in a batch wins */
+	pstDisp->stStaged = *pstChnAttr;
+	pstDisp->bStaged = CVI_TRUE;
+
+	return CVI_SUCCESS;
+}
+
+CVI_S32 SAMPLE_COMM_REGION_BatchCommit(SAMPLE_REGION_BATCH_S *pstBatch)
+{
+	SAMPLE_REGION_BATCH_STAT_S *pstStat;
+	REGION_BATCH_DISP_S *pstDisp;
+	CVI_U64 u64Start, u64Burst;
+	CVI_U32 u32Us, i;
+	CVI_S32 s32Ret = CVI_SUCCESS;
+
+	CHECK_NULL_PTR(pstBatch);
+	if (!pstBatch->bOpen) {
+		SAMPLE_PRT("no batch open\n");
+		return CVI_FAILURE;
+	}
+	pstStat = &pstBatch->stStat;
+	u64Start = SAMPLE_COMM_SYS_GetNowUs();
+
+	pstStat->u32FlushBytes = 0;
+	pstStat->u32FlushRanges = 0;
+	if (region_batch_flush(pstBatch) != CVI_SUCCESS)
+		s32Ret = CVI_FAILURE;
+
+	/* callers fill attributes on a memset struct, so a byte compare is enough */
+	pstStat->u32Skipped = 0;
+	for (i = 0; i < pstBatch->u32DispNum; i++) {
+		pstDisp = &pstBatch->pastDisp[i];
+		if (pstDisp->bStaged && pstDisp->bApplied &&
+		    !memcmp(&pstDisp->stStaged, &pstDisp->stApplied, sizeof(pstDisp->stApplied))) {
+			pstDisp->bStaged = CVI_FALSE;
+			pstStat->u32Skipped++;
+		}
+	}
+
+	region_batch_sync(pstBatch);
+
+	u64Burst = SAMPLE_COMM_SYS_GetNowUs();
+	for (i = 0; i < pstBatch->u32CanvasNum; i++) {
+		if (CVI_RGN_UpdateCanvas(pstBatch->pastCanvas[i].Handle) != CVI_SUCCESS) {
+			SAMPLE_PRT("CVI_RGN_UpdateCanvas Handle %d failed\n", pstBatch->pastCanvas[i].Handle);
+			s32Ret = CVI_FAILURE;
+		}
+	}
+	pstStat->u32DisplayAttrs = 0;
+	for (i = 0; i < pstBatch->u32DispNum; i++) {
+		pstDisp = &pstBatch->pastDisp[i];
+		if (!pstDisp->bStaged)
+			continue;
+		pstDisp->bStaged = CVI_FALSE;
+		if (CVI_RGN_SetDisplayAttr(pstDisp->Handle, &pstDisp->stChn, &pstDisp->stStaged) != CVI_SUCCESS) {
+			SAMPLE_PRT("CVI_RGN_SetDisplayAttr Handle %d failed\n", pstDisp->Handle);
+			pstDisp->bApplied = CVI_FALSE;
+			s32Ret = CVI_FAILURE;
+			continue;
+		}
+		pstDisp->stApplied = pstDisp->stStaged;
+		pstDisp->bApplied = CVI_TRUE;
+		pstStat->u32DisplayAttrs++;
+	}
+
+	u32Us = (CVI_U32)(SAMPLE_COMM_SYS_GetNowUs() - u64Start);
+	pstStat->u32BurstUs = (CVI_U32)(SAMPLE_COMM_SYS_GetNowUs() - u64Burst);
+	pstStat->u32Canvases = pstBatch->u32CanvasNum;
+	pstStat->u32Ioctls = pstBatch->u32CanvasNum * 2 + pstStat->u32DisplayAttrs;
+	pstStat->u32Commits++;
+	pstStat->u32CommitUs = u32Us;
+	if (u32Us > pstStat->u32CommitMaxUs)
+		pstStat->u32CommitMaxUs = u32Us;
+	pstBatch->u64CommitSumUs += u32Us;
+	pstStat->u32CommitAvgUs = (CVI_U32)(pstBatch->u64CommitSumUs / pstStat->u32Commits);
+
+	pstBatch->u32CanvasNum = 0;
+	pstBatch->bOpen = CVI_FALSE;
+
+	return s32Ret;
+}
+
+CVI_S32 SAMPLE_COMM_REGION_BatchAbort(SAMPLE_REGION_BATCH_S *pstBatch)
+{
+	CHECK_NULL_PTR(pstBatch);
+
+	/* canvases already drawn stay in the back buffers, they are not shown */
+	for (CVI_U32 i = 0; i < pstBatch->u32DispNum; i++)
+		pstBatch->pastDisp[i].bStaged = CVI_FALSE;
+	pstBatch->u32CanvasNum = 0;
+	pstBatch->bOpen = CVI_FALSE;
+
+	return CVI_SUCCESS;
+}
+
+CVI_S32 SAMPLE_COMM_REGION_BatchGetStat(SAMPLE_REGION_BATCH_S *pstBatch, SAMPLE_REGION_BATCH_STAT_S *pstStat)
+{
+	CHECK_NULL_PTR(pstBatch);
+	CHECK_NULL_PTR(pstStat);
+
+	*pstStat = pstBatch->stStat;
+	return CVI_SUCCESS;
+}
+
+CVI_VOID SAMPLE_COMM_REGION_BatchDestroy(SAMPLE_REGION_BATCH_S *pstBatch)
+{
+	if (!pstBatch)
+		return;
+
+	if (pstBatch->bOpen)
+		SAMPLE_COMM_REGION_BatchAbort(pstBatch);
+	for (CVI_U32 i = 0; i < pstBatch->u32MapNum; i++)
+		CVI_SYS_Munmap(pstBatch->pastMap[i].pu8VirtAddr, pstBatch->pastMap[i].u32Len);
+	free(pstBatch->pastMap);
+	free(pstBatch->pastCanvas);
+	free(pstBatch->pastRange);
+	free(pstBatch->pastDisp);
+	free(pstBatch);
+}
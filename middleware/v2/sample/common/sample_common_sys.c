@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
+#include <time.h>
 
 #include "sample_comm.h"
 
@@ -64,6 +65,15 @@ CVI_VOID SAMPLE_COMM_SYS_Exit(void)
 	CVI_VB_Exit();
 }
 
+/* CLOCK_MONOTONIC in us, the clock VI/VPSS/VENC stamp frame PTS with */
+CVI_U64 SAMPLE_COMM_SYS_GetNowUs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (CVI_U64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 CVI_S32 SAMPLE_COMM_VI_Bind_VO(VI_PIPE ViPipe, VI_CHN ViChn, VO_LAYER VoLayer, VO_CHN VoChn)
 {
 	MMF_CHN_S stSrcChn;
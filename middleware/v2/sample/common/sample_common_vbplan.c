@@ -0,0 +1,300 @@
+/*
+ * Copyright (C) Cvitek Co., Ltd. 2019-2020. All rights reserved.
+ *
+ * File Name: sample/common/sample_common_vbplan.c
+ * Description:
+ *   Derive the common VB pools from the frame producers of a pipeline and
+ *   watch how many blocks each pool really uses at run time.
+ *
+ *   Every producer node needs one block being written by the hardware, one
+ *   travelling to its consumer and u32Depth more held downstream (user
+ *   GetChnFrame depth, VENC input queue). Nodes with the same block size
+ *   share a pool. The monitor then samples CVI_VB_InquireUserCnt() on each
+ *   block and reports the peak per pool, which is what the config needs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "sample_comm.h"
+
+#define VB_PLAN_IN_FLIGHT	2
+#define VB_PLAN_VENC_BLKS	3	/* as SAMPLE_COMM_VENC_InitVBPool */
+
+static CVI_U32 vb_plan_align(const SAMPLE_VB_PLAN_NODE_S *pstNode)
+{
+	CVI_U32 u32Align = pstNode->u32Align;
+
+	/* only known once the channel exists, so usually after a first run */
+	if (!u32Align && pstNode->enModId == CVI_ID_VPSS &&
+	    CVI_VPSS_GetChnAlign(pstNode->s32DevId, pstNode->s32ChnId, &u32Align) != CVI_SUCCESS)
+		u32Align = 0;
+
+	return u32Align ? u32Align : DEFAULT_ALIGN;
+}
+
+static CVI_U32 vb_plan_node(const SAMPLE_VB_PLAN_NODE_S *pstNode, CVI_U32 *pu32BlkCnt)
+{
+	const SIZE_S *pstSize = &pstNode->stSize;
+
+	switch (pstNode->enModId) {
+	case CVI_ID_VI:
+	case CVI_ID_VPSS:
+		*pu32BlkCnt = VB_PLAN_IN_FLIGHT + pstNode->u32Depth;
+		return COMMON_GetPicBufferSize(pstSize->u32Width, pstSize->u32Height, pstNode->enPixelFormat,
+					       pstNode->enBitWidth, pstNode->enCompressMode, vb_plan_align(pstNode));
+	case CVI_ID_VENC:
+		/* only for channels taking their frame buffers from the common pools */
+		*pu32BlkCnt = pstNode->u32Depth ? pstNode->u32Depth : VB_PLAN_VENC_BLKS;
+		return COMMON_GetVencFrameBufferSize(pstNode->enType, pstSize->u32Width, pstSize->u32Height);
+	default:
+		*pu32BlkCnt = 0;
+		return 0;
+	}
+}
+
+CVI_S32 SAMPLE_COMM_VB_Plan(const SAMPLE_VB_PLAN_NODE_S *pastNode, CVI_U32 u32NodeNum, VB_CONFIG_S *pstVbConfig)
+{
+	VB_POOL_CONFIG_S *pstPool, stTmp;
+	CVI_U32 u32BlkSize, u32BlkCnt;
+	CVI_U64 u64Total = 0;
+	CVI_U32 i, j;
+
+	CHECK_NULL_PTR(pastNode);
+	CHECK_NULL_PTR(pstVbConfig);
+
+	memset(pstVbConfig, 0, sizeof(*pstVbConfig));
+
+	for (i = 0; i < u32NodeNum; i++) {
+		u32BlkSize = vb_plan_node(&pastNode[i], &u32BlkCnt);
+		if (!u32BlkSize || !u32BlkCnt) {
+			SAMPLE_PRT("node %u (mod %d dev %d chn %d) needs no common VB\n", i,
+				   pastNode[i].enModId, pastNode[i].s32DevId, pastNode[i].s32ChnId);
+			continue;
+		}
+
+		for (j = 0; j < pstVbConfig->u32MaxPoolCnt; j++)
+			if (pstVbConfig->astCommPool[j].u32BlkSize == u32BlkSize)
+				break;
+
+		if (j == pstVbConfig->u32MaxPoolCnt) {
+			if (j == VB_MAX_COMM_POOLS) {
+				SAMPLE_PRT("more than %d distinct block sizes\n", VB_MAX_COMM_POOLS);
+				return CVI_FAILURE;
+			}
+			pstPool = &pstVbConfig->astCommPool[j];
+			pstPool->u32BlkSize = u32BlkSize;
+			pstPool->enRemapMode = VB_REMAP_MODE_CACHED;
+			snprintf(pstPool->acName, sizeof(pstPool->acName), "plan%u", j);
+			pstVbConfig->u32MaxPoolCnt++;
+		}
+		pstVbConfig->astCommPool[j].u32BlkCnt += u32BlkCnt;
+	}
+
+	/* smallest first, so a block request lands in the tightest pool that fits */
+	for (i = 1; i < pstVbConfig->u32MaxPoolCnt; i++) {
+		for (j = i; j > 0 && pstVbConfig->astCommPool[j - 1].u32BlkSize >
+				     pstVbConfig->astCommPool[j].u32BlkSize; j--) {
+			stTmp = pstVbConfig->astCommPool[j];
+			pstVbConfig->astCommPool[j] = pstVbConfig->astCommPool[j - 1];
+			pstVbConfig->astCommPool[j - 1] = stTmp;
+		}
+	}
+
+	for (i = 0; i < pstVbConfig->u32MaxPoolCnt; i++) {
+		pstPool = &pstVbConfig->astCommPool[i];
+		u64Total += (CVI_U64)pstPool->u32BlkSize * pstPool->u32BlkCnt;
+		SAMPLE_PRT("pool %u: %u x %u bytes\n", i, pstPool->u32BlkCnt, pstPool->u32BlkSize);
+	}
+	SAMPLE_PRT("common VB total %llu KB\n", (unsigned long long)(u64Total >> 10));
+
+	return CVI_SUCCESS;
+}
+
+typedef struct _SAMPLE_VB_MON_POOL_S {
+	VB_POOL_CONFIG_S stCfg;
+	CVI_U32 u32KnownCnt;	// blocks found free at start, the rest counts as always used
+	VB_BLK *pBlk;
+	CVI_U32 u32Cur;
+	CVI_U32 u32Peak;
+} SAMPLE_VB_MON_POOL_S;
+
+struct _SAMPLE_VB_MON_S {
+	CVI_U32 u32PoolCnt;
+	SAMPLE_VB_MON_POOL_S astPool[VB_MAX_COMM_POOLS];
+	CVI_U32 u32IntervalMs;
+	CVI_BOOL bRun;
+	pthread_t thread;
+	pthread_mutex_t lock;
+};
+
+/* find the handles of a pool by taking every free block once */
+static CVI_S32 vb_mon_discover(SAMPLE_VB_MON_POOL_S *pstPool, VB_POOL Pool)
+{
+	CVI_U32 i;
+	VB_BLK blk;
+
+	pstPool->pBlk = calloc(pstPool->stCfg.u32BlkCnt, sizeof(VB_BLK));
+	if (!pstPool->pBlk)
+		return CVI_FAILURE;
+
+	while (pstPool->u32KnownCnt < pstPool->stCfg.u32BlkCnt) {
+		blk = CVI_VB_GetBlock(Pool, pstPool->stCfg.u32BlkSize);
+		if (blk == VB_INVALID_HANDLE)
+			break;
+		pstPool->pBlk[pstPool->u32KnownCnt++] = blk;
+	}
+	for (i = 0; i < pstPool->u32KnownCnt; i++)
+		CVI_VB_ReleaseBlock(pstPool->pBlk[i]);
+
+	if (pstPool->u32KnownCnt < pstPool->stCfg.u32BlkCnt)
+		SAMPLE_PRT("pool %u: %u of %u blocks already in use at start\n", Pool,
+			   pstPool->stCfg.u32BlkCnt - pstPool->u32KnownCnt, pstPool->stCfg.u32BlkCnt);
+
+	return CVI_SUCCESS;
+}
+
+CVI_VOID SAMPLE_COMM_VB_MonSample(SAMPLE_VB_MON_S *pstMon)
+{
+	SAMPLE_VB_MON_POOL_S *pstPool;
+	CVI_U32 i, j, u32Cnt, u32Used;
+
+	if (!pstMon)
+		return;
+
+	pthread_mutex_lock(&pstMon->lock);
+	for (i = 0; i < pstMon->u32PoolCnt; i++) {
+		pstPool = &pstMon->astPool[i];
+		u32Used = pstPool->stCfg.u32BlkCnt - pstPool->u32KnownCnt;
+		for (j = 0; j < pstPool->u32KnownCnt; j++)
+			if (CVI_VB_InquireUserCnt(pstPool->pBlk[j], &u32Cnt) == CVI_SUCCESS && u32Cnt)
+				u32Used++;
+		pstPool->u32Cur = u32Used;
+		if (u32Used > pstPool->u32Peak)
+			pstPool->u32Peak = u32Used;
+	}
+	pthread_mutex_unlock(&pstMon->lock);
+}
+
+static void *vb_mon_thread(void *arg)
+{
+	SAMPLE_VB_MON_S *pstMon = arg;
+
+	while (pstMon->bRun) {
+		SAMPLE_COMM_VB_MonSample(pstMon);
+		usleep(pstMon->u32IntervalMs * 1000);
+	}
+
+	return NULL;
+}
+
+CVI_S32 SAMPLE_COMM_VB_MonStart(CVI_U32 u32IntervalMs, SAMPLE_VB_MON_S **ppstMon)
+{
+	SAMPLE_VB_MON_S *pstMon;
+	VB_CONFIG_S stVbConfig;
+	CVI_U32 i;
+
+	CHECK_NULL_PTR(ppstMon);
+
+	if (CVI_VB_GetConfig(&stVbConfig) != CVI_SUCCESS) {
+		SAMPLE_PRT("CVI_VB_GetConfig failed\n");
+		return CVI_FAILURE;
+	}
+
+	pstMon = calloc(1, sizeof(*pstMon));
+	if (!pstMon)
+		return CVI_FAILURE;
+	pthread_mutex_init(&pstMon->lock, NULL);
+	pstMon->u32IntervalMs = u32IntervalMs;
+
+	for (i = 0; i < stVbConfig.u32MaxPoolCnt && i < VB_MAX_COMM_POOLS; i++) {
+		pstMon->astPool[i].stCfg = stVbConfig.astCommPool[i];
+		if (vb_mon_discover(&pstMon->astPool[i], i) != CVI_SUCCESS)
+			goto err;
+		pstMon->u32PoolCnt++;
+	}
+
+	if (u32IntervalMs) {
+		pstMon->bRun = CVI_TRUE;
+		if (pthread_create(&pstMon->thread, NULL, vb_mon_thread, pstMon)) {
+			SAMPLE_PRT("vb monitor thread create failed\n");
+			pstMon->bRun = CVI_FALSE;
+			goto err;
+		}
+	}
+
+	*ppstMon = pstMon;
+	return CVI_SUCCESS;
+
+err:
+	for (i = 0; i < VB_MAX_COMM_POOLS; i++)
+		free(pstMon->astPool[i].pBlk);
+	pthread_mutex_destroy(&pstMon->lock);
+	free(pstMon);
+	return CVI_FAILURE;
+}
+
+CVI_S32 SAMPLE_COMM_VB_MonReport(SAMPLE_VB_MON_S *pstMon, CVI_U32 u32Headroom, VB_CONFIG_S *pstSuggest)
+{
+	SAMPLE_VB_MON_POOL_S *pstPool;
+	CVI_U64 u64Now = 0, u64New = 0;
+	CVI_U32 i, u32Cnt;
+
+	CHECK_NULL_PTR(pstMon);
+
+	if (pstSuggest)
+		memset(pstSuggest, 0, sizeof(*pstSuggest));
+
+	pthread_mutex_lock(&pstMon->lock);
+	printf("%-5s %10s %6s %6s %6s %8s\n", "pool", "blk_size", "cnt", "cur", "peak", "suggest");
+	for (i = 0; i < pstMon->u32PoolCnt; i++) {
+		pstPool = &pstMon->astPool[i];
+		u32Cnt = pstPool->u32Peak + u32Headroom;
+		if (!pstPool->u32Peak)
+			u32Cnt = 0;	/* never touched, drop the pool */
+		else if (u32Cnt > pstPool->stCfg.u32BlkCnt && pstPool->u32Peak < pstPool->stCfg.u32BlkCnt)
+			u32Cnt = pstPool->stCfg.u32BlkCnt;
+		printf("%-5u %10u %6u %6u %6u %8u%s\n", i, pstPool->stCfg.u32BlkSize, pstPool->stCfg.u32BlkCnt,
+		       pstPool->u32Cur, pstPool->u32Peak, u32Cnt,
+		       pstPool->u32Peak >= pstPool->stCfg.u32BlkCnt ? "  exhausted" : "");
+
+		u64Now += (CVI_U64)pstPool->stCfg.u32BlkSize * pstPool->stCfg.u32BlkCnt;
+		u64New += (CVI_U64)pstPool->stCfg.u32BlkSize * u32Cnt;
+
+		if (pstSuggest && u32Cnt) {
+			pstSuggest->astCommPool[pstSuggest->u32MaxPoolCnt] = pstPool->stCfg;
+			pstSuggest->astCommPool[pstSuggest->u32MaxPoolCnt].u32BlkCnt = u32Cnt;
+			pstSuggest->u32MaxPoolCnt++;
+		}
+	}
+	pthread_mutex_unlock(&pstMon->lock);
+
+	printf("common VB %llu KB, suggested %llu KB\n", (unsigned long long)(u64Now >> 10),
+	       (unsigned long long)(u64New >> 10));
+
+	for (i = 0; i < pstMon->u32PoolCnt; i++)
+		CVI_VB_PrintPool(i);
+
+	return CVI_SUCCESS;
+}
+
+CVI_VOID SAMPLE_COMM_VB_MonStop(SAMPLE_VB_MON_S *pstMon)
+{
+	CVI_U32 i;
+
+	if (!pstMon)
+		return;
+
+	if (pstMon->bRun) {
+		pstMon->bRun = CVI_FALSE;
+		pthread_join(pstMon->thread, NULL);
+	}
+
+	for (i = 0; i < pstMon->u32PoolCnt; i++)
+		free(pstMon->astPool[i].pBlk);
+	pthread_mutex_destroy(&pstMon->lock);
+	free(pstMon);
+}
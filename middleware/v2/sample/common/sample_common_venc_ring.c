@@ -0,0 +1,488 @@
+/*
+ * Copyright (C) Cvitek Co., Ltd. 2019-2020. All rights reserved.
+ *
+ * File Name: sample/common/sample_common_venc_ring.c
+ * Description:
+ *   Pre-trigger ring of H.264/H.265 streams for event recording.
+ *
+ *   The payloads of the last seconds of a channel are kept in one ION
+ *   buffer allocated at create time, frame by frame, and always start at
+ *   an IDR: old frames leave the ring a whole GOP at a time. On a trigger
+ *   the frames in the ring are pinned, the following seconds are appended
+ *   behind them and the writer thread stores the lot with one writev()
+ *   (two pieces when it wraps), so the card sees one sequential write per
+ *   event instead of a continuous stream.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/prctl.h>
+#include <sys/uio.h>
+
+#include "sample_comm.h"
+
+#define VENC_RING_DEF_FRAMES	4096
+#define VENC_RING_FLUSH_SLACK	2	/* seconds to wait for frames past the post window */
+
+typedef struct _VENC_RING_FRAME_S {
+	CVI_U64 u64Off;		/* offset of the first byte, counted from create */
+	CVI_U64 u64PTS;
+	CVI_U32 u32Len;
+	CVI_BOOL bKey;
+} VENC_RING_FRAME_S;
+
+struct _SAMPLE_VENC_RING_S {
+	SAMPLE_VENC_RING_ATTR_S stAttr;
+	CVI_U64 u64PhyAddr;
+	CVI_U8 *pu8Buf;
+	CVI_BOOL bIon;
+
+	VENC_RING_FRAME_S *pastFrame;
+	CVI_U32 u32First;	/* oldest frame in pastFrame */
+	CVI_U32 u32Count;
+	CVI_U64 u64Head;	/* offsets of the next byte written / oldest byte kept */
+	CVI_U64 u64Tail;
+	CVI_BOOL bWaitKey;
+
+	/* event in progress: nothing is evicted until it is stored */
+	CVI_BOOL bPinned;
+	CVI_BOOL bPostDone;
+	CVI_U64 u64PinOff;
+	CVI_U64 u64EndPTS;
+	CVI_U32 u32PostSec;
+	char szPath[128];
+
+	SAMPLE_VENC_RING_STAT_S stStat;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	pthread_t writer;
+	CVI_BOOL bExit;
+};
+
+static CVI_BOOL venc_ring_is_key(PAYLOAD_TYPE_E enType, const VENC_PACK_S *pstPack)
+{
+	if (enType == PT_H264)
+		return pstPack->DataType.enH264EType == H264E_NALU_IDRSLICE ||
+		       pstPack->DataType.enH264EType == H264E_NALU_SPS;
+	if (enType == PT_H265)
+		return pstPack->DataType.enH265EType == H265E_NALU_IDRSLICE ||
+		       pstPack->DataType.enH265EType == H265E_NALU_VPS ||
+		       pstPack->DataType.enH265EType == H265E_NALU_SPS;
+	return CVI_FALSE;
+}
+
+static VENC_RING_FRAME_S *venc_ring_frame(SAMPLE_VENC_RING_S *pstRing, CVI_U32 n)
+{
+	return &pstRing->pastFrame[(pstRing->u32First + n) % pstRing->stAttr.u32MaxFrames];
+}
+
+static CVI_VOID venc_ring_drop_first(SAMPLE_VENC_RING_S *pstRing)
+{
+	VENC_RING_FRAME_S *pstFrame = venc_ring_frame(pstRing, 0);
+
+	pstRing->u64Tail = pstFrame->u64Off + pstFrame->u32Len;
+	pstRing->u32First = (pstRing->u32First + 1) % pstRing->stAttr.u32MaxFrames;
+	pstRing->u32Count--;
+	pstRing->stStat.u64Evicted++;
+}
+
+/* frames of the first GOP, u32Count if the ring holds only one */
+static CVI_U32 venc_ring_first_gop(SAMPLE_VENC_RING_S *pstRing)
+{
+	CVI_U32 n;
+
+	for (n = 1; n < pstRing->u32Count; n++)
+		if (venc_ring_frame(pstRing, n)->bKey)
+			break;
+	return n;
+}
+
+/*
+ * Make room for a frame of u32Len bytes at u64PTS. Whole GOPs go, and
+ * none while an event is pinned. Also drops GOPs that are entirely older
+ * than the pre-trigger window.
+ */
+static CVI_BOOL venc_ring_make_room(SAMPLE_VENC_RING_S *pstRing, CVI_U32 u32Len, CVI_U64 u64PTS)
+{
+	CVI_U64 u64Window = (CVI_U64)pstRing->stAttr.u32PreSec * 1000000;
+	CVI_U32 u32Gop;
+	CVI_BOOL bFull, bOld;
+
+	while (pstRing->u32Count) {
+		u32Gop = venc_ring_first_gop(pstRing);
+		bFull = pstRing->u64Head + u32Len - pstRing->u64Tail > pstRing->stAttr.u32BufSize ||
+			pstRing->u32Count == pstRing->stAttr.u32MaxFrames;
+		/* the second GOP alone still covers the window */
+		bOld = u32Gop < pstRing->u32Count &&
+		       venc_ring_frame(pstRing, u32Gop)->u64PTS + u64Window <= u64PTS;
+
+		if (!bFull && !bOld)
+			return CVI_TRUE;
+		if (pstRing->bPinned)
+			return !bFull;
+
+		while (u32Gop--)
+			venc_ring_drop_first(pstRing);
+	}
+
+	pstRing->u64Tail = pstRing->u64Head;
+	return u32Len <= pstRing->stAttr.u32BufSize;
+}
+
+static CVI_VOID venc_ring_copy_in(SAMPLE_VENC_RING_S *pstRing, const CVI_U8 *pu8Src, CVI_U32 u32Len)
+{
+	CVI_U32 u32Size = pstRing->stAttr.u32BufSize;
+	CVI_U32 u32Pos = pstRing->u64Head % u32Size;
+	CVI_U32 u32Part = u32Len < u32Size - u32Pos ? u32Len : u32Size - u32Pos;
+
+	memcpy(pstRing->pu8Buf + u32Pos, pu8Src, u32Part);
+	if (u32Part < u32Len)
+		memcpy(pstRing->pu8Buf, pu8Src + u32Part, u32Len - u32Part);
+	pstRing->u64Head += u32Len;
+}
+
+static CVI_S32 venc_ring_store(SAMPLE_VENC_RING_S *pstRing, const char *pszPath, CVI_U64 u64Off, CVI_U64 u64End)
+{
+	CVI_U32 u32Size = pstRing->stAttr.u32BufSize;
+	CVI_U32 u32Pos = u64Off % u32Size;
+	size_t len = u64End - u64Off;
+	struct iovec iov[2];
+	int iovcnt = 1;
+	ssize_t ret;
+	int fd;
+
+	iov[0].iov_base = pstRing->pu8Buf + u32Pos;
+	iov[0].iov_len = len;
+	if (u32Pos + len > u32Size) {
+		iov[0].iov_len = u32Size - u32Pos;
+		iov[1].iov_base = pstRing->pu8Buf;
+		iov[1].iov_len = len - iov[0].iov_len;
+		iovcnt = 2;
+	}
+
+	fd = open(pszPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		SAMPLE_PRT("open %s failed, %s\n", pszPath, strerror(errno));
+		return CVI_FAILURE;
+	}
+
+	while (len) {
+		ret = writev(fd, iov, iovcnt);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			SAMPLE_PRT("write %s failed, %s\n", pszPath, strerror(errno));
+			close(fd);
+			return CVI_FAILURE;
+		}
+		len -= ret;
+		/* short write, skip what went out */
+		while (ret > 0 && iovcnt) {
+			if ((size_t)ret < iov[0].iov_len) {
+				iov[0].iov_base = (CVI_U8 *)iov[0].iov_base + ret;
+				iov[0].iov_len -= ret;
+				break;
+			}
+			ret -= iov[0].iov_len;
+			iov[0] = iov[1];
+			iovcnt--;
+		}
+	}
+
+	fsync(fd);
+	close(fd);
+	return CVI_SUCCESS;
+}
+
+static CVI_VOID *venc_ring_writer(CVI_VOID *arg)
+{
+	SAMPLE_VENC_RING_S *pstRing = arg;
+	struct timespec ts;
+	CVI_U64 u64Off, u64End;
+	char szPath[sizeof(pstRing->szPath)];
+	CVI_S32 s32Ret;
+
+	prctl(PR_SET_NAME, "venc_ring");
+
+	pthread_mutex_lock(&pstRing->mutex);
+	while (!pstRing->bExit) {
+		if (!pstRing->bPinned) {
+			pthread_cond_wait(&pstRing->cond, &pstRing->mutex);
+			continue;
+		}
+
+		/* the stream may stop, don't wait for the post window forever */
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		ts.tv_sec += pstRing->u32PostSec + VENC_RING_FLUSH_SLACK;
+		while (!pstRing->bPostDone && !pstRing->bExit) {
+			if (pthread_cond_timedwait(&pstRing->cond, &pstRing->mutex, &ts) == ETIMEDOUT)
+				break;
+		}
+
+		u64Off = pstRing->u64PinOff;
+		u64End = pstRing->u64Head;
+		snprintf(szPath, sizeof(szPath), "%s", pstRing->szPath);
+		pthread_mutex_unlock(&pstRing->mutex);
+
+		/* [u64Off, u64End) can't be overwritten while pinned */
+		s32Ret = venc_ring_store(pstRing, szPath, u64Off, u64End);
+		SAMPLE_PRT("event %s: %llu bytes, %s\n", szPath, (unsigned long long)(u64End - u64Off),
+			   s32Ret == CVI_SUCCESS ? "stored" : "failed");
+
+		pthread_mutex_lock(&pstRing->mutex);
+		if (s32Ret == CVI_SUCCESS)
+			pstRing->stStat.u32Events++;
+		else
+			pstRing->stStat.u32Failed++;
+		pstRing->bPinned = CVI_FALSE;
+		pthread_cond_broadcast(&pstRing->cond);
+	}
+	pthread_mutex_unlock(&pstRing->mutex);
+
+	return NULL;
+}
+
+CVI_S32 SAMPLE_COMM_VENC_RING_Create(const SAMPLE_VENC_RING_ATTR_S *pstAttr, SAMPLE_VENC_RING_S **ppstRing)
+{
+	SAMPLE_VENC_RING_S *pstRing;
+	pthread_condattr_t condAttr;
+	CVI_S32 s32Ret;
+
+	CHECK_NULL_PTR(pstAttr);
+	CHECK_NULL_PTR(ppstRing);
+
+	if (pstAttr->enType != PT_H264 && pstAttr->enType != PT_H265) {
+		SAMPLE_PRT("payload type %d not supported\n", pstAttr->enType);
+		return CVI_FAILURE;
+	}
+	if (!pstAttr->u32BufSize || !pstAttr->u32PreSec) {
+		SAMPLE_PRT("buffer size and pre-trigger seconds required\n");
+		return CVI_FAILURE;
+	}
+
+	pstRing = calloc(1, sizeof(*pstRing));
+	if (!pstRing)
+		return CVI_FAILURE;
+	pstRing->stAttr = *pstAttr;
+	if (!pstRing->stAttr.u32MaxFrames)
+		pstRing->stAttr.u32MaxFrames = VENC_RING_DEF_FRAMES;
+
+	pstRing->pastFrame = calloc(pstRing->stAttr.u32MaxFrames, sizeof(VENC_RING_FRAME_S));
+	if (!pstRing->pastFrame) {
+		free(pstRing);
+		return CVI_FAILURE;
+	}
+
+	s32Ret = CVI_SYS_IonAlloc_Cached(&pstRing->u64PhyAddr, (CVI_VOID **)&pstRing->pu8Buf,
+					 "venc_ring", pstAttr->u32BufSize);
+	if (s32Ret == CVI_SUCCESS) {
+		pstRing->bIon = CVI_TRUE;
+	} else {
+		SAMPLE_PRT("ION alloc of %u bytes failed, use heap\n", pstAttr->u32BufSize);
+		pstRing->pu8Buf = malloc(pstAttr->u32BufSize);
+		if (!pstRing->pu8Buf) {
+			free(pstRing->pastFrame);
+			free(pstRing);
+			return CVI_FAILURE;
+		}
+	}
+
+	pstRing->bWaitKey = CVI_TRUE;
+	pthread_mutex_init(&pstRing->mutex, NULL);
+	pthread_condattr_init(&condAttr);
+	pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+	pthread_cond_init(&pstRing->cond, &condAttr);
+	pthread_condattr_destroy(&condAttr);
+
+	if (pthread_create(&pstRing->writer, NULL, venc_ring_writer, pstRing) != 0) {
+		SAMPLE_PRT("create writer thread failed\n");
+		SAMPLE_COMM_VENC_RING_Destroy(pstRing);
+		return CVI_FAILURE;
+	}
+
+	*ppstRing = pstRing;
+	return CVI_SUCCESS;
+}
+
+CVI_S32 SAMPLE_COMM_VENC_RING_Push(SAMPLE_VENC_RING_S *pstRing, const VENC_STREAM_S *pstStream)
+{
+	const VENC_PACK_S *pstPack;
+	VENC_RING_FRAME_S *pstFrame;
+	CVI_U32 u32Len = 0;
+	CVI_BOOL bKey = CVI_FALSE;
+	CVI_U64 u64PTS;
+	CVI_U32 i;
+
+	CHECK_NULL_PTR(pstRing);
+	CHECK_NULL_PTR(pstStream);
+
+	if (!pstStream->u32PackCount)
+		return CVI_SUCCESS;
+
+	for (i = 0; i < pstStream->u32PackCount; i++) {
+		pstPack = &pstStream->pstPack[i];
+		u32Len += pstPack->u32Len - pstPack->u32Offset;
+		bKey |= venc_ring_is_key(pstRing->stAttr.enType, pstPack);
+	}
+	u64PTS = pstStream->pstPack[0].u64PTS;
+
+	pthread_mutex_lock(&pstRing->mutex);
+
+	if (pstRing->bPinned && !pstRing->u64EndPTS)
+		pstRing->u64EndPTS = u64PTS + (CVI_U64)pstRing->u32PostSec * 1000000;
+	if (pstRing->bPinned && !pstRing->bPostDone && u64PTS >= pstRing->u64EndPTS) {
+		pstRing->bPostDone = CVI_TRUE;
+		pthread_cond_broadcast(&pstRing->cond);
+	}
+
+	if (bKey)
+		pstRing->bWaitKey = CVI_FALSE;
+	if (pstRing->bWaitKey || !venc_ring_make_room(pstRing, u32Len, u64PTS) ||
+	    (!pstRing->u32Count && !bKey)) {
+		/* a hole in the stream, restart at the next IDR */
+		pstRing->bWaitKey = CVI_TRUE;
+		pstRing->stStat.u64Dropped++;
+		pthread_mutex_unlock(&pstRing->mutex);
+		return CVI_SUCCESS;
+	}
+
+	pstFrame = venc_ring_frame(pstRing, pstRing->u32Count);
+	pstFrame->u64Off = pstRing->u64Head;
+	pstFrame->u64PTS = u64PTS;
+	pstFrame->u32Len = u32Len;
+	pstFrame->bKey = bKey;
+	for (i = 0; i < pstStream->u32PackCount; i++) {
+		pstPack = &pstStream->pstPack[i];
+		venc_ring_copy_in(pstRing, pstPack->pu8Addr + pstPack->u32Offset,
+				  pstPack->u32Len - pstPack->u32Offset);
+	}
+	pstRing->u32Count++;
+	pstRing->stStat.u64Frames++;
+
+	pthread_mutex_unlock(&pstRing->mutex);
+	return CVI_SUCCESS;
+}
+
+CVI_S32 SAMPLE_COMM_VENC_RING_PushChn(SAMPLE_VENC_RING_S *pstRing, VENC_CHN VencChn, CVI_S32 s32MilliSec)
+{
+	VENC_CHN_STATUS_S stStat;
+	VENC_STREAM_S stStream;
+	CVI_S32 s32Ret;
+
+	CHECK_NULL_PTR(pstRing);
+
+	s32Ret = CVI_VENC_QueryStatus(VencChn, &stStat);
+	if (s32Ret != CVI_SUCCESS) {
+		SAMPLE_PRT("CVI_VENC_QueryStatus, VencChn = %d, s32Ret = %#x\n", VencChn, s32Ret);
+		return s32Ret;
+	}
+	if (!stStat.u32CurPacks)
+		stStat.u32CurPacks = 8;
+
+	stStream.pstPack = malloc(sizeof(VENC_PACK_S) * stStat.u32CurPacks);
+	if (!stStream.pstPack)
+		return CVI_FAILURE;
+
+	s32Ret = CVI_VENC_GetStream(VencChn, &stStream, s32MilliSec);
+	if (s32Ret == CVI_SUCCESS) {
+		s32Ret = SAMPLE_COMM_VENC_RING_Push(pstRing, &stStream);
+		CVI_VENC_ReleaseStream(VencChn, &stStream);
+	}
+
+	free(stStream.pstPack);
+	return s32Ret;
+}
+
+CVI_S32 SAMPLE_COMM_VENC_RING_Trigger(SAMPLE_VENC_RING_S *pstRing, CVI_U32 u32PostSec, const char *pszPath)
+{
+	VENC_RING_FRAME_S *pstLast;
+
+	CHECK_NULL_PTR(pstRing);
+	CHECK_NULL_PTR(pszPath);
+
+	pthread_mutex_lock(&pstRing->mutex);
+	if (pstRing->bPinned) {
+		/* one event at a time, the next one would share most frames anyway */
+		pthread_mutex_unlock(&pstRing->mutex);
+		SAMPLE_PRT("event %s still recording, %s ignored\n", pstRing->szPath, pszPath);
+		return CVI_FAILURE;
+	}
+
+	pstRing->bPinned = CVI_TRUE;
+	pstRing->bPostDone = !u32PostSec;
+	pstRing->u64PinOff = pstRing->u32Count ? venc_ring_frame(pstRing, 0)->u64Off : pstRing->u64Head;
+	pstRing->u32PostSec = u32PostSec;
+	pstRing->u64EndPTS = 0;
+	if (pstRing->u32Count) {
+		pstLast = venc_ring_frame(pstRing, pstRing->u32Count - 1);
+		pstRing->u64EndPTS = pstLast->u64PTS + (CVI_U64)u32PostSec * 1000000;
+	}
+	snprintf(pstRing->szPath, sizeof(pstRing->szPath), "%s", pszPath);
+	pthread_cond_broadcast(&pstRing->cond);
+	pthread_mutex_unlock(&pstRing->mutex);
+
+	return CVI_SUCCESS;
+}
+
+CVI_S32 SAMPLE_COMM_VENC_RING_Wait(SAMPLE_VENC_RING_S *pstRing)
+{
+	CHECK_NULL_PTR(pstRing);
+
+	pthread_mutex_lock(&pstRing->mutex);
+	while (pstRing->bPinned && !pstRing->bExit)
+		pthread_cond_wait(&pstRing->cond, &pstRing->mutex);
+	pthread_mutex_unlock(&pstRing->mutex);
+
+	return CVI_SUCCESS;
+}
+
+CVI_S32 SAMPLE_COMM_VENC_RING_GetStat(SAMPLE_VENC_RING_S *pstRing, SAMPLE_VENC_RING_STAT_S *pstStat)
+{
+	CHECK_NULL_PTR(pstRing);
+	CHECK_NULL_PTR(pstStat);
+
+	pthread_mutex_lock(&pstRing->mutex);
+	*pstStat = pstRing->stStat;
+	pstStat->u32Frames = pstRing->u32Count;
+	pstStat->u32Bytes = pstRing->u64Head - pstRing->u64Tail;
+	pstStat->u64SpanUs = 0;
+	if (pstRing->u32Count)
+		pstStat->u64SpanUs = venc_ring_frame(pstRing, pstRing->u32Count - 1)->u64PTS -
+				     venc_ring_frame(pstRing, 0)->u64PTS;
+	pstStat->bRecording = pstRing->bPinned;
+	pthread_mutex_unlock(&pstRing->mutex);
+
+	return CVI_SUCCESS;
+}
+
+CVI_VOID SAMPLE_COMM_VENC_RING_Destroy(SAMPLE_VENC_RING_S *pstRing)
+{
+	if (!pstRing)
+		return;
+
+	if (pstRing->writer) {
+		/* let a recording event finish first */
+		SAMPLE_COMM_VENC_RING_Wait(pstRing);
+		pthread_mutex_lock(&pstRing->mutex);
+		pstRing->bExit = CVI_TRUE;
+		pthread_cond_broadcast(&pstRing->cond);
+		pthread_mutex_unlock(&pstRing->mutex);
+		pthread_join(pstRing->writer, NULL);
+	}
+
+	pthread_cond_destroy(&pstRing->cond);
+	pthread_mutex_destroy(&pstRing->mutex);
+	if (pstRing->bIon)
+		CVI_SYS_IonFree(pstRing->u64PhyAddr, pstRing->pu8Buf);
+	else
+		free(pstRing->pu8Buf);
+	free(pstRing->pastFrame);
+	free(pstRing);
+}
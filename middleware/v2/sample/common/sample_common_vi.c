@@ -14,6 +14,8 @@
 #include "cvi_sns_ctrl.h"
 #include <linux/cvi_defines.h>
 #include <linux/cvi_common.h>
+#include "cvi_ae.h"
+#include "cvi_awb.h"
 #include "cvi_awb_comm.h"
 #include "cvi_af_comm.h"
 #include "cvi_comm_isp.h"
@@ -1154,4 +1156,307 @@ CVI_S32 SAMPLE_COMM_VI_DefaultConfig(CVI_VOID)
 	}
 
 	return s32Ret;
-}
\ No newline at end of file
+}
+
+static CVI_U32 SAMPLE_COMM_VI_ElapsedUs(CVI_U64 *pu64Last)
+{
+	CVI_U64 u64Now = SAMPLE_COMM_SYS_GetNowUs();
+	CVI_U32 u32Us = (CVI_U32)(u64Now - *pu64Last);
+
+	*pu64Last = u64Now;
+	return u32Us;
+}
+
+/* seed the new mode with the exposure/WB of the old one, time scaled to fit the frame */
+static CVI_VOID SAMPLE_COMM_VI_Seed3A(VI_PIPE ViPipe, const ISP_EXP_INFO_S *pstExpInfo,
+		const ISP_WB_INFO_S *pstWBInfo, CVI_FLOAT f32Fps)
+{
+	ISP_EXPOSURE_ATTR_S stExpAttr;
+	ISP_WB_ATTR_S stWBAttr;
+	CVI_U32 u32MaxExp = (CVI_U32)(1000000 / f32Fps);
+	CVI_U64 u64AGain = pstExpInfo->u32AGain;
+
+	CVI_ISP_GetExposureAttr(ViPipe, &stExpAttr);
+	stExpAttr.enOpType = OP_TYPE_MANUAL;
+	stExpAttr.stManual.enExpTimeOpType = OP_TYPE_MANUAL;
+	stExpAttr.stManual.enAGainOpType = OP_TYPE_MANUAL;
+	stExpAttr.stManual.enDGainOpType = OP_TYPE_MANUAL;
+	stExpAttr.stManual.enISPDGainOpType = OP_TYPE_MANUAL;
+	stExpAttr.stManual.u32ExpTime = pstExpInfo->u32ExpTime;
+	if (pstExpInfo->u32ExpTime > u32MaxExp) {
+		/* shorter frame, keep the brightness with analog gain */
+		u64AGain = u64AGain * pstExpInfo->u32ExpTime / u32MaxExp;
+		stExpAttr.stManual.u32ExpTime = u32MaxExp;
+	}
+	stExpAttr.stManual.u32AGain = u64AGain > 0x7FFFFFFF ? 0x7FFFFFFF : (CVI_U32)u64AGain;
+	stExpAttr.stManual.u32DGain = pstExpInfo->u32DGain;
+	stExpAttr.stManual.u32ISPDGain = pstExpInfo->u32ISPDGain;
+	CVI_ISP_SetExposureAttr(ViPipe, &stExpAttr);
+
+	CVI_ISP_GetWBAttr(ViPipe, &stWBAttr);
+	stWBAttr.enOpType = OP_TYPE_MANUAL;
+	stWBAttr.stManual.u16Rgain = pstWBInfo->u16Rgain;
+	stWBAttr.stManual.u16Grgain = pstWBInfo->u16Grgain;
+	stWBAttr.stManual.u16Gbgain = pstWBInfo->u16Gbgain;
+	stWBAttr.stManual.u16Bgain = pstWBInfo->u16Bgain;
+	CVI_ISP_SetWBAttr(ViPipe, &stWBAttr);
+}
+
+static CVI_VOID SAMPLE_COMM_VI_SetStatisticsWnd(VI_PIPE ViPipe, const ISP_PUB_ATTR_S *pstPubAttr)
+{
+	ISP_STATISTICS_CFG_S stsCfg;
+
+	if (CVI_ISP_GetStatisticsConfig(ViPipe, &stsCfg) != CVI_SUCCESS)
+		return;
+
+	stsCfg.stAECfg.stCrop[0].u16W = pstPubAttr->stWndRect.u32Width;
+	stsCfg.stAECfg.stCrop[0].u16H = pstPubAttr->stWndRect.u32Height;
+	#ifdef ARCH_CV183X
+	stsCfg.stAECfg.stCrop[1].u16W = pstPubAttr->stWndRect.u32Width;
+	stsCfg.stAECfg.stCrop[1].u16H = pstPubAttr->stWndRect.u32Height;
+	#endif
+	stsCfg.stWBCfg.stCrop.u16W = pstPubAttr->stWndRect.u32Width;
+	stsCfg.stWBCfg.stCrop.u16H = pstPubAttr->stWndRect.u32Height;
+	stsCfg.stFocusCfg.stConfig.stCrop.u16W = pstPubAttr->stWndRect.u32Width - AF_XOFFSET_MIN * 2;
+	stsCfg.stFocusCfg.stConfig.stCrop.u16H = pstPubAttr->stWndRect.u32Height - AF_YOFFSET_MIN * 2;
+	CVI_ISP_SetStatisticsConfig(ViPipe, &stsCfg);
+}
+
+/*
+ * steps 2-5 of the switch, also used to put the old mode back when one of them
+ * fails. The pipes and the channel are expected stopped.
+ */
+static CVI_S32 SAMPLE_COMM_VI_ApplyMode(SAMPLE_VI_INFO_S *pstViInfo, const ISP_SNS_OBJ_S *pstSnsObj,
+		const VI_PIPE *aPipe, CVI_U32 u32PipeNum, SAMPLE_SNS_TYPE_E enSnsType,
+		const ISP_PUB_ATTR_S *pstPubAttr, const VI_DEV_ATTR_S *pstDevAttr,
+		const ISP_EXP_INFO_S *pstExpInfo, const ISP_WB_INFO_S *pstWBInfo,
+		SAMPLE_VI_SWITCH_STAT_S *pstStat, CVI_U64 *pu64Step)
+{
+	VI_PIPE ViPipe = aPipe[0];
+	VI_CHN ViChn = pstViInfo->stChnInfo.ViChn;
+	VI_DEV ViDev = pstViInfo->stDevInfo.ViDev;
+	VI_DEV_ATTR_S stCurDevAttr;
+	VI_CHN_ATTR_S stChnAttr;
+	ISP_SENSOR_EXP_FUNC_S stSnsrSensorFunc;
+	ISP_CMOS_SENSOR_IMAGE_MODE_S stSnsrMode;
+	SNS_COMBO_DEV_ATTR_S stRxAttr;
+	CVI_U32 i;
+	CVI_S32 s32Ret;
+
+	/* step2: new sensor mode, registers only, no reset or power cycle */
+	SAMPLE_COMM_ISP_SetSnsObj(pstViInfo->stSnsInfo.s32SnsId, enSnsType);
+	pstViInfo->stSnsInfo.enSnsType = enSnsType;
+	stSnsrMode.u16Width = pstPubAttr->stSnsSize.u32Width;
+	stSnsrMode.u16Height = pstPubAttr->stSnsSize.u32Height;
+	stSnsrMode.f32Fps = pstPubAttr->f32FrameRate;
+	memset(&stSnsrSensorFunc, 0, sizeof(stSnsrSensorFunc));
+	pstSnsObj->pfnExpSensorCb(&stSnsrSensorFunc);
+	if (stSnsrSensorFunc.pfn_cmos_set_image_mode) {
+		s32Ret = stSnsrSensorFunc.pfn_cmos_set_image_mode(ViPipe, &stSnsrMode);
+		if (s32Ret != CVI_SUCCESS) {
+			CVI_TRACE_LOG(CVI_DBG_ERR, "sensor set image mode failed!\n");
+			return s32Ret;
+		}
+	}
+	if (stSnsrSensorFunc.pfn_cmos_set_wdr_mode)
+		stSnsrSensorFunc.pfn_cmos_set_wdr_mode(ViPipe, pstViInfo->stDevInfo.enWDRMode);
+	if (stSnsrSensorFunc.pfn_cmos_sensor_init)
+		stSnsrSensorFunc.pfn_cmos_sensor_init(ViPipe);
+	pstStat->u32SensorUs = SAMPLE_COMM_VI_ElapsedUs(pu64Step);
+
+	/* step3: MIPI rx and dev timing, only when the mode changes them */
+	pstSnsObj->pfnGetRxAttr(ViPipe, &stRxAttr);
+	CVI_MIPI_SetMipiReset(pstViInfo->stSnsInfo.MipiDev, 1);
+	CVI_MIPI_SetMipiAttr(ViPipe, (CVI_VOID *)&stRxAttr);
+	CVI_MIPI_SetMipiReset(pstViInfo->stSnsInfo.MipiDev, 0);
+
+	CVI_VI_GetDevAttr(ViDev, &stCurDevAttr);
+	if (stCurDevAttr.stSize.u32Width != pstDevAttr->stSize.u32Width ||
+	    stCurDevAttr.stSize.u32Height != pstDevAttr->stSize.u32Height ||
+	    stCurDevAttr.snrFps != pstDevAttr->snrFps) {
+		/* not SAMPLE_COMM_VI_StopDev, the PM/flip callbacks stay registered */
+		CVI_VI_DisableDev(ViDev);
+		s32Ret = CVI_VI_SetDevAttr(ViDev, pstDevAttr);
+		if (s32Ret != CVI_SUCCESS) {
+			CVI_TRACE_LOG(CVI_DBG_ERR, "CVI_VI_SetDevAttr failed with %#x!\n", s32Ret);
+			return s32Ret;
+		}
+		s32Ret = CVI_VI_EnableDev(ViDev);
+		if (s32Ret != CVI_SUCCESS) {
+			CVI_TRACE_LOG(CVI_DBG_ERR, "CVI_VI_EnableDev failed with %#x!\n", s32Ret);
+			return s32Ret;
+		}
+	}
+	pstStat->u32DevUs = SAMPLE_COMM_VI_ElapsedUs(pu64Step);
+
+	/* step4: ISP context stays, only the window, rate and stats follow the mode */
+	for (i = 0; i < u32PipeNum; i++) {
+		s32Ret = CVI_ISP_SetPubAttr(aPipe[i], pstPubAttr);
+		if (s32Ret != CVI_SUCCESS) {
+			CVI_TRACE_LOG(CVI_DBG_ERR, "SetPubAttr failed with %#x!\n", s32Ret);
+			return s32Ret;
+		}
+	}
+	SAMPLE_COMM_VI_SetStatisticsWnd(ViPipe, pstPubAttr);
+	if (pstExpInfo && pstWBInfo)
+		SAMPLE_COMM_VI_Seed3A(ViPipe, pstExpInfo, pstWBInfo, pstPubAttr->f32FrameRate);
+	pstStat->u32IspUs = SAMPLE_COMM_VI_ElapsedUs(pu64Step);
+
+	/* step5: restart the stream on the kept pipe and pools */
+	for (i = 0; i < u32PipeNum; i++) {
+		s32Ret = CVI_VI_StartPipe(aPipe[i]);
+		if (s32Ret != CVI_SUCCESS) {
+			CVI_TRACE_LOG(CVI_DBG_ERR, "CVI_VI_StartPipe failed with %#x!\n", s32Ret);
+			return s32Ret;
+		}
+	}
+	CVI_VI_GetChnAttr(ViPipe, ViChn, &stChnAttr);
+	stChnAttr.stSize = pstDevAttr->stSize;
+	s32Ret = CVI_VI_SetChnAttr(ViPipe, ViChn, &stChnAttr);
+	if (s32Ret != CVI_SUCCESS) {
+		CVI_TRACE_LOG(CVI_DBG_ERR, "CVI_VI_SetChnAttr failed with %#x!\n", s32Ret);
+		return s32Ret;
+	}
+	s32Ret = CVI_VI_EnableChn(ViPipe, ViChn);
+	if (s32Ret != CVI_SUCCESS) {
+		CVI_TRACE_LOG(CVI_DBG_ERR, "CVI_VI_EnableChn failed with %#x!\n", s32Ret);
+		return s32Ret;
+	}
+	if (pstSnsObj->pfnRestart)
+		pstSnsObj->pfnRestart(ViPipe);
+	pstStat->u32StartUs = SAMPLE_COMM_VI_ElapsedUs(pu64Step);
+
+	return CVI_SUCCESS;
+}
+
+CVI_S32 SAMPLE_COMM_VI_SwitchMode(SAMPLE_VI_CONFIG_S *pstViConfig, CVI_S32 s32ViNum,
+		SAMPLE_SNS_TYPE_E enSnsType, SAMPLE_VI_SWITCH_STAT_S *pstStat)
+{
+	SAMPLE_VI_INFO_S *pstViInfo;
+	SAMPLE_VI_SWITCH_STAT_S stStat = {0}, stUndoStat;
+	SAMPLE_SNS_TYPE_E enOldSnsType;
+	VI_PIPE ViPipe, aPipe[WDR_MAX_PIPE_NUM];
+	VI_CHN ViChn;
+	VI_DEV ViDev;
+	CVI_U32 u32SnsId, u32PipeNum = 0, i;
+	VI_PIPE_ATTR_S stPipeAttr;
+	VI_DEV_ATTR_S stDevAttr, stOldDevAttr;
+	ISP_PUB_ATTR_S stPubAttr, stOldPubAttr;
+	ISP_EXPOSURE_ATTR_S stExpAttr;
+	ISP_WB_ATTR_S stWBAttr;
+	ISP_EXP_INFO_S stExpInfo;
+	ISP_WB_INFO_S stWBInfo;
+	VIDEO_FRAME_INFO_S stFrame;
+	const ISP_SNS_OBJ_S *pstSnsObj;
+	CVI_U64 u64Start, u64Step;
+	CVI_S32 s32Ret;
+
+	if (!pstViConfig || s32ViNum < 0 || s32ViNum >= VI_MAX_DEV_NUM) {
+		SAMPLE_PRT("%s: invalid param\n", __func__);
+		return CVI_FAILURE;
+	}
+
+	pstViInfo = &pstViConfig->astViInfo[s32ViNum];
+	ViPipe = pstViInfo->stPipeInfo.aPipe[0];
+	ViChn = pstViInfo->stChnInfo.ViChn;
+	ViDev = pstViInfo->stDevInfo.ViDev;
+	u32SnsId = pstViInfo->stSnsInfo.s32SnsId;
+	enOldSnsType = pstViInfo->stSnsInfo.enSnsType;
+	for (i = 0; i < WDR_MAX_PIPE_NUM; i++) {
+		if (pstViInfo->stPipeInfo.aPipe[i] >= 0 && pstViInfo->stPipeInfo.aPipe[i] < VI_MAX_PIPE_NUM)
+			aPipe[u32PipeNum++] = pstViInfo->stPipeInfo.aPipe[i];
+	}
+
+	/*
+	 * Only a mode of the same sensor driver fits in the running pipe: another
+	 * driver or a bigger frame than the pipe (and so the VB pools) was created
+	 * for needs the full restart.
+	 */
+	pstSnsObj = (ISP_SNS_OBJ_S *)SAMPLE_COMM_ISP_GetSnsObj(u32SnsId);
+	if (!pstSnsObj || SAMPLE_COMM_SNS_GetSnsObj(enSnsType) != pstSnsObj) {
+		SAMPLE_PRT("sensor type %d is another driver, restart VI instead\n", enSnsType);
+		return CVI_FAILURE;
+	}
+	if (!pstSnsObj->pfnExpSensorCb || !pstSnsObj->pfnGetRxAttr) {
+		CVI_TRACE_LOG(CVI_DBG_ERR, "no sensor %d ExpSensor/GetRxAttr callback\n", u32SnsId);
+		return CVI_FAILURE;
+	}
+	if (SAMPLE_COMM_ISP_GetIspAttrBySns(enSnsType, &stPubAttr) != CVI_SUCCESS ||
+	    SAMPLE_COMM_VI_GetDevAttrBySns(enSnsType, &stDevAttr) != CVI_SUCCESS)
+		return CVI_FAILURE;
+	s32Ret = CVI_VI_GetPipeAttr(ViPipe, &stPipeAttr);
+	if (s32Ret != CVI_SUCCESS) {
+		CVI_TRACE_LOG(CVI_DBG_ERR, "CVI_VI_GetPipeAttr failed with %#x!\n", s32Ret);
+		return s32Ret;
+	}
+	if (stDevAttr.stSize.u32Width > stPipeAttr.u32MaxW || stDevAttr.stSize.u32Height > stPipeAttr.u32MaxH) {
+		SAMPLE_PRT("mode %ux%u exceeds pipe max %ux%u, restart VI instead\n",
+			   stDevAttr.stSize.u32Width, stDevAttr.stSize.u32Height,
+			   stPipeAttr.u32MaxW, stPipeAttr.u32MaxH);
+		return CVI_FAILURE;
+	}
+	stDevAttr.stWDRAttr.enWDRMode = pstViInfo->stDevInfo.enWDRMode;
+	stDevAttr.snrFps = (CVI_U32)stPubAttr.f32FrameRate;
+
+	/* what the rollback needs to put the old mode back */
+	if (CVI_VI_GetDevAttr(ViDev, &stOldDevAttr) != CVI_SUCCESS ||
+	    CVI_ISP_GetPubAttr(ViPipe, &stOldPubAttr) != CVI_SUCCESS) {
+		CVI_TRACE_LOG(CVI_DBG_ERR, "get the running dev/pub attr failed!\n");
+		return CVI_FAILURE;
+	}
+
+	u64Start = SAMPLE_COMM_SYS_GetNowUs();
+	u64Step = u64Start;
+
+	/* step1: keep the 3A state and stop the stream */
+	CVI_ISP_GetExposureAttr(ViPipe, &stExpAttr);
+	CVI_ISP_GetWBAttr(ViPipe, &stWBAttr);
+	CVI_ISP_QueryExposureInfo(ViPipe, &stExpInfo);
+	CVI_ISP_QueryWBInfo(ViPipe, &stWBInfo);
+
+	CVI_VI_DisableChn(ViPipe, ViChn);
+	for (i = 0; i < u32PipeNum; i++)
+		CVI_VI_StopPipe(aPipe[i]);
+	if (pstSnsObj->pfnStandby)
+		pstSnsObj->pfnStandby(ViPipe);
+	stStat.u32StopUs = SAMPLE_COMM_VI_ElapsedUs(&u64Step);
+
+	/* step2-5 */
+	s32Ret = SAMPLE_COMM_VI_ApplyMode(pstViInfo, pstSnsObj, aPipe, u32PipeNum, enSnsType,
+			&stPubAttr, &stDevAttr, &stExpInfo, &stWBInfo, &stStat, &u64Step);
+	if (s32Ret != CVI_SUCCESS) {
+		/* back to the old mode so the caller still has a running stream */
+		SAMPLE_PRT("switch to sensor type %d failed with %#x, back to %d\n",
+			   enSnsType, s32Ret, enOldSnsType);
+		CVI_VI_DisableChn(ViPipe, ViChn);
+		for (i = 0; i < u32PipeNum; i++)
+			CVI_VI_StopPipe(aPipe[i]);
+		if (pstSnsObj->pfnStandby)
+			pstSnsObj->pfnStandby(ViPipe);
+		if (SAMPLE_COMM_VI_ApplyMode(pstViInfo, pstSnsObj, aPipe, u32PipeNum, enOldSnsType,
+				&stOldPubAttr, &stOldDevAttr, NULL, NULL, &stUndoStat, &u64Step) != CVI_SUCCESS)
+			SAMPLE_PRT("old mode restore failed, restart VI\n");
+		CVI_ISP_SetExposureAttr(ViPipe, &stExpAttr);
+		CVI_ISP_SetWBAttr(ViPipe, &stWBAttr);
+		return s32Ret;
+	}
+
+	/* step6: first frame of the new mode, then 3A back to what the user set */
+	if (CVI_VI_GetChnFrame(ViPipe, ViChn, &stFrame, 1000) == CVI_SUCCESS)
+		CVI_VI_ReleaseChnFrame(ViPipe, ViChn, &stFrame);
+	else
+		SAMPLE_PRT("no frame 1s after the mode switch\n");
+	stStat.u32FirstFrameUs = SAMPLE_COMM_VI_ElapsedUs(&u64Step);
+	CVI_ISP_SetExposureAttr(ViPipe, &stExpAttr);
+	CVI_ISP_SetWBAttr(ViPipe, &stWBAttr);
+
+	stStat.u32TotalUs = SAMPLE_COMM_VI_ElapsedUs(&u64Start);
+	SAMPLE_PRT("switch to %ux%u@%.2f: stop %u sensor %u dev %u isp %u start %u 1st frame %u total %u us\n",
+		   stDevAttr.stSize.u32Width, stDevAttr.stSize.u32Height, stPubAttr.f32FrameRate,
+		   stStat.u32StopUs, stStat.u32SensorUs, stStat.u32DevUs, stStat.u32IspUs,
+		   stStat.u32StartUs, stStat.u32FirstFrameUs, stStat.u32TotalUs);
+	if (pstStat)
+		*pstStat = stStat;
+
+	return CVI_SUCCESS;
+}
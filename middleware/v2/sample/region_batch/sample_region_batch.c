@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) Cvitek Co., Ltd. 2019-2020. All rights reserved.
+ *
+ * File Name: sample/region_batch/sample_region_batch.c
+ * Description:
+ *   Overlay update cost, one by one against batched.
+ *
+ *   Up to 32 ARGB1555 overlays are attached to VPSS channels, 8 per
+ *   channel. For 1, 8 and 32 regions every round redraws all canvases and
+ *   moves the regions every other round, first the way the other samples
+ *   do it (GetCanvasInfo, draw, UpdateCanvas and SetDisplayAttr per region),
+ *   then through SAMPLE_COMM_REGION_Batch*. No frames are fed, so this is
+ *   the CPU and ioctl side of an update only.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "sample_comm.h"
+
+#define RB_MAX_REGION		32
+#define RB_RGN_PER_CHN		RGN_MAX_NUM_VPSS
+#define RB_RGN_PER_GRP		(RB_RGN_PER_CHN * VPSS_MAX_PHY_CHN_NUM)
+#define RB_GRP_NUM		((RB_MAX_REGION + RB_RGN_PER_GRP - 1) / RB_RGN_PER_GRP)
+#define RB_CHN_WIDTH		640
+#define RB_CHN_HEIGHT		360
+#define RB_RGN_WIDTH		128
+#define RB_RGN_HEIGHT		32
+
+typedef struct _RB_RESULT_S {
+	CVI_U32 u32AvgUs;
+	CVI_U32 u32MaxUs;
+} RB_RESULT_S;
+
+static void rb_usage(const char *prog)
+{
+	printf("Usage: %s [-i rounds]\n", prog);
+	printf("\t-i: rounds per region count, default 100\n");
+}
+
+static void rb_region_chn(CVI_U32 u32Idx, MMF_CHN_S *pstChn)
+{
+	pstChn->enModId = CVI_ID_VPSS;
+	pstChn->s32DevId = u32Idx / RB_RGN_PER_GRP;
+	pstChn->s32ChnId = (u32Idx % RB_RGN_PER_GRP) / RB_RGN_PER_CHN;
+}
+
+/* 2 x 4 grid per channel, shifted by u32Shift pixels */
+static void rb_region_attr(CVI_U32 u32Idx, CVI_U32 u32Shift, RGN_CHN_ATTR_S *pstAttr)
+{
+	CVI_U32 k = u32Idx % RB_RGN_PER_CHN;
+
+	memset(pstAttr, 0, sizeof(*pstAttr));
+	pstAttr->bShow = CVI_TRUE;
+	pstAttr->enType = OVERLAY_RGN;
+	pstAttr->unChnAttr.stOverlayChn.stPoint.s32X = 16 + (k % 2) * 256 + u32Shift;
+	pstAttr->unChnAttr.stOverlayChn.stPoint.s32Y = 16 + (k / 2) * 64;
+	pstAttr->unChnAttr.stOverlayChn.u32Layer = k;
+	pstAttr->unChnAttr.stOverlayChn.stInvertColor.bInvColEn = CVI_FALSE;
+}
+
+static void rb_draw(const RGN_CANVAS_INFO_S *pstInfo, CVI_U32 u32Round)
+{
+	CVI_U16 u16Color = 0x8000 | ((u32Round * 0x0421) & 0x7fff);
+
+	for (CVI_U32 y = 0; y < pstInfo->stSize.u32Height; y++) {
+		CVI_U16 *pu16Line = (CVI_U16 *)(pstInfo->pu8VirtAddr + y * pstInfo->u32Stride);
+
+		for (CVI_U32 x = 0; x < pstInfo->stSize.u32Width; x++)
+			pu16Line[x] = (x / 8 + y / 8 + u32Round) & 1 ? u16Color : 0;
+	}
+}
+
+static CVI_S32 rb_start_vpss(void)
+{
+	VPSS_GRP_ATTR_S stVpssGrpAttr;
+	CVI_BOOL abChnEnable[VPSS_MAX_PHY_CHN_NUM] = {0};
+	VPSS_CHN_ATTR_S astVpssChnAttr[VPSS_MAX_PHY_CHN_NUM];
+	CVI_S32 s32Ret;
+	VPSS_GRP grp;
+	CVI_U32 i;
+
+	memset(&stVpssGrpAttr, 0, sizeof(stVpssGrpAttr));
+	memset(astVpssChnAttr, 0, sizeof(astVpssChnAttr));
+	stVpssGrpAttr.stFrameRate.s32SrcFrameRate = -1;
+	stVpssGrpAttr.stFrameRate.s32DstFrameRate = -1;
+	stVpssGrpAttr.enPixelFormat = SAMPLE_PIXEL_FORMAT;
+	stVpssGrpAttr.u32MaxW = RB_CHN_WIDTH;
+	stVpssGrpAttr.u32MaxH = RB_CHN_HEIGHT;
+	stVpssGrpAttr.u8VpssDev = 0;
+
+	for (i = 0; i < VPSS_MAX_PHY_CHN_NUM; i++) {
+		abChnEnable[i] = CVI_TRUE;
+		astVpssChnAttr[i].u32Width = RB_CHN_WIDTH;
+		astVpssChnAttr[i].u32Height = RB_CHN_HEIGHT;
+		astVpssChnAttr[i].enVideoFormat = VIDEO_FORMAT_LINEAR;
+		astVpssChnAttr[i].enPixelFormat = SAMPLE_PIXEL_FORMAT;
+		astVpssChnAttr[i].stFrameRate.s32SrcFrameRate = -1;
+		astVpssChnAttr[i].stFrameRate.s32DstFrameRate = -1;
+		astVpssChnAttr[i].u32Depth = 0;
+		astVpssChnAttr[i].stAspectRatio.enMode = ASPECT_RATIO_NONE;
+		astVpssChnAttr[i].stNormalize.bEnable = CVI_FALSE;
+	}
+
+	for (grp = 0; grp < RB_GRP_NUM; grp++) {
+		s32Ret = SAMPLE_COMM_VPSS_Init(grp, abChnEnable, &stVpssGrpAttr, astVpssChnAttr);
+		if (s32Ret != CVI_SUCCESS) {
+			SAMPLE_PRT("init vpss group %d failed. s32Ret: 0x%x !\n", grp, s32Ret);
+			return s32Ret;
+		}
+		s32Ret = SAMPLE_COMM_VPSS_Start(grp, abChnEnable, &stVpssGrpAttr, astVpssChnAttr);
+		if (s32Ret != CVI_SUCCESS) {
+			SAMPLE_PRT("start vpss group %d failed. s32Ret: 0x%x !\n", grp, s32Ret);
+			return s32Ret;
+		}
+	}
+	return CVI_SUCCESS;
+}
+
+static void rb_stop_vpss(void)
+{
+	CVI_BOOL abChnEnable[VPSS_MAX_PHY_CHN_NUM];
+
+	for (CVI_U32 i = 0; i < VPSS_MAX_PHY_CHN_NUM; i++)
+		abChnEnable[i] = CVI_TRUE;
+	for (VPSS_GRP grp = 0; grp < RB_GRP_NUM; grp++)
+		SAMPLE_COMM_VPSS_Stop(grp, abChnEnable);
+}
+
+static CVI_S32 rb_create_regions(CVI_U32 *pu32Created)
+{
+	RGN_ATTR_S stRegion;
+	RGN_CHN_ATTR_S stChnAttr;
+	MMF_CHN_S stChn;
+	CVI_S32 s32Ret;
+
+	memset(&stRegion, 0, sizeof(stRegion));
+	stRegion.enType = OVERLAY_RGN;
+	stRegion.unAttr.stOverlay.enPixelFormat = PIXEL_FORMAT_ARGB_1555;
+	stRegion.unAttr.stOverlay.stSize.u32Width = RB_RGN_WIDTH;
+	stRegion.unAttr.stOverlay.stSize.u32Height = RB_RGN_HEIGHT;
+	stRegion.unAttr.stOverlay.u32BgColor = 0x00000000;
+	stRegion.unAttr.stOverlay.u32CanvasNum = 2;
+	stRegion.unAttr.stOverlay.stCompressInfo.enOSDCompressMode = OSD_COMPRESS_MODE_NONE;
+
+	for (*pu32Created = 0; *pu32Created < RB_MAX_REGION; (*pu32Created)++) {
+		RGN_HANDLE Handle = *pu32Created;
+
+		s32Ret = CVI_RGN_Create(Handle, &stRegion);
+		if (s32Ret != CVI_SUCCESS) {
+			SAMPLE_PRT("CVI_RGN_Create %d failed with %#x!\n", Handle, s32Ret);
+			return CVI_FAILURE;
+		}
+		rb_region_chn(Handle, &stChn);
+		rb_region_attr(Handle, 0, &stChnAttr);
+		s32Ret = CVI_RGN_AttachToChn(Handle, &stChn, &stChnAttr);
+		if (s32Ret != CVI_SUCCESS) {
+			SAMPLE_PRT("CVI_RGN_AttachToChn %d failed with %#x!\n", Handle, s32Ret);
+			CVI_RGN_Destroy(Handle);
+			return CVI_FAILURE;
+		}
+	}
+	return CVI_SUCCESS;
+}
+
+static void rb_destroy_regions(CVI_U32 u32Created)
+{
+	MMF_CHN_S stChn;
+
+	for (RGN_HANDLE Handle = 0; Handle < (RGN_HANDLE)u32Created; Handle++) {
+		rb_region_chn(Handle, &stChn);
+		CVI_RGN_DetachFromChn(Handle, &stChn);
+		CVI_RGN_Destroy(Handle);
+	}
+}
+
+static CVI_S32 rb_run_single(CVI_U32 u32Num, CVI_U32 u32Rounds, RB_RESULT_S *pstRes)
+{
+	RGN_CANVAS_INFO_S stInfo;
+	RGN_CHN_ATTR_S stChnAttr;
+	MMF_CHN_S stChn;
+	CVI_U64 u64SumUs = 0;
+	CVI_S32 s32Ret;
+
+	memset(pstRes, 0, sizeof(*pstRes));
+	for (CVI_U32 n = 0; n < u32Rounds; n++) {
+		CVI_U64 u64Start = SAMPLE_COMM_SYS_GetNowUs();
+		CVI_U32 u32Us;
+
+		for (RGN_HANDLE Handle = 0; Handle < (RGN_HANDLE)u32Num; Handle++) {
+			s32Ret = CVI_RGN_GetCanvasInfo(Handle, &stInfo);
+			if (s32Ret != CVI_SUCCESS) {
+				SAMPLE_PRT("CVI_RGN_GetCanvasInfo failed with %#x!\n", s32Ret);
+				return CVI_FAILURE;
+			}
+			rb_draw(&stInfo, n);
+			s32Ret = CVI_RGN_UpdateCanvas(Handle);
+			if (s32Ret != CVI_SUCCESS) {
+				SAMPLE_PRT("CVI_RGN_UpdateCanvas failed with %#x!\n", s32Ret);
+				return CVI_FAILURE;
+			}
+			rb_region_chn(Handle, &stChn);
+			rb_region_attr(Handle, (n / 2 % 8) * 2, &stChnAttr);
+			s32Ret = CVI_RGN_SetDisplayAttr(Handle, &stChn, &stChnAttr);
+			if (s32Ret != CVI_SUCCESS) {
+				SAMPLE_PRT("CVI_RGN_SetDisplayAttr failed with %#x!\n", s32Ret);
+				return CVI_FAILURE;
+			}
+		}
+
+		u32Us = (CVI_U32)(SAMPLE_COMM_SYS_GetNowUs() - u64Start);
+		u64SumUs += u32Us;
+		if (u32Us > pstRes->u32MaxUs)
+			pstRes->u32MaxUs = u32Us;
+	}
+	pstRes->u32AvgUs = (CVI_U32)(u64SumUs / u32Rounds);
+
+	return CVI_SUCCESS;
+}
+
+static CVI_S32 rb_run_batch(SAMPLE_REGION_BATCH_S *pstBatch, CVI_U32 u32Num, CVI_U32 u32Rounds,
+	RB_RESULT_S *pstRes)
+{
+	RGN_CANVAS_INFO_S stInfo;
+	RGN_CHN_ATTR_S stChnAttr;
+	MMF_CHN_S stChn;
+	CVI_U64 u64SumUs = 0;
+	CVI_S32 s32Ret;
+
+	memset(pstRes, 0, sizeof(*pstRes));
+	for (CVI_U32 n = 0; n < u32Rounds; n++) {
+		CVI_U64 u64Start = SAMPLE_COMM_SYS_GetNowUs();
+		CVI_U32 u32Us;
+
+		SAMPLE_COMM_REGION_BatchBegin(pstBatch);
+		for (RGN_HANDLE Handle = 0; Handle < (RGN_HANDLE)u32Num; Handle++) {
+			s32Ret = SAMPLE_COMM_REGION_BatchGetCanvas(pstBatch, Handle, &stInfo);
+			if (s32Ret != CVI_SUCCESS) {
+				SAMPLE_COMM_REGION_BatchAbort(pstBatch);
+				return CVI_FAILURE;
+			}
+			rb_draw(&stInfo, n);
+			rb_region_chn(Handle, &stChn);
+			rb_region_attr(Handle, (n / 2 % 8) * 2, &stChnAttr);
+			SAMPLE_COMM_REGION_BatchSetDisplayAttr(pstBatch, Handle, &stChn, &stChnAttr);
+		}
+		s32Ret = SAMPLE_COMM_REGION_BatchCommit(pstBatch);
+		if (s32Ret != CVI_SUCCESS)
+			return CVI_FAILURE;
+
+		u32Us = (CVI_U32)(SAMPLE_COMM_SYS_GetNowUs() - u64Start);
+		u64SumUs += u32Us;
+		if (u32Us > pstRes->u32MaxUs)
+			pstRes->u32MaxUs = u32Us;
+	}
+	pstRes->u32AvgUs = (CVI_U32)(u64SumUs / u32Rounds);
+
+	return CVI_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+	static const CVI_U32 au32Num[] = {1, 8, 32};
+	SAMPLE_REGION_BATCH_ATTR_S stBatchAttr;
+	SAMPLE_REGION_BATCH_STAT_S stStat;
+	SAMPLE_REGION_BATCH_S *pstBatch = NULL;
+	RB_RESULT_S stSingle, stBatched;
+	VB_CONFIG_S stVbConf;
+	CVI_U32 u32Rounds = 100, u32Created = 0;
+	CVI_S32 s32Ret, c;
+
+	while ((c = getopt(argc, argv, "i:h")) != -1) {
+		switch (c) {
+		case 'i':
+			u32Rounds = atoi(optarg);
+			break;
+		default:
+			rb_usage(argv[0]);
+			return CVI_FAILURE;
+		}
+	}
+	if (!u32Rounds) {
+		rb_usage(argv[0]);
+		return CVI_FAILURE;
+	}
+
+	memset(&stVbConf, 0, sizeof(stVbConf));
+	stVbConf.u32MaxPoolCnt = 1;
+	stVbConf.astCommPool[0].u32BlkSize = COMMON_GetPicBufferSize(RB_CHN_WIDTH, RB_CHN_HEIGHT,
+		SAMPLE_PIXEL_FORMAT, DATA_BITWIDTH_8, COMPRESS_MODE_NONE, DEFAULT_ALIGN);
+	stVbConf.astCommPool[0].u32BlkCnt = RB_GRP_NUM * VPSS_MAX_PHY_CHN_NUM + 2;
+	stVbConf.astCommPool[0].enRemapMode = VB_REMAP_MODE_CACHED;
+	s32Ret = SAMPLE_COMM_SYS_Init(&stVbConf);
+	if (s32Ret != CVI_SUCCESS) {
+		SAMPLE_PRT("system init failed with %#x\n", s32Ret);
+		return s32Ret;
+	}
+
+	s32Ret = rb_start_vpss();
+	if (s32Ret != CVI_SUCCESS)
+		goto out_vpss;
+	s32Ret = rb_create_regions(&u32Created);
+	if (s32Ret != CVI_SUCCESS)
+		goto out_rgn;
+
+	memset(&stBatchAttr, 0, sizeof(stBatchAttr));
+	stBatchAttr.u32MaxRegion = RB_MAX_REGION;
+	s32Ret = SAMPLE_COMM_REGION_BatchCreate(&stBatchAttr, &pstBatch);
+	if (s32Ret != CVI_SUCCESS)
+		goto out_rgn;
+
+	printf("%u rounds, %ux%u ARGB1555 canvases, region moved every other round\n",
+	       u32Rounds, RB_RGN_WIDTH, RB_RGN_HEIGHT);
+	printf("%7s %12s %12s %12s %12s %10s %8s %8s %8s %9s\n", "regions", "single(us)", "single_max",
+	       "batch(us)", "batch_max", "us/region", "ioctls", "flushes", "skipped", "burst(us)");
+	for (CVI_U32 i = 0; i < sizeof(au32Num) / sizeof(au32Num[0]); i++) {
+		CVI_U32 u32Num = au32Num[i];
+
+		s32Ret = rb_run_single(u32Num, u32Rounds, &stSingle);
+		if (s32Ret != CVI_SUCCESS)
+			break;
+		s32Ret = rb_run_batch(pstBatch, u32Num, u32Rounds, &stBatched);
+		if (s32Ret != CVI_SUCCESS)
+			break;
+		SAMPLE_COMM_REGION_BatchGetStat(pstBatch, &stStat);
+
+		printf("%7u %12u %12u %12u %12u %4u/%-5u %8u %8u %8u %9u\n", u32Num,
+		       stSingle.u32AvgUs, stSingle.u32MaxUs, stBatched.u32AvgUs, stBatched.u32MaxUs,
+		       stSingle.u32AvgUs / u32Num, stBatched.u32AvgUs / u32Num,
+		       stStat.u32Ioctls, stStat.u32FlushRanges, stStat.u32Skipped, stStat.u32BurstUs);
+	}
+
+	SAMPLE_COMM_REGION_BatchGetStat(pstBatch, &stStat);
+	printf("commits %u, commit avg/max %u/%u us, sync timeouts %u\n", stStat.u32Commits,
+	       stStat.u32CommitAvgUs, stStat.u32CommitMaxUs, stStat.u32SyncTimeouts);
+
+	SAMPLE_COMM_REGION_BatchDestroy(pstBatch);
+out_rgn:
+	rb_destroy_regions(u32Created);
+out_vpss:
+	rb_stop_vpss();
+	SAMPLE_COMM_SYS_Exit();
+
+	return s32Ret;
+}
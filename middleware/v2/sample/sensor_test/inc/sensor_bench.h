@@ -0,0 +1,25 @@
+/*
+ * Copyright (C) Cvitek Co., Ltd. 2019-2020. All rights reserved.
+ *
+ * File Name: sensor_bench.h
+ * Description:
+ */
+
+#ifndef __SENSOR_BENCH_H_
+#define __SENSOR_BENCH_H_
+
+#ifdef __cplusplus
+#if __cplusplus
+extern "C" {
+#endif
+#endif /* End of #ifdef __cplusplus */
+
+CVI_S32 sensor_bench(SAMPLE_VI_CONFIG_S *pstViConfig);
+
+#ifdef __cplusplus
+#if __cplusplus
+}
+#endif
+#endif /* End of #ifdef __cplusplus */
+
+#endif
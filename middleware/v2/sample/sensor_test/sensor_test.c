@@ -22,6 +22,7 @@
 #include "cvi_sns_ctrl.h"
 #include "sample_comm.h"
 #include "ae_test.h"
+#include "sensor_bench.h"
 
 static SAMPLE_VI_CONFIG_S g_stViConfig;
 static SAMPLE_INI_CFG_S g_stIniCfg;
@@ -583,6 +584,7 @@ int main(int argc, char **argv)
 		SAMPLE_PRT("5: AE debug\n");
 		SAMPLE_PRT("6: sensor dump\n");
 		SAMPLE_PRT("7: sensor proc\n");
+		SAMPLE_PRT("8: camera benchmark\n");
 		SAMPLE_PRT("255: exit\n");
 	    SAMPLE_PRT("input your choice: ");
 		scanf("%d", &op);
@@ -609,6 +611,9 @@ int main(int argc, char **argv)
 		case 7:
 			s32Ret = sensor_proc();
 			break;
+		case 8:
+			s32Ret = sensor_bench(&g_stViConfig);
+			break;
 		default:
 			break;
 		}
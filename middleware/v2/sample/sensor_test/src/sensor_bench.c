@@ -0,0 +1,432 @@
+/*
+ * Copyright (C) Cvitek Co., Ltd. 2019-2020. All rights reserved.
+ *
+ * File Name: sensor_bench.c
+ * Description:
+ *   Throughput and latency of the running sensor mode: delivered frame rate,
+ *   frame interval jitter, dropped frames and SOF/exposure to userspace
+ *   latency, optionally with VPSS channels and a VENC channel loading the
+ *   pipeline. Latency is taken against the frame PTS, which VI stamps at the
+ *   frame start on CLOCK_MONOTONIC.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/prctl.h>
+
+#include "sample_comm.h"
+#include "cvi_comm_isp.h"
+#include "cvi_ae.h"
+#include "sensor_bench.h"
+
+#define BENCH_VPSS_GRP		0
+#define BENCH_VPSS_MAX_CHN	3
+#define BENCH_VENC_CHN		0
+#define BENCH_LAT_BUCKETS	500	/* 0.5 ms each, up to 250 ms */
+#define BENCH_LAT_BUCKET_US	500
+#define BENCH_PTS_SANE_US	10000000
+
+typedef struct _BENCH_STAGE_S {
+	const char *pszName;
+	CVI_U32 u32Frames;
+	CVI_U32 u32Dropped;
+	CVI_U32 u32Errors;
+	CVI_U64 u64LastPts;
+	CVI_U32 u32PeriodUs;
+	/* interval, Welford */
+	CVI_U32 u32IntN;
+	double dIntMean;
+	double dIntM2;
+	CVI_U32 u32IntMin;
+	CVI_U32 u32IntMax;
+	/* PTS to userspace */
+	CVI_U32 u32LatN;
+	CVI_U64 u64LatSum;
+	CVI_U32 u32LatMax;
+	CVI_U32 au32LatHist[BENCH_LAT_BUCKETS + 1];
+	CVI_BOOL bPtsBad;
+} BENCH_STAGE_S;
+
+struct _BENCH_CTX_S;
+
+/* one drain thread per VPSS channel, so a slow channel does not hold the others */
+typedef struct _BENCH_VPSS_ARG_S {
+	struct _BENCH_CTX_S *pstCtx;
+	VPSS_CHN VpssChn;
+} BENCH_VPSS_ARG_S;
+
+typedef struct _BENCH_CTX_S {
+	VI_PIPE ViPipe;
+	VI_CHN ViChn;
+	CVI_U32 u32VpssChnNum;
+	CVI_BOOL bVenc;
+	PAYLOAD_TYPE_E enVencType;
+	volatile CVI_BOOL bRun;
+	BENCH_STAGE_S stVi;
+	BENCH_STAGE_S astVpss[BENCH_VPSS_MAX_CHN];
+	BENCH_STAGE_S stVenc;
+	BENCH_VPSS_ARG_S astVpssArg[BENCH_VPSS_MAX_CHN];
+} BENCH_CTX_S;
+
+static CVI_VOID bench_stage_init(BENCH_STAGE_S *pstStage, const char *pszName, CVI_U32 u32PeriodUs)
+{
+	memset(pstStage, 0, sizeof(*pstStage));
+	pstStage->pszName = pszName;
+	pstStage->u32PeriodUs = u32PeriodUs;
+	pstStage->u32IntMin = UINT32_MAX;
+}
+
+static CVI_VOID bench_stage_add(BENCH_STAGE_S *pstStage, CVI_U64 u64Pts)
+{
+	CVI_U64 u64Now = SAMPLE_COMM_SYS_GetNowUs();
+	CVI_U32 u32Int, u32Lat, u32Missed;
+	double dDelta;
+
+	pstStage->u32Frames++;
+
+	if (pstStage->u64LastPts && u64Pts > pstStage->u64LastPts) {
+		u32Int = u64Pts - pstStage->u64LastPts;
+		/* a gap of more than 1.5 periods is frames that never arrived */
+		if (pstStage->u32PeriodUs && u32Int > pstStage->u32PeriodUs * 3 / 2) {
+			u32Missed = (u32Int + pstStage->u32PeriodUs / 2) / pstStage->u32PeriodUs - 1;
+			pstStage->u32Dropped += u32Missed;
+		}
+		pstStage->u32IntN++;
+		dDelta = u32Int - pstStage->dIntMean;
+		pstStage->dIntMean += dDelta / pstStage->u32IntN;
+		pstStage->dIntM2 += dDelta * (u32Int - pstStage->dIntMean);
+		if (u32Int < pstStage->u32IntMin)
+			pstStage->u32IntMin = u32Int;
+		if (u32Int > pstStage->u32IntMax)
+			pstStage->u32IntMax = u32Int;
+	}
+	pstStage->u64LastPts = u64Pts;
+
+	if (u64Now < u64Pts || u64Now - u64Pts > BENCH_PTS_SANE_US) {
+		pstStage->bPtsBad = CVI_TRUE;
+		return;
+	}
+	u32Lat = u64Now - u64Pts;
+	pstStage->u32LatN++;
+	pstStage->u64LatSum += u32Lat;
+	if (u32Lat > pstStage->u32LatMax)
+		pstStage->u32LatMax = u32Lat;
+	pstStage->au32LatHist[MIN(u32Lat / BENCH_LAT_BUCKET_US, BENCH_LAT_BUCKETS)]++;
+}
+
+static CVI_U32 bench_stage_pct(const BENCH_STAGE_S *pstStage, CVI_U32 u32Pct)
+{
+	CVI_U32 u32Want = (pstStage->u32LatN * u32Pct + 99) / 100;
+	CVI_U32 u32Sum = 0, i;
+
+	for (i = 0; i <= BENCH_LAT_BUCKETS; i++) {
+		u32Sum += pstStage->au32LatHist[i];
+		if (u32Sum >= u32Want)
+			return (i + 1) * BENCH_LAT_BUCKET_US;
+	}
+	return pstStage->u32LatMax;
+}
+
+static CVI_VOID bench_stage_print(const BENCH_STAGE_S *pstStage, CVI_U32 u32Sec, CVI_U32 u32ExpUs)
+{
+	double dStd = pstStage->u32IntN > 1 ? sqrt(pstStage->dIntM2 / (pstStage->u32IntN - 1)) : 0;
+
+	if (!pstStage->u32Frames) {
+		printf("%-8s no frames, %u errors\n", pstStage->pszName, pstStage->u32Errors);
+		return;
+	}
+
+	printf("%-8s %6.2f fps  interval %.0f us (min %u max %u std %.0f)  dropped %u  errors %u\n",
+	       pstStage->pszName, (double)pstStage->u32Frames / u32Sec, pstStage->dIntMean,
+	       pstStage->u32IntN ? pstStage->u32IntMin : 0, pstStage->u32IntMax, dStd,
+	       pstStage->u32Dropped, pstStage->u32Errors);
+	if (pstStage->bPtsBad || !pstStage->u32LatN) {
+		printf("%-8s PTS not on CLOCK_MONOTONIC, no latency\n", "");
+		return;
+	}
+	/* the first line's exposure ends at SOF, its middle half an exposure earlier */
+	printf("%-8s SOF->user avg %llu p50 %u p99 %u max %u us, exposure mid->user avg %llu us\n", "",
+	       (unsigned long long)(pstStage->u64LatSum / pstStage->u32LatN),
+	       bench_stage_pct(pstStage, 50), bench_stage_pct(pstStage, 99), pstStage->u32LatMax,
+	       (unsigned long long)(pstStage->u64LatSum / pstStage->u32LatN + u32ExpUs / 2));
+}
+
+static CVI_VOID *bench_vi_thread(CVI_VOID *arg)
+{
+	BENCH_CTX_S *pstCtx = arg;
+	VIDEO_FRAME_INFO_S stFrame;
+
+	prctl(PR_SET_NAME, "bench_vi");
+	while (pstCtx->bRun) {
+		if (CVI_VI_GetChnFrame(pstCtx->ViPipe, pstCtx->ViChn, &stFrame, 1000) != CVI_SUCCESS) {
+			pstCtx->stVi.u32Errors++;
+			continue;
+		}
+		bench_stage_add(&pstCtx->stVi, stFrame.stVFrame.u64PTS);
+		CVI_VI_ReleaseChnFrame(pstCtx->ViPipe, pstCtx->ViChn, &stFrame);
+	}
+	return NULL;
+}
+
+static CVI_VOID *bench_vpss_thread(CVI_VOID *arg)
+{
+	BENCH_VPSS_ARG_S *pstArg = arg;
+	BENCH_CTX_S *pstCtx = pstArg->pstCtx;
+	VPSS_CHN VpssChn = pstArg->VpssChn;
+	BENCH_STAGE_S *pstStage = &pstCtx->astVpss[VpssChn];
+	VIDEO_FRAME_INFO_S stFrame;
+	char szName[16];
+
+	snprintf(szName, sizeof(szName), "bench_vpss%d", VpssChn);
+	prctl(PR_SET_NAME, szName);
+	while (pstCtx->bRun) {
+		if (CVI_VPSS_GetChnFrame(BENCH_VPSS_GRP, VpssChn, &stFrame, 1000) != CVI_SUCCESS) {
+			pstStage->u32Errors++;
+			continue;
+		}
+		bench_stage_add(pstStage, stFrame.stVFrame.u64PTS);
+		CVI_VPSS_ReleaseChnFrame(BENCH_VPSS_GRP, VpssChn, &stFrame);
+	}
+	return NULL;
+}
+
+static CVI_VOID *bench_venc_thread(CVI_VOID *arg)
+{
+	BENCH_CTX_S *pstCtx = arg;
+	VENC_CHN_STATUS_S stStat;
+	VENC_STREAM_S stStream;
+	VENC_PACK_S astPack[8];
+
+	prctl(PR_SET_NAME, "bench_venc");
+	stStream.pstPack = astPack;
+	while (pstCtx->bRun) {
+		if (CVI_VENC_QueryStatus(BENCH_VENC_CHN, &stStat) != CVI_SUCCESS ||
+		    stStat.u32CurPacks > ARRAY_SIZE(astPack)) {
+			pstCtx->stVenc.u32Errors++;
+			usleep(10 * 1000);
+			continue;
+		}
+		if (CVI_VENC_GetStream(BENCH_VENC_CHN, &stStream, 1000) != CVI_SUCCESS) {
+			pstCtx->stVenc.u32Errors++;
+			continue;
+		}
+		bench_stage_add(&pstCtx->stVenc, stStream.pstPack[0].u64PTS);
+		CVI_VENC_ReleaseStream(BENCH_VENC_CHN, &stStream);
+	}
+	return NULL;
+}
+
+static CVI_S32 bench_start_vpss(BENCH_CTX_S *pstCtx, const SIZE_S *pstSize, CVI_U32 u32Fps)
+{
+	VPSS_GRP_ATTR_S stVpssGrpAttr;
+	CVI_BOOL abChnEnable[VPSS_MAX_PHY_CHN_NUM] = {0};
+	VPSS_CHN_ATTR_S astVpssChnAttr[VPSS_MAX_PHY_CHN_NUM];
+	CVI_S32 s32Ret;
+	CVI_U32 i;
+
+	memset(&stVpssGrpAttr, 0, sizeof(stVpssGrpAttr));
+	memset(astVpssChnAttr, 0, sizeof(astVpssChnAttr));
+	stVpssGrpAttr.stFrameRate.s32SrcFrameRate = -1;
+	stVpssGrpAttr.stFrameRate.s32DstFrameRate = -1;
+	stVpssGrpAttr.enPixelFormat = SAMPLE_PIXEL_FORMAT;
+	stVpssGrpAttr.u32MaxW = pstSize->u32Width;
+	stVpssGrpAttr.u32MaxH = pstSize->u32Height;
+	stVpssGrpAttr.u8VpssDev = 0;
+
+	/* full, half and quarter size, like a preview/encode/inference split */
+	for (i = 0; i < pstCtx->u32VpssChnNum; i++) {
+		abChnEnable[i] = CVI_TRUE;
+		astVpssChnAttr[i].u32Width = ALIGN(pstSize->u32Width >> i, 2);
+		astVpssChnAttr[i].u32Height = ALIGN(pstSize->u32Height >> i, 2);
+		astVpssChnAttr[i].enVideoFormat = VIDEO_FORMAT_LINEAR;
+		astVpssChnAttr[i].enPixelFormat = SAMPLE_PIXEL_FORMAT;
+		astVpssChnAttr[i].stFrameRate.s32SrcFrameRate = u32Fps;
+		astVpssChnAttr[i].stFrameRate.s32DstFrameRate = u32Fps;
+		astVpssChnAttr[i].u32Depth = 1;
+		astVpssChnAttr[i].stAspectRatio.enMode = ASPECT_RATIO_NONE;
+		astVpssChnAttr[i].stNormalize.bEnable = CVI_FALSE;
+	}
+
+	s32Ret = SAMPLE_COMM_VPSS_Init(BENCH_VPSS_GRP, abChnEnable, &stVpssGrpAttr, astVpssChnAttr);
+	if (s32Ret != CVI_SUCCESS) {
+		SAMPLE_PRT("init vpss group failed. s32Ret: 0x%x !\n", s32Ret);
+		return s32Ret;
+	}
+	s32Ret = SAMPLE_COMM_VPSS_Start(BENCH_VPSS_GRP, abChnEnable, &stVpssGrpAttr, astVpssChnAttr);
+	if (s32Ret != CVI_SUCCESS) {
+		SAMPLE_PRT("start vpss group failed. s32Ret: 0x%x !\n", s32Ret);
+		SAMPLE_COMM_VPSS_Stop(BENCH_VPSS_GRP, abChnEnable);
+		return s32Ret;
+	}
+	return SAMPLE_COMM_VI_Bind_VPSS(pstCtx->ViPipe, pstCtx->ViChn, BENCH_VPSS_GRP);
+}
+
+static CVI_VOID bench_stop_vpss(BENCH_CTX_S *pstCtx)
+{
+	CVI_BOOL abChnEnable[VPSS_MAX_PHY_CHN_NUM] = {0};
+	CVI_U32 i;
+
+	for (i = 0; i < pstCtx->u32VpssChnNum; i++)
+		abChnEnable[i] = CVI_TRUE;
+	SAMPLE_COMM_VI_UnBind_VPSS(pstCtx->ViPipe, pstCtx->ViChn, BENCH_VPSS_GRP);
+	SAMPLE_COMM_VPSS_Stop(BENCH_VPSS_GRP, abChnEnable);
+}
+
+static CVI_S32 bench_start_venc(BENCH_CTX_S *pstCtx, PIC_SIZE_E enPicSize, CVI_U32 u32Fps)
+{
+	chnInputCfg stIc;
+	VENC_GOP_ATTR_S stGopAttr;
+	CVI_S32 s32Ret;
+
+	SAMPLE_COMM_VENC_InitChnInputCfg(&stIc);
+	stIc.rcMode = SAMPLE_RC_CBR;
+	stIc.bitrate = 4096;
+	stIc.framerate = u32Fps;
+	stIc.gop = u32Fps * 2;
+	stIc.bind_mode = VENC_BIND_VPSS;
+	stIc.vpssGrp = BENCH_VPSS_GRP;
+	stIc.vpssChn = 0;
+
+	s32Ret = SAMPLE_COMM_VENC_GetGopAttr(VENC_GOPMODE_NORMALP, &stGopAttr);
+	if (s32Ret != CVI_SUCCESS)
+		return s32Ret;
+
+	s32Ret = SAMPLE_COMM_VENC_Start(&stIc, BENCH_VENC_CHN, pstCtx->enVencType, enPicSize,
+					SAMPLE_RC_CBR, 0, CVI_FALSE, &stGopAttr);
+	if (s32Ret != CVI_SUCCESS)
+		SAMPLE_PRT("start venc failed. s32Ret: 0x%x !\n", s32Ret);
+	return s32Ret;
+}
+
+static CVI_VOID bench_stop_venc(CVI_VOID)
+{
+	SAMPLE_COMM_VPSS_UnBind_VENC(BENCH_VPSS_GRP, 0, BENCH_VENC_CHN);
+	SAMPLE_COMM_VENC_Stop(BENCH_VENC_CHN);
+}
+
+CVI_S32 sensor_bench(SAMPLE_VI_CONFIG_S *pstViConfig)
+{
+	static const char * const apszVpssName[BENCH_VPSS_MAX_CHN] = { "vpss0", "vpss1", "vpss2" };
+	BENCH_CTX_S *pstCtx;
+	SAMPLE_VI_INFO_S *pstViInfo;
+	ISP_PUB_ATTR_S stPubAttr;
+	ISP_EXP_INFO_S stExpInfo;
+	VI_CHN_STATUS_S stChnStat0, stChnStat1;
+	PIC_SIZE_E enPicSize;
+	SIZE_S stSize;
+	pthread_t viThread, vencThread, vpssThread[BENCH_VPSS_MAX_CHN];
+	CVI_S32 s32Ret = CVI_SUCCESS;
+	CVI_U32 u32PeriodUs, u32Fps, i;
+	int tmp, sec, vpss, venc;
+
+	SAMPLE_PRT("bench which dev(0~1): ");
+	scanf("%d", &tmp);
+	SAMPLE_PRT("seconds to run: ");
+	scanf("%d", &sec);
+	SAMPLE_PRT("vpss load, channels (0~%d): ", BENCH_VPSS_MAX_CHN);
+	scanf("%d", &vpss);
+	SAMPLE_PRT("venc load (0:none/1:h264/2:h265): ");
+	scanf("%d", &venc);
+
+	if (tmp < 0 || tmp >= pstViConfig->s32WorkingViNum || sec <= 0 ||
+	    vpss < 0 || vpss > BENCH_VPSS_MAX_CHN || venc < 0 || venc > 2) {
+		SAMPLE_PRT("invalid input\n");
+		return CVI_SUCCESS;
+	}
+	if (venc && !vpss)
+		vpss = 1;	/* VENC takes VPSS chn0 */
+
+	pstViInfo = &pstViConfig->astViInfo[tmp];
+	SAMPLE_COMM_ISP_GetIspAttrBySns(pstViInfo->stSnsInfo.enSnsType, &stPubAttr);
+	SAMPLE_COMM_VI_GetSizeBySensor(pstViInfo->stSnsInfo.enSnsType, &enPicSize);
+	SAMPLE_COMM_SYS_GetPicSize(enPicSize, &stSize);
+	u32Fps = stPubAttr.f32FrameRate > 0 ? (CVI_U32)(stPubAttr.f32FrameRate + 0.5f) : 30;
+	u32PeriodUs = 1000000 / u32Fps;
+
+	pstCtx = calloc(1, sizeof(*pstCtx));
+	if (!pstCtx)
+		return CVI_FAILURE;
+	pstCtx->ViPipe = pstViInfo->stPipeInfo.aPipe[0];
+	pstCtx->ViChn = pstViInfo->stChnInfo.ViChn;
+	pstCtx->u32VpssChnNum = vpss;
+	pstCtx->bVenc = venc != 0;
+	pstCtx->enVencType = venc == 2 ? PT_H265 : PT_H264;
+	bench_stage_init(&pstCtx->stVi, "vi", u32PeriodUs);
+	for (i = 0; i < BENCH_VPSS_MAX_CHN; i++)
+		bench_stage_init(&pstCtx->astVpss[i], apszVpssName[i], u32PeriodUs);
+	bench_stage_init(&pstCtx->stVenc, venc == 2 ? "h265" : "h264", u32PeriodUs);
+
+	if (pstCtx->u32VpssChnNum) {
+		s32Ret = bench_start_vpss(pstCtx, &stSize, u32Fps);
+		if (s32Ret != CVI_SUCCESS)
+			goto exit;
+	}
+	if (pstCtx->bVenc) {
+		s32Ret = bench_start_venc(pstCtx, enPicSize, u32Fps);
+		if (s32Ret != CVI_SUCCESS) {
+			bench_stop_vpss(pstCtx);
+			goto exit;
+		}
+	}
+
+	/* let the loaded pipeline settle before counting */
+	sleep(1);
+	CVI_VI_QueryChnStatus(pstCtx->ViPipe, pstCtx->ViChn, &stChnStat0);
+
+	pstCtx->bRun = CVI_TRUE;
+	pthread_create(&viThread, NULL, bench_vi_thread, pstCtx);
+	/* chn0 feeds VENC when it runs */
+	for (i = pstCtx->bVenc ? 1 : 0; i < pstCtx->u32VpssChnNum; i++) {
+		pstCtx->astVpssArg[i].pstCtx = pstCtx;
+		pstCtx->astVpssArg[i].VpssChn = i;
+		pthread_create(&vpssThread[i], NULL, bench_vpss_thread, &pstCtx->astVpssArg[i]);
+	}
+	if (pstCtx->bVenc)
+		pthread_create(&vencThread, NULL, bench_venc_thread, pstCtx);
+
+	sleep(sec);
+
+	pstCtx->bRun = CVI_FALSE;
+	pthread_join(viThread, NULL);
+	for (i = pstCtx->bVenc ? 1 : 0; i < pstCtx->u32VpssChnNum; i++)
+		pthread_join(vpssThread[i], NULL);
+	if (pstCtx->bVenc)
+		pthread_join(vencThread, NULL);
+
+	CVI_VI_QueryChnStatus(pstCtx->ViPipe, pstCtx->ViChn, &stChnStat1);
+	memset(&stExpInfo, 0, sizeof(stExpInfo));
+	CVI_ISP_QueryExposureInfo(pstCtx->ViPipe, &stExpInfo);
+
+	if (pstCtx->bVenc)
+		bench_stop_venc();
+	if (pstCtx->u32VpssChnNum)
+		bench_stop_vpss(pstCtx);
+
+	printf("---bench %s %ux%u@%.2f, %d s, vpss %d chn, venc %s, exposure %u us---\n",
+	       SAMPLE_COMM_VI_GetSnsrTypeName(), stSize.u32Width, stSize.u32Height,
+	       stPubAttr.f32FrameRate, sec, vpss, venc ? pstCtx->stVenc.pszName : "off", stExpInfo.u32ExpTime);
+	bench_stage_print(&pstCtx->stVi, sec, stExpInfo.u32ExpTime);
+	for (i = pstCtx->bVenc ? 1 : 0; i < pstCtx->u32VpssChnNum; i++)
+		bench_stage_print(&pstCtx->astVpss[i], sec, stExpInfo.u32ExpTime);
+	if (pstCtx->bVenc)
+		bench_stage_print(&pstCtx->stVenc, sec, stExpInfo.u32ExpTime);
+	printf("vi chn lost %u vb fail %u\n", stChnStat1.u32LostFrame - stChnStat0.u32LostFrame,
+	       stChnStat1.u32VbFail - stChnStat0.u32VbFail);
+	/* one line per run for collecting sensor/mode tables */
+	printf("BENCH,%s,%ux%u,%.2f,%d,%d,%.2f,%.0f,%u,%u,%u\n",
+	       SAMPLE_COMM_VI_GetSnsrTypeName(), stSize.u32Width, stSize.u32Height, stPubAttr.f32FrameRate,
+	       vpss, venc, (double)pstCtx->stVi.u32Frames / sec,
+	       pstCtx->stVi.u32IntN > 1 ? sqrt(pstCtx->stVi.dIntM2 / (pstCtx->stVi.u32IntN - 1)) : 0,
+	       pstCtx->stVi.u32Dropped,
+	       pstCtx->stVi.u32LatN ? bench_stage_pct(&pstCtx->stVi, 50) : 0,
+	       pstCtx->stVi.u32LatN ? bench_stage_pct(&pstCtx->stVi, 99) : 0);
+
+exit:
+	free(pstCtx);
+	return s32Ret;
+}